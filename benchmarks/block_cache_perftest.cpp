@@ -0,0 +1,167 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "block_cache.hpp"
+#include "index_types.hpp"
+#include "io.hpp"
+#include "memory_source.hpp"
+#include "query/queries.hpp"
+#include "query/sharded_search.hpp"
+#include "scorer/scorer.hpp"
+#include "util/do_not_optimize_away.hpp"
+#include "util/util.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using pisa::do_not_optimize_away;
+using pisa::get_time_usecs;
+
+using WandType = pisa::wand_data<pisa::wand_data_raw>;
+
+/// Evicts `filename` from the page cache, so that the next run reads it from disk.
+void drop_page_cache(std::string const& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), filename);
+    }
+    ::fdatasync(fd);
+    if (int err = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED); err != 0) {
+        spdlog::warn("Cannot drop {} from page cache: {}", filename, std::strerror(err));
+    }
+    ::close(fd);
+}
+
+/// Returns the mean time of a query in microseconds, calling `before_query` before each one.
+template <typename Index, typename BeforeQuery>
+auto run_queries(
+    Index const& index,
+    WandType const& wdata,
+    std::vector<pisa::Query> const& queries,
+    pisa::ShardedAlgorithm const& algorithm,
+    std::size_t k,
+    BeforeQuery&& before_query) -> double
+{
+    auto scorer = pisa::scorer::from_params(ScorerParams("bm25"), wdata);
+    pisa::IndexCursors<Index, WandType> cursors{index, wdata, *scorer};
+    auto tick = get_time_usecs();
+    for (auto const& query: queries) {
+        before_query(query);
+        auto results =
+            pisa::paged_search(cursors, query, index.num_docs(), algorithm, k, 0, nullptr);
+        do_not_optimize_away(results.primary.size());
+    }
+    return (get_time_usecs() - tick) / queries.size();
+}
+
+template <typename IndexType>
+void perftest(
+    std::string const& index_filename,
+    std::string const& wand_filename,
+    std::vector<pisa::Query> const& queries,
+    std::size_t cache_size,
+    std::size_t k)
+{
+    using namespace pisa;
+
+    if constexpr (std::is_same_v<typename IndexType::index_layout_tag, BlockIndexTag>) {
+        WandType wdata(MemorySource::mapped_file(wand_filename));
+        auto algorithm = ShardedAlgorithm::parse("block_max_wand");
+        auto no_op = [](Query const&) {};
+
+        for (bool cold: {true, false}) {
+            auto label = cold ? "cold" : "warm";
+            if (cold) {
+                drop_page_cache(index_filename);
+            }
+            double mmap_time = 0;
+            {
+                IndexType index(MemorySource::mapped_file(index_filename, LoadPolicy::Lazy));
+                mmap_time = run_queries(index, wdata, queries, algorithm, k, no_op);
+            }
+
+            if (cold) {
+                drop_page_cache(index_filename);
+            }
+            auto cache = std::make_shared<BlockCache>(index_filename, cache_size);
+            auto index = open_cached_index<IndexType>(cache);
+            auto load = [&](Query const& query) {
+                load_posting_lists(*cache, index, gsl::make_span(&query, 1));
+            };
+            auto cached_time = run_queries(index, wdata, queries, algorithm, k, load);
+            auto stats = cache->stats();
+
+            spdlog::info(
+                "{} page cache: {:.1f} us per query with mmap, {:.1f} us with block cache "
+                "({}, hit rate {:.3f}, {} evictions, {} bytes read)",
+                label,
+                mmap_time,
+                cached_time,
+                cache->uses_io_uring() ? "io_uring" : "pread",
+                stats.hit_rate(),
+                stats.evictions,
+                stats.bytes_read);
+            std::cout << fmt::format(
+                "{}\t{}\t{}\t{:.1f}\t{:.1f}\t{:.3f}\n",
+                label,
+                cache_size,
+                k,
+                mmap_time,
+                cached_time,
+                stats.hit_rate());
+        }
+    } else {
+        spdlog::error("The block cache supports only block-compressed indexes");
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    using namespace pisa;
+
+    if (argc != 6 && argc != 7) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <index type> <index filename> <wand data filename> <query IDs filename>"
+                     " <cache size in MiB> [<k>]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string type = argv[1];
+    std::string index_filename = argv[2];
+    std::string wand_filename = argv[3];
+    std::size_t cache_size = std::stoul(argv[5]) * 1024 * 1024;
+    std::size_t k = argc == 7 ? std::stoul(argv[6]) : 10;
+
+    std::vector<Query> queries;
+    std::ifstream is(argv[4]);
+    io::for_each_line(
+        is, [&](std::string const& line) { queries.push_back(parse_query_ids(line)); });
+    spdlog::info("Read {} queries", queries.size());
+
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                                                  \
+    }                                                                                          \
+    else if (type == BOOST_PP_STRINGIZE(T))                                                    \
+    {                                                                                          \
+        perftest<BOOST_PP_CAT(T, _index)>(                                                     \
+            index_filename, wand_filename, queries, cache_size, k);                            \
+        /**/
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+    } else {
+        spdlog::error("Unknown type {}", type);
+    }
+}
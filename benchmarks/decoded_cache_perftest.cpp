@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <tbb/global_control.h>
+#include <tbb/parallel_for.h>
+
+#include "spdlog/spdlog.h"
+
+#include "decoded_block_cache.hpp"
+#include "index_types.hpp"
+#include "io.hpp"
+#include "memory_source.hpp"
+#include "query/queries.hpp"
+#include "query/sharded_search.hpp"
+#include "scorer/scorer.hpp"
+#include "util/do_not_optimize_away.hpp"
+#include "util/util.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using pisa::do_not_optimize_away;
+using pisa::get_time_usecs;
+
+using WandType = pisa::wand_data<pisa::wand_data_raw>;
+
+struct Latencies {
+    double mean;
+    double p50;
+    double p99;
+};
+
+/// Runs `queries` concurrently and returns the distribution of their times in microseconds.
+template <typename Cursors>
+auto run_queries(
+    Cursors const& cursors,
+    std::vector<pisa::Query> const& queries,
+    std::uint64_t num_docs,
+    pisa::ShardedAlgorithm const& algorithm,
+    std::size_t k) -> Latencies
+{
+    std::vector<double> times(queries.size());
+    tbb::parallel_for(std::size_t(0), queries.size(), [&](std::size_t idx) {
+        auto tick = get_time_usecs();
+        auto results =
+            pisa::paged_search(cursors, queries[idx], num_docs, algorithm, k, 0, nullptr);
+        do_not_optimize_away(results.primary.size());
+        times[idx] = get_time_usecs() - tick;
+    });
+    std::sort(times.begin(), times.end());
+    return Latencies{
+        std::accumulate(times.begin(), times.end(), 0.0) / times.size(),
+        times[times.size() / 2],
+        times[times.size() * 99 / 100]};
+}
+
+template <typename IndexType>
+void perftest(
+    std::string const& type,
+    std::string const& index_filename,
+    std::string const& wand_filename,
+    std::vector<pisa::Query> const& queries,
+    std::size_t cache_size,
+    std::size_t threads,
+    std::size_t k)
+{
+    using namespace pisa;
+
+    if constexpr (std::is_same_v<typename IndexType::index_layout_tag, BlockIndexTag>) {
+        IndexType index(MemorySource::mapped_file(index_filename));
+        WandType wdata(MemorySource::mapped_file(wand_filename));
+        auto scorer = scorer::from_params(ScorerParams("bm25"), wdata);
+        IndexCursors<IndexType, WandType> cursors{index, wdata, *scorer};
+
+        for (auto const& name: {"block_max_wand", "block_max_maxscore"}) {
+            auto algorithm = ShardedAlgorithm::parse(name);
+            // The first run of each configuration warms up the page cache and decoded blocks.
+            index.set_decoded_block_cache(nullptr);
+            run_queries(cursors, queries, index.num_docs(), algorithm, k);
+            auto uncached = run_queries(cursors, queries, index.num_docs(), algorithm, k);
+
+            auto cache = std::make_shared<DecodedBlockCache>(
+                cache_size, IndexType::block_codec_type::block_size);
+            index.set_decoded_block_cache(cache);
+            run_queries(cursors, queries, index.num_docs(), algorithm, k);
+            cache->reset_stats();
+            auto cached = run_queries(cursors, queries, index.num_docs(), algorithm, k);
+            auto stats = cache->stats();
+
+            spdlog::info(
+                "{} {}: mean {:.1f} -> {:.1f} us ({:+.1f}%), p99 {:.1f} -> {:.1f} us, "
+                "hit rate {:.3f}",
+                type,
+                name,
+                uncached.mean,
+                cached.mean,
+                100.0 * (cached.mean - uncached.mean) / uncached.mean,
+                uncached.p99,
+                cached.p99,
+                stats.hit_rate());
+            std::cout << fmt::format(
+                "{}\t{}\t{}\t{}\t{:.1f}\t{:.1f}\t{:.1f}\t{:.1f}\t{:.1f}\t{:.1f}\t{:.3f}\n",
+                type,
+                name,
+                threads,
+                cache_size,
+                uncached.mean,
+                cached.mean,
+                uncached.p50,
+                cached.p50,
+                uncached.p99,
+                cached.p99,
+                stats.hit_rate());
+        }
+    } else {
+        spdlog::error("The decoded block cache supports only block-compressed indexes");
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    using namespace pisa;
+
+    if (argc < 6 || argc > 8) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <index type> <index filename> <wand data filename> <query IDs filename>"
+                     " <cache size in MiB> [<threads> [<k>]]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string type = argv[1];
+    std::string index_filename = argv[2];
+    std::string wand_filename = argv[3];
+    std::size_t cache_size = std::stoul(argv[5]) * 1024 * 1024;
+    std::size_t threads = argc > 6 ? std::stoul(argv[6]) : std::thread::hardware_concurrency();
+    std::size_t k = argc > 7 ? std::stoul(argv[7]) : 10;
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, threads);
+
+    std::vector<Query> queries;
+    std::ifstream is(argv[4]);
+    io::for_each_line(
+        is, [&](std::string const& line) { queries.push_back(parse_query_ids(line)); });
+    spdlog::info("Read {} queries", queries.size());
+
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                                                  \
+    }                                                                                          \
+    else if (type == BOOST_PP_STRINGIZE(T))                                                    \
+    {                                                                                          \
+        perftest<BOOST_PP_CAT(T, _index)>(                                                     \
+            type, index_filename, wand_filename, queries, cache_size, threads, k);             \
+        /**/
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+    } else {
+        spdlog::error("Unknown type {}", type);
+    }
+}
@@ -0,0 +1,147 @@
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "cursor/deletion_filtered_cursor.hpp"
+#include "deleted_documents.hpp"
+#include "index_types.hpp"
+#include "io.hpp"
+#include "memory_source.hpp"
+#include "query/queries.hpp"
+#include "query/sharded_search.hpp"
+#include "scorer/scorer.hpp"
+#include "util/do_not_optimize_away.hpp"
+#include "util/util.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using pisa::do_not_optimize_away;
+using pisa::get_time_usecs;
+
+using WandType = pisa::wand_data<pisa::wand_data_raw>;
+
+/// Deletes each document with probability `rate`.
+void random_deletions(pisa::DeletedDocuments& deleted, std::uint64_t num_docs, double rate)
+{
+    std::mt19937_64 rng(1729);
+    std::bernoulli_distribution coin(rate);
+    pisa::DeletedDocuments::builder builder(num_docs);
+    for (std::uint64_t docid = 0; docid < num_docs; ++docid) {
+        if (coin(rng)) {
+            builder.remove(docid);
+        }
+    }
+    builder.build(deleted);
+}
+
+/// Returns the mean time of a query in microseconds.
+template <typename Cursors>
+auto run_queries(
+    Cursors const& cursors,
+    std::vector<pisa::Query> const& queries,
+    std::uint64_t num_docs,
+    pisa::ShardedAlgorithm const& algorithm,
+    std::size_t k,
+    std::size_t secondary_k) -> double
+{
+    auto paged_k = algorithm.method == pisa::PageMethod::None ? 0 : secondary_k;
+    auto tick = get_time_usecs();
+    for (auto const& query: queries) {
+        auto results = pisa::paged_search(cursors, query, num_docs, algorithm, k, paged_k, nullptr);
+        do_not_optimize_away(results.primary.size() + results.secondary.size());
+    }
+    return (get_time_usecs() - tick) / queries.size();
+}
+
+template <typename IndexType>
+void perftest(
+    std::string const& index_filename,
+    std::string const& wand_filename,
+    std::vector<pisa::Query> const& queries,
+    std::size_t k,
+    std::size_t secondary_k)
+{
+    using namespace pisa;
+
+    IndexType index(MemorySource::mapped_file(index_filename));
+    WandType wdata(MemorySource::mapped_file(wand_filename));
+    auto scorer = scorer::from_params(ScorerParams("bm25"), wdata);
+    IndexCursors<IndexType, WandType> cursors{index, wdata, *scorer};
+
+    std::vector<std::string> algorithms{
+        "wand",
+        "block_max_wand",
+        "maxscore",
+        "block_max_maxscore",
+        "wand_method_1",
+        "wand_method_2",
+        "wand_method_3",
+        "block_max_wand_method_1",
+        "block_max_wand_method_2",
+        "block_max_wand_method_3"};
+    for (auto rate: {0.01, 0.1, 0.3}) {
+        DeletedDocuments deleted;
+        random_deletions(deleted, index.num_docs(), rate);
+        DeletionFilteredCursors<IndexCursors<IndexType, WandType>> filtered{cursors, deleted};
+        spdlog::info("Deleted {} of {} documents", deleted.count(), deleted.num_docs());
+        for (auto const& name: algorithms) {
+            auto algorithm = ShardedAlgorithm::parse(name);
+            auto unfiltered =
+                run_queries(cursors, queries, index.num_docs(), algorithm, k, secondary_k);
+            auto with_deletions =
+                run_queries(filtered, queries, index.num_docs(), algorithm, k, secondary_k);
+            spdlog::info(
+                "{}: {:.1f} us per query without deletions, {:.1f} us with {:.0f}% deleted",
+                name,
+                unfiltered,
+                with_deletions,
+                rate * 100);
+            std::cout << fmt::format(
+                "{}\t{}\t{:.2f}\t{:.1f}\t{:.1f}\n", name, k, rate, unfiltered, with_deletions);
+        }
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    using namespace pisa;
+
+    if (argc != 5 && argc != 7) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <index type> <index filename> <wand data filename> <query IDs filename>"
+                     " [<k> <secondary k>]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string type = argv[1];
+    std::string index_filename = argv[2];
+    std::string wand_filename = argv[3];
+    std::size_t k = argc == 7 ? std::stoul(argv[5]) : 10;
+    std::size_t secondary_k = argc == 7 ? std::stoul(argv[6]) : 10;
+
+    std::vector<Query> queries;
+    std::ifstream is(argv[4]);
+    io::for_each_line(
+        is, [&](std::string const& line) { queries.push_back(parse_query_ids(line)); });
+    spdlog::info("Read {} queries", queries.size());
+
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                                                  \
+    }                                                                                          \
+    else if (type == BOOST_PP_STRINGIZE(T))                                                    \
+    {                                                                                          \
+        perftest<BOOST_PP_CAT(T, _index)>(                                                     \
+            index_filename, wand_filename, queries, k, secondary_k);                           \
+        /**/
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+    } else {
+        spdlog::error("Unknown type {}", type);
+    }
+}
@@ -1,5 +1,8 @@
+#include <functional>
+
 #include "mappable/mapper.hpp"
-#include "mio/mmap.hpp"
+#include "memory_residency.hpp"
+#include "memory_source.hpp"
 #include "spdlog/spdlog.h"
 
 #include "index_types.hpp"
@@ -9,8 +12,30 @@
 using pisa::do_not_optimize_away;
 using pisa::get_time_usecs;
 
+/// Evicts the index from the page cache if `evict` is given, and returns the I/O counters
+/// at the start of a timed run.
+auto start_run(std::function<void()> const& evict) -> pisa::IoCounters
+{
+    if (evict) {
+        evict();
+    }
+    return pisa::io_counters();
+}
+
+/// Logs the I/O done since `start`, if the run started with a cold cache.
+void log_run_io(std::function<void()> const& evict, pisa::IoCounters const& start)
+{
+    if (evict) {
+        auto end = pisa::io_counters();
+        spdlog::info(
+            "  {} major page faults, {} bytes read",
+            end.major_faults - start.major_faults,
+            end.read_bytes - start.read_bytes);
+    }
+}
+
 template <typename IndexType, bool with_freqs>
-void perftest(IndexType const& index, std::string const& type)
+void perftest(IndexType const& index, std::string const& type, std::function<void()> const& evict)
 {
     std::string freqs_log = with_freqs ? "+freq()" : "";
     {
@@ -31,6 +56,7 @@ void perftest(IndexType const& index, std::string const& type)
             }
         }
 
+        auto io = start_run(evict);
         auto tick = get_time_usecs();
         uint64_t calls_per_list = 500000;
         size_t postings = 0;
@@ -54,6 +80,7 @@ void perftest(IndexType const& index, std::string const& type)
             freqs_log,
             uint64_t(elapsed / 1000000),
             next_ns);
+        log_run_io(evict, io);
         spdlog::info("{}\tnext{}\t{:.1f}", type, (with_freqs ? "_freq" : ""), next_ns);
     }
 
@@ -76,6 +103,7 @@ void perftest(IndexType const& index, std::string const& type)
             }
         }
 
+        auto io = start_run(evict);
         auto tick = get_time_usecs();
         size_t calls = 0;
         for (auto const& p: skip_values) {
@@ -98,41 +126,47 @@ void perftest(IndexType const& index, std::string const& type)
             freqs_log,
             skip,
             next_geq_ns);
+        log_run_io(evict, io);
         spdlog::info(
             "{}\tnext_geq{}\t{}\t{:.1f}", type, (with_freqs ? "_freq" : ""), skip, next_geq_ns);
     }
 }
 
 template <typename IndexType>
-void perftest(const char* index_filename, std::string const& type)
+void perftest(const char* index_filename, std::string const& type, bool cold)
 {
     spdlog::info("Loading index from {}", index_filename);
-    IndexType index;
-    mio::mmap_source m(index_filename);
-    pisa::mapper::map(index, m, pisa::mapper::map_flags::warmup);
+    IndexType index(pisa::MemorySource::mapped_file(std::string(index_filename)));
 
-    perftest<IndexType, false>(index, type);
-    perftest<IndexType, true>(index, type);
+    std::function<void()> evict;
+    if (cold) {
+        spdlog::info("Evicting the index from the page cache before each run");
+        evict = [&] { pisa::evict_structure(index, index_filename); };
+    }
+    perftest<IndexType, false>(index, type, evict);
+    perftest<IndexType, true>(index, type, evict);
 }
 
 int main(int argc, const char** argv)
 {
     using namespace pisa;
 
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <index type> <index filename>" << std::endl;
+    if (argc < 3 || argc > 4 || (argc == 4 && std::string(argv[3]) != "--cold")) {
+        std::cerr << "Usage: " << argv[0] << " <index type> <index filename> [--cold]"
+                  << std::endl;
         return 1;
     }
 
     std::string type = argv[1];
     const char* index_filename = argv[2];
+    bool cold = argc == 4;
 
     if (false) {
-#define LOOP_BODY(R, DATA, T)                                    \
-    }                                                            \
-    else if (type == BOOST_PP_STRINGIZE(T))                      \
-    {                                                            \
-        perftest<BOOST_PP_CAT(T, _index)>(index_filename, type); \
+#define LOOP_BODY(R, DATA, T)                                          \
+    }                                                                  \
+    else if (type == BOOST_PP_STRINGIZE(T))                            \
+    {                                                                  \
+        perftest<BOOST_PP_CAT(T, _index)>(index_filename, type, cold); \
         /**/
 
         BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
@@ -0,0 +1,53 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "spdlog/spdlog.h"
+
+#include "tokenizer.hpp"
+#include "util/do_not_optimize_away.hpp"
+#include "util/util.hpp"
+
+using pisa::do_not_optimize_away;
+using pisa::get_time_usecs;
+
+template <typename Tokenizer>
+void perftest(std::string const& text, std::string const& name, int runs)
+{
+    size_t tokens = 0;
+    auto tick = get_time_usecs();
+    for (int run = 0; run < runs; ++run) {
+        Tokenizer tokenizer(text);
+        for (auto term: tokenizer) {
+            do_not_optimize_away(term.size());
+            ++tokens;
+        }
+    }
+    double elapsed = get_time_usecs() - tick;
+    spdlog::info(
+        "[{}] {} tokens in {:.3f} seconds: {:.1f} MB/s, {:.1f} ns per token",
+        name,
+        tokens,
+        elapsed / 1000000,
+        double(text.size()) * runs / elapsed,
+        elapsed / tokens * 1000);
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " <text file> [runs]" << std::endl;
+        return 1;
+    }
+    int runs = argc == 3 ? std::stoi(argv[2]) : 1;
+
+    std::ifstream is(argv[1]);
+    std::stringstream buffer;
+    buffer << is.rdbuf();
+    std::string text = buffer.str();
+    spdlog::info("Tokenizing {} bytes {} times", text.size(), runs);
+
+    perftest<pisa::TermTokenizer>(text, "lexer", runs);
+    perftest<pisa::FastTermTokenizer>(text, "fast", runs);
+}
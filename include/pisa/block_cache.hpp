@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <gsl/span>
+
+#include "mappable/mappable_vector.hpp"
+#include "memory_source.hpp"
+#include "query/queries.hpp"
+
+namespace pisa {
+
+/// A file read on demand with direct I/O, for indexes larger than memory.
+///
+/// The file is backed by an anonymous memory buffer of the same size, and read into it in
+/// blocks of `block_size` bytes. Missing blocks are read by `load` all at once, through
+/// io_uring when the kernel supports it, with `O_DIRECT` so that the page cache is bypassed.
+/// At most `capacity` bytes are kept in memory: when more are needed, blocks loaded by earlier
+/// calls are evicted with the CLOCK algorithm, except those that are pinned.
+///
+/// Reading a block that is not loaded returns zeros rather than faulting it in, so all
+/// memory a reader accesses must be loaded first. Blocks are only evicted by `load`, which
+/// makes the ranges of a call valid until the next call.
+class BlockCache {
+  public:
+    static constexpr std::size_t default_block_size = 64 * 1024;
+
+    /// Hit and miss counts of loaded blocks.
+    struct Stats {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+        std::size_t bytes_read = 0;
+
+        [[nodiscard]] auto hit_rate() const -> double
+        {
+            return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+        }
+    };
+
+    /// Opens `file`, keeping at most `capacity` bytes of it in memory.
+    ///
+    /// \throws std::invalid_argument  if `block_size` is not a multiple of 4096
+    /// \throws std::system_error      if the file cannot be opened or read
+    BlockCache(
+        std::string const& file,
+        std::size_t capacity,
+        std::size_t block_size = default_block_size,
+        unsigned int queue_depth = 64);
+    BlockCache(BlockCache const&) = delete;
+    BlockCache(BlockCache&&) = delete;
+    BlockCache& operator=(BlockCache const&) = delete;
+    BlockCache& operator=(BlockCache&&) = delete;
+    ~BlockCache();
+
+    [[nodiscard]] auto data() const -> char const* { return m_data; }
+    [[nodiscard]] auto size() const -> std::size_t { return m_size; }
+    [[nodiscard]] auto block_size() const -> std::size_t { return m_block_size; }
+    [[nodiscard]] auto capacity() const -> std::size_t { return m_capacity; }
+
+    /// Whether reads go through io_uring rather than `pread`.
+    [[nodiscard]] auto uses_io_uring() const -> bool { return m_ring != nullptr; }
+
+    /// Reads the missing blocks of `ranges`, which point into `data()`, concurrently.
+    ///
+    /// Blocks of `ranges` are not evicted until the next call, even if they exceed the
+    /// capacity of the cache.
+    void load(gsl::span<gsl::span<char const> const> ranges);
+
+    /// Reads `range` and keeps it in memory until the cache is destroyed.
+    void pin(gsl::span<char const> range);
+
+    [[nodiscard]] auto stats() const -> Stats;
+    void reset_stats();
+
+  private:
+    struct Ring;
+
+    void read_blocks(std::vector<std::size_t> const& blocks);
+    auto evict_one() -> bool;
+
+    int m_fd = -1;
+    char* m_data = nullptr;
+    std::size_t m_size = 0;
+    std::size_t m_buffer_size = 0;
+    std::size_t m_block_size;
+    std::size_t m_capacity;
+    std::unique_ptr<Ring> m_ring;
+    std::vector<std::uint8_t> m_state;
+    std::vector<std::uint32_t> m_last_used;
+    std::uint32_t m_epoch = 0;
+    std::size_t m_clock_hand = 0;
+    std::size_t m_resident_blocks = 0;
+    Stats m_stats;
+    mutable std::mutex m_mutex;
+};
+
+namespace detail {
+
+    /// Pins everything that precedes the data of the last mappable vector of a frozen
+    /// structure, which is where the vector data begins.
+    class pin_prefix_visitor {
+      public:
+        explicit pin_prefix_visitor(BlockCache& cache) : m_cache(cache) {}
+        pin_prefix_visitor(pin_prefix_visitor const&) = delete;
+        pin_prefix_visitor(pin_prefix_visitor&&) = delete;
+        pin_prefix_visitor& operator=(pin_prefix_visitor const&) = delete;
+        pin_prefix_visitor& operator=(pin_prefix_visitor&&) = delete;
+        ~pin_prefix_visitor() = default;
+
+        template <typename T>
+        typename std::enable_if<!std::is_pod<T>::value, pin_prefix_visitor&>::type
+        operator()(T& val, const char* /* friendly_name */)
+        {
+            val.map(*this);
+            return *this;
+        }
+
+        template <typename T>
+        typename std::enable_if<std::is_pod<T>::value, pin_prefix_visitor&>::type
+        operator()(T& val, const char* /* friendly_name */)
+        {
+            m_cache.pin(gsl::span<char const>(m_cache.data() + m_offset, sizeof(T)));
+            std::memcpy(&val, m_cache.data() + m_offset, sizeof(T));
+            m_offset += sizeof(T);
+            return *this;
+        }
+
+        template <typename T>
+        pin_prefix_visitor& operator()(mapper::mappable_vector<T>& /* vec */, const char* name)
+        {
+            std::uint64_t size = 0;
+            (*this)(size, name);
+            m_prefix = m_offset;
+            m_offset += size * sizeof(T);
+            return *this;
+        }
+
+        [[nodiscard]] auto prefix() const -> std::size_t { return m_prefix; }
+
+        /// Size of the structure, after which the file may continue with its `TermLayout`.
+        [[nodiscard]] auto end() const -> std::size_t { return m_offset; }
+
+      private:
+        BlockCache& m_cache;
+        std::size_t m_offset = sizeof(std::uint64_t);
+        std::size_t m_prefix = 0;
+    };
+
+}  // namespace detail
+
+/// Opens a block-compressed index whose posting lists are read on demand through `cache`.
+///
+/// Everything that precedes or follows the posting lists, such as their endpoints and layout,
+/// is read and pinned when the index is opened. Posting lists must be loaded with
+/// `load_posting_lists` before they are traversed.
+template <typename Index>
+[[nodiscard]] auto open_cached_index(std::shared_ptr<BlockCache> cache) -> Index
+{
+    Index probe;
+    detail::pin_prefix_visitor visitor(*cache);
+    probe.map(visitor);
+    cache->pin(gsl::span<char const>(cache->data(), visitor.prefix()));
+    if (visitor.end() < cache->size()) {
+        cache->pin(gsl::span<char const>(
+            cache->data() + visitor.end(), cache->size() - visitor.end()));
+    }
+    return Index(MemorySource::from_block_cache(std::move(cache)));
+}
+
+/// Reads the posting lists of the terms of `queries` into `cache`, all of them concurrently.
+template <typename Index>
+void load_posting_lists(BlockCache& cache, Index const& index, gsl::span<Query const> queries)
+{
+    // Block decoders may read a few bytes past the end of a list.
+    constexpr std::size_t slack = 64;
+    std::vector<gsl::span<char const>> ranges;
+    for (auto const& query: queries) {
+        for (auto term: query.terms) {
+            auto memory = index.posting_list_memory(term);
+            auto end = std::min<std::size_t>(
+                memory.data() + memory.size() + slack - cache.data(), cache.size());
+            ranges.emplace_back(memory.data(), cache.data() + end - memory.data());
+        }
+    }
+    cache.load(ranges);
+}
+
+}  // namespace pisa
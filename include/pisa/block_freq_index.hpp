@@ -1,14 +1,21 @@
 #pragma once
 
+#include <memory>
+
+#include <fmt/format.h>
+#include <gsl/span>
+
 #include "bit_vector.hpp"
 #include "mappable/mappable_vector.hpp"
 #include "mappable/mapper.hpp"
 
 #include "block_posting_list.hpp"
 #include "codec/compact_elias_fano.hpp"
+#include "decoded_block_cache.hpp"
 #include "mappable/mapper.hpp"
 #include "memory_source.hpp"
 #include "temporary_directory.hpp"
+#include "term_layout.hpp"
 
 namespace pisa {
 
@@ -18,10 +25,13 @@ template <typename BlockCodec, bool Profile = false>
 class block_freq_index {
   public:
     using index_layout_tag = BlockIndexTag;
+    using posting_list_type = block_posting_list<BlockCodec, Profile>;
+    using block_codec_type = BlockCodec;
     block_freq_index() = default;
     explicit block_freq_index(MemorySource source) : m_source(std::move(source))
     {
-        mapper::map(*this, m_source.data(), mapper::map_flags::warmup);
+        auto bytes = mapper::map(*this, m_source.data(), m_source.map_flags());
+        m_layout.map_trailer(m_source, bytes);
     }
 
     class builder {
@@ -46,6 +56,27 @@ class block_freq_index {
             m_endpoints.push_back(m_lists.size());
         }
 
+        using encoded_posting_list = std::vector<std::uint8_t>;
+
+        /// Encodes a posting list without modifying the builder; this can be called
+        /// concurrently, as long as the results are added in term order.
+        template <typename DocsIterator, typename FreqsIterator>
+        [[nodiscard]] auto encode_posting_list(
+            uint64_t n,
+            DocsIterator docs_begin,
+            FreqsIterator freqs_begin,
+            uint64_t /* occurrences */) const -> encoded_posting_list
+        {
+            if (!n) {
+                throw std::invalid_argument("List must be nonempty");
+            }
+            encoded_posting_list buf;
+            block_posting_list<BlockCodec, Profile>::write(buf, n, docs_begin, freqs_begin);
+            return buf;
+        }
+
+        void add_encoded_posting_list(encoded_posting_list const& list) { add_posting_list(list); }
+
         template <typename BlockDataRange>
         void add_posting_list(uint64_t n, BlockDataRange const& blocks)
         {
@@ -113,6 +144,27 @@ class block_freq_index {
             m_endpoints.push_back(m_postings_bytes_written);
         }
 
+        using encoded_posting_list = std::vector<std::uint8_t>;
+
+        /// Encodes a posting list without modifying the builder; this can be called
+        /// concurrently, as long as the results are added in term order.
+        template <typename DocsIterator, typename FreqsIterator>
+        [[nodiscard]] auto encode_posting_list(
+            uint64_t n,
+            DocsIterator docs_begin,
+            FreqsIterator freqs_begin,
+            uint64_t /* occurrences */) const -> encoded_posting_list
+        {
+            if (!n) {
+                throw std::invalid_argument("List must be nonempty");
+            }
+            encoded_posting_list buf;
+            block_posting_list<BlockCodec, Profile>::write(buf, n, docs_begin, freqs_begin);
+            return buf;
+        }
+
+        void add_encoded_posting_list(encoded_posting_list const& list) { add_posting_list(list); }
+
         template <typename BlockDataRange>
         void add_posting_list(uint64_t n, BlockDataRange const& blocks)
         {
@@ -178,34 +230,64 @@ class block_freq_index {
         assert(i < size());
         compact_elias_fano::enumerator endpoints(m_endpoints, 0, m_lists.size(), m_size, m_params);
 
-        auto endpoint = endpoints.move(i).second;
-        return document_enumerator(m_lists.data() + endpoint, num_docs(), i);
+        auto endpoint = endpoints.move(m_layout.position(i)).second;
+        return document_enumerator(
+            m_lists.data() + endpoint, num_docs(), i, m_decoded_block_cache.get());
     }
 
-    void warmup(size_t i) const
+    /// Shares decoded blocks of long posting lists between enumerators through `cache`, or
+    /// stops sharing them if `cache` is null.
+    ///
+    /// \throws std::invalid_argument  if the cache has a different block size than the codec
+    void set_decoded_block_cache(std::shared_ptr<DecodedBlockCache> cache)
+    {
+        if (cache && cache->block_size() != BlockCodec::block_size) {
+            throw std::invalid_argument(fmt::format(
+                "Decoded block cache has block size {} but the index has {}",
+                cache->block_size(),
+                BlockCodec::block_size));
+        }
+        m_decoded_block_cache = std::move(cache);
+    }
+
+    /// Memory occupied by the `i`-th posting list.
+    [[nodiscard]] auto posting_list_memory(size_t i) const -> gsl::span<char const>
     {
         assert(i < size());
         compact_elias_fano::enumerator endpoints(m_endpoints, 0, m_lists.size(), m_size, m_params);
 
-        auto begin = endpoints.move(i).second;
+        auto position = m_layout.position(i);
+        auto begin = endpoints.move(position).second;
         auto end = m_lists.size();
-        if (i + 1 != size()) {
-            end = endpoints.move(i + 1).second;
+        if (position + 1 != size()) {
+            end = endpoints.move(position + 1).second;
         }
+        return gsl::span<char const>(
+            reinterpret_cast<char const*>(m_lists.data()) + begin, end - begin);
+    }
 
-        volatile uint32_t tmp;
-        for (size_t i = begin; i != end; ++i) {
-            tmp = m_lists[i];
+    void warmup(size_t i) const
+    {
+        volatile char tmp;
+        for (auto byte: posting_list_memory(i)) {
+            tmp = byte;
         }
         (void)tmp;
     }
 
+    /// Order in which posting lists are stored, see `TermLayout`.
+    [[nodiscard]] auto layout() const -> TermLayout const& { return m_layout; }
+
     void swap(block_freq_index& other)
     {
         std::swap(m_params, other.m_params);
         std::swap(m_size, other.m_size);
+        std::swap(m_num_docs, other.m_num_docs);
         m_endpoints.swap(other.m_endpoints);
         m_lists.swap(other.m_lists);
+        m_layout.swap(other.m_layout);
+        std::swap(m_source, other.m_source);
+        m_decoded_block_cache.swap(other.m_decoded_block_cache);
     }
 
     template <typename Visitor>
@@ -221,6 +303,8 @@ class block_freq_index {
     size_t m_num_docs{0};
     bit_vector m_endpoints;
     mapper::mappable_vector<uint8_t> m_lists;
+    TermLayout m_layout;
     MemorySource m_source;
+    std::shared_ptr<DecodedBlockCache> m_decoded_block_cache;
 };
 }  // namespace pisa
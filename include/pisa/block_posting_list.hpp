@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <optional>
+
 #include "codec/block_codecs.hpp"
+#include "decoded_block_cache.hpp"
 #include "util/block_profiler.hpp"
 #include "util/util.hpp"
 
@@ -77,15 +81,104 @@ struct block_posting_list {
         }
     }
 
+    /// Writes the concatenation of `lists`, in which the document IDs of each list are shifted
+    /// by its offset, given the resulting `documents` and `frequencies`.
+    ///
+    /// Compressed blocks of the input lists are copied verbatim whenever they start at a block
+    /// boundary of the output list and follow the same document as in their input list; since
+    /// a block is encoded relative to the last document of the previous block, this holds for
+    /// all full blocks of a list that starts at a block boundary, except its first block if
+    /// the previous list does not end right before its offset. The other blocks, including
+    /// the last block of each input list, are encoded from `documents` and `frequencies`.
+    /// Returns the number of copied blocks.
+    template <typename Enumerators, typename Documents, typename Frequencies>
+    static auto write_merged(
+        std::vector<uint8_t>& out,
+        Enumerators const& lists,
+        std::vector<uint32_t> const& offsets,
+        Documents const& documents,
+        Frequencies const& frequencies) -> std::size_t
+    {
+        static const uint64_t block_size = BlockCodec::block_size;
+        uint64_t n = documents.size();
+        TightVariableByte::encode_single(n, out);
+
+        uint64_t blocks = ceil_div(n, block_size);
+        size_t begin_block_maxs = out.size();
+        size_t begin_block_endpoints = begin_block_maxs + 4 * blocks;
+        size_t begin_blocks = begin_block_endpoints + 4 * (blocks - 1);
+        out.resize(begin_blocks);
+
+        uint64_t pos = 0;
+        auto start_block = [&](uint32_t max) {
+            uint64_t b = pos / block_size;
+            if (b != 0) {
+                *((uint32_t*)&out[begin_block_endpoints + 4 * (b - 1)]) = out.size() - begin_blocks;
+            }
+            *((uint32_t*)&out[begin_block_maxs + 4 * b]) = max;
+        };
+        std::vector<uint32_t> docs_buf(block_size);
+        std::vector<uint32_t> freqs_buf(block_size);
+        auto encode_until = [&](uint64_t end) {
+            while (pos < end) {
+                uint32_t cur_block_size = std::min(block_size, n - pos);
+                uint32_t block_base = pos == 0 ? 0 : documents[pos - 1] + 1;
+                int64_t last_doc = int64_t(block_base) - 1;
+                for (size_t i = 0; i < cur_block_size; ++i) {
+                    docs_buf[i] = documents[pos + i] - last_doc - 1;
+                    last_doc = documents[pos + i];
+                    freqs_buf[i] = frequencies[pos + i] - 1;
+                }
+                start_block(last_doc);
+                BlockCodec::encode(
+                    docs_buf.data(),
+                    last_doc - block_base - (cur_block_size - 1),
+                    cur_block_size,
+                    out);
+                BlockCodec::encode(freqs_buf.data(), uint32_t(-1), cur_block_size, out);
+                pos += cur_block_size;
+            }
+        };
+
+        std::size_t copied = 0;
+        uint64_t list_begin = 0;
+        for (size_t l = 0; l < lists.size(); ++l) {
+            auto const& list = lists[l];
+            for (uint64_t b = 0; list_begin % block_size == 0 && b + 1 < list.num_blocks(); ++b) {
+                encode_until(list_begin + b * block_size);
+                uint32_t list_base = (b != 0 ? list.last_docid(b - 1) + 1 : 0) + offsets[l];
+                uint32_t block_base = pos == 0 ? 0 : documents[pos - 1] + 1;
+                if (list_base == block_base) {
+                    auto [begin, end] = list.block_bytes(b);
+                    start_block(list.last_docid(b) + offsets[l]);
+                    out.insert(out.end(), begin, end);
+                    pos += block_size;
+                    ++copied;
+                }
+            }
+            list_begin += list.size();
+        }
+        encode_until(n);
+        return copied;
+    }
+
     class document_enumerator {
       public:
-        document_enumerator(uint8_t const* data, uint64_t universe, size_t term_id = 0)
+        /// Opens the list at `data`; if `cache` is given and the list has at least
+        /// `cache->min_blocks()` blocks, its decoded blocks are shared through `cache`.
+        document_enumerator(
+            uint8_t const* data,
+            uint64_t universe,
+            size_t term_id = 0,
+            DecodedBlockCache* cache = nullptr)
             : m_base(TightVariableByte::decode(data, &m_n, 1)),
               m_blocks(ceil_div(m_n, BlockCodec::block_size)),
               m_block_maxs(m_base),
               m_block_endpoints(m_block_maxs + 4 * m_blocks),
               m_blocks_data(m_block_endpoints + 4 * (m_blocks - 1)),
-              m_universe(universe)
+              m_universe(universe),
+              m_term_id(term_id),
+              m_cache(cache != nullptr && m_blocks >= cache->min_blocks() ? cache : nullptr)
         {
             if (Profile) {
                 // std::cout << "OPEN\t" << m_term_id << "\t" << m_blocks << "\n";
@@ -122,7 +215,12 @@ struct block_posting_list {
                     return;
                 }
 
+                // Block maxima are first skipped `skip_stride` at a time, then one at a time.
                 uint64_t block = m_cur_block + 1;
+                while (block + skip_stride < m_blocks
+                       && block_max(block + skip_stride) < lower_bound) {
+                    block += skip_stride + 1;
+                }
                 while (block_max(block) < lower_bound) {
                     ++block;
                 }
@@ -164,6 +262,53 @@ struct block_posting_list {
 
         uint64_t num_blocks() const { return m_blocks; }
 
+        /// Last document ID of `block`.
+        uint32_t last_docid(uint64_t block) const { return block_max(block); }
+
+        /// Compressed documents and frequencies of `block`, which must not be the last one.
+        std::pair<uint8_t const*, uint8_t const*> block_bytes(uint64_t block) const
+        {
+            assert(block + 1 < m_blocks);
+            uint32_t begin = block != 0U ? ((uint32_t const*)m_block_endpoints)[block - 1] : 0;
+            uint32_t end = ((uint32_t const*)m_block_endpoints)[block];
+            return {m_blocks_data + begin, m_blocks_data + end};
+        }
+
+        /// Number of postings in `block`.
+        uint32_t block_length(uint64_t block) const
+        {
+            static const uint64_t block_size = BlockCodec::block_size;
+            return ((block + 1) * block_size <= size()) ? block_size : (size() % block_size);
+        }
+
+        /// Decodes the document IDs of `block` into `docs`, which must have room for a full
+        /// block, independently of the position of the enumerator. Returns the start of the
+        /// encoded frequencies of the block.
+        uint8_t const* decode_docs(uint64_t block, uint32_t* docs) const
+        {
+            uint32_t endpoint = block != 0U ? ((uint32_t const*)m_block_endpoints)[block - 1] : 0;
+            uint32_t length = block_length(block);
+            uint32_t base = (block != 0U ? block_max(block - 1) : uint32_t(-1)) + 1;
+            uint8_t const* freqs = BlockCodec::decode(
+                m_blocks_data + endpoint, docs, block_max(block) - base - (length - 1), length);
+            docs[0] += base;
+            for (uint32_t pos = 1; pos < length; ++pos) {
+                docs[pos] += docs[pos - 1] + 1;
+            }
+            return freqs;
+        }
+
+        /// Decodes the frequencies of `block`, encoded at `data` as returned by `decode_docs`,
+        /// into `freqs`, which must have room for a full block.
+        void decode_freqs(uint64_t block, uint8_t const* data, uint32_t* freqs) const
+        {
+            uint32_t length = block_length(block);
+            BlockCodec::decode(data, freqs, uint32_t(-1), length);
+            for (uint32_t pos = 0; pos < length; ++pos) {
+                freqs[pos] += 1;
+            }
+        }
+
         uint64_t stats_freqs_size() const
         {
             // XXX rewrite in terms of get_blocks()
@@ -254,6 +399,10 @@ struct block_posting_list {
         }
 
       private:
+        /// Number of block maxima skipped at once by `next_geq`. They span 64 bytes, but are not
+        /// aligned to cache lines.
+        static constexpr uint64_t skip_stride = 16;
+
         uint32_t block_max(uint32_t block) const { return ((uint32_t const*)m_block_maxs)[block]; }
 
         void PISA_NOINLINE decode_docs_block(uint64_t block)
@@ -265,14 +414,31 @@ struct block_posting_list {
                 ((block + 1) * block_size <= size()) ? block_size : (size() % block_size);
             uint32_t cur_base = (block != 0U ? block_max(block - 1) : uint32_t(-1)) + 1;
             m_cur_block_max = block_max(block);
-            m_freqs_block_data = BlockCodec::decode(
-                block_data,
-                m_docs_buf.data(),
-                m_cur_block_max - cur_base - (m_cur_block_size - 1),
-                m_cur_block_size);
-            intrinsics::prefetch(m_freqs_block_data);
-
-            m_docs_buf[0] += cur_base;
+            std::optional<uint32_t> cached_freqs_offset;
+            if (m_cache != nullptr) {
+                cached_freqs_offset =
+                    m_cache->find_docs(m_term_id, block, m_docs_buf.data(), m_cur_block_size);
+            }
+            if (cached_freqs_offset) {
+                m_freqs_block_data = block_data + *cached_freqs_offset;
+            } else {
+                m_freqs_block_data = BlockCodec::decode(
+                    block_data,
+                    m_docs_buf.data(),
+                    m_cur_block_max - cur_base - (m_cur_block_size - 1),
+                    m_cur_block_size);
+                intrinsics::prefetch(m_freqs_block_data);
+
+                m_docs_buf[0] += cur_base;
+                if (m_cache != nullptr) {
+                    m_cache->insert_docs(
+                        m_term_id,
+                        block,
+                        m_docs_buf.data(),
+                        m_cur_block_size,
+                        m_freqs_block_data - block_data);
+                }
+            }
 
             m_cur_block = block;
             m_pos_in_block = 0;
@@ -285,10 +451,20 @@ struct block_posting_list {
 
         void PISA_NOINLINE decode_freqs_block()
         {
+            if (m_cache != nullptr
+                && m_cache->find_freqs(
+                    m_term_id, m_cur_block, m_freqs_buf.data(), m_cur_block_size)) {
+                m_freqs_decoded = true;
+                return;
+            }
             uint8_t const* next_block = BlockCodec::decode(
                 m_freqs_block_data, m_freqs_buf.data(), uint32_t(-1), m_cur_block_size);
             intrinsics::prefetch(next_block);
             m_freqs_decoded = true;
+            if (m_cache != nullptr) {
+                m_cache->insert_freqs(
+                    m_term_id, m_cur_block, m_freqs_buf.data(), m_cur_block_size);
+            }
 
             if (Profile) {
                 ++m_block_profile[2 * m_cur_block + 1];
@@ -302,6 +478,8 @@ struct block_posting_list {
         uint8_t const* m_block_endpoints;
         uint8_t const* m_blocks_data;
         uint64_t m_universe;
+        uint32_t m_term_id;
+        DecodedBlockCache* m_cache;
 
         uint32_t m_cur_block{0};
         uint32_t m_pos_in_block{0};
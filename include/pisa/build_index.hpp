@@ -0,0 +1,316 @@
+#pragma once
+
+#include <numeric>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+
+#include "binary_freq_collection.hpp"
+#include "compress.hpp"
+#include "index_types.hpp"
+#include "invert.hpp"
+#include "mappable/mapper.hpp"
+#include "util/util.hpp"
+#include "wand_data.hpp"
+#include "wand_data_compressed.hpp"
+#include "wand_data_range.hpp"
+#include "wand_data_raw.hpp"
+
+namespace pisa {
+
+/// Merged posting lists that are passed together to the index and wand data builders.
+class PostingListChunk {
+  public:
+    void push_back(std::vector<uint32_t> documents, std::vector<uint32_t> frequencies)
+    {
+        m_postings += documents.size();
+        m_documents.push_back(std::move(documents));
+        m_frequencies.push_back(std::move(frequencies));
+    }
+
+    [[nodiscard]] auto postings() const -> std::size_t { return m_postings; }
+    [[nodiscard]] auto empty() const -> bool { return m_documents.empty(); }
+
+    /// Returns views of the posting lists, valid as long as the chunk is not modified.
+    [[nodiscard]] auto lists() const -> std::vector<binary_freq_collection::sequence>
+    {
+        std::vector<binary_freq_collection::sequence> lists;
+        lists.reserve(m_documents.size());
+        for (std::size_t idx = 0; idx < m_documents.size(); ++idx) {
+            auto const& documents = m_documents[idx];
+            auto const& frequencies = m_frequencies[idx];
+            lists.push_back(binary_freq_collection::sequence{
+                {documents.data(), documents.data() + documents.size()},
+                {frequencies.data(), frequencies.data() + frequencies.size()}});
+        }
+        return lists;
+    }
+
+    void clear()
+    {
+        m_documents.clear();
+        m_frequencies.clear();
+        m_postings = 0;
+    }
+
+  private:
+    std::vector<std::vector<uint32_t>> m_documents{};
+    std::vector<std::vector<uint32_t>> m_frequencies{};
+    std::size_t m_postings = 0;
+};
+
+/// Builds a compressed index and its wand data from the posting lists produced by
+/// `for_each_posting_list(consume)`, which must call `consume(term_id, documents, frequencies)`
+/// once for each of the `term_count` terms, in order.
+///
+/// Posting lists are passed straight to both builders in chunks, without writing an
+/// intermediate inverted collection. Each list is compressed, in parallel with other lists of
+/// its chunk, by `encode_posting_list(index_builder, term_id, list)`, which must return the
+/// builder's `encoded_posting_list`.
+template <
+    typename CollectionType,
+    typename WandType,
+    typename ForEachPostingList,
+    typename EncodePostingList>
+void build_index_from_posting_lists(
+    std::vector<uint32_t> document_sizes,
+    std::uint32_t term_count,
+    ForEachPostingList&& for_each_posting_list,
+    EncodePostingList&& encode_posting_list,
+    std::string const& output_filename,
+    std::string const& wand_data_filename,
+    std::string const& seq_type,
+    ScorerParams const& scorer_params,
+    BlockSize block_size)
+{
+    auto num_docs = document_sizes.size();
+    spdlog::info("Processing {} documents", num_docs);
+
+    global_parameters params;
+    WandType wdata;
+    typename WandType::builder wand_builder(
+        wdata, std::move(document_sizes), term_count, scorer_params, block_size, false);
+
+    auto build = [&](auto& index_builder) {
+        using builder_type = std::decay_t<decltype(index_builder)>;
+        pisa::progress progress("Create index and wand data", term_count);
+        PostingListChunk chunk;
+        std::uint32_t first_term = 0;
+        std::size_t postings = 0;
+        auto add_posting_lists = [&](gsl::span<binary_freq_collection::sequence const> lists) {
+            std::vector<typename builder_type::encoded_posting_list> encoded_lists(lists.size());
+            tbb::parallel_for(std::size_t{0}, encoded_lists.size(), [&](std::size_t idx) {
+                encoded_lists[idx] = encode_posting_list(
+                    std::as_const(index_builder), first_term + idx, lists[idx]);
+            });
+            for (auto& list: encoded_lists) {
+                index_builder.add_encoded_posting_list(list);
+            }
+        };
+        auto flush = [&] {
+            auto lists = chunk.lists();
+            tbb::parallel_invoke(
+                [&] { add_posting_lists(lists); },
+                [&] { wand_builder.add_posting_lists(lists); });
+            postings += chunk.postings();
+            progress.update(lists.size());
+            first_term += lists.size();
+            chunk.clear();
+        };
+        for_each_posting_list([&](auto /* term_id */, auto documents, auto frequencies) {
+            chunk.push_back(std::move(documents), std::move(frequencies));
+            if (chunk.postings() >= compression_chunk_postings) {
+                flush();
+            }
+        });
+        if (not chunk.empty()) {
+            flush();
+        }
+        return postings;
+    };
+
+    if constexpr (std::is_same_v<typename CollectionType::index_layout_tag, BlockIndexTag>) {
+        typename CollectionType::stream_builder builder(num_docs, params);
+        build(builder);
+        builder.build(output_filename);
+    } else {
+        typename CollectionType::builder builder(num_docs, params);
+        auto postings = build(builder);
+        CollectionType coll;
+        builder.build(coll);
+        dump_stats(coll, seq_type, postings);
+        mapper::freeze(coll, output_filename.c_str());
+    }
+    wand_builder.build();
+    mapper::freeze(wdata, wand_data_filename.c_str());
+}
+
+/// Builds a compressed index and its wand data from posting lists, encoding each list with
+/// the index builder.
+template <typename CollectionType, typename WandType, typename ForEachPostingList>
+void build_index_from_posting_lists(
+    std::vector<uint32_t> document_sizes,
+    std::uint32_t term_count,
+    ForEachPostingList&& for_each_posting_list,
+    std::string const& output_filename,
+    std::string const& wand_data_filename,
+    std::string const& seq_type,
+    ScorerParams const& scorer_params,
+    BlockSize block_size)
+{
+    build_index_from_posting_lists<CollectionType, WandType>(
+        std::move(document_sizes),
+        term_count,
+        std::forward<ForEachPostingList>(for_each_posting_list),
+        [](auto const& builder, auto /* term_id */, auto const& list) {
+            uint64_t freqs_sum = std::accumulate(list.freqs.begin(), list.freqs.end(), uint64_t(0));
+            return builder.encode_posting_list(
+                list.docs.size(), list.docs.begin(), list.freqs.begin(), freqs_sum);
+        },
+        output_filename,
+        wand_data_filename,
+        seq_type,
+        scorer_params,
+        block_size);
+}
+
+/// Builds a compressed index and its wand data directly from a forward index.
+///
+/// The forward index is inverted in batches of `batch_size` documents, which are written to
+/// temporary files next to the output index. The batches are then merged term by term, and each
+/// merged posting list is passed straight to both builders, skipping the intermediate inverted
+/// collection that `invert`, `compress_inverted_index`, and `create_wand_data` would otherwise
+/// write and read back.
+template <typename CollectionType, typename WandType>
+void build_index(
+    std::string const& input_basename,
+    std::string const& output_filename,
+    std::string const& wand_data_filename,
+    std::string const& seq_type,
+    ScorerParams const& scorer_params,
+    BlockSize block_size,
+    std::size_t batch_size,
+    std::size_t threads,
+    std::uint32_t term_count)
+{
+    double tick = get_time_usecs();
+
+    uint32_t batch_count =
+        invert::build_batches(input_basename, output_filename, term_count, batch_size, threads);
+    build_index_from_posting_lists<CollectionType, WandType>(
+        invert::read_batch_document_sizes(output_filename, batch_count),
+        term_count,
+        [&](auto&& consume) {
+            invert::for_each_merged_posting_list(
+                output_filename, batch_count, term_count, consume);
+        },
+        output_filename,
+        wand_data_filename,
+        seq_type,
+        scorer_params,
+        block_size);
+    invert::remove_batches(output_filename, batch_count);
+
+    double elapsed_secs = (get_time_usecs() - tick) / 1000000;
+    spdlog::info("Index and wand data built in {} seconds", elapsed_secs);
+}
+
+template <typename CollectionType>
+void build_index(
+    std::string const& input_basename,
+    std::string const& output_filename,
+    std::string const& wand_data_filename,
+    std::string const& seq_type,
+    ScorerParams const& scorer_params,
+    BlockSize block_size,
+    bool range,
+    bool compress,
+    std::size_t batch_size,
+    std::size_t threads,
+    std::uint32_t term_count)
+{
+    if (compress) {
+        build_index<CollectionType, wand_data<wand_data_compressed<>>>(
+            input_basename,
+            output_filename,
+            wand_data_filename,
+            seq_type,
+            scorer_params,
+            block_size,
+            batch_size,
+            threads,
+            term_count);
+    } else if (range) {
+        build_index<CollectionType, wand_data<wand_data_range<128, 1024>>>(
+            input_basename,
+            output_filename,
+            wand_data_filename,
+            seq_type,
+            scorer_params,
+            block_size,
+            batch_size,
+            threads,
+            term_count);
+    } else {
+        build_index<CollectionType, wand_data<wand_data_raw>>(
+            input_basename,
+            output_filename,
+            wand_data_filename,
+            seq_type,
+            scorer_params,
+            block_size,
+            batch_size,
+            threads,
+            term_count);
+    }
+}
+
+inline void build_index(
+    std::string const& input_basename,
+    std::string const& index_encoding,
+    std::string const& output_filename,
+    std::string const& wand_data_filename,
+    ScorerParams const& scorer_params,
+    BlockSize block_size,
+    bool range,
+    bool compress,
+    std::size_t batch_size,
+    std::size_t threads,
+    std::optional<std::uint32_t> term_count)
+{
+    if (not term_count) {
+        term_count = invert::read_term_count(input_basename);
+    }
+
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                     \
+    }                                                             \
+    else if (index_encoding == BOOST_PP_STRINGIZE(T))             \
+    {                                                             \
+        build_index<pisa::BOOST_PP_CAT(T, _index)>(               \
+            input_basename,                                       \
+            output_filename,                                      \
+            wand_data_filename,                                   \
+            index_encoding,                                       \
+            scorer_params,                                        \
+            block_size,                                           \
+            range,                                                \
+            compress,                                             \
+            batch_size,                                           \
+            threads,                                              \
+            *term_count);                                         \
+        /**/
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+    } else {
+        spdlog::error("Unknown type {}", index_encoding);
+        std::abort();
+    }
+}
+
+}  // namespace pisa
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <numeric>
 #include <optional>
 #include <thread>
@@ -10,6 +11,11 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
+#include <gsl/span>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/pipeline.h>
+#include <tbb/task_arena.h>
 
 #include "configuration.hpp"
 #include "ensure.hpp"
@@ -29,12 +35,12 @@ template <typename Collection>
 void dump_index_specific_stats(Collection const&, std::string const&)
 {}
 
-void dump_index_specific_stats(pisa::pefuniform_index const& coll, std::string const& type)
+inline void dump_index_specific_stats(pisa::pefuniform_index const& coll, std::string const& type)
 {
     pisa::stats_line()("type", type)("log_partition_size", int(coll.params().log_partition_size));
 }
 
-void dump_index_specific_stats(pisa::pefopt_index const& coll, std::string const& type)
+inline void dump_index_specific_stats(pisa::pefopt_index const& coll, std::string const& type)
 {
     auto const& conf = pisa::configuration::get();
 
@@ -65,29 +71,63 @@ struct QuantizedScorer {
     LinearQuantizer quantizer;
 };
 
-template <typename CollectionType, typename Wand>
-void compress_index_streaming(
+/// Maximum number of postings read into a single chunk of the compression pipeline.
+constexpr std::size_t compression_chunk_postings = 1U << 20U;
+
+/// Compresses all posting lists of `input` into `builder` in three pipeline stages:
+///
+///  1. a serial reader groups consecutive posting lists into chunks;
+///  2. parallel workers score (if quantizing) and encode each chunk into their own buffers;
+///  3. a serial committer appends the encoded lists to the builder in term order.
+///
+/// The number of chunks in flight is bounded, and so is the memory of intermediate buffers.
+/// Each list is encoded exactly as it would be by `builder.add_posting_list`, so the output
+/// is identical to that of sequential compression. Returns the number of postings.
+template <typename Builder, typename Wand>
+std::size_t compress_posting_lists(
     binary_freq_collection const& input,
-    pisa::global_parameters const& params,
-    std::string const& output_filename,
-    std::optional<QuantizedScorer<Wand>> quantized_scorer,
-    bool check)
+    Builder& builder,
+    std::optional<QuantizedScorer<Wand>> const& quantized_scorer,
+    pisa::progress& progress)
 {
-    spdlog::info("Processing {} documents (streaming)", input.num_docs());
-    double tick = get_time_usecs();
+    struct Chunk {
+        std::size_t first_term_id = 0;
+        std::vector<binary_freq_collection::sequence> lists;
+        std::vector<typename Builder::encoded_posting_list> encoded_lists;
+        std::size_t postings = 0;
+    };
+    using ChunkPtr = std::shared_ptr<Chunk>;
 
-    typename CollectionType::stream_builder builder(input.num_docs(), params);
-    size_t postings = 0;
-    {
-        pisa::progress progress("Create index", input.size());
+    auto plist_it = input.begin();
+    auto const plist_end = input.end();
+    std::size_t term_id = 0;
+    std::size_t postings = 0;
 
-        size_t term_id = 0;
-        if (quantized_scorer) {
-            auto&& [scorer, quantizer] = *quantized_scorer;
-            std::vector<std::uint64_t> quantized_scores;
-            for (auto const& plist: input) {
-                auto term_scorer = scorer->term_scorer(term_id);
-                std::size_t size = plist.docs.size();
+    auto read = [&](tbb::flow_control& fc) -> ChunkPtr {
+        if (plist_it == plist_end) {
+            fc.stop();
+            return nullptr;
+        }
+        auto chunk = std::make_shared<Chunk>();
+        chunk->first_term_id = term_id;
+        while (plist_it != plist_end && chunk->postings < compression_chunk_postings) {
+            chunk->lists.push_back(*plist_it);
+            chunk->postings += plist_it->docs.size();
+            ++plist_it;
+            ++term_id;
+        }
+        return chunk;
+    };
+
+    auto encode = [&](ChunkPtr chunk) -> ChunkPtr {
+        chunk->encoded_lists.reserve(chunk->lists.size());
+        std::vector<std::uint64_t> quantized_scores;
+        std::size_t chunk_term_id = chunk->first_term_id;
+        for (auto const& plist: chunk->lists) {
+            std::size_t size = plist.docs.size();
+            if (quantized_scorer) {
+                auto&& [scorer, quantizer] = *quantized_scorer;
+                auto term_scorer = scorer->term_scorer(chunk_term_id);
                 for (size_t pos = 0; pos < size; ++pos) {
                     auto doc = *(plist.docs.begin() + pos);
                     auto freq = *(plist.freqs.begin() + pos);
@@ -96,22 +136,71 @@ void compress_index_streaming(
                 }
                 auto sum = std::accumulate(
                     quantized_scores.begin(), quantized_scores.end(), std::uint64_t(0));
-                builder.add_posting_list(size, plist.docs.begin(), quantized_scores.begin(), sum);
-                term_id += 1;
+                chunk->encoded_lists.push_back(builder.encode_posting_list(
+                    size, plist.docs.begin(), quantized_scores.begin(), sum));
                 quantized_scores.clear();
-                progress.update(1);
-            }
-        } else {
-            for (auto const& plist: input) {
-                size_t size = plist.docs.size();
+            } else {
                 uint64_t freqs_sum =
                     std::accumulate(plist.freqs.begin(), plist.freqs.begin() + size, uint64_t(0));
-                builder.add_posting_list(size, plist.docs.begin(), plist.freqs.begin(), freqs_sum);
-                progress.update(1);
-                postings += size;
-                term_id += 1;
+                chunk->encoded_lists.push_back(builder.encode_posting_list(
+                    size, plist.docs.begin(), plist.freqs.begin(), freqs_sum));
             }
+            chunk_term_id += 1;
         }
+        return chunk;
+    };
+
+    auto commit = [&](ChunkPtr chunk) {
+        for (auto& list: chunk->encoded_lists) {
+            builder.add_encoded_posting_list(list);
+        }
+        postings += chunk->postings;
+        progress.update(chunk->lists.size());
+    };
+
+    auto max_chunks_in_flight = 2 * tbb::this_task_arena::max_concurrency();
+    tbb::parallel_pipeline(
+        max_chunks_in_flight,
+        tbb::make_filter<void, ChunkPtr>(tbb::filter::serial_in_order, read)
+            & tbb::make_filter<ChunkPtr, ChunkPtr>(tbb::filter::parallel, encode)
+            & tbb::make_filter<ChunkPtr, void>(tbb::filter::serial_in_order, commit));
+    return postings;
+}
+
+/// Encodes `lists` in parallel and appends them to `builder` in order.
+template <typename Builder>
+void add_posting_lists(Builder& builder, gsl::span<binary_freq_collection::sequence const> lists)
+{
+    std::vector<typename Builder::encoded_posting_list> encoded_lists(lists.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, lists.size()), [&](auto const& range) {
+        for (auto idx = range.begin(); idx != range.end(); ++idx) {
+            auto const& plist = lists[idx];
+            uint64_t freqs_sum =
+                std::accumulate(plist.freqs.begin(), plist.freqs.end(), uint64_t(0));
+            encoded_lists[idx] = builder.encode_posting_list(
+                plist.docs.size(), plist.docs.begin(), plist.freqs.begin(), freqs_sum);
+        }
+    });
+    for (auto& list: encoded_lists) {
+        builder.add_encoded_posting_list(list);
+    }
+}
+
+template <typename CollectionType, typename Wand>
+void compress_index_streaming(
+    binary_freq_collection const& input,
+    pisa::global_parameters const& params,
+    std::string const& output_filename,
+    std::optional<QuantizedScorer<Wand>> quantized_scorer,
+    bool check)
+{
+    spdlog::info("Processing {} documents (streaming)", input.num_docs());
+    double tick = get_time_usecs();
+
+    typename CollectionType::stream_builder builder(input.num_docs(), params);
+    {
+        pisa::progress progress("Create index", input.size());
+        compress_posting_lists(input, builder, quantized_scorer, progress);
     }
 
     builder.build(output_filename);
@@ -174,41 +263,15 @@ void compress_index(
             return WandType{};
         }();
 
-        std::unique_ptr<index_scorer<WandType>> scorer;
-
+        std::optional<QuantizedScorer<WandType>> quantized_scorer{};
         if (quantized) {
-            scorer = scorer::from_params(scorer_params, wdata);
+            LinearQuantizer quantizer(
+                wdata.index_max_term_weight(), configuration::get().quantization_bits);
+            quantized_scorer =
+                QuantizedScorer(scorer::from_params(scorer_params, wdata), quantizer);
         }
 
-        size_t term_id = 0;
-        for (auto const& plist: input) {
-            size_t size = plist.docs.size();
-            if (quantized) {
-                LinearQuantizer quantizer(
-                    wdata.index_max_term_weight(), configuration::get().quantization_bits);
-                auto term_scorer = scorer->term_scorer(term_id);
-                std::vector<uint64_t> quants;
-                for (size_t pos = 0; pos < size; ++pos) {
-                    uint64_t doc = *(plist.docs.begin() + pos);
-                    uint64_t freq = *(plist.freqs.begin() + pos);
-                    float score = term_scorer(doc, freq);
-                    uint64_t quant_score = quantizer(score);
-                    quants.push_back(quant_score);
-                }
-                assert(quants.size() == size);
-                uint64_t quants_sum =
-                    std::accumulate(quants.begin(), quants.begin() + quants.size(), uint64_t(0));
-                builder.add_posting_list(size, plist.docs.begin(), quants.begin(), quants_sum);
-            } else {
-                uint64_t freqs_sum =
-                    std::accumulate(plist.freqs.begin(), plist.freqs.begin() + size, uint64_t(0));
-                builder.add_posting_list(size, plist.docs.begin(), plist.freqs.begin(), freqs_sum);
-            }
-
-            progress.update(1);
-            postings += size;
-            term_id += 1;
-        }
+        postings = compress_posting_lists(input, builder, quantized_scorer, progress);
     }
 
     CollectionType coll;
@@ -216,7 +279,7 @@ void compress_index(
     double elapsed_secs = (get_time_usecs() - tick) / 1000000;
     spdlog::info("{} collection built in {} seconds", seq_type, elapsed_secs);
 
-    stats_line()("type", seq_type)("worker_threads", std::thread::hardware_concurrency())(
+    stats_line()("type", seq_type)("worker_threads", tbb::this_task_arena::max_concurrency())(
         "construction_time", elapsed_secs);
 
     dump_stats(coll, seq_type, postings);
@@ -234,7 +297,7 @@ void compress_index(
     }
 }
 
-void compress(
+inline void compress(
     std::string const& input_basename,
     std::optional<std::string> const& wand_data_filename,
     std::string const& index_encoding,
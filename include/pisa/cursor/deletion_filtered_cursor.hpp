@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "deleted_documents.hpp"
+#include "query/queries.hpp"
+#include "util/compiler_attribute.hpp"
+#include "util/likely.hpp"
+
+namespace pisa {
+
+/// Cursor that skips the postings of deleted documents.
+///
+/// A deleted document never becomes the current document, so query algorithms neither score
+/// it nor insert it into any of their queues, and the upper bounds of the wrapped cursor
+/// remain valid for the documents that are left. Runs of deleted documents are skipped with
+/// `DeletedDocuments::next_live`. If the wrapped cursor has block-max metadata, a block whose
+/// remaining documents are all deleted has a block-max score of 0, so that block-max
+/// algorithms skip it without decoding it.
+template <typename Cursor>
+class DeletionFilteredCursor {
+  public:
+    using base_cursor_type = typename Cursor::base_cursor_type;
+
+    DeletionFilteredCursor(Cursor cursor, DeletedDocuments const& deleted)
+        : m_cursor(std::move(cursor)), m_deleted(&deleted)
+    {
+        skip_deleted();
+    }
+    DeletionFilteredCursor(DeletionFilteredCursor const&) = delete;
+    DeletionFilteredCursor(DeletionFilteredCursor&&) = default;
+    DeletionFilteredCursor& operator=(DeletionFilteredCursor const&) = delete;
+    DeletionFilteredCursor& operator=(DeletionFilteredCursor&&) = default;
+    ~DeletionFilteredCursor() = default;
+
+    [[nodiscard]] PISA_ALWAYSINLINE auto query_weight() const noexcept -> float
+    {
+        return m_cursor.query_weight();
+    }
+    [[nodiscard]] PISA_ALWAYSINLINE auto docid() const -> std::uint32_t
+    {
+        return m_cursor.docid();
+    }
+    [[nodiscard]] PISA_ALWAYSINLINE auto freq() -> std::uint32_t { return m_cursor.freq(); }
+    [[nodiscard]] PISA_ALWAYSINLINE auto score() -> float { return m_cursor.score(); }
+    [[nodiscard]] PISA_ALWAYSINLINE auto size() -> std::size_t { return m_cursor.size(); }
+    [[nodiscard]] PISA_ALWAYSINLINE auto max_score() const noexcept -> float
+    {
+        return m_cursor.max_score();
+    }
+
+    void PISA_ALWAYSINLINE next()
+    {
+        m_cursor.next();
+        skip_deleted();
+    }
+
+    void PISA_ALWAYSINLINE next_geq(std::uint32_t docid)
+    {
+        m_cursor.next_geq(docid);
+        skip_deleted();
+    }
+
+    //NEXTPAGE: Resets the cursor
+    void PISA_ALWAYSINLINE reset()
+    {
+        m_cursor.reset();
+        skip_deleted();
+    }
+
+    void PISA_ALWAYSINLINE block_max_next_geq(std::uint32_t docid)
+    {
+        m_cursor.block_max_next_geq(docid);
+        m_block_deleted = m_deleted->next_live(docid) > m_cursor.block_max_docid();
+    }
+    [[nodiscard]] PISA_ALWAYSINLINE auto block_max_score() -> float
+    {
+        return m_block_deleted ? 0.0F : m_cursor.block_max_score();
+    }
+    [[nodiscard]] PISA_ALWAYSINLINE auto block_max_docid() -> std::uint32_t
+    {
+        return m_cursor.block_max_docid();
+    }
+
+    //NEXTPAGE: Resets the wdata enumerator
+    void PISA_ALWAYSINLINE block_max_reset()
+    {
+        m_cursor.block_max_reset();
+        m_block_deleted = false;
+    }
+
+  private:
+    void PISA_ALWAYSINLINE skip_deleted()
+    {
+        while (PISA_UNLIKELY(m_deleted->is_deleted(m_cursor.docid()))) {
+            m_cursor.next_geq(m_deleted->next_live(m_cursor.docid()));
+        }
+    }
+
+    Cursor m_cursor;
+    DeletedDocuments const* m_deleted;
+    bool m_block_deleted = false;
+};
+
+/// Wraps each of `cursors` so that it skips the documents in `deleted`.
+template <typename Cursor>
+[[nodiscard]] auto filter_deleted(std::vector<Cursor> cursors, DeletedDocuments const& deleted)
+    -> std::vector<DeletionFilteredCursor<Cursor>>
+{
+    std::vector<DeletionFilteredCursor<Cursor>> filtered;
+    filtered.reserve(cursors.size());
+    for (auto& cursor: cursors) {
+        filtered.emplace_back(std::move(cursor), deleted);
+    }
+    return filtered;
+}
+
+/// Creates the cursors of `Cursors` (see `paged_search`), filtered with `deleted`.
+template <typename Cursors>
+struct DeletionFilteredCursors {
+    Cursors const& cursors;
+    DeletedDocuments const& deleted;
+
+    [[nodiscard]] auto scored(Query const& query) const
+    {
+        return filter_deleted(cursors.scored(query), deleted);
+    }
+    [[nodiscard]] auto max_scored(Query const& query) const
+    {
+        return filter_deleted(cursors.max_scored(query), deleted);
+    }
+    [[nodiscard]] auto block_max_scored(Query const& query) const
+    {
+        return filter_deleted(cursors.block_max_scored(query), deleted);
+    }
+};
+
+}  // namespace pisa
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "util/compiler_attribute.hpp"
+#include "util/likely.hpp"
+
+namespace pisa {
+
+namespace detail {
+    template <typename Cursor, typename = void>
+    struct has_max_score: std::false_type {};
+
+    template <typename Cursor>
+    struct has_max_score<Cursor, std::void_t<decltype(std::declval<Cursor const&>().max_score())>>
+        : std::true_type {};
+}  // namespace detail
+
+/// Cursor over the postings of one term in a sequence of index segments, presented as a single
+/// posting list in which the documents of each segment follow those of the previous ones.
+///
+/// Each segment has its own cursor, positioned in the segment's document ID space, and the ID
+/// of its first document in the union. All the other members of the wrapped cursors (scores,
+/// maximum scores, and block-max metadata) are forwarded from the segment of the current
+/// position, so that query algorithms can process any cursor type wrapped this way.
+template <typename Cursor>
+class MultiSegmentCursor {
+  public:
+    using base_cursor_type = typename Cursor::base_cursor_type;
+
+    /// Creates a cursor over `cursors`, where segment `i` spans documents `offsets[i]` to
+    /// `ends[i] - 1` of the union of `num_docs` documents. Segments must be in document order.
+    MultiSegmentCursor(
+        std::vector<Cursor> cursors,
+        std::vector<std::uint32_t> offsets,
+        std::vector<std::uint32_t> ends,
+        std::uint32_t num_docs,
+        float query_weight)
+        : m_cursors(std::move(cursors)),
+          m_offsets(std::move(offsets)),
+          m_ends(std::move(ends)),
+          m_num_docs(num_docs),
+          m_query_weight(query_weight)
+    {
+        if constexpr (detail::has_max_score<Cursor>::value) {
+            for (auto const& cursor: m_cursors) {
+                m_max_score = std::max(m_max_score, cursor.max_score());
+            }
+        }
+        m_size = std::accumulate(
+            m_cursors.begin(), m_cursors.end(), std::size_t{0}, [](auto sum, auto& cursor) {
+                return sum + cursor.size();
+            });
+        skip_exhausted_segments();
+    }
+    MultiSegmentCursor(MultiSegmentCursor const&) = delete;
+    MultiSegmentCursor(MultiSegmentCursor&&) = default;
+    MultiSegmentCursor& operator=(MultiSegmentCursor const&) = delete;
+    MultiSegmentCursor& operator=(MultiSegmentCursor&&) = default;
+    ~MultiSegmentCursor() = default;
+
+    [[nodiscard]] PISA_ALWAYSINLINE auto query_weight() const noexcept -> float
+    {
+        return m_query_weight;
+    }
+    [[nodiscard]] PISA_ALWAYSINLINE auto docid() const -> std::uint32_t { return m_docid; }
+    [[nodiscard]] PISA_ALWAYSINLINE auto freq() -> std::uint32_t
+    {
+        return m_cursors[m_current].freq();
+    }
+    [[nodiscard]] PISA_ALWAYSINLINE auto score() -> float { return m_cursors[m_current].score(); }
+    [[nodiscard]] PISA_ALWAYSINLINE auto size() -> std::size_t { return m_size; }
+    [[nodiscard]] PISA_ALWAYSINLINE auto max_score() const noexcept -> float
+    {
+        return m_max_score;
+    }
+
+    void PISA_ALWAYSINLINE next()
+    {
+        m_cursors[m_current].next();
+        skip_exhausted_segments();
+    }
+
+    void PISA_ALWAYSINLINE next_geq(std::uint32_t docid)
+    {
+        if (PISA_UNLIKELY(docid <= m_docid)) {
+            return;
+        }
+        while (m_current < m_cursors.size() && docid >= m_ends[m_current]) {
+            ++m_current;
+        }
+        if (m_current < m_cursors.size() && docid > m_offsets[m_current]) {
+            m_cursors[m_current].next_geq(docid - m_offsets[m_current]);
+        }
+        skip_exhausted_segments();
+    }
+
+    //NEXTPAGE: Resets the cursor
+    void PISA_ALWAYSINLINE reset()
+    {
+        for (auto& cursor: m_cursors) {
+            cursor.reset();
+        }
+        m_current = 0;
+        skip_exhausted_segments();
+    }
+
+    /// Moves the block-max metadata to the block containing `docid`. Between segments in
+    /// which the term occurs, and after the last one, this is an empty block with score 0.
+    void PISA_ALWAYSINLINE block_max_next_geq(std::uint32_t docid)
+    {
+        while (m_block_segment < m_cursors.size() && docid >= m_ends[m_block_segment]) {
+            ++m_block_segment;
+        }
+        if (m_block_segment == m_cursors.size()) {
+            m_block_gap = true;
+            m_block_docid = std::max(m_num_docs, 1U) - 1;
+        } else if (docid < m_offsets[m_block_segment]) {
+            m_block_gap = true;
+            m_block_docid = m_offsets[m_block_segment] - 1;
+        } else {
+            auto& cursor = m_cursors[m_block_segment];
+            cursor.block_max_next_geq(docid - m_offsets[m_block_segment]);
+            m_block_gap = false;
+            m_block_docid = m_offsets[m_block_segment] + cursor.block_max_docid();
+        }
+    }
+    [[nodiscard]] PISA_ALWAYSINLINE auto block_max_score() -> float
+    {
+        return m_block_gap ? 0.0F : m_cursors[m_block_segment].block_max_score();
+    }
+    [[nodiscard]] PISA_ALWAYSINLINE auto block_max_docid() -> std::uint32_t
+    {
+        return m_block_docid;
+    }
+
+    //NEXTPAGE: Resets the wdata enumerator
+    void PISA_ALWAYSINLINE block_max_reset()
+    {
+        for (auto& cursor: m_cursors) {
+            cursor.block_max_reset();
+        }
+        m_block_segment = 0;
+        m_block_gap = false;
+        m_block_docid = 0;
+    }
+
+  private:
+    void PISA_ALWAYSINLINE skip_exhausted_segments()
+    {
+        while (m_current < m_cursors.size()
+               && m_cursors[m_current].docid() + m_offsets[m_current] >= m_ends[m_current]) {
+            ++m_current;
+        }
+        m_docid = m_current < m_cursors.size()
+            ? m_cursors[m_current].docid() + m_offsets[m_current]
+            : m_num_docs;
+    }
+
+    std::vector<Cursor> m_cursors;
+    std::vector<std::uint32_t> m_offsets;
+    std::vector<std::uint32_t> m_ends;
+    std::uint32_t m_num_docs;
+    float m_query_weight;
+    float m_max_score = 0.0F;
+    std::size_t m_size = 0;
+    std::size_t m_current = 0;
+    std::uint32_t m_docid = 0;
+    std::size_t m_block_segment = 0;
+    bool m_block_gap = false;
+    std::uint32_t m_block_docid = 0;
+};
+
+}  // namespace pisa
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace pisa {
+
+/// Decoded posting blocks shared by all queries, keyed by term and block.
+///
+/// Blocks of frequent terms are decoded again by every query that contains them. With a
+/// cache, enumerators copy the documents (and frequencies, which are decoded lazily) of
+/// a block from the cache instead, and add the blocks they decode to it. Only lists with at
+/// least `min_blocks` blocks are cached, since short lists are cheap to decode and
+/// unlikely to be shared.
+///
+/// The cache holds at most as many blocks as fit in its memory budget, evicting with the
+/// CLOCK algorithm. It is split into shards with a lock each, so that it can be used by
+/// concurrent queries.
+class DecodedBlockCache {
+  public:
+    static constexpr std::size_t default_min_blocks = 16;
+
+    /// Lookup counts, over documents and frequencies.
+    struct Stats {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+
+        [[nodiscard]] auto hit_rate() const -> double
+        {
+            return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+        }
+    };
+
+    /// Creates a cache of blocks of `block_size` postings using at most `budget` bytes.
+    ///
+    /// \throws std::invalid_argument  if not even a single block fits in `budget`
+    DecodedBlockCache(
+        std::size_t budget, std::size_t block_size, std::size_t min_blocks = default_min_blocks);
+    DecodedBlockCache(DecodedBlockCache const&) = delete;
+    DecodedBlockCache(DecodedBlockCache&&) = delete;
+    DecodedBlockCache& operator=(DecodedBlockCache const&) = delete;
+    DecodedBlockCache& operator=(DecodedBlockCache&&) = delete;
+    ~DecodedBlockCache();
+
+    [[nodiscard]] auto block_size() const -> std::size_t { return m_block_size; }
+    [[nodiscard]] auto min_blocks() const -> std::size_t { return m_min_blocks; }
+
+    /// Maximum number of blocks in the cache.
+    [[nodiscard]] auto capacity() const -> std::size_t;
+
+    /// Copies the `size` documents of `block` of `term` to `docs`, and returns the offset of
+    /// its encoded frequencies from the beginning of the block; or nothing if it is missing.
+    [[nodiscard]] auto find_docs(
+        std::uint32_t term, std::uint32_t block, std::uint32_t* docs, std::uint32_t size)
+        -> std::optional<std::uint32_t>;
+
+    /// Adds the decoded documents of `block` of `term`, evicting another block if full.
+    void insert_docs(
+        std::uint32_t term,
+        std::uint32_t block,
+        std::uint32_t const* docs,
+        std::uint32_t size,
+        std::uint32_t freqs_offset);
+
+    /// Copies the `size` frequencies of `block` of `term` to `freqs`, if they are cached.
+    [[nodiscard]] auto find_freqs(
+        std::uint32_t term, std::uint32_t block, std::uint32_t* freqs, std::uint32_t size)
+        -> bool;
+
+    /// Adds the decoded frequencies of `block` of `term`, if its documents are cached.
+    void insert_freqs(
+        std::uint32_t term, std::uint32_t block, std::uint32_t const* freqs, std::uint32_t size);
+
+    [[nodiscard]] auto stats() const -> Stats;
+    void reset_stats();
+
+  private:
+    struct Shard;
+
+    [[nodiscard]] auto shard(std::uint64_t key) const -> Shard&;
+
+    std::size_t m_block_size;
+    std::size_t m_min_blocks;
+    std::size_t m_num_shards;
+    std::unique_ptr<Shard[]> m_shards;
+};
+
+}  // namespace pisa
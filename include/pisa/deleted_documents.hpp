@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "mappable/mappable_vector.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "util/broadword.hpp"
+#include "util/util.hpp"
+
+namespace pisa {
+
+/// Set of documents removed from an index without rebuilding it.
+///
+/// Deleted documents are stored as a bitmap with one bit per document, together with a
+/// summary bit for each group of `summary_block_size` documents, set when all of them are
+/// deleted, so that long runs of deleted documents are skipped a group at a time. The set can
+/// be written with `mapper::freeze` and memory-mapped.
+class DeletedDocuments {
+  public:
+    static constexpr std::uint64_t summary_block_size = 4096;
+
+    class builder {
+      public:
+        explicit builder(std::uint64_t num_docs)
+            : m_num_docs(num_docs), m_bits(ceil_div(num_docs, 64), 0)
+        {}
+
+        /// Starts from the documents already deleted in `deleted`.
+        explicit builder(DeletedDocuments const& deleted)
+            : m_num_docs(deleted.num_docs()),
+              m_bits(deleted.m_bits.begin(), deleted.m_bits.end())
+        {}
+
+        /// Marks `docid` as deleted.
+        void remove(std::uint64_t docid)
+        {
+            if (docid >= m_num_docs) {
+                throw std::out_of_range(fmt::format(
+                    "Cannot delete document {} of an index of {} documents", docid, m_num_docs));
+            }
+            m_bits[docid / 64] |= std::uint64_t(1) << (docid % 64);
+        }
+
+        void build(DeletedDocuments& deleted)
+        {
+            deleted.m_num_docs = m_num_docs;
+            deleted.m_count = 0;
+            for (auto word: m_bits) {
+                deleted.m_count += broadword::popcount(word);
+            }
+            std::uint64_t words_per_block = summary_block_size / 64;
+            std::vector<std::uint64_t> summary(
+                ceil_div(ceil_div(m_num_docs, summary_block_size), 64), 0);
+            for (std::uint64_t block = 0; block * summary_block_size < m_num_docs; ++block) {
+                auto first = block * summary_block_size;
+                auto last = std::min(first + summary_block_size, m_num_docs);
+                bool all_deleted = true;
+                for (auto word = block * words_per_block; word * 64 < last; ++word) {
+                    auto docs_in_word = std::min<std::uint64_t>(64, last - word * 64);
+                    auto mask = docs_in_word == 64 ? ~std::uint64_t(0)
+                                                   : (std::uint64_t(1) << docs_in_word) - 1;
+                    if ((m_bits[word] & mask) != mask) {
+                        all_deleted = false;
+                        break;
+                    }
+                }
+                if (all_deleted) {
+                    summary[block / 64] |= std::uint64_t(1) << (block % 64);
+                }
+            }
+            deleted.m_bits.steal(m_bits);
+            deleted.m_summary.steal(summary);
+        }
+
+      private:
+        std::uint64_t m_num_docs;
+        std::vector<std::uint64_t> m_bits;
+    };
+
+    DeletedDocuments() = default;
+    explicit DeletedDocuments(MemorySource source) : m_source(std::move(source))
+    {
+        mapper::map(*this, m_source.data(), m_source.map_flags());
+    }
+
+    /// Number of documents of the index, deleted or not.
+    [[nodiscard]] auto num_docs() const -> std::uint64_t { return m_num_docs; }
+
+    /// Number of deleted documents.
+    [[nodiscard]] auto count() const -> std::uint64_t { return m_count; }
+
+    [[nodiscard]] auto is_deleted(std::uint64_t docid) const -> bool
+    {
+        return docid < m_num_docs && ((m_bits[docid / 64] >> (docid % 64)) & 1U) != 0U;
+    }
+
+    /// Returns the first document not deleted at or after `docid`, or `num_docs()` if there is
+    /// none.
+    [[nodiscard]] auto next_live(std::uint64_t docid) const -> std::uint64_t
+    {
+        while (docid < m_num_docs) {
+            auto block = docid / summary_block_size;
+            if (((m_summary[block / 64] >> (block % 64)) & 1U) != 0U) {
+                docid = (block + 1) * summary_block_size;
+                continue;
+            }
+            // Bits past the end of the index are zero, and thus reported as live.
+            auto live = ~m_bits[docid / 64] >> (docid % 64);
+            if (live != 0U) {
+                return std::min(docid + broadword::lsb(live), m_num_docs);
+            }
+            docid = (docid / 64 + 1) * 64;
+        }
+        return m_num_docs;
+    }
+
+    template <typename Visitor>
+    void map(Visitor& visit)
+    {
+        visit(m_num_docs, "m_num_docs")(m_count, "m_count")(m_bits, "m_bits")(
+            m_summary, "m_summary");
+    }
+
+  private:
+    std::uint64_t m_num_docs = 0;
+    std::uint64_t m_count = 0;
+    mapper::mappable_vector<std::uint64_t> m_bits;
+    mapper::mappable_vector<std::uint64_t> m_summary;
+    MemorySource m_source;
+};
+
+}  // namespace pisa
@@ -2,19 +2,20 @@
 
 #include <algorithm>
 #include <cctype>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <numeric>
 #include <optional>
+#include <queue>
 #include <sstream>
-#include <stack>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/filesystem.hpp>
-#include <gsl/gsl_assert>
-#include <pstl/algorithm>
-#include <pstl/execution>
+#include <mio/mmap.hpp>
 #include <range/v3/range/conversion.hpp>
 #include <range/v3/view/iota.hpp>
 #include <range/v3/view/transform.hpp>
@@ -22,21 +23,49 @@
 #include <spdlog/fmt/ostr.h>
 #include <spdlog/spdlog.h>
 #include <tbb/concurrent_queue.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+#include <tbb/task_arena.h>
 #include <tbb/task_group.h>
 
 #include "binary_collection.hpp"
 #include "document_record.hpp"
 #include "io.hpp"
 #include "payload_vector.hpp"
+#include "query/stem_cache.hpp"
 #include "query/term_processor.hpp"
 #include "tokenizer.hpp"
 #include "type_safe.hpp"
 
 namespace pisa {
 
-using process_term_function_type = std::function<std::string(std::string)>;
+/// Processes a token into a term, which must remain valid until the next call.
+using process_term_function_type = std::function<std::string_view(std::string_view)>;
 using process_content_function_type =
-    std::function<void(std::string&&, std::function<void(std::string&&)>)>;
+    std::function<void(std::string&&, std::function<void(std::string_view)>)>;
+
+/// Assigns consecutive IDs to distinct terms, storing each term only once.
+class Term_Interner {
+  public:
+    /// Returns the ID of `term`, and whether it is seen for the first time. The term is copied
+    /// only when it is inserted.
+    auto intern(std::string_view term) -> std::pair<uint32_t, bool>
+    {
+        if (auto pos = m_ids.find(term); pos != m_ids.end()) {
+            return {pos->second, false};
+        }
+        auto id = static_cast<uint32_t>(m_terms.size());
+        auto const& stored = m_terms.emplace_back(term);
+        m_ids.emplace(std::string_view(stored), id);
+        return {id, true};
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t { return m_terms.size(); }
+
+  private:
+    std::deque<std::string> m_terms{};
+    std::unordered_map<std::string_view, uint32_t> m_ids{};
+};
 
 class Forward_Index_Builder {
   public:
@@ -89,7 +118,7 @@ class Forward_Index_Builder {
         std::ofstream term_os(basename + ".terms");
         write_header(os, bp.records.size());
 
-        std::map<std::string, uint32_t> map;
+        Term_Interner terms;
 
         for (auto&& record: bp.records) {
             title_os << record.title() << '\n';
@@ -97,14 +126,10 @@ class Forward_Index_Builder {
 
             std::vector<uint32_t> term_ids;
 
-            auto process = [&](auto&& term) {
-                term = process_term(std::move(term));
-                uint32_t id = 0;
-                if (auto pos = map.find(term); pos != map.end()) {
-                    id = pos->second;
-                } else {
-                    id = map.size();
-                    map[term] = id;
+            auto process = [&](std::string_view token) {
+                auto term = process_term(token);
+                auto [id, inserted] = terms.intern(term);
+                if (inserted) {
                     term_os << term << '\n';
                 }
                 term_ids.push_back(id);
@@ -119,135 +144,243 @@ class Forward_Index_Builder {
             bp.first_document + bp.records.size());
     }
 
-    [[nodiscard]] static auto reverse_mapping(std::vector<std::string>&& terms)
-        -> std::unordered_map<std::string, Term_Id>
+    /// Terms of a batch in lexicographical order, along with their IDs within the batch.
+    struct Batch_Lexicon {
+        std::vector<std::string> terms{};
+        std::vector<uint32_t> term_ids{};
+    };
+
+    [[nodiscard]] static auto read_batch_lexicon(std::string const& batch_basename)
+        -> Batch_Lexicon
     {
-        std::unordered_map<std::string, Term_Id> mapping;
-        Term_Id term_id{0};
-        for (std::string& term: terms) {
-            mapping.emplace(std::move(term), term_id);
-            ++term_id;
+        auto terms = io::read_string_vector(batch_basename + ".terms");
+        Batch_Lexicon lexicon;
+        lexicon.term_ids.resize(terms.size());
+        std::iota(lexicon.term_ids.begin(), lexicon.term_ids.end(), 0U);
+        std::sort(lexicon.term_ids.begin(), lexicon.term_ids.end(), [&](auto lhs, auto rhs) {
+            return terms[lhs] < terms[rhs];
+        });
+        lexicon.terms.reserve(terms.size());
+        for (auto term_id: lexicon.term_ids) {
+            lexicon.terms.push_back(std::move(terms[term_id]));
         }
-        return mapping;
+        return lexicon;
     }
 
-    [[nodiscard]] static auto collect_terms(std::string const& basename, std::ptrdiff_t batch_count)
+    /// Global lexicon, and the mapping from batch term IDs to global term IDs for each batch.
+    struct Merged_Lexicon {
+        std::vector<std::string> terms{};
+        std::vector<std::vector<uint32_t>> mappings{};
+    };
+
+    /// Merges sorted batch lexicons into a global lexicon.
+    ///
+    /// The term space is split into ranges by splitters sampled from all batches, and each range
+    /// is merged with an independent k-way merge, so that ranges can be processed in parallel.
+    [[nodiscard]] static auto merge_lexicons(std::vector<Batch_Lexicon> const& batches)
+        -> Merged_Lexicon
     {
-        struct Term_Span {
-            size_t first;
-            size_t last;
-            size_t lvl;
-        };
-        std::stack<Term_Span> spans;
-        std::vector<std::string> terms;
-        auto merge_spans = [&](Term_Span lhs, Term_Span rhs) {
-            Expects(lhs.last == rhs.first);
-            auto first = std::next(terms.begin(), lhs.first);
-            auto mid = std::next(terms.begin(), lhs.last);
-            auto last = std::next(terms.begin(), rhs.last);
-            std::inplace_merge(pstl::execution::par, first, mid, last);
-            terms.erase(std::unique(pstl::execution::par, first, last), last);
-            return Term_Span{lhs.first, terms.size(), lhs.lvl + 1};
-        };
-        auto push_span = [&](Term_Span s) {
-            while (not spans.empty() and spans.top().lvl == s.lvl) {
-                s = merge_spans(spans.top(), s);
-                spans.pop();
+        auto partition_count =
+            static_cast<std::size_t>(4 * tbb::this_task_arena::max_concurrency());
+
+        std::vector<std::string_view> splitters;
+        for (auto const& batch: batches) {
+            auto step = std::max<std::size_t>(1, batch.terms.size() / partition_count);
+            for (std::size_t idx = step; idx < batch.terms.size(); idx += step) {
+                splitters.emplace_back(batch.terms[idx]);
             }
-            spans.push(s);
-        };
+        }
+        std::sort(splitters.begin(), splitters.end());
+        splitters.erase(std::unique(splitters.begin(), splitters.end()), splitters.end());
+        if (splitters.size() >= partition_count) {
+            std::vector<std::string_view> sampled;
+            auto step = splitters.size() / partition_count;
+            for (std::size_t idx = step; idx < splitters.size(); idx += step) {
+                sampled.push_back(splitters[idx]);
+            }
+            sampled.erase(std::unique(sampled.begin(), sampled.end()), sampled.end());
+            splitters = std::move(sampled);
+        }
+        partition_count = splitters.size() + 1;
+
+        // bounds[p][b] is the first position in batch b that belongs to partition p.
+        std::vector<std::vector<std::size_t>> bounds(
+            partition_count + 1, std::vector<std::size_t>(batches.size()));
+        for (std::size_t batch = 0; batch < batches.size(); ++batch) {
+            auto const& terms = batches[batch].terms;
+            for (std::size_t partition = 1; partition < partition_count; ++partition) {
+                auto pos = std::lower_bound(
+                    terms.begin(), terms.end(), splitters[partition - 1], [](auto&& lhs, auto rhs) {
+                        return std::string_view(lhs) < rhs;
+                    });
+                bounds[partition][batch] = std::distance(terms.begin(), pos);
+            }
+            bounds[partition_count][batch] = terms.size();
+        }
 
-        spdlog::info("Collecting terms");
-        for (auto batch: ranges::views::iota(0, batch_count)) {
-            spdlog::debug("[Collecting terms] Batch {}/{}", batch, batch_count);
-            auto mid = terms.size();
-            std::ifstream terms_is(batch_file(basename, batch) + ".terms");
-            std::string term;
-            while (std::getline(terms_is, term)) {
-                terms.push_back(term);
+        Merged_Lexicon merged;
+        merged.mappings.resize(batches.size());
+        for (std::size_t batch = 0; batch < batches.size(); ++batch) {
+            merged.mappings[batch].resize(batches[batch].terms.size());
+        }
+        std::vector<std::vector<std::string>> partition_terms(partition_count);
+        tbb::parallel_for(std::size_t(0), partition_count, [&](auto partition) {
+            using Entry = std::pair<std::string_view, std::size_t>;
+            std::priority_queue<Entry, std::vector<Entry>, std::greater<>> heap;
+            auto positions = bounds[partition];
+            auto const& ends = bounds[partition + 1];
+            for (std::size_t batch = 0; batch < batches.size(); ++batch) {
+                if (positions[batch] < ends[batch]) {
+                    heap.emplace(batches[batch].terms[positions[batch]], batch);
+                }
             }
-            std::sort(std::next(terms.begin(), mid), terms.end());
-            push_span(Term_Span{mid, terms.size(), 0U});
+            auto& terms = partition_terms[partition];
+            while (not heap.empty()) {
+                auto [term, batch] = heap.top();
+                heap.pop();
+                if (terms.empty() || terms.back() != term) {
+                    terms.emplace_back(term);
+                }
+                auto pos = positions[batch]++;
+                merged.mappings[batch][batches[batch].term_ids[pos]] = terms.size() - 1;
+                if (positions[batch] < ends[batch]) {
+                    heap.emplace(batches[batch].terms[positions[batch]], batch);
+                }
+            }
+        });
+
+        std::vector<std::size_t> offsets(partition_count + 1, 0);
+        for (std::size_t partition = 0; partition < partition_count; ++partition) {
+            offsets[partition + 1] = offsets[partition] + partition_terms[partition].size();
         }
-        while (spans.size() > 1) {
-            auto rhs = spans.top();
-            spans.pop();
-            auto lhs = spans.top();
-            spans.pop();
-            spans.push(merge_spans(lhs, rhs));
+        tbb::parallel_for(std::size_t(0), partition_count, [&](auto partition) {
+            for (std::size_t batch = 0; batch < batches.size(); ++batch) {
+                auto const& term_ids = batches[batch].term_ids;
+                auto& mapping = merged.mappings[batch];
+                for (auto pos = bounds[partition][batch]; pos < bounds[partition + 1][batch];
+                     ++pos) {
+                    mapping[term_ids[pos]] += offsets[partition];
+                }
+            }
+        });
+        merged.terms.reserve(offsets.back());
+        for (auto& terms: partition_terms) {
+            std::move(terms.begin(), terms.end(), std::back_inserter(merged.terms));
         }
-        terms.shrink_to_fit();
-        return terms;
+        return merged;
     }
 
-    void merge(std::string const& basename, std::ptrdiff_t document_count, std::ptrdiff_t batch_count) const
+    [[nodiscard]] static auto collect_terms(std::string const& basename, std::ptrdiff_t batch_count)
+        -> Merged_Lexicon
     {
-        std::ofstream term_os(basename + ".terms");
+        spdlog::info("Collecting terms");
+        std::vector<Batch_Lexicon> batches(batch_count);
+        tbb::parallel_for(std::ptrdiff_t(0), batch_count, [&](auto batch) {
+            spdlog::debug("[Collecting terms] Batch {}/{}", batch, batch_count);
+            batches[batch] = read_batch_lexicon(batch_file(basename, batch));
+        });
+        spdlog::info("Merging terms");
+        return merge_lexicons(batches);
+    }
 
-        {
-            spdlog::info("Merging titles");
-            std::ofstream title_os(basename + ".documents");
-            for (auto batch: ranges::views::iota(0, batch_count)) {
-                spdlog::debug("[Merging titles] Batch {}/{}", batch, batch_count);
-                std::ifstream title_is(batch_file(basename, batch) + ".documents");
-                title_os << title_is.rdbuf();
-            }
-        }
-        {
-            spdlog::info("Creating document lexicon");
-            std::ifstream title_is(basename + ".documents");
-            encode_payload_vector(
-                std::istream_iterator<io::Line>(title_is), std::istream_iterator<io::Line>())
-                .to_file(basename + ".doclex");
+    /// Writes the forward index, concatenating the memory-mapped batches in parallel and
+    /// remapping their term IDs on the way.
+    static void remap_and_concatenate(
+        std::string const& basename,
+        std::ptrdiff_t document_count,
+        std::ptrdiff_t batch_count,
+        std::vector<std::vector<uint32_t>> const& mappings)
+    {
+        std::size_t const header_size = 2 * sizeof(uint32_t);
+        std::vector<std::size_t> offsets(batch_count + 1, header_size);
+        for (auto batch: ranges::views::iota(0, batch_count)) {
+            auto batch_size = boost::filesystem::file_size(batch_file(basename, batch));
+            offsets[batch + 1] = offsets[batch] + batch_size - header_size;
         }
         {
-            spdlog::info("Merging URLs");
-            std::ofstream url_os(basename + ".urls");
-            for (auto batch: ranges::views::iota(0, batch_count)) {
-                spdlog::debug("[Merging URLs] Batch {}/{}", batch, batch_count);
-                std::ifstream url_is(batch_file(basename, batch) + ".urls");
-                url_os << url_is.rdbuf();
-            }
+            std::ofstream os(basename);
+            write_header(os, document_count);
         }
-
-        auto terms = collect_terms(basename, batch_count);
-
-        spdlog::info("Writing terms");
-        for (auto const& term: terms) {
-            term_os << term << '\n';
+        boost::filesystem::resize_file(basename, offsets.back());
+
+        std::error_code error;
+        mio::mmap_sink output;
+        output.map(basename, error);
+        if (error) {
+            spdlog::error("Error mapping file {}: {}", basename, error.message());
+            throw std::runtime_error("Error opening file");
         }
-        encode_payload_vector(terms.begin(), terms.end()).to_file(basename + ".termlex");
-
-        spdlog::info("Mapping terms");
-        auto term_mapping = reverse_mapping(std::move(terms));
-
-        spdlog::info("Remapping IDs");
-        for (auto batch: ranges::views::iota(0, batch_count)) {
+        tbb::parallel_for(std::ptrdiff_t(0), batch_count, [&](auto batch) {
             spdlog::debug("[Remapping IDs] Batch {}/{}", batch, batch_count);
-            auto batch_terms = io::read_string_vector(batch_file(basename, batch) + ".terms");
-            std::vector<Term_Id> mapping(batch_terms.size());
-            std::transform(
-                batch_terms.begin(), batch_terms.end(), mapping.begin(), [&](auto const& bterm) {
-                    return term_mapping[bterm];
+            auto size = offsets[batch + 1] - offsets[batch];
+            if (size == 0) {
+                return;
+            }
+            auto filename = batch_file(basename, batch);
+            std::error_code error;
+            mio::mmap_source input;
+            input.map(filename, error);
+            if (error) {
+                spdlog::error("Error mapping file {}: {}", filename, error.message());
+                throw std::runtime_error("Error opening file");
+            }
+            auto const& mapping = mappings[batch];
+            auto const* src = reinterpret_cast<uint32_t const*>(input.data() + header_size);
+            auto* dst = reinterpret_cast<uint32_t*>(output.data() + offsets[batch]);
+            auto const* end = std::next(src, size / sizeof(uint32_t));
+            while (src != end) {
+                auto length = *src++;
+                *dst++ = length;
+                dst = std::transform(src, std::next(src, length), dst, [&](auto term_id) {
+                    return mapping[term_id];
                 });
-            writable_binary_collection coll(batch_file(basename, batch).c_str());
-            for (auto doc_iter = ++coll.begin(); doc_iter != coll.end(); ++doc_iter) {
-                for (auto& term_id: *doc_iter) {
-                    term_id = mapping[term_id].as_int();
-                }
+                src = std::next(src, length);
             }
-        }
-        term_mapping.clear();
+        });
+    }
 
-        spdlog::info("Concatenating batches");
-        std::ofstream os(basename);
-        write_header(os, document_count);
-        for (auto batch: ranges::views::iota(0, batch_count)) {
-            spdlog::debug("[Concatenating batches] Batch {}/{}", batch, batch_count);
-            std::ifstream is(batch_file(basename, batch));
-            is.ignore(8);
-            os << is.rdbuf();
-        }
+    void merge(std::string const& basename, std::ptrdiff_t document_count, std::ptrdiff_t batch_count) const
+    {
+        Merged_Lexicon lexicon;
+        tbb::parallel_invoke(
+            [&] {
+                {
+                    spdlog::info("Merging titles");
+                    std::ofstream title_os(basename + ".documents");
+                    for (auto batch: ranges::views::iota(0, batch_count)) {
+                        spdlog::debug("[Merging titles] Batch {}/{}", batch, batch_count);
+                        std::ifstream title_is(batch_file(basename, batch) + ".documents");
+                        title_os << title_is.rdbuf();
+                    }
+                }
+                spdlog::info("Creating document lexicon");
+                std::ifstream title_is(basename + ".documents");
+                encode_payload_vector(
+                    std::istream_iterator<io::Line>(title_is), std::istream_iterator<io::Line>())
+                    .to_file(basename + ".doclex");
+            },
+            [&] {
+                spdlog::info("Merging URLs");
+                std::ofstream url_os(basename + ".urls");
+                for (auto batch: ranges::views::iota(0, batch_count)) {
+                    spdlog::debug("[Merging URLs] Batch {}/{}", batch, batch_count);
+                    std::ifstream url_is(batch_file(basename, batch) + ".urls");
+                    url_os << url_is.rdbuf();
+                }
+            },
+            [&] {
+                lexicon = collect_terms(basename, batch_count);
+                spdlog::info("Writing terms");
+                std::ofstream term_os(basename + ".terms");
+                for (auto const& term: lexicon.terms) {
+                    term_os << term << '\n';
+                }
+                encode_payload_vector(lexicon.terms.begin(), lexicon.terms.end())
+                    .to_file(basename + ".termlex");
+            });
+
+        spdlog::info("Remapping IDs and concatenating batches");
+        remap_and_concatenate(basename, document_count, batch_count, lexicon.mappings);
 
         spdlog::info("Success.");
     }
@@ -269,6 +402,14 @@ class Forward_Index_Builder {
         Document_Id first_document{0};
         std::ptrdiff_t batch_number = 0;
 
+        ThreadLocalStemCache stem_cache(term_processor);
+        auto run_batch = [&](Batch_Process const& bp) {
+            auto& cache = stem_cache.local();
+            run(bp,
+                [&cache](std::string_view term) { return cache(term); },
+                process_content);
+        };
+
         std::vector<Document_Record> record_batch;
         tbb::task_group batch_group;
         tbb::concurrent_bounded_queue<int> queue;
@@ -282,12 +423,8 @@ class Forward_Index_Builder {
                         batch_number, std::move(record_batch), first_document, output_file};
                 };
                 queue.push(0);
-                batch_group.run([bp = batch_process(),
-                                 term_processor = term_processor(),
-                                 this,
-                                 &queue,
-                                 &process_content]() {
-                    run(bp, std::move(term_processor), process_content);
+                batch_group.run([bp = batch_process(), &run_batch, &queue]() {
+                    run_batch(bp);
                     int x;
                     queue.try_pop(x);
                 });
@@ -304,12 +441,8 @@ class Forward_Index_Builder {
                         batch_number, std::move(record_batch), first_document, output_file};
                 };
                 queue.push(0);
-                batch_group.run([bp = batch_process(),
-                                 term_processor = term_processor(),
-                                 this,
-                                 &queue,
-                                 &process_content]() {
-                    run(bp, std::move(term_processor), process_content);
+                batch_group.run([bp = batch_process(), &run_batch, &queue]() {
+                    run_batch(bp);
                     int x;
                     queue.try_pop(x);
                 });
@@ -319,6 +452,11 @@ class Forward_Index_Builder {
             }
         }
         batch_group.wait();
+        spdlog::info(
+            "Stem cache hit rate: {:.2f}% ({} hits, {} misses)",
+            100 * stem_cache.hit_rate(),
+            stem_cache.hits(),
+            stem_cache.misses());
         merge(output_file, first_document.as_int(), batch_number);
         remove_batches(output_file, batch_number);
     }
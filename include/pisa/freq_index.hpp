@@ -22,7 +22,7 @@ class freq_index {
 
     explicit freq_index(MemorySource source) : m_source(std::move(source))
     {
-        mapper::map(*this, m_source.data(), mapper::map_flags::warmup);
+        mapper::map(*this, m_source.data(), m_source.map_flags());
     }
 
     class builder {
@@ -34,29 +34,69 @@ class freq_index {
               m_freqs_sequences(params)
         {}
 
+        /// Docs and freqs sequences of a single list, encoded independently of the builder.
+        struct encoded_posting_list {
+            encoded_posting_list() = default;
+            encoded_posting_list(encoded_posting_list const&) = delete;
+            encoded_posting_list(encoded_posting_list&& other) noexcept
+            {
+                docs_bits.swap(other.docs_bits);
+                freqs_bits.swap(other.freqs_bits);
+            }
+            encoded_posting_list& operator=(encoded_posting_list const&) = delete;
+            encoded_posting_list& operator=(encoded_posting_list&& other) noexcept
+            {
+                docs_bits.swap(other.docs_bits);
+                freqs_bits.swap(other.freqs_bits);
+                return *this;
+            }
+            ~encoded_posting_list() = default;
+
+            bit_vector_builder docs_bits;
+            bit_vector_builder freqs_bits;
+        };
+
         template <typename DocsIterator, typename FreqsIterator>
         void add_posting_list(
             uint64_t n, DocsIterator docs_begin, FreqsIterator freqs_begin, uint64_t occurrences)
+        {
+            auto list = encode_posting_list(n, docs_begin, freqs_begin, occurrences);
+            add_encoded_posting_list(list);
+        }
+
+        /// Encodes a posting list without modifying the builder; this can be called
+        /// concurrently, as long as the results are added in term order.
+        template <typename DocsIterator, typename FreqsIterator>
+        [[nodiscard]] auto encode_posting_list(
+            uint64_t n,
+            DocsIterator docs_begin,
+            FreqsIterator freqs_begin,
+            uint64_t occurrences) const -> encoded_posting_list
         {
             if (!n) {
                 throw std::invalid_argument("List must be nonempty");
             }
 
+            encoded_posting_list list;
             tbb::parallel_invoke(
                 [&] {
-                    bit_vector_builder docs_bits;
-                    write_gamma_nonzero(docs_bits, occurrences);
+                    write_gamma_nonzero(list.docs_bits, occurrences);
                     if (occurrences > 1) {
-                        docs_bits.append_bits(n, ceil_log2(occurrences + 1));
+                        list.docs_bits.append_bits(n, ceil_log2(occurrences + 1));
                     }
-                    DocsSequence::write(docs_bits, docs_begin, m_num_docs, n, m_params);
-                    m_docs_sequences.append(docs_bits);
+                    DocsSequence::write(list.docs_bits, docs_begin, m_num_docs, n, m_params);
                 },
                 [&] {
-                    bit_vector_builder freqs_bits;
-                    FreqsSequence::write(freqs_bits, freqs_begin, occurrences + 1, n, m_params);
-                    m_freqs_sequences.append(freqs_bits);
+                    FreqsSequence::write(
+                        list.freqs_bits, freqs_begin, occurrences + 1, n, m_params);
                 });
+            return list;
+        }
+
+        void add_encoded_posting_list(encoded_posting_list& list)
+        {
+            m_docs_sequences.append(list.docs_bits);
+            m_freqs_sequences.append(list.freqs_bits);
         }
 
         void build(freq_index& sq)
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+#include <gsl/span>
+
+#include "payload_vector.hpp"
+#include "string_table.hpp"
+
+namespace pisa {
+
+namespace hashed_lexicon {
+
+    /// Bytes `PISAMPHL` read as a little-endian integer.
+    constexpr std::uint64_t magic = 0x4c48504d41534950;
+    constexpr std::uint64_t version = 1;
+
+    /// Average number of terms hashed to the same bucket.
+    constexpr std::size_t terms_per_bucket = 4;
+
+    /// MurmurHash64A by Austin Appleby.
+    [[nodiscard]] inline auto hash(std::string_view key, std::uint64_t seed) -> std::uint64_t
+    {
+        constexpr std::uint64_t m = 0xc6a4a7935bd1e995;
+        constexpr int r = 47;
+        std::uint64_t h = seed ^ (key.size() * m);
+        auto const* data = key.data();
+        auto const* end = data + (key.size() / 8) * 8;
+        for (; data != end; data += 8) {
+            std::uint64_t k;
+            std::memcpy(&k, data, sizeof(k));
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+        switch (key.size() & 7U) {
+        case 7: h ^= std::uint64_t(static_cast<unsigned char>(data[6])) << 48; [[fallthrough]];
+        case 6: h ^= std::uint64_t(static_cast<unsigned char>(data[5])) << 40; [[fallthrough]];
+        case 5: h ^= std::uint64_t(static_cast<unsigned char>(data[4])) << 32; [[fallthrough]];
+        case 4: h ^= std::uint64_t(static_cast<unsigned char>(data[3])) << 24; [[fallthrough]];
+        case 3: h ^= std::uint64_t(static_cast<unsigned char>(data[2])) << 16; [[fallthrough]];
+        case 2: h ^= std::uint64_t(static_cast<unsigned char>(data[1])) << 8; [[fallthrough]];
+        case 1: h ^= std::uint64_t(static_cast<unsigned char>(data[0])); h *= m;
+        };
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+
+    /// Finalizer of MurmurHash3, used to scramble pilots and derive fingerprints.
+    [[nodiscard]] constexpr auto mix(std::uint64_t h) -> std::uint64_t
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccd;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53;
+        h ^= h >> 33;
+        return h;
+    }
+
+    [[nodiscard]] constexpr auto bucket(std::uint64_t h, std::uint64_t bucket_count) -> std::uint64_t
+    {
+        return ((h >> 32) * bucket_count) >> 32;
+    }
+
+    [[nodiscard]] constexpr auto position(std::uint64_t h, std::uint32_t pilot, std::uint64_t size)
+        -> std::uint64_t
+    {
+        return mix(h ^ mix(pilot)) % size;
+    }
+
+    [[nodiscard]] constexpr auto fingerprint(std::uint64_t h) -> std::uint32_t
+    {
+        return static_cast<std::uint32_t>(mix(h) >> 32);
+    }
+
+    struct Header {
+        std::uint64_t magic;
+        std::uint64_t version;
+        std::uint64_t size;
+        std::uint64_t bucket_count;
+        std::uint64_t seed;
+        /// Size of the string table of terms in bytes, or 0 if the terms are not stored.
+        std::uint64_t terms_bytes;
+    };
+
+    struct Slot {
+        std::uint32_t term_id;
+        std::uint32_t fingerprint;
+    };
+
+    [[nodiscard]] constexpr auto padded(std::size_t bytes) -> std::size_t
+    {
+        return (bytes + 7) & ~std::size_t{7};
+    }
+
+}  // namespace hashed_lexicon
+
+/// Read-only term lexicon resolving terms to their IDs with a minimal perfect hash function.
+///
+/// Terms are hashed into buckets, and each bucket stores a pilot that displaces its terms into
+/// distinct slots of a table with exactly one slot per term (a PTHash-style construction). Each
+/// slot holds the term ID together with a 32-bit fingerprint of the term, which is used to reject
+/// terms that are not in the lexicon; a missing term is mistakenly resolved with probability of
+/// about 2^-32. A lookup costs one hash computation and two memory accesses, and since the
+/// structure is read directly from memory, a memory-mapped lexicon is ready to use immediately.
+///
+/// The lexicon can optionally store the terms themselves in a sorted `StringTable`, which enables
+/// ID-to-term lookups and prefix queries.
+class HashedLexicon {
+  public:
+    using size_type = std::uint32_t;
+
+    template <typename ContiguousContainer>
+    [[nodiscard]] static auto from(ContiguousContainer&& mem) -> HashedLexicon
+    {
+        return from(gsl::make_span(reinterpret_cast<std::byte const*>(mem.data()), mem.size()));
+    }
+
+    [[nodiscard]] static auto from(gsl::span<std::byte const> mem) -> HashedLexicon
+    {
+        using hashed_lexicon::padded;
+        if (not is_hashed_lexicon(mem)) {
+            throw std::runtime_error("Not a hashed lexicon: invalid header");
+        }
+        hashed_lexicon::Header header;
+        std::memcpy(&header, mem.data(), sizeof(header));
+        if (header.version != hashed_lexicon::version) {
+            throw std::runtime_error(fmt::format(
+                "Unsupported hashed lexicon version {} (expected {})",
+                header.version,
+                hashed_lexicon::version));
+        }
+        auto [pilots, after_pilots] = split(
+            mem.subspan(sizeof(header)), padded(header.bucket_count * sizeof(std::uint32_t)));
+        auto [slots, terms] =
+            split(after_pilots, header.size * sizeof(hashed_lexicon::Slot));
+        if (terms.size() != header.terms_bytes) {
+            throw std::runtime_error(fmt::format(
+                "Hashed lexicon has {} bytes of terms but header declares {}",
+                terms.size(),
+                header.terms_bytes));
+        }
+        return HashedLexicon(
+            header,
+            cast_span<std::uint32_t>(pilots).first(header.bucket_count),
+            cast_span<hashed_lexicon::Slot>(slots),
+            terms);
+    }
+
+    template <typename ContiguousContainer>
+    [[nodiscard]] static auto is_hashed_lexicon(ContiguousContainer&& mem) -> bool
+    {
+        return is_hashed_lexicon(
+            gsl::make_span(reinterpret_cast<std::byte const*>(mem.data()), mem.size()));
+    }
+
+    /// Checks whether the memory starts with a hashed lexicon header.
+    [[nodiscard]] static auto is_hashed_lexicon(gsl::span<std::byte const> mem) -> bool
+    {
+        std::uint64_t magic = 0;
+        if (mem.size() < sizeof(hashed_lexicon::Header)) {
+            return false;
+        }
+        std::memcpy(&magic, mem.data(), sizeof(magic));
+        return magic == hashed_lexicon::magic;
+    }
+
+    /// Returns the ID of `term`, or `std::nullopt` if it is not in the lexicon.
+    [[nodiscard]] auto find(std::string_view term) const -> std::optional<size_type>
+    {
+        if (m_slots.empty()) {
+            return std::nullopt;
+        }
+        auto h = hashed_lexicon::hash(term, m_seed);
+        auto pilot = m_pilots[hashed_lexicon::bucket(h, m_pilots.size())];
+        auto const& slot = m_slots[hashed_lexicon::position(h, pilot, m_slots.size())];
+        if (slot.fingerprint != hashed_lexicon::fingerprint(h)) {
+            return std::nullopt;
+        }
+        return slot.term_id;
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t { return m_slots.size(); }
+
+    /// Whether the terms are stored, which is required by `terms`, `term`, and `prefix`.
+    [[nodiscard]] auto has_terms() const -> bool { return m_terms.has_value(); }
+
+    /// Returns the sorted table of terms.
+    [[nodiscard]] auto terms() const -> StringTable const&
+    {
+        if (not m_terms) {
+            throw std::logic_error("Hashed lexicon was built without terms");
+        }
+        return *m_terms;
+    }
+
+    /// Returns the term with the given ID.
+    [[nodiscard]] auto term(size_type term_id) const -> std::string { return terms()[term_id]; }
+
+    /// Returns the half-open range of IDs of the terms starting with `prefix`.
+    [[nodiscard]] auto prefix(std::string_view prefix) const -> std::pair<size_type, size_type>
+    {
+        auto [first, last] = terms().prefix(prefix);
+        return {static_cast<size_type>(first), static_cast<size_type>(last)};
+    }
+
+  private:
+    HashedLexicon(
+        hashed_lexicon::Header const& header,
+        gsl::span<std::uint32_t const> pilots,
+        gsl::span<hashed_lexicon::Slot const> slots,
+        gsl::span<std::byte const> terms)
+        : m_seed(header.seed), m_pilots(pilots), m_slots(slots)
+    {
+        if (not terms.empty()) {
+            m_terms = StringTable::from(terms);
+        }
+    }
+
+    std::uint64_t m_seed;
+    gsl::span<std::uint32_t const> m_pilots;
+    gsl::span<hashed_lexicon::Slot const> m_slots;
+    std::optional<StringTable> m_terms{};
+};
+
+/// Builds a hashed lexicon, in which each term is assigned its position in `terms` as its ID.
+///
+/// If `store_terms` is set, the terms must be unique and lexicographically sorted, as in the
+/// lexicons produced by `parse_collection` and `lexicon build`. Otherwise, duplicates are
+/// detected while building the hash function.
+class HashedLexiconBuilder {
+  public:
+    template <typename Terms>
+    explicit HashedLexiconBuilder(Terms const& terms, bool store_terms = false)
+    {
+        std::vector<std::string_view> views;
+        for (std::string_view term: terms) {
+            views.push_back(term);
+        }
+        if (views.size() > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::invalid_argument("Too many terms for a hashed lexicon");
+        }
+        if (store_terms) {
+            auto table = encode_string_table(views.begin(), views.end());
+            if (not table.sorted()) {
+                throw std::invalid_argument("Terms must be unique and sorted to be stored");
+            }
+            std::ostringstream os;
+            table.to_stream(os);
+            m_terms = os.str();
+        }
+        for (std::uint64_t seed = 0;; ++seed) {
+            if (seed == max_attempts) {
+                throw std::runtime_error("Failed to build a minimal perfect hash function");
+            }
+            if (try_build(views, seed)) {
+                break;
+            }
+        }
+    }
+
+    void to_stream(std::ostream& os) const
+    {
+        hashed_lexicon::Header header{
+            hashed_lexicon::magic,
+            hashed_lexicon::version,
+            m_slots.size(),
+            m_pilots.size(),
+            m_seed,
+            m_terms.size()};
+        os.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        auto pilot_bytes = m_pilots.size() * sizeof(std::uint32_t);
+        os.write(reinterpret_cast<char const*>(m_pilots.data()), pilot_bytes);
+        std::array<char, 8> padding{};
+        os.write(padding.data(), hashed_lexicon::padded(pilot_bytes) - pilot_bytes);
+        os.write(
+            reinterpret_cast<char const*>(m_slots.data()),
+            m_slots.size() * sizeof(hashed_lexicon::Slot));
+        os.write(m_terms.data(), m_terms.size());
+    }
+
+    void to_file(std::string const& filename) const
+    {
+        std::ofstream os(filename, std::ios::binary);
+        to_stream(os);
+    }
+
+  private:
+    static constexpr std::uint64_t max_attempts = 100;
+    static constexpr std::uint64_t max_pilot = std::numeric_limits<std::uint32_t>::max();
+
+    [[nodiscard]] auto try_build(gsl::span<std::string_view const> terms, std::uint64_t seed)
+        -> bool
+    {
+        using namespace hashed_lexicon;
+
+        std::uint64_t size = terms.size();
+        std::uint64_t bucket_count = std::max<std::uint64_t>(1, size / terms_per_bucket);
+
+        // Sorting by hash groups terms by bucket, because buckets are determined by high bits.
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> hashes(size);
+        for (std::uint32_t term_id = 0; term_id < size; ++term_id) {
+            hashes[term_id] = {hash(terms[term_id], seed), term_id};
+        }
+        std::sort(hashes.begin(), hashes.end());
+        for (std::size_t idx = 1; idx < hashes.size(); ++idx) {
+            if (hashes[idx].first == hashes[idx - 1].first) {
+                auto term = terms[hashes[idx].second];
+                if (term == terms[hashes[idx - 1].second]) {
+                    throw std::invalid_argument(fmt::format("Duplicate term: `{}`", term));
+                }
+                return false;
+            }
+        }
+
+        std::vector<std::size_t> bucket_begin(bucket_count + 1, 0);
+        for (auto [h, term_id]: hashes) {
+            bucket_begin[bucket(h, bucket_count) + 1] += 1;
+        }
+        std::partial_sum(bucket_begin.begin(), bucket_begin.end(), bucket_begin.begin());
+        std::vector<std::uint32_t> buckets(bucket_count);
+        std::iota(buckets.begin(), buckets.end(), 0);
+        std::stable_sort(buckets.begin(), buckets.end(), [&](auto lhs, auto rhs) {
+            return bucket_begin[lhs + 1] - bucket_begin[lhs]
+                > bucket_begin[rhs + 1] - bucket_begin[rhs];
+        });
+
+        // Larger buckets are placed first, while most of the table is still free.
+        std::vector<std::uint32_t> pilots(bucket_count, 0);
+        std::vector<bool> taken(size, false);
+        std::vector<std::uint64_t> positions;
+        for (auto b: buckets) {
+            auto first = std::next(hashes.begin(), bucket_begin[b]);
+            auto last = std::next(hashes.begin(), bucket_begin[b + 1]);
+            if (first == last) {
+                continue;
+            }
+            std::uint64_t pilot = 0;
+            for (; pilot <= max_pilot; ++pilot) {
+                positions.clear();
+                bool fits = std::all_of(first, last, [&](auto const& entry) {
+                    auto pos = position(entry.first, pilot, size);
+                    if (taken[pos]
+                        || std::find(positions.begin(), positions.end(), pos) != positions.end()) {
+                        return false;
+                    }
+                    positions.push_back(pos);
+                    return true;
+                });
+                if (fits) {
+                    break;
+                }
+            }
+            if (pilot > max_pilot) {
+                return false;
+            }
+            pilots[b] = pilot;
+            for (auto pos: positions) {
+                taken[pos] = true;
+            }
+        }
+
+        m_slots.resize(size);
+        for (auto [h, term_id]: hashes) {
+            auto pos = position(h, pilots[bucket(h, bucket_count)], size);
+            m_slots[pos] = Slot{term_id, fingerprint(h)};
+        }
+        m_pilots = std::move(pilots);
+        m_seed = seed;
+        return true;
+    }
+
+    std::uint64_t m_seed = 0;
+    std::vector<std::uint32_t> m_pilots{};
+    std::vector<hashed_lexicon::Slot> m_slots{};
+    std::string m_terms{};
+};
+
+}  // namespace pisa
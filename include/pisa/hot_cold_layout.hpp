@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+#include <gsl/span>
+#include <spdlog/spdlog.h>
+
+#include "global_parameters.hpp"
+#include "mappable/mapper.hpp"
+#include "query/queries.hpp"
+#include "term_layout.hpp"
+
+namespace pisa {
+
+/// Counts how many of `queries` contain each of `num_terms` terms.
+[[nodiscard]] inline auto term_accesses_from_queries(
+    gsl::span<Query const> queries, std::size_t num_terms) -> std::vector<std::uint64_t>
+{
+    std::vector<std::uint64_t> accesses(num_terms, 0);
+    for (auto const& query: queries) {
+        for (auto term: query.terms) {
+            if (term >= num_terms) {
+                throw std::out_of_range(
+                    fmt::format("Query term {} is out of range of {} terms", term, num_terms));
+            }
+            ++accesses[term];
+        }
+    }
+    return accesses;
+}
+
+/// Sums the block access counts of each of `num_terms` terms, as written by
+/// `block_profiler::dump`: a line per term with its ID followed by its counts.
+[[nodiscard]] inline auto term_accesses_from_profile(std::istream& is, std::size_t num_terms)
+    -> std::vector<std::uint64_t>
+{
+    std::vector<std::uint64_t> accesses(num_terms, 0);
+    std::string line;
+    while (std::getline(is, line)) {
+        std::istringstream fields(line);
+        std::uint64_t term = 0;
+        if (not(fields >> term)) {
+            continue;
+        }
+        if (term >= num_terms) {
+            throw std::out_of_range(
+                fmt::format("Profiled term {} is out of range of {} terms", term, num_terms));
+        }
+        std::uint64_t count = 0;
+        while (fields >> count) {
+            accesses[term] += count;
+        }
+    }
+    return accesses;
+}
+
+/// Returns the order in which to store the posting lists of `index`: first the lists with any
+/// `accesses`, by decreasing accesses per byte, so that the most frequently accessed bytes are
+/// stored together; then the others, in term order.
+template <typename Index>
+[[nodiscard]] auto hot_cold_order(Index const& index, std::vector<std::uint64_t> const& accesses)
+    -> std::vector<std::uint32_t>
+{
+    std::vector<std::uint32_t> order(index.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<double> density(index.size(), 0.0);
+    for (std::uint32_t term = 0; term < index.size(); ++term) {
+        auto bytes = index.posting_list_memory(term).size();
+        density[term] = static_cast<double>(accesses[term]) / bytes;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](auto lhs, auto rhs) {
+        return density[lhs] > density[rhs];
+    });
+    return order;
+}
+
+/// Writes `index` to `output` with the list of term `order[pos]` at position `pos`, followed by
+/// the layout that maps term IDs to their new positions.
+template <typename Index>
+void write_with_layout(
+    Index const& index, std::vector<std::uint32_t> const& order, std::string const& output)
+{
+    global_parameters params;
+    typename Index::stream_builder builder(index.num_docs(), params);
+    for (auto term: order) {
+        builder.add_posting_list(index.posting_list_memory(term));
+    }
+    builder.build(output);
+    TermLayout layout(order);
+    std::ofstream os(output, std::ios::binary | std::ios::app);
+    mapper::freeze(layout, os);
+}
+
+}  // namespace pisa
@@ -6,19 +6,23 @@
 #include <functional>
 #include <iostream>
 #include <numeric>
+#include <memory>
 #include <optional>
+#include <queue>
 #include <sstream>
 #include <thread>
+#include <type_traits>
 #include <unordered_map>
 
 #include "boost/filesystem.hpp"
 #include "gsl/span"
 #include "memory_source.hpp"
-#include "payload_vector.hpp"
 #include "pstl/algorithm"
 #include "pstl/execution"
 #include "range/v3/view/iota.hpp"
 #include "spdlog/spdlog.h"
+#include "streamvbyte/include/streamvbyte.h"
+#include "string_table.hpp"
 #include "tbb/concurrent_queue.h"
 #include "tbb/task_group.h"
 #include "type_safe.hpp"
@@ -71,7 +75,7 @@ namespace invert {
         ranges::iota_view<Document_Id, Document_Id> document_ids;
     };
 
-    std::vector<std::pair<Term_Id, Document_Id>> map_to_postings(Batch batch)
+    inline std::vector<std::pair<Term_Id, Document_Id>> map_to_postings(Batch batch)
     {
         auto docid = batch.document_ids.begin();
         std::vector<std::pair<Term_Id, Document_Id>> postings;
@@ -84,7 +88,7 @@ namespace invert {
         return postings;
     }
 
-    void join_term(
+    inline void join_term(
         std::vector<Document_Id>& lower_doc,
         std::vector<Frequency>& lower_freq,
         std::vector<Document_Id>& higher_doc,
@@ -193,7 +197,7 @@ namespace invert {
         write_sequence(sstream, gsl::span<uint32_t const>(index.document_sizes));
     }
 
-    auto invert_range(
+    inline auto invert_range(
         gsl::span<gsl::span<Term_Id const>> documents, Document_Id first_document_id, size_t threads)
     {
         std::vector<uint32_t> document_sizes(documents.size());
@@ -235,7 +239,15 @@ namespace invert {
         return index;
     }
 
-    [[nodiscard]] auto build_batches(
+    [[nodiscard]] inline auto batch_basename(std::string const& output_basename, uint32_t batch)
+        -> std::string
+    {
+        std::ostringstream batch_name_stream;
+        batch_name_stream << output_basename << ".batch." << batch;
+        return batch_name_stream.str();
+    }
+
+    [[nodiscard]] inline auto build_batches(
         std::string const& input_basename,
         std::string const& output_basename,
         uint32_t term_count,
@@ -257,29 +269,41 @@ namespace invert {
             spdlog::info(
                 "Inverting [{}, {})", documents_processed, documents_processed + documents.size());
             auto index = invert_range(documents, Document_Id(documents_processed), threads);
-            write(fmt::format("{}.batch.{}", output_basename, batch), index, term_count);
+            write(batch_basename(output_basename, batch), index, term_count);
             documents_processed += documents.size();
             batch += 1;
         }
         return batch;
     }
 
-    void merge_batches(std::string const& output_basename, uint32_t batch_count, uint32_t term_count)
+    /// Reads document sizes of all batches, in document order.
+    [[nodiscard]] inline auto read_batch_document_sizes(
+        std::string const& output_basename, uint32_t batch_count) -> std::vector<uint32_t>
     {
-        std::vector<binary_collection> doc_collections;
-        std::vector<binary_collection> freq_collections;
         std::vector<uint32_t> document_sizes;
         for (auto batch: ranges::views::iota(uint32_t(0), batch_count)) {
-            std::ostringstream batch_name_stream;
-            batch_name_stream << output_basename << ".batch." << batch;
-            doc_collections.emplace_back((batch_name_stream.str() + ".docs").c_str());
-            freq_collections.emplace_back((batch_name_stream.str() + ".freqs").c_str());
-            std::ifstream sizes_is(batch_name_stream.str() + ".sizes");
+            std::ifstream sizes_is(batch_basename(output_basename, batch) + ".sizes");
             read_sequence(sizes_is, document_sizes);
         }
+        return document_sizes;
+    }
 
-        std::ofstream sos(output_basename + ".sizes");
-        write_sequence(sos, gsl::span<uint32_t const>(document_sizes));
+    /// Merges the posting lists of all batches and passes them, one term at a time and in term
+    /// order, to `consume(term_id, documents, frequencies)`.
+    template <typename Consumer>
+    void for_each_merged_posting_list(
+        std::string const& output_basename,
+        uint32_t batch_count,
+        uint32_t term_count,
+        Consumer&& consume)
+    {
+        std::vector<binary_collection> doc_collections;
+        std::vector<binary_collection> freq_collections;
+        for (auto batch: ranges::views::iota(uint32_t(0), batch_count)) {
+            auto basename = batch_basename(output_basename, batch);
+            doc_collections.emplace_back((basename + ".docs").c_str());
+            freq_collections.emplace_back((basename + ".freqs").c_str());
+        }
 
         std::vector<binary_collection::const_iterator> doc_iterators;
         std::vector<binary_collection::const_iterator> freq_iterators;
@@ -294,11 +318,6 @@ namespace invert {
             std::back_inserter(freq_iterators),
             [](auto const& coll) { return coll.begin(); });
 
-        std::ofstream dos(output_basename + ".docs");
-        std::ofstream fos(output_basename + ".freqs");
-        auto document_count = static_cast<uint32_t>(document_sizes.size());
-        write_sequence(dos, gsl::make_span<uint32_t const>(&document_count, 1));
-        size_t postings_count = 0;
         for (auto term_id: ranges::views::iota(uint32_t(0), term_count)) {
             std::vector<uint32_t> dlist;
             for (auto& iter: doc_iterators) {
@@ -327,41 +346,447 @@ namespace invert {
                 spdlog::error(msg);
                 throw std::runtime_error(msg);
             }
+            consume(term_id, std::move(dlist), std::move(flist));
+        }
+    }
+
+    /// Writes the posting lists produced by `for_each_posting_list(consume)` as a binary
+    /// frequency collection.
+    template <typename ForEachPostingList>
+    void write_inverted_index(
+        std::string const& output_basename,
+        std::vector<uint32_t> const& document_sizes,
+        uint32_t term_count,
+        ForEachPostingList&& for_each_posting_list)
+    {
+        std::ofstream sos(output_basename + ".sizes");
+        write_sequence(sos, gsl::span<uint32_t const>(document_sizes));
+
+        std::ofstream dos(output_basename + ".docs");
+        std::ofstream fos(output_basename + ".freqs");
+        auto document_count = static_cast<uint32_t>(document_sizes.size());
+        write_sequence(dos, gsl::make_span<uint32_t const>(&document_count, 1));
+        size_t postings_count = 0;
+        for_each_posting_list([&](auto /* term_id */, auto const& dlist, auto const& flist) {
             postings_count += dlist.size();
             write_sequence(dos, gsl::span<uint32_t const>(dlist));
             write_sequence(fos, gsl::span<uint32_t const>(flist));
-        }
+        });
 
         spdlog::info("Number of terms: {}", term_count);
         spdlog::info("Number of documents: {}", document_count);
         spdlog::info("Number of postings: {}", postings_count);
     }
 
-    void invert_forward_index(
+    inline void merge_batches(
+        std::string const& output_basename, uint32_t batch_count, uint32_t term_count)
+    {
+        write_inverted_index(
+            output_basename,
+            read_batch_document_sizes(output_basename, batch_count),
+            term_count,
+            [&](auto&& consume) {
+                for_each_merged_posting_list(output_basename, batch_count, term_count, consume);
+            });
+    }
+
+    inline void remove_batches(std::string const& output_basename, uint32_t batch_count)
+    {
+        for (auto batch: ranges::views::iota(uint32_t(0), batch_count)) {
+            auto basename = batch_basename(output_basename, batch);
+            boost::filesystem::remove(boost::filesystem::path{basename + ".docs"});
+            boost::filesystem::remove(boost::filesystem::path{basename + ".freqs"});
+            boost::filesystem::remove(boost::filesystem::path{basename + ".sizes"});
+            boost::filesystem::remove(boost::filesystem::path{basename + ".run"});
+        }
+    }
+
+    /// Reads the number of terms from the term lexicon of the forward index.
+    [[nodiscard]] inline auto read_term_count(std::string const& input_basename) -> std::uint32_t
+    {
+        auto source = MemorySource::mapped_file(fmt::format("{}.termlex", input_basename));
+        return static_cast<std::uint32_t>(Lexicon::from(source).size());
+    }
+
+    /// Estimated peak number of bytes used by `invert_range` per posting of a batch: the
+    /// per-thread and the concatenated posting vectors, and the lists of the inverted batch.
+    constexpr std::size_t inversion_bytes_per_posting =
+        2 * sizeof(std::pair<Term_Id, Document_Id>) + sizeof(Document_Id) + sizeof(Frequency);
+
+    /// Minimum size of the read buffer of a single run when merging.
+    constexpr std::size_t min_run_buffer_size = 1U << 16U;
+
+    /// A run is a batch whose non-empty posting lists are written in term order, each as a
+    /// header followed by the gaps between document IDs and the frequencies, both encoded
+    /// with streamvbyte.
+    struct Run_Header {
+        uint32_t term_id;
+        uint32_t length;
+        uint32_t documents_bytes;
+        uint32_t frequencies_bytes;
+    };
+
+    /// Writes posting lists, in term order, to a run.
+    class Run_Writer {
+      public:
+        Run_Writer(std::string const& filename, std::size_t buffer_size) : m_buffer(buffer_size)
+        {
+            m_stream.rdbuf()->pubsetbuf(m_buffer.data(), m_buffer.size());
+            m_stream.open(filename, std::ios::binary);
+            if (not m_stream) {
+                throw std::runtime_error(fmt::format("Unable to open run: {}", filename));
+            }
+        }
+        Run_Writer(Run_Writer const&) = delete;
+        Run_Writer(Run_Writer&&) = delete;
+        Run_Writer& operator=(Run_Writer const&) = delete;
+        Run_Writer& operator=(Run_Writer&&) = delete;
+        ~Run_Writer() = default;
+
+        /// Appends the posting list of `term_id`, given as document IDs and frequencies, either
+        /// integers or their strong types.
+        template <typename Documents, typename Frequencies>
+        void write(uint32_t term_id, Documents const& documents, Frequencies const& frequencies)
+        {
+            auto to_int = [](auto value) -> uint32_t {
+                if constexpr (std::is_integral_v<decltype(value)>) {
+                    return value;
+                } else {
+                    return static_cast<uint32_t>(value.as_int());
+                }
+            };
+            Run_Header header{};
+            header.term_id = term_id;
+            header.length = static_cast<uint32_t>(documents.size());
+
+            m_values.resize(documents.size());
+            uint32_t prev = 0;
+            for (std::size_t idx = 0; idx < documents.size(); ++idx) {
+                auto doc = to_int(documents[idx]);
+                m_values[idx] = doc - prev;
+                prev = doc;
+            }
+            header.documents_bytes = encode(m_encoded_documents);
+            std::transform(frequencies.begin(), frequencies.end(), m_values.begin(), to_int);
+            header.frequencies_bytes = encode(m_encoded_frequencies);
+
+            m_stream.write(reinterpret_cast<char const*>(&header), sizeof(header));
+            m_stream.write(
+                reinterpret_cast<char const*>(m_encoded_documents.data()), header.documents_bytes);
+            m_stream.write(
+                reinterpret_cast<char const*>(m_encoded_frequencies.data()),
+                header.frequencies_bytes);
+        }
+
+      private:
+        auto encode(std::vector<uint8_t>& encoded) -> uint32_t
+        {
+            encoded.resize(streamvbyte_max_compressedbytes(m_values.size()));
+            auto bytes = streamvbyte_encode(m_values.data(), m_values.size(), encoded.data());
+            encoded.resize(bytes);
+            return static_cast<uint32_t>(bytes);
+        }
+
+        std::vector<char> m_buffer;
+        std::ofstream m_stream{};
+        std::vector<uint32_t> m_values{};
+        std::vector<uint8_t> m_encoded_documents{};
+        std::vector<uint8_t> m_encoded_frequencies{};
+    };
+
+    template <typename Iterator>
+    void write_run(std::string const& basename, invert::Inverted_Index<Iterator> const& index)
+    {
+        std::vector<Term_Id> terms;
+        terms.reserve(index.documents.size());
+        for (auto const& entry: index.documents) {
+            terms.push_back(entry.first);
+        }
+        std::sort(terms.begin(), terms.end());
+
+        {
+            Run_Writer writer(basename + ".run", min_run_buffer_size);
+            for (auto term: terms) {
+                writer.write(
+                    static_cast<uint32_t>(term.as_int()),
+                    index.documents.at(term),
+                    index.frequencies.at(term));
+            }
+        }
+
+        std::ofstream sstream(basename + ".sizes");
+        write_sequence(sstream, gsl::span<uint32_t const>(index.document_sizes));
+    }
+
+    /// Sequentially reads the posting lists of a run through a buffer of a fixed size.
+    class Run_Reader {
+      public:
+        Run_Reader(std::string const& filename, std::size_t buffer_size) : m_buffer(buffer_size)
+        {
+            m_stream.rdbuf()->pubsetbuf(m_buffer.data(), m_buffer.size());
+            m_stream.open(filename, std::ios::binary);
+            if (not m_stream) {
+                throw std::runtime_error(fmt::format("Unable to open run: {}", filename));
+            }
+            read_header();
+        }
+        Run_Reader(Run_Reader const&) = delete;
+        Run_Reader(Run_Reader&&) = delete;
+        Run_Reader& operator=(Run_Reader const&) = delete;
+        Run_Reader& operator=(Run_Reader&&) = delete;
+        ~Run_Reader() = default;
+
+        [[nodiscard]] auto empty() const -> bool { return m_empty; }
+        [[nodiscard]] auto term_id() const -> uint32_t { return m_header.term_id; }
+
+        /// Appends the postings of the current term and moves to the next term.
+        void read_postings(std::vector<uint32_t>& documents, std::vector<uint32_t>& frequencies)
+        {
+            m_encoded.resize(std::max(m_header.documents_bytes, m_header.frequencies_bytes));
+            auto size = documents.size();
+            documents.resize(size + m_header.length);
+            frequencies.resize(size + m_header.length);
+
+            m_stream.read(reinterpret_cast<char*>(m_encoded.data()), m_header.documents_bytes);
+            streamvbyte_decode(m_encoded.data(), &documents[size], m_header.length);
+            std::partial_sum(
+                std::next(documents.begin(), size),
+                documents.end(),
+                std::next(documents.begin(), size));
+
+            m_stream.read(reinterpret_cast<char*>(m_encoded.data()), m_header.frequencies_bytes);
+            streamvbyte_decode(m_encoded.data(), &frequencies[size], m_header.length);
+            if (not m_stream) {
+                throw std::runtime_error(
+                    fmt::format("Truncated run at term {}", m_header.term_id));
+            }
+            read_header();
+        }
+
+      private:
+        void read_header()
+        {
+            m_stream.read(reinterpret_cast<char*>(&m_header), sizeof(m_header));
+            m_empty = m_stream.gcount() == 0;
+        }
+
+        std::vector<char> m_buffer;
+        std::ifstream m_stream{};
+        Run_Header m_header{};
+        bool m_empty = false;
+        std::vector<uint8_t> m_encoded{};
+    };
+
+    /// Inverts the forward index in batches of documents whose estimated inversion memory
+    /// stays within `memory_budget` bytes, and writes each batch as a run.
+    [[nodiscard]] inline auto build_runs(
+        std::string const& input_basename,
+        std::string const& output_basename,
+        std::size_t memory_budget,
+        size_t threads) -> uint32_t
+    {
+        uint32_t run = 0;
+        binary_collection coll(input_basename.c_str());
+        auto doc_iter = ++coll.begin();
+        uint32_t documents_processed = 0;
+        while (doc_iter != coll.end()) {
+            std::vector<gsl::span<Term_Id const>> documents;
+            std::size_t postings = 0;
+            for (; doc_iter != coll.end(); ++doc_iter) {
+                auto document_sequence = *doc_iter;
+                auto batch_bytes =
+                    (postings + document_sequence.size()) * inversion_bytes_per_posting;
+                if (not documents.empty() && batch_bytes > memory_budget) {
+                    break;
+                }
+                documents.emplace_back(
+                    reinterpret_cast<Term_Id const*>(document_sequence.begin()),
+                    document_sequence.size());
+                postings += document_sequence.size();
+            }
+            spdlog::info(
+                "Inverting [{}, {}) ({} postings)",
+                documents_processed,
+                documents_processed + documents.size(),
+                postings);
+            auto index = invert_range(documents, Document_Id(documents_processed), threads);
+            write_run(batch_basename(output_basename, run), index);
+            documents_processed += documents.size();
+            run += 1;
+        }
+        return run;
+    }
+
+    /// Merges the runs `filenames` with a k-way merge on term IDs, and passes the posting list
+    /// of each term found in any of them, in term order, to `consume(term_id, documents,
+    /// frequencies)`. Each run is read sequentially through a buffer of `buffer_size` bytes.
+    template <typename Consumer>
+    void merge_run_files(
+        std::vector<std::string> const& filenames, std::size_t buffer_size, Consumer&& consume)
+    {
+        std::vector<std::unique_ptr<Run_Reader>> readers;
+        for (auto const& filename: filenames) {
+            readers.push_back(std::make_unique<Run_Reader>(filename, buffer_size));
+        }
+
+        // Ties are broken by run, which keeps documents in order.
+        using Entry = std::pair<uint32_t, uint32_t>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<>> heap;
+        for (auto run: ranges::views::iota(uint32_t(0), uint32_t(readers.size()))) {
+            if (not readers[run]->empty()) {
+                heap.emplace(readers[run]->term_id(), run);
+            }
+        }
+
+        while (not heap.empty()) {
+            auto term_id = heap.top().first;
+            std::vector<uint32_t> dlist;
+            std::vector<uint32_t> flist;
+            while (not heap.empty() && heap.top().first == term_id) {
+                auto run = heap.top().second;
+                heap.pop();
+                auto& reader = *readers[run];
+                reader.read_postings(dlist, flist);
+                if (not reader.empty()) {
+                    heap.emplace(reader.term_id(), run);
+                }
+            }
+            consume(term_id, std::move(dlist), std::move(flist));
+        }
+    }
+
+    /// Merges the runs `filenames` and passes posting lists, one term at a time and in term
+    /// order, to `consume(term_id, documents, frequencies)`. Every term below `term_count` must
+    /// have postings.
+    template <typename Consumer>
+    void for_each_merged_run_posting_list(
+        std::vector<std::string> const& filenames,
+        uint32_t term_count,
+        std::size_t buffer_size,
+        Consumer&& consume)
+    {
+        uint32_t expected_term = 0;
+        auto missing_term = [&] {
+            auto msg = fmt::format("Posting list must be non-empty (term {})", expected_term);
+            spdlog::error(msg);
+            return std::runtime_error(msg);
+        };
+        merge_run_files(filenames, buffer_size, [&](auto term_id, auto&& dlist, auto&& flist) {
+            if (term_id >= term_count) {
+                auto msg = fmt::format(
+                    "Term ID {} out of range (term count: {})", term_id, term_count);
+                spdlog::error(msg);
+                throw std::runtime_error(msg);
+            }
+            if (term_id != expected_term) {
+                throw missing_term();
+            }
+            consume(term_id, std::move(dlist), std::move(flist));
+            expected_term += 1;
+        });
+        if (expected_term != term_count) {
+            throw missing_term();
+        }
+    }
+
+    /// How runs are merged within a memory budget: at most `fan_in` runs at once, each read
+    /// through a buffer of `buffer_size` bytes.
+    struct Run_Merge_Plan {
+        uint32_t fan_in;
+        std::size_t buffer_size;
+    };
+
+    /// Plans the merge of `run_count` runs so that the buffers of a merge, those of the runs
+    /// read and that of the run written by an intermediate pass, fit in `memory_budget` bytes.
+    /// If more than `fan_in` runs remain, they are merged in several passes.
+    [[nodiscard]] inline auto plan_run_merge(uint32_t run_count, std::size_t memory_budget)
+        -> Run_Merge_Plan
+    {
+        // One buffer is kept for the written run. At least two runs are merged at once, so that
+        // each pass reduces the number of runs, even if their buffers are then smaller.
+        auto buffers = memory_budget / min_run_buffer_size;
+        auto max_fan_in = std::max<std::size_t>(2, buffers > 0 ? buffers - 1 : 0);
+        auto fan_in = static_cast<uint32_t>(
+            std::clamp<std::size_t>(run_count, 1, std::min<std::size_t>(max_fan_in, UINT32_MAX)));
+        return {fan_in, memory_budget / (fan_in + 1)};
+    }
+
+    /// Merges the runs into the inverted index, in as many passes as needed to keep the read
+    /// buffers within `memory_budget` bytes. Intermediate passes write their merged runs next
+    /// to the output. Runs are removed once they are merged.
+    inline void merge_runs(
+        std::string const& output_basename,
+        uint32_t run_count,
+        uint32_t term_count,
+        std::size_t memory_budget)
+    {
+        auto plan = plan_run_merge(run_count, memory_budget);
+        std::vector<std::string> runs;
+        for (auto run: ranges::views::iota(uint32_t(0), run_count)) {
+            runs.push_back(batch_basename(output_basename, run) + ".run");
+        }
+        auto remove_runs = [](auto first, auto last) {
+            std::for_each(first, last, [](auto const& filename) {
+                boost::filesystem::remove(boost::filesystem::path{filename});
+            });
+        };
+        for (uint32_t pass = 0; runs.size() > plan.fan_in; ++pass) {
+            spdlog::info("Merging {} runs, {} at a time", runs.size(), plan.fan_in);
+            std::vector<std::string> merged;
+            for (std::size_t first = 0; first < runs.size(); first += plan.fan_in) {
+                auto last = std::min(first + plan.fan_in, runs.size());
+                if (last - first == 1) {
+                    merged.push_back(runs[first]);
+                    continue;
+                }
+                std::vector<std::string> group(runs.begin() + first, runs.begin() + last);
+                auto filename =
+                    fmt::format("{}.pass.{}.{}.run", output_basename, pass, merged.size());
+                {
+                    Run_Writer writer(filename, plan.buffer_size);
+                    merge_run_files(
+                        group, plan.buffer_size, [&](auto term_id, auto&& dlist, auto&& flist) {
+                            writer.write(term_id, dlist, flist);
+                        });
+                }
+                remove_runs(group.begin(), group.end());
+                merged.push_back(filename);
+            }
+            runs = std::move(merged);
+        }
+        write_inverted_index(
+            output_basename,
+            read_batch_document_sizes(output_basename, run_count),
+            term_count,
+            [&](auto&& consume) {
+                for_each_merged_run_posting_list(runs, term_count, plan.buffer_size, consume);
+            });
+        remove_runs(runs.begin(), runs.end());
+    }
+
+    inline void invert_forward_index(
         std::string const& input_basename,
         std::string const& output_basename,
         size_t batch_size,
         size_t threads,
-        std::optional<std::uint32_t> term_count = std::nullopt)
+        std::optional<std::uint32_t> term_count = std::nullopt,
+        std::optional<std::size_t> memory_budget = std::nullopt)
     {
         if (not term_count) {
-            auto source = MemorySource::mapped_file(fmt::format("{}.termlex", input_basename));
-            auto terms = Payload_Vector<>::from(source);
-            term_count = static_cast<std::uint32_t>(terms.size());
+            term_count = read_term_count(input_basename);
         }
 
+        if (memory_budget) {
+            uint32_t run_count =
+                invert::build_runs(input_basename, output_basename, *memory_budget, threads);
+            invert::merge_runs(output_basename, run_count, *term_count, *memory_budget);
+            invert::remove_batches(output_basename, run_count);
+            return;
+        }
         uint32_t batch_count =
             invert::build_batches(input_basename, output_basename, *term_count, batch_size, threads);
         invert::merge_batches(output_basename, batch_count, *term_count);
-
-        for (auto batch: ranges::views::iota(uint32_t(0), batch_count)) {
-            std::ostringstream batch_name_stream;
-            batch_name_stream << output_basename << ".batch." << batch;
-            auto batch_basename = batch_name_stream.str();
-            boost::filesystem::remove(boost::filesystem::path{batch_basename + ".docs"});
-            boost::filesystem::remove(boost::filesystem::path{batch_basename + ".freqs"});
-            boost::filesystem::remove(boost::filesystem::path{batch_basename + ".sizes"});
-        }
+        invert::remove_batches(output_basename, batch_count);
     }
 
 }  // namespace invert
@@ -2,6 +2,8 @@
 
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "mio/mmap.hpp"
 
@@ -32,6 +34,14 @@ namespace pisa { namespace mapper {
         }
     };
 
+    /// Memory occupied by a mappable vector of a structure, named by the path of member names
+    /// leading to it, such as `m_docs_sequences.m_endpoints.m_bits`.
+    struct memory_region {
+        std::string name;
+        const char* data;
+        size_t size;
+    };
+
     namespace detail {
         class freeze_visitor {
           public:
@@ -227,6 +237,51 @@ namespace pisa { namespace mapper {
             size_node_ptr m_cur_size_node;
         };
 
+        class regions_visitor {
+          public:
+            regions_visitor() = default;
+            regions_visitor(regions_visitor const&) = delete;
+            regions_visitor(regions_visitor&&) = delete;
+            regions_visitor& operator=(regions_visitor const&) = delete;
+            regions_visitor& operator=(regions_visitor&&) = delete;
+            ~regions_visitor() = default;
+
+            template <typename T>
+            typename std::enable_if<!std::is_pod<T>::value, regions_visitor&>::type
+            operator()(T& val, const char* friendly_name)
+            {
+                auto length = m_path.size();
+                m_path += friendly_name;
+                m_path += '.';
+                val.map(*this);
+                m_path.resize(length);
+                return *this;
+            }
+
+            template <typename T>
+            typename std::enable_if<std::is_pod<T>::value, regions_visitor&>::type
+            operator()(T& /* val */, const char* /* friendly_name */)
+            {
+                return *this;
+            }
+
+            template <typename T>
+            regions_visitor& operator()(mappable_vector<T>& vec, const char* friendly_name)
+            {
+                m_regions.push_back(memory_region{
+                    m_path + friendly_name,
+                    reinterpret_cast<const char*>(vec.data()),
+                    static_cast<size_t>(vec.size() * sizeof(T))});
+                return *this;
+            }
+
+            std::vector<memory_region> regions() const { return m_regions; }
+
+          protected:
+            std::string m_path;
+            std::vector<memory_region> m_regions;
+        };
+
     }  // namespace detail
 
     template <typename T>
@@ -270,6 +325,16 @@ namespace pisa { namespace mapper {
         return sizer.size();
     }
 
+    /// Returns the memory regions of all mappable vectors of `val`, in the order they are
+    /// stored.
+    template <typename T>
+    std::vector<memory_region> regions_of(T& val)
+    {
+        detail::regions_visitor visitor;
+        val.map(visitor);
+        return visitor.regions();
+    }
+
     template <typename T>
     size_node_ptr size_tree_of(T& val, const char* friendly_name = "<TOP>")
     {
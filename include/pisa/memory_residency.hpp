@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <gsl/span>
+#include <spdlog/spdlog.h>
+
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+
+namespace pisa {
+
+/// Locks the memory of the structures selected by `selectors` in physical memory.
+///
+/// `name` selects all of `structure`, while `name.path` selects its mappable vectors whose
+/// member path starts with `path`, e.g., `index.m_endpoints` selects the posting list
+/// endpoints of a block-compressed index. Returns the number of bytes locked.
+///
+/// \throws std::system_error   if the memory cannot be locked, e.g., over `RLIMIT_MEMLOCK`
+template <typename T>
+auto lock_structure(
+    std::string const& name, T& structure, std::vector<std::string> const& selectors)
+    -> std::size_t
+{
+    std::size_t locked = 0;
+    for (auto const& region: mapper::regions_of(structure)) {
+        bool selected = false;
+        for (auto const& selector: selectors) {
+            if (selector == name
+                || (selector.rfind(name + ".", 0) == 0
+                    && region.name.rfind(selector.substr(name.size() + 1), 0) == 0)) {
+                selected = true;
+            }
+        }
+        if (selected) {
+            locked += lock_memory(gsl::span<char const>(region.data, region.size));
+            spdlog::info("Locked {}.{}: {} bytes", name, region.name, region.size);
+        }
+    }
+    return locked;
+}
+
+/// Logs the time it took to load `structure` since `start`, and how many bytes of each of its
+/// mappable vectors are resident in physical memory.
+template <typename T>
+void log_residency(
+    std::string const& name, T& structure, std::chrono::steady_clock::time_point start)
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+        std::chrono::steady_clock::now() - start);
+    std::size_t bytes = 0;
+    std::size_t resident = 0;
+    auto regions = mapper::regions_of(structure);
+    std::vector<std::size_t> region_resident;
+    for (auto const& region: regions) {
+        region_resident.push_back(resident_bytes(gsl::span<char const>(region.data, region.size)));
+        bytes += region.size;
+        resident += region_resident.back();
+    }
+    spdlog::info(
+        "Loaded {} in {:.1f} ms: {} of {} bytes resident", name, elapsed.count(), resident, bytes);
+    for (std::size_t idx = 0; idx < regions.size(); ++idx) {
+        spdlog::info(
+            "  {}.{}: {} of {} bytes resident",
+            name,
+            regions[idx].name,
+            region_resident[idx],
+            regions[idx].size);
+    }
+}
+
+/// Drops `structure`, mapped from `file`, from the page cache, so that the next access to
+/// each of its pages reads it from storage.
+template <typename T>
+void evict_structure(T& structure, std::string const& file)
+{
+    auto regions = mapper::regions_of(structure);
+    if (regions.empty()) {
+        return;
+    }
+    // Regions are in the order they are stored, so they span the mapping of the whole file.
+    auto const* first = regions.front().data;
+    auto const* last = regions.back().data + regions.back().size;
+    evict_from_page_cache(gsl::span<char const>(first, last - first), file);
+}
+
+}  // namespace pisa
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <string>
 
 #include <boost/filesystem/path.hpp>
 #include <gsl/span>
@@ -8,6 +10,57 @@
 
 namespace pisa {
 
+class BlockCache;
+
+/// How the pages of a memory-mapped file are brought into memory.
+enum class LoadPolicy {
+    /// Structures touch each of their elements when they are mapped (the default).
+    Warmup,
+    /// Pages are read on first access.
+    Lazy,
+    /// All pages are faulted in by several threads before the file is used.
+    Parallel,
+    /// The file is mapped with `MAP_POPULATE`, which reads it ahead of time in the kernel.
+    Populate,
+    /// `madvise(MADV_WILLNEED)`: asynchronous read-ahead of the whole file.
+    WillNeed,
+    /// `madvise(MADV_HUGEPAGE)`: transparent huge pages, where the file system supports them.
+    HugePage,
+    /// `madvise(MADV_RANDOM)`: no read-ahead, for indexes much larger than memory.
+    Random,
+};
+
+/// Parses a load policy from its lowercase name, such as `lazy` or `willneed`.
+///
+/// \throws std::invalid_argument  if the name is unknown
+[[nodiscard]] auto parse_load_policy(std::string const& name) -> LoadPolicy;
+
+/// Number of bytes of `memory` resident in physical memory.
+[[nodiscard]] auto resident_bytes(gsl::span<char const> memory) -> std::size_t;
+
+/// Locks the pages of `memory` in physical memory, and returns the number of bytes locked.
+///
+/// \throws std::system_error   if the pages cannot be locked, e.g., over `RLIMIT_MEMLOCK`
+auto lock_memory(gsl::span<char const> memory) -> std::size_t;
+
+/// Drops `memory`, a mapping of `file`, from the page cache, so that it is read from storage
+/// again on its next access. The pages are unmapped from this process first, because the
+/// kernel keeps mapped pages in the cache, and the file is flushed, because dirty pages cannot
+/// be dropped. File systems backed by memory, such as tmpfs, keep their pages regardless.
+///
+/// \throws std::system_error   if `file` cannot be opened
+void evict_from_page_cache(gsl::span<char const> memory, std::string const& file);
+
+/// Counts of the I/O done by this process since it started.
+struct IoCounters {
+    /// Page faults that had to read from storage.
+    std::uint64_t major_faults = 0;
+    /// Bytes read from storage, as reported by `/proc/self/io`, or 0 where it is unavailable.
+    std::uint64_t read_bytes = 0;
+};
+
+[[nodiscard]] auto io_counters() -> IoCounters;
+
 /// This is an owning memory source for any byte-based structures.
 class MemorySource {
   public:
@@ -42,9 +95,36 @@ class MemorySource {
     /// \throws std::system_error   if fails to map the file.
     [[nodiscard]] static auto mapped_file(boost::filesystem::path file) -> MemorySource;
 
+    /// Constructs a memory source using a memory mapped file, loaded according to `policy`.
+    ///
+    /// \throws NoSuchFile          if the file doesn't exist
+    /// \throws std::system_error   if fails to map the file.
+    [[nodiscard]] static auto mapped_file(std::string const& file, LoadPolicy policy)
+        -> MemorySource;
+
+    /// Constructs a memory source using a memory mapped file, loaded according to `policy`.
+    ///
+    /// \throws NoSuchFile          if the file doesn't exist
+    /// \throws std::system_error   if fails to map the file.
+    [[nodiscard]] static auto mapped_file(boost::filesystem::path file, LoadPolicy policy)
+        -> MemorySource;
+
+    /// Constructs a memory source over a file read on demand by `cache`.
+    ///
+    /// Structures mapped onto it are never warmed up, as only the memory loaded by the cache is
+    /// readable; see `BlockCache`.
+    [[nodiscard]] static auto from_block_cache(std::shared_ptr<BlockCache> cache) -> MemorySource;
+
     /// Checks if memory is mapped.
     [[nodiscard]] auto is_mapped() noexcept -> bool;
 
+    /// Policy the source was loaded with.
+    [[nodiscard]] auto load_policy() const noexcept -> LoadPolicy;
+
+    /// Flags passed to `mapper::map` by structures mapped onto this source: elements are
+    /// touched while mapping only with `LoadPolicy::Warmup`.
+    [[nodiscard]] auto map_flags() const noexcept -> std::uint64_t;
+
     /// Pointer to the first byte.
     ///
     /// \throws std::domain_error   if memory is empty
@@ -109,6 +189,7 @@ class MemorySource {
     {}
 
     std::unique_ptr<Interface> m_source;
+    LoadPolicy m_load_policy = LoadPolicy::Warmup;
 };
 
 }  // namespace pisa
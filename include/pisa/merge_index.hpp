@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "binary_freq_collection.hpp"
+#include "build_index.hpp"
+#include "scorer/scorer.hpp"
+#include "wand_data.hpp"
+
+namespace pisa {
+
+/// Merges indexes of consecutive document ranges into one index of `term_count` terms, and
+/// computes its wand data.
+///
+/// The documents of each input follow those of the previous ones. `local_terms[i][term]` is
+/// the ID of `term` in `indexes[i]`, or -1 if it does not occur there, and `wand_data[i]`
+/// provides the document lengths of `indexes[i]`. Wand data is computed from scratch, as the
+/// term statistics of the merged collection differ from those of each input.
+///
+/// Every posting of the inputs is decoded, since the wand data and the blocks that must be
+/// re-encoded are computed from the merged postings. Block-compressed posting lists then copy
+/// the compressed blocks of the inputs without re-encoding them, except those which no longer
+/// start at a block boundary or follow the same document (see
+/// `block_posting_list::write_merged`); other encodings are re-encoded. Returns the number of
+/// copied blocks.
+template <typename Index, typename Wand>
+auto merge_indexes(
+    std::vector<Index const*> const& indexes,
+    std::vector<Wand const*> const& wand_data,
+    std::vector<std::vector<std::int64_t>> const& local_terms,
+    std::uint32_t term_count,
+    std::string const& output_filename,
+    std::string const& wand_data_filename,
+    std::string const& seq_type,
+    ScorerParams const& scorer_params,
+    BlockSize block_size) -> std::size_t
+{
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> document_sizes;
+    for (std::size_t idx = 0; idx < indexes.size(); ++idx) {
+        offsets.push_back(document_sizes.size());
+        for (std::uint32_t doc = 0; doc < indexes[idx]->num_docs(); ++doc) {
+            document_sizes.push_back(wand_data[idx]->doc_len(doc));
+        }
+    }
+    spdlog::info("Merging {} indexes with {} documents", indexes.size(), document_sizes.size());
+
+    auto for_each_posting_list = [&](auto&& consume) {
+        for (std::uint32_t term = 0; term < term_count; ++term) {
+            std::vector<std::uint32_t> documents;
+            std::vector<std::uint32_t> frequencies;
+            for (std::size_t idx = 0; idx < indexes.size(); ++idx) {
+                if (auto local = local_terms[idx][term]; local >= 0) {
+                    auto cursor = (*indexes[idx])[local];
+                    for (; cursor.docid() < indexes[idx]->num_docs(); cursor.next()) {
+                        documents.push_back(cursor.docid() + offsets[idx]);
+                        frequencies.push_back(cursor.freq());
+                    }
+                }
+            }
+            consume(term, std::move(documents), std::move(frequencies));
+        }
+    };
+
+    std::atomic_size_t copied_blocks{0};
+    auto num_docs = document_sizes.size();
+    if constexpr (std::is_same_v<typename Index::index_layout_tag, BlockIndexTag>) {
+        std::atomic_size_t total_blocks{0};
+        build_index_from_posting_lists<Index, Wand>(
+            std::move(document_sizes),
+            term_count,
+            for_each_posting_list,
+            [&](auto const& /* builder */, std::uint32_t term, auto const& list) {
+                std::vector<typename Index::posting_list_type::document_enumerator> lists;
+                std::vector<std::uint32_t> list_offsets;
+                for (std::size_t idx = 0; idx < indexes.size(); ++idx) {
+                    if (auto local = local_terms[idx][term]; local >= 0) {
+                        lists.push_back((*indexes[idx])[local]);
+                        list_offsets.push_back(offsets[idx]);
+                    }
+                }
+                std::vector<std::uint8_t> encoded;
+                copied_blocks += Index::posting_list_type::write_merged(
+                    encoded, lists, list_offsets, list.docs, list.freqs);
+                total_blocks += typename Index::posting_list_type::document_enumerator(
+                                    encoded.data(), num_docs)
+                                    .num_blocks();
+                return encoded;
+            },
+            output_filename,
+            wand_data_filename,
+            seq_type,
+            scorer_params,
+            block_size);
+        spdlog::info(
+            "Copied {} of {} compressed blocks", copied_blocks.load(), total_blocks.load());
+    } else {
+        build_index_from_posting_lists<Index, Wand>(
+            std::move(document_sizes),
+            term_count,
+            for_each_posting_list,
+            output_filename,
+            wand_data_filename,
+            seq_type,
+            scorer_params,
+            block_size);
+    }
+    return copied_blocks;
+}
+
+}  // namespace pisa
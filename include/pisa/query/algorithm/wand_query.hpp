@@ -402,7 +402,7 @@ struct wand_query {
             }
 
             // Case 2: We are yet to score it, and the pivots are aligned. So we score.
-            if (pivot_id == ordered_cursors[0]->docid()) {
+            else if (pivot_id == ordered_cursors[0]->docid()) {
                 float score = 0;
                 for (Cursor* en: ordered_cursors) {
                     if (en->docid() != pivot_id) {
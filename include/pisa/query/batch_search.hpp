@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <gsl/span>
+
+#include "cursor/block_max_scored_cursor.hpp"
+#include "cursor/max_scored_cursor.hpp"
+#include "cursor/scored_cursor.hpp"
+#include "query/queries.hpp"
+#include "scorer/index_scorer.hpp"
+#include "util/compiler_attribute.hpp"
+#include "util/likely.hpp"
+
+namespace pisa {
+
+/// A posting list shared by the queries of a batch. Each block is decoded the first time a
+/// query reaches it, and its frequencies the first time a query scores one of its postings;
+/// the other queries of the batch read the decoded values. Decoded values are allocated per
+/// block, so the memory of a batch grows with the blocks its queries reach, not with the length
+/// of its lists.
+///
+/// The list is not thread safe: a batch is executed by a single thread.
+template <typename Enumerator>
+class SharedPostingList {
+  public:
+    explicit SharedPostingList(Enumerator list)
+        : m_list(std::move(list)),
+          m_block_size(m_list.block_length(0)),
+          m_values(m_list.num_blocks()),
+          m_freqs_data(m_list.num_blocks(), nullptr),
+          m_freqs_decoded(m_list.num_blocks(), false)
+    {}
+
+    [[nodiscard]] auto size() const -> std::uint64_t { return m_list.size(); }
+    [[nodiscard]] auto num_blocks() const -> std::uint64_t { return m_list.num_blocks(); }
+    [[nodiscard]] auto block_max(std::uint64_t block) const -> std::uint32_t
+    {
+        return m_list.last_docid(block);
+    }
+    [[nodiscard]] auto block_length(std::uint64_t block) const -> std::uint32_t
+    {
+        return m_list.block_length(block);
+    }
+
+    /// Document IDs of `block`, decoded on the first call.
+    [[nodiscard]] auto docs(std::uint64_t block) -> std::uint32_t const*
+    {
+        auto& values = m_values[block];
+        if (PISA_UNLIKELY(values == nullptr)) {
+            // Document IDs come first, followed by the frequencies once they are decoded.
+            values.reset(new std::uint32_t[2 * m_block_size]);
+            m_freqs_data[block] = m_list.decode_docs(block, values.get());
+            ++m_decoded_blocks;
+        }
+        return values.get();
+    }
+
+    /// Frequencies of `block`, decoded on the first call. The documents must be decoded first.
+    [[nodiscard]] auto freqs(std::uint64_t block) -> std::uint32_t const*
+    {
+        auto* freqs = m_values[block].get() + m_block_size;
+        if (PISA_UNLIKELY(not m_freqs_decoded[block])) {
+            m_list.decode_freqs(block, m_freqs_data[block], freqs);
+            m_freqs_decoded[block] = true;
+        }
+        return freqs;
+    }
+
+    /// Number of blocks decoded so far.
+    [[nodiscard]] auto decoded_blocks() const -> std::size_t { return m_decoded_blocks; }
+
+  private:
+    Enumerator m_list;
+    std::uint64_t m_block_size;
+    std::vector<std::unique_ptr<std::uint32_t[]>> m_values;
+    std::vector<std::uint8_t const*> m_freqs_data;
+    std::vector<bool> m_freqs_decoded;
+    std::size_t m_decoded_blocks = 0;
+};
+
+/// A cursor of a single query over a `SharedPostingList`.
+template <typename Enumerator>
+class SharedListCursor {
+  public:
+    SharedListCursor(SharedPostingList<Enumerator>& list, std::uint64_t universe)
+        : m_list(&list), m_universe(universe)
+    {
+        reset();
+    }
+
+    void reset() { load_block(0); }
+
+    void PISA_ALWAYSINLINE next()
+    {
+        if (PISA_LIKELY(++m_pos < m_length)) {
+            m_docid = m_docs[m_pos];
+        } else {
+            load_block(m_block + 1);
+        }
+    }
+
+    void PISA_ALWAYSINLINE next_geq(std::uint64_t lower_bound)
+    {
+        if (PISA_UNLIKELY(lower_bound > m_block_max)) {
+            auto block = m_block + 1;
+            while (block < m_list->num_blocks() && m_list->block_max(block) < lower_bound) {
+                ++block;
+            }
+            load_block(block);
+            if (block == m_list->num_blocks()) {
+                return;
+            }
+        }
+        while (m_docid < lower_bound) {
+            m_docid = m_docs[++m_pos];
+        }
+    }
+
+    [[nodiscard]] auto docid() const -> std::uint64_t { return m_docid; }
+    [[nodiscard]] auto freq() -> std::uint64_t { return m_list->freqs(m_block)[m_pos]; }
+    [[nodiscard]] auto size() const -> std::uint64_t { return m_list->size(); }
+
+  private:
+    void load_block(std::uint64_t block)
+    {
+        m_block = block;
+        m_pos = 0;
+        if (block >= m_list->num_blocks()) {
+            m_length = 0;
+            m_block_max = m_universe;
+            m_docid = m_universe;
+            return;
+        }
+        m_length = m_list->block_length(block);
+        m_block_max = m_list->block_max(block);
+        m_docs = m_list->docs(block);
+        m_docid = m_docs[0];
+    }
+
+    SharedPostingList<Enumerator>* m_list;
+    std::uint64_t m_universe;
+    std::uint64_t m_block = 0;
+    std::uint32_t m_pos = 0;
+    std::uint32_t m_length = 0;
+    std::uint64_t m_block_max = 0;
+    std::uint32_t const* m_docs = nullptr;
+    std::uint64_t m_docid = 0;
+};
+
+/// Cursors of a batch of queries, in which each posting list is shared by all queries of the
+/// batch containing its term. It can be passed to `paged_search` in place of `IndexCursors`;
+/// the queries of a batch are executed one after another by the same thread.
+///
+/// Only block indexes can be executed in batches.
+template <typename Index, typename Wand>
+class QueryBatch {
+  public:
+    using enumerator_type = typename Index::document_enumerator;
+    using cursor_type = SharedListCursor<enumerator_type>;
+
+    QueryBatch(
+        Index const& index,
+        Wand const& wdata,
+        index_scorer<Wand> const& scorer,
+        gsl::span<Query const> queries)
+        : m_index(index), m_wdata(wdata), m_scorer(scorer)
+    {
+        std::unordered_map<std::uint32_t, std::size_t> occurrences;
+        for (auto const& query: queries) {
+            for (auto term: query_freqs(query.terms)) {
+                if (++occurrences[term.first] == 1) {
+                    m_lists.emplace(
+                        term.first,
+                        std::make_unique<SharedPostingList<enumerator_type>>(index[term.first]));
+                }
+            }
+        }
+        m_num_shared = std::count_if(occurrences.begin(), occurrences.end(), [](auto const& term) {
+            return term.second > 1;
+        });
+    }
+
+    [[nodiscard]] auto scored(Query const& query) const
+    {
+        std::vector<ScoredCursor<cursor_type>> cursors;
+        for (auto term: query_freqs(query.terms)) {
+            cursors.emplace_back(cursor(term.first), m_scorer.term_scorer(term.first), term.second);
+        }
+        return cursors;
+    }
+
+    [[nodiscard]] auto max_scored(Query const& query) const
+    {
+        std::vector<MaxScoredCursor<cursor_type>> cursors;
+        for (auto term: query_freqs(query.terms)) {
+            float weight = term.second;
+            cursors.emplace_back(
+                cursor(term.first),
+                m_scorer.term_scorer(term.first),
+                weight,
+                weight * m_wdata.max_term_weight(term.first));
+        }
+        return cursors;
+    }
+
+    [[nodiscard]] auto block_max_scored(Query const& query) const
+    {
+        std::vector<BlockMaxScoredCursor<cursor_type, Wand>> cursors;
+        for (auto term: query_freqs(query.terms)) {
+            float weight = term.second;
+            cursors.emplace_back(
+                cursor(term.first),
+                m_scorer.term_scorer(term.first),
+                weight,
+                weight * m_wdata.max_term_weight(term.first),
+                m_wdata.getenum(term.first));
+        }
+        return cursors;
+    }
+
+    /// Number of distinct posting lists of the batch.
+    [[nodiscard]] auto num_lists() const -> std::size_t { return m_lists.size(); }
+
+    /// Number of posting lists used by more than one query of the batch.
+    [[nodiscard]] auto num_shared() const -> std::size_t { return m_num_shared; }
+
+    /// Number of blocks decoded by the batch so far.
+    [[nodiscard]] auto decoded_blocks() const -> std::size_t
+    {
+        return std::accumulate(
+            m_lists.begin(), m_lists.end(), std::size_t{0}, [](auto sum, auto const& list) {
+                return sum + list.second->decoded_blocks();
+            });
+    }
+
+  private:
+    [[nodiscard]] auto cursor(std::uint32_t term) const -> cursor_type
+    {
+        return cursor_type(*m_lists.at(term), m_index.num_docs());
+    }
+
+    Index const& m_index;
+    Wand const& m_wdata;
+    index_scorer<Wand> const& m_scorer;
+    std::unordered_map<std::uint32_t, std::unique_ptr<SharedPostingList<enumerator_type>>> m_lists;
+    std::size_t m_num_shared = 0;
+};
+
+/// Groups `queries` into batches of at most `batch_size` queries, returned as positions in
+/// `queries`. Queries sharing their most frequent term end up in the same batch.
+[[nodiscard]] inline auto group_queries(gsl::span<Query const> queries, std::size_t batch_size)
+    -> std::vector<std::vector<std::size_t>>
+{
+    std::unordered_map<std::uint32_t, std::size_t> occurrences;
+    for (auto const& query: queries) {
+        for (auto term: query_freqs(query.terms)) {
+            ++occurrences[term.first];
+        }
+    }
+    // Queries are keyed by their most frequent term, ties broken by term ID. Queries without
+    // terms have no occurrences and come last.
+    std::vector<std::pair<std::size_t, std::uint32_t>> keys;
+    for (auto const& query: queries) {
+        std::pair<std::size_t, std::uint32_t> key{0, std::numeric_limits<std::uint32_t>::max()};
+        for (auto term: query.terms) {
+            auto count = occurrences[term];
+            if (count > key.first || (count == key.first && term < key.second)) {
+                key = {count, term};
+            }
+        }
+        keys.push_back(key);
+    }
+    std::vector<std::size_t> order(queries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](auto lhs, auto rhs) {
+        return std::tie(keys[rhs].first, keys[lhs].second)
+            < std::tie(keys[lhs].first, keys[rhs].second);
+    });
+    batch_size = std::max<std::size_t>(batch_size, 1);
+    std::vector<std::vector<std::size_t>> batches;
+    for (std::size_t pos = 0; pos < order.size(); pos += batch_size) {
+        auto last = std::min(pos + batch_size, order.size());
+        batches.emplace_back(order.begin() + pos, order.begin() + last);
+    }
+    return batches;
+}
+
+}  // namespace pisa
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <numeric>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <gsl/span>
+
+#include "dec_time_prediction.hpp"
+#include "query/queries.hpp"
+#include "topk_queue.hpp"
+
+namespace pisa {
+
+struct BlockIndexTag;
+
+/// Features of a query that its processing time depends on, for all algorithms alike.
+struct QueryCostFeatures {
+    enum Feature : std::size_t {
+        /// Constant 1, for the intercept of a model.
+        Bias,
+        /// Number of query terms.
+        Terms,
+        /// Number of postings in all lists.
+        Postings,
+        /// Number of postings in the shortest list.
+        Shortest,
+        /// Predicted time to decode all lists.
+        Decode,
+        /// Postings, scaled by how far the threshold is below the sum of the max scores.
+        AboveThreshold,
+        /// Postings of the lists that MaxScore cannot skip at the threshold.
+        Essential,
+        Count
+    };
+
+    std::array<double, Count> values{};
+
+    [[nodiscard]] auto operator[](Feature feature) const -> double { return values[feature]; }
+    [[nodiscard]] auto operator[](Feature feature) -> double& { return values[feature]; }
+};
+
+/// Estimates the `k`-th highest score of `query` as the highest, over its terms, of the `k`-th
+/// highest block-max score of the term's list. Block-max scores bound the scores of all
+/// documents in their block, so this is an estimate, not a bound.
+template <typename Wand>
+[[nodiscard]] auto estimate_threshold(Wand const& wdata, Query const& query, std::size_t k)
+    -> Threshold
+{
+    Threshold threshold = 0;
+    std::vector<float> block_scores;
+    for (auto term: query.terms) {
+        block_scores.clear();
+        auto blocks = wdata.getenum(term);
+        while (true) {
+            block_scores.push_back(blocks.score());
+            auto docid = blocks.docid();
+            blocks.next_geq(docid + 1);
+            if (blocks.docid() == docid) {
+                break;
+            }
+        }
+        if (block_scores.size() >= k) {
+            std::nth_element(
+                block_scores.begin(),
+                block_scores.begin() + k - 1,
+                block_scores.end(),
+                std::greater<>());
+            threshold = std::max(threshold, block_scores[k - 1]);
+        }
+    }
+    return threshold;
+}
+
+/// Computes the cost features of `query`.
+///
+/// `threshold` is the expected `k`-th highest score, or 0 to estimate it from the block-max
+/// scores of `wdata`. `decode` predicts the time to decode a list from its number of postings
+/// (`n`) and, for block-compressed indexes, its size in bytes (`size`).
+template <typename Index, typename Wand>
+[[nodiscard]] auto query_cost_features(
+    Index const& index,
+    Wand const& wdata,
+    Query const& query,
+    std::size_t k,
+    Threshold threshold,
+    time_prediction::predictor const& decode) -> QueryCostFeatures
+{
+    QueryCostFeatures features;
+    features[QueryCostFeatures::Bias] = 1;
+    features[QueryCostFeatures::Terms] = query.terms.size();
+    if (query.terms.empty()) {
+        return features;
+    }
+    if (threshold <= 0) {
+        threshold = estimate_threshold(wdata, query, k);
+    }
+
+    std::vector<std::pair<float, std::uint64_t>> lists;
+    double postings = 0;
+    double shortest = index.num_docs();
+    for (auto term: query.terms) {
+        auto length = index[term].size();
+        lists.emplace_back(wdata.max_term_weight(term), length);
+        postings += length;
+        shortest = std::min(shortest, static_cast<double>(length));
+
+        time_prediction::feature_vector list_features;
+        list_features[time_prediction::feature_type::n] = length;
+        if constexpr (std::is_same_v<typename Index::index_layout_tag, BlockIndexTag>) {
+            list_features[time_prediction::feature_type::size] =
+                index.posting_list_memory(term).size();
+        }
+        features[QueryCostFeatures::Decode] += decode(list_features);
+    }
+    features[QueryCostFeatures::Postings] = postings;
+    features[QueryCostFeatures::Shortest] = shortest;
+
+    double max_score_sum = std::accumulate(
+        lists.begin(), lists.end(), 0.0, [](double sum, auto list) { return sum + list.first; });
+    if (max_score_sum > 0) {
+        features[QueryCostFeatures::AboveThreshold] =
+            postings * std::clamp(1.0 - threshold / max_score_sum, 0.0, 1.0);
+    }
+
+    // MaxScore skips the lists with the lowest max scores while their sum is below the threshold.
+    std::sort(lists.begin(), lists.end());
+    double non_essential_score = 0;
+    for (auto [max_score, length]: lists) {
+        non_essential_score += max_score;
+        if (non_essential_score >= threshold) {
+            features[QueryCostFeatures::Essential] += length;
+        }
+    }
+    return features;
+}
+
+/// Predicts the processing time of a query with each of several algorithms, as a linear
+/// function of its `QueryCostFeatures`.
+///
+/// A model is written as text: a `decode` line with the feature names and weights of the
+/// decoding time predictor, followed by a line per algorithm with its name and a weight for
+/// each query feature.
+class CostModel {
+  public:
+    CostModel() = default;
+    explicit CostModel(time_prediction::predictor decode);
+
+    /// \throws std::invalid_argument  if a line cannot be parsed
+    [[nodiscard]] static auto read(std::istream& is) -> CostModel;
+    void write(std::ostream& os) const;
+
+    [[nodiscard]] auto decode() const -> time_prediction::predictor const& { return m_decode; }
+
+    /// Algorithms in the model, in the order they were added.
+    [[nodiscard]] auto algorithms() const -> std::vector<std::string>;
+
+    /// Fits the weights of `algorithm` to the measured `times` of queries with `features` by
+    /// least squares, replacing its previous weights.
+    ///
+    /// \throws std::invalid_argument  if the numbers of features and times differ
+    void fit(
+        std::string const& algorithm,
+        gsl::span<QueryCostFeatures const> features,
+        gsl::span<double const> times);
+
+    /// \throws std::out_of_range  if `algorithm` is not in the model
+    [[nodiscard]] auto
+    predict(std::string const& algorithm, QueryCostFeatures const& features) const -> double;
+
+    /// Algorithm with the lowest predicted time, and that time.
+    ///
+    /// \throws std::logic_error  if the model has no algorithms
+    [[nodiscard]] auto cheapest(QueryCostFeatures const& features) const
+        -> std::pair<std::string const&, double>;
+
+  private:
+    using Weights = std::array<double, QueryCostFeatures::Count>;
+
+    time_prediction::predictor m_decode;
+    std::vector<std::pair<std::string, Weights>> m_weights;
+};
+
+}  // namespace pisa
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace pisa {
+
+/// Order in which a `QueryScheduler` runs pending tasks.
+enum class SchedulingPolicy {
+    /// In the order they were submitted.
+    Fifo,
+    /// Shortest predicted job first: cheapest first, with aging to prevent starvation.
+    ShortestPredictedFirst,
+};
+
+/// Parses a scheduling policy from `fifo` or `spjf`.
+///
+/// \throws std::invalid_argument  if the name is unknown
+[[nodiscard]] auto parse_scheduling_policy(std::string const& name) -> SchedulingPolicy;
+
+/// Runs tasks, such as queries, on a fixed number of worker threads.
+///
+/// With the shortest-predicted-job-first policy, a pending task with a lower predicted cost
+/// runs first, but every microsecond it has waited counts as `aging` microseconds less of
+/// cost. A task submitted `w` microseconds after another thus runs first only if it is
+/// predicted to be cheaper by more than `aging * w`, and no task waits forever. With an aging
+/// of 0, expensive tasks may starve under load.
+class QueryScheduler {
+  public:
+    QueryScheduler(std::size_t threads, SchedulingPolicy policy, double aging = 1.0);
+    QueryScheduler(QueryScheduler const&) = delete;
+    QueryScheduler(QueryScheduler&&) = delete;
+    QueryScheduler& operator=(QueryScheduler const&) = delete;
+    QueryScheduler& operator=(QueryScheduler&&) = delete;
+
+    /// Finishes all pending tasks, and stops the workers.
+    ~QueryScheduler();
+
+    /// Queues `task`, which is predicted to take `cost` microseconds.
+    void submit(double cost, std::function<void()> task);
+
+    /// Queues the parts of a single job, such as the document ranges of a split query, which
+    /// is predicted to take `cost` microseconds in total. The parts run one after the other
+    /// unless workers are idle, since they all have the priority of the job.
+    void submit(double cost, std::vector<std::function<void()>> tasks);
+
+    /// Blocks until all submitted tasks have finished.
+    void wait();
+
+    [[nodiscard]] auto threads() const -> std::size_t { return m_workers.size(); }
+    [[nodiscard]] auto policy() const -> SchedulingPolicy { return m_policy; }
+
+  private:
+    struct Task {
+        double key;
+        std::uint64_t sequence;
+        std::function<void()> run;
+    };
+    struct Later {
+        [[nodiscard]] auto operator()(Task const& lhs, Task const& rhs) const -> bool
+        {
+            return std::tie(lhs.key, lhs.sequence) > std::tie(rhs.key, rhs.sequence);
+        }
+    };
+
+    [[nodiscard]] auto key(double cost) const -> double;
+    void work();
+
+    SchedulingPolicy m_policy;
+    double m_aging;
+    std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+    std::mutex m_mutex;
+    std::condition_variable m_task_available;
+    std::condition_variable m_idle;
+    std::priority_queue<Task, std::vector<Task>, Later> m_tasks;
+    std::uint64_t m_sequence = 0;
+    std::size_t m_running = 0;
+    bool m_stopping = false;
+    std::vector<std::thread> m_workers;
+};
+
+}  // namespace pisa
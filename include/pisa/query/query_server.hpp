@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace pisa {
+
+/// A request to the query server, sent as a JSON object on a single line, such as
+/// `{"id": 7, "session": "s1", "query": "new york", "k": 10, "page": 2}`.
+///
+/// All fields are optional: the server has a default `k` and algorithm, and a request for the
+/// second page of a session needs no query if the server retained it. Unknown fields are
+/// ignored.
+struct ServerRequest {
+    /// Any JSON string or number, returned as is in the response.
+    std::optional<std::string> id;
+    std::optional<std::string> session;
+    std::optional<std::string> query;
+    std::optional<std::size_t> k;
+    std::optional<std::string> algorithm;
+    /// Page of `k` results, starting from 1.
+    std::size_t page = 1;
+};
+
+/// Parses a request from a flat JSON object, whose values are strings, numbers, booleans, or
+/// null.
+///
+/// \throws std::invalid_argument  if the line is not such an object, or a field has the wrong
+///                                type
+[[nodiscard]] auto parse_request(std::string_view line) -> ServerRequest;
+
+/// A document in the results of a request.
+struct ServerResult {
+    std::string document;
+    float score;
+};
+
+/// Formats the response to `request` as a JSON object on a single line, without the newline.
+/// Results are ranked from `first_rank`, which is 0 on the first page. `from_session` tells
+/// whether they were retained from an earlier request, and `usecs` is the time taken.
+[[nodiscard]] auto format_response(
+    ServerRequest const& request,
+    std::size_t first_rank,
+    std::vector<ServerResult> const& results,
+    bool from_session,
+    double usecs) -> std::string;
+
+/// Formats an error response as a JSON object on a single line, without the newline.
+[[nodiscard]] auto format_error(std::optional<std::string> const& id, std::string_view message)
+    -> std::string;
+
+/// Results of the second page of a query, retained until its session asks for them.
+struct NextPage {
+    std::string query;
+    std::string algorithm;
+    std::size_t k = 0;
+    std::vector<std::pair<float, std::uint64_t>> results;
+};
+
+/// Next pages of the most recently active sessions. When full, the session that was used the
+/// longest time ago is dropped, and its next page is computed again if requested.
+///
+/// All member functions are thread-safe.
+class SessionStore {
+  public:
+    explicit SessionStore(std::size_t capacity);
+
+    /// Retains `page` for `session`, replacing any page it had.
+    void put(std::string const& session, NextPage page);
+
+    /// Returns the page retained for `session`, if any.
+    [[nodiscard]] auto get(std::string const& session) -> std::optional<NextPage>;
+
+    [[nodiscard]] auto size() const -> std::size_t;
+    [[nodiscard]] auto capacity() const -> std::size_t { return m_capacity; }
+
+  private:
+    using Entry = std::pair<std::string, NextPage>;
+
+    std::size_t m_capacity;
+    mutable std::mutex m_mutex;
+    /// Most recently used first.
+    std::list<Entry> m_entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_positions;
+};
+
+}  // namespace pisa
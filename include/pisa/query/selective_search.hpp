@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <gsl/span>
+
+#include "query/queries.hpp"
+#include "query/sharded_search.hpp"
+#include "type_safe.hpp"
+
+namespace pisa {
+
+/// Shards to search for each page of a query.
+struct ShardSelection {
+    /// Shards searched for the first page.
+    std::vector<Shard_Id> first_page{};
+    /// Additional shards searched only once the second page is requested.
+    std::vector<Shard_Id> second_page{};
+};
+
+/// Selects the shards whose estimated number of documents in the top `k` results is at least
+/// `cutoff` for the first page, and those whose estimate for the top `k + secondary_k` is at
+/// least `cutoff` for the second page, as estimated by, e.g., Taily.
+///
+/// At least the shard with the highest estimate is always selected for the first page.
+[[nodiscard]] inline auto select_shards(
+    gsl::span<double const> first_page_estimates,
+    gsl::span<double const> second_page_estimates,
+    double cutoff) -> ShardSelection
+{
+    if (first_page_estimates.size() != second_page_estimates.size()) {
+        throw std::invalid_argument("Estimates of both pages must be given for each shard");
+    }
+    ShardSelection selection;
+    if (first_page_estimates.empty()) {
+        return selection;
+    }
+    for (std::size_t shard = 0; shard < first_page_estimates.size(); ++shard) {
+        if (first_page_estimates[shard] >= cutoff) {
+            selection.first_page.emplace_back(shard);
+        } else if (second_page_estimates[shard] >= cutoff) {
+            selection.second_page.emplace_back(shard);
+        }
+    }
+    if (selection.first_page.empty()) {
+        auto best = Shard_Id(std::distance(
+            first_page_estimates.begin(),
+            std::max_element(first_page_estimates.begin(), first_page_estimates.end())));
+        selection.first_page.push_back(best);
+        auto pos =
+            std::find(selection.second_page.begin(), selection.second_page.end(), best);
+        if (pos != selection.second_page.end()) {
+            selection.second_page.erase(pos);
+        }
+    }
+    return selection;
+}
+
+/// Number of shards and postings visited by a selective query.
+struct SelectiveSearchCost {
+    std::size_t shards = 0;
+    std::size_t postings = 0;
+    std::size_t exhaustive_shards = 0;
+    std::size_t exhaustive_postings = 0;
+};
+
+/// A query executed only on selected shards, one page at a time.
+///
+/// The first page searches the first-page shards; per-shard results are kept to a depth that
+/// also covers the second page. When the second page is requested, only the additional shards
+/// are searched, with their shared threshold seeded from the results already retrieved, and
+/// the second page is drawn from all retrieved results except those shown on the first page.
+template <typename Searcher>
+class SelectiveQuery {
+  public:
+    SelectiveQuery(
+        Searcher const& searcher,
+        gsl::span<Query const> queries,
+        ShardSelection selection,
+        ShardedAlgorithm algorithm,
+        std::size_t k,
+        std::size_t secondary_k)
+        : m_searcher(searcher),
+          m_queries(queries),
+          m_selection(std::move(selection)),
+          m_algorithm(std::move(algorithm)),
+          m_k(k),
+          m_secondary_k(secondary_k),
+          m_results(searcher.shard_count())
+    {
+        m_cost.exhaustive_shards = searcher.shard_count();
+        for (std::size_t shard = 0; shard < searcher.shard_count(); ++shard) {
+            m_cost.exhaustive_postings += searcher.postings(Shard_Id(shard), queries[shard]);
+        }
+    }
+
+    /// Returns the first page, searching the first-page shards on the first call.
+    [[nodiscard]] auto first_page() -> std::vector<ShardedResult> const&
+    {
+        if (not m_first_page) {
+            search(m_selection.first_page, 0);
+            m_first_page = merge_shard_results(m_results, m_k, 0).first_page;
+        }
+        return *m_first_page;
+    }
+
+    /// Returns the second page, searching the additional second-page shards on the first call.
+    [[nodiscard]] auto second_page() -> std::vector<ShardedResult> const&
+    {
+        if (not m_second_page) {
+            auto const& first = first_page();
+            if (not m_selection.second_page.empty()) {
+                auto retrieved = all_results();
+                auto depth = Searcher::shared_depth(m_algorithm, m_k, m_secondary_k);
+                Threshold threshold = retrieved.size() >= depth ? retrieved[depth - 1].score : 0;
+                search(m_selection.second_page, threshold);
+            }
+            std::set<std::pair<Shard_Id, std::uint64_t>> shown;
+            for (auto const& result: first) {
+                shown.emplace(result.shard, result.docid);
+            }
+            m_second_page.emplace();
+            for (auto const& result: all_results()) {
+                if (m_second_page->size() == m_secondary_k) {
+                    break;
+                }
+                if (shown.find({result.shard, result.docid}) == shown.end()) {
+                    m_second_page->push_back(result);
+                }
+            }
+        }
+        return *m_second_page;
+    }
+
+    [[nodiscard]] auto cost() const -> SelectiveSearchCost const& { return m_cost; }
+
+  private:
+    void search(gsl::span<Shard_Id const> shards, Threshold threshold)
+    {
+        m_searcher.search_shards(
+            m_queries, shards, m_algorithm, m_k, m_secondary_k, threshold, m_results);
+        m_cost.shards += shards.size();
+        for (auto shard: shards) {
+            m_cost.postings += m_searcher.postings(shard, m_queries[shard.as_int()]);
+        }
+    }
+
+    /// All results retrieved so far, sorted by decreasing score.
+    [[nodiscard]] auto all_results() const -> std::vector<ShardedResult>
+    {
+        return merge_shard_results(m_results, 0, std::numeric_limits<std::size_t>::max())
+            .second_page;
+    }
+
+    Searcher const& m_searcher;
+    gsl::span<Query const> m_queries;
+    ShardSelection m_selection;
+    ShardedAlgorithm m_algorithm;
+    std::size_t m_k;
+    std::size_t m_secondary_k;
+    std::vector<ShardResults> m_results;
+    std::optional<std::vector<ShardedResult>> m_first_page{};
+    std::optional<std::vector<ShardedResult>> m_second_page{};
+    SelectiveSearchCost m_cost{};
+};
+
+}  // namespace pisa
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <fmt/format.h>
+#include <gsl/span>
+#include <tbb/parallel_for.h>
+
+#include "cursor/block_max_scored_cursor.hpp"
+#include "cursor/max_scored_cursor.hpp"
+#include "cursor/scored_cursor.hpp"
+#include "cyclic_queue.hpp"
+#include "memory_source.hpp"
+#include "query/algorithm.hpp"
+#include "query/queries.hpp"
+#include "scorer/scorer.hpp"
+#include "topk_queue.hpp"
+#include "type_safe.hpp"
+
+namespace pisa {
+
+/// Which next-page method (if any) is used to fill in the second page.
+enum class PageMethod { None, One, Two, Three };
+
+/// Query algorithm executed on each shard, parsed from names such as `wand` or
+/// `block_max_wand_method_2`.
+struct ShardedAlgorithm {
+    std::string name;
+    PageMethod method = PageMethod::None;
+
+    [[nodiscard]] static auto parse(std::string const& algorithm) -> ShardedAlgorithm
+    {
+        ShardedAlgorithm parsed{algorithm, PageMethod::None};
+        if (auto pos = algorithm.rfind("_method_"); pos != std::string::npos) {
+            auto method = algorithm.substr(pos + 8);
+            parsed.name = algorithm.substr(0, pos);
+            if (method == "1") {
+                parsed.method = PageMethod::One;
+            } else if (method == "2") {
+                parsed.method = PageMethod::Two;
+            } else if (method == "3") {
+                parsed.method = PageMethod::Three;
+            } else {
+                throw std::invalid_argument(fmt::format("Unknown method: {}", algorithm));
+            }
+            if (parsed.name != "wand" && parsed.name != "block_max_wand") {
+                throw std::invalid_argument(
+                    fmt::format("Next-page methods are only supported by WAND and BMW: {}", algorithm));
+            }
+            return parsed;
+        }
+        static std::vector<std::string> const algorithms{
+            "wand",
+            "block_max_wand",
+            "block_max_maxscore",
+            "maxscore",
+            "ranked_and",
+            "block_max_ranked_and",
+            "ranked_or"};
+        if (std::find(algorithms.begin(), algorithms.end(), algorithm) == algorithms.end()) {
+            throw std::invalid_argument(fmt::format("Unsupported query type: {}", algorithm));
+        }
+        return parsed;
+    }
+};
+
+/// A single result of a sharded query: `docid` is local to `shard`.
+struct ShardedResult {
+    float score;
+    Shard_Id shard;
+    std::uint64_t docid;
+
+    [[nodiscard]] auto operator==(ShardedResult const& other) const -> bool
+    {
+        return std::tie(score, shard, docid) == std::tie(other.score, other.shard, other.docid);
+    }
+};
+
+/// Results of a single shard: the primary heap and the secondary heap or cyclic queue.
+struct ShardResults {
+    std::vector<std::pair<float, std::uint64_t>> primary{};
+    std::vector<std::pair<float, std::uint64_t>> secondary{};
+};
+
+/// Global first and second page of a sharded query.
+struct ShardedPages {
+    std::vector<ShardedResult> first_page{};
+    std::vector<ShardedResult> second_page{};
+};
+
+/// Merges per-shard results into global pages.
+///
+/// The first page is the top `k` of all primary heaps. The second page is the top `secondary_k`
+/// of the remaining primary results together with all secondary results. Results with a zero
+/// score (empty slots of a cyclic queue) are skipped, and ties are broken by shard and docid.
+[[nodiscard]] inline auto
+merge_shard_results(gsl::span<ShardResults const> shards, std::size_t k, std::size_t secondary_k)
+    -> ShardedPages
+{
+    auto order = [](ShardedResult const& lhs, ShardedResult const& rhs) {
+        return std::make_tuple(-lhs.score, lhs.shard, lhs.docid)
+            < std::make_tuple(-rhs.score, rhs.shard, rhs.docid);
+    };
+    auto take = [&](std::vector<ShardedResult>& results, std::size_t count) {
+        auto size = std::min(results.size(), count);
+        std::partial_sort(results.begin(), results.begin() + size, results.end(), order);
+        std::vector<ShardedResult> rest(results.begin() + size, results.end());
+        results.resize(size);
+        return rest;
+    };
+
+    ShardedPages pages;
+    Shard_Id shard{0};
+    for (auto const& results: shards) {
+        for (auto [score, docid]: results.primary) {
+            if (score > 0) {
+                pages.first_page.push_back({score, shard, docid});
+            }
+        }
+        shard += 1;
+    }
+    pages.second_page = take(pages.first_page, k);
+    shard = Shard_Id{0};
+    for (auto const& results: shards) {
+        for (auto [score, docid]: results.secondary) {
+            if (score > 0) {
+                pages.second_page.push_back({score, shard, docid});
+            }
+        }
+        shard += 1;
+    }
+    take(pages.second_page, secondary_k);
+    return pages;
+}
+
+/// Creates the cursors of a query on `index`, as required by `paged_search`.
+template <typename Index, typename Wand>
+struct IndexCursors {
+    Index const& index;
+    Wand const& wdata;
+    index_scorer<Wand> const& scorer;
+
+    [[nodiscard]] auto scored(Query const& query) const
+    {
+        return make_scored_cursors(index, scorer, query);
+    }
+    [[nodiscard]] auto max_scored(Query const& query) const
+    {
+        return make_max_scored_cursors(index, wdata, scorer, query);
+    }
+    [[nodiscard]] auto block_max_scored(Query const& query) const
+    {
+        return make_block_max_scored_cursors(index, wdata, scorer, query);
+    }
+};
+
+/// Executes `query` with `algorithm`, retrieving the results of both pages.
+///
+/// `cursors` creates the cursors of the query with its `scored`, `max_scored`, and
+/// `block_max_scored` member functions. If `shared` is not null, the queue described in
+/// `ShardedSearcher` shares its threshold through it.
+template <typename Cursors>
+[[nodiscard]] auto paged_search(
+    Cursors const& cursors,
+    Query const& query,
+    std::uint64_t num_docs,
+    ShardedAlgorithm const& algorithm,
+    std::size_t k,
+    std::size_t secondary_k,
+    SharedThreshold* shared) -> ShardResults
+{
+    bool paged = algorithm.method != PageMethod::None;
+
+    topk_queue topk(paged ? k : k + secondary_k);
+    topk_queue secondary(paged ? secondary_k : 0);
+    cyclic_queue cyclic(paged ? secondary_k : 0);
+    if (algorithm.method == PageMethod::Three) {
+        secondary.share_threshold(shared);
+    } else {
+        topk.share_threshold(shared);
+    }
+
+    auto run = [&](auto&& query_algorithm, auto&& cursors) {
+        switch (algorithm.method) {
+        case PageMethod::None: query_algorithm(cursors, num_docs); break;
+        case PageMethod::One: query_algorithm.method_one(cursors, num_docs); break;
+        case PageMethod::Two: query_algorithm.method_two(cursors, num_docs); break;
+        case PageMethod::Three: query_algorithm.method_three(cursors, num_docs); break;
+        }
+    };
+    auto run_simple = [&](auto&& query_algorithm, auto&& cursors) {
+        query_algorithm(cursors, num_docs);
+    };
+
+    if (algorithm.name == "wand") {
+        run(wand_query(topk, secondary, cyclic), cursors.max_scored(query));
+    } else if (algorithm.name == "block_max_wand") {
+        run(block_max_wand_query(topk, secondary, cyclic), cursors.block_max_scored(query));
+    } else if (algorithm.name == "block_max_maxscore") {
+        run_simple(block_max_maxscore_query(topk), cursors.block_max_scored(query));
+    } else if (algorithm.name == "maxscore") {
+        run_simple(maxscore_query(topk), cursors.max_scored(query));
+    } else if (algorithm.name == "ranked_and") {
+        run_simple(ranked_and_query(topk), cursors.scored(query));
+    } else if (algorithm.name == "block_max_ranked_and") {
+        run_simple(block_max_ranked_and_query(topk), cursors.block_max_scored(query));
+    } else if (algorithm.name == "ranked_or") {
+        run_simple(ranked_or_query(topk), cursors.scored(query));
+    } else {
+        throw std::invalid_argument(fmt::format("Unsupported query type: {}", algorithm.name));
+    }
+
+    topk.finalize();
+    ShardResults results{topk.topk(), {}};
+    if (algorithm.method == PageMethod::One) {
+        cyclic.finalize();
+        results.secondary = cyclic.topk();
+    } else if (paged) {
+        secondary.finalize();
+        results.secondary = secondary.topk();
+    }
+    return results;
+}
+
+/// Executes queries on several shards in parallel and merges the results into two pages.
+///
+/// All shards of a query share one threshold, so that a high threshold reached on one shard
+/// prunes the others. Which queue shares it depends on the algorithm:
+///  - without a next-page method, each shard retrieves `k + secondary_k` results into its
+///    primary heap, which shares the threshold; both pages are exact;
+///  - methods 1 and 2 share the threshold of the primary heap of size `k`; the first page is
+///    exact and the second page has the guarantees of the method;
+///  - method 3 restarts from a position derived from its own thresholds, so only the secondary
+///    heap shares the threshold; both pages are exact.
+template <typename Index, typename Wand>
+class ShardedSearcher {
+  public:
+    ShardedSearcher(
+        std::vector<std::unique_ptr<Index>> indexes,
+        std::vector<std::unique_ptr<Wand>> wdata,
+        ScorerParams const& scorer_params)
+        : m_indexes(std::move(indexes)), m_wdata(std::move(wdata))
+    {
+        if (m_indexes.size() != m_wdata.size()) {
+            throw std::invalid_argument(fmt::format(
+                "Got {} indexes but {} wand data files", m_indexes.size(), m_wdata.size()));
+        }
+        for (auto const& wdata: m_wdata) {
+            m_scorers.push_back(scorer::from_params(scorer_params, *wdata));
+        }
+    }
+
+    /// Memory-maps the index and wand data of each shard.
+    [[nodiscard]] static auto open(
+        std::vector<std::string> const& index_paths,
+        std::vector<std::string> const& wand_paths,
+        ScorerParams const& scorer_params) -> ShardedSearcher
+    {
+        std::vector<std::unique_ptr<Index>> indexes;
+        std::vector<std::unique_ptr<Wand>> wdata;
+        for (auto const& path: index_paths) {
+            indexes.push_back(std::make_unique<Index>(MemorySource::mapped_file(path)));
+        }
+        for (auto const& path: wand_paths) {
+            wdata.push_back(std::make_unique<Wand>(MemorySource::mapped_file(path)));
+        }
+        return ShardedSearcher(std::move(indexes), std::move(wdata), scorer_params);
+    }
+
+    [[nodiscard]] auto shard_count() const -> std::size_t { return m_indexes.size(); }
+    [[nodiscard]] auto index(Shard_Id shard) const -> Index const&
+    {
+        return *m_indexes[shard.as_int()];
+    }
+
+    /// Executes `queries`, one per shard, as the same query resolved against shard lexicons.
+    ///
+    /// `threshold` must be a lower bound on the `k`-th global score; it is only used where
+    /// the shared queue holds `k` results, i.e., for methods 1 and 2, or when `secondary_k == 0`.
+    [[nodiscard]] auto search(
+        gsl::span<Query const> queries,
+        ShardedAlgorithm const& algorithm,
+        std::size_t k,
+        std::size_t secondary_k,
+        Threshold threshold = 0) const -> ShardedPages
+    {
+        bool seeded = shared_depth(algorithm, k, secondary_k) == k;
+        std::vector<ShardResults> results(shard_count());
+        std::vector<Shard_Id> shards;
+        for (std::size_t shard = 0; shard < shard_count(); ++shard) {
+            shards.emplace_back(shard);
+        }
+        search_shards(
+            queries, shards, algorithm, k, secondary_k, seeded ? threshold : 0, results);
+        return merge_shard_results(results, k, secondary_k);
+    }
+
+    /// Executes `queries` on the given subset of `shards` only, storing the results of each
+    /// searched shard in `results`, which must have one entry per shard.
+    ///
+    /// `threshold` seeds the threshold shared by the shards, and must be a lower bound on the
+    /// score of the last result of the shared queue; see `shared_depth`.
+    void search_shards(
+        gsl::span<Query const> queries,
+        gsl::span<Shard_Id const> shards,
+        ShardedAlgorithm const& algorithm,
+        std::size_t k,
+        std::size_t secondary_k,
+        Threshold threshold,
+        gsl::span<ShardResults> results) const
+    {
+        if (queries.size() != shard_count() || results.size() != shard_count()) {
+            throw std::invalid_argument(fmt::format(
+                "Expected {} shard queries and results but got {} and {}",
+                shard_count(),
+                queries.size(),
+                results.size()));
+        }
+        SharedThreshold shared(threshold);
+        auto count = static_cast<std::size_t>(shards.size());
+        tbb::parallel_for(std::size_t{0}, count, [&](std::size_t idx) {
+            auto shard = static_cast<std::size_t>(shards[idx].as_int());
+            results[shard] = search_shard(shard, queries[shard], algorithm, k, secondary_k, shared);
+        });
+    }
+
+    /// Number of results held by the queue that shares its threshold between shards.
+    [[nodiscard]] static auto
+    shared_depth(ShardedAlgorithm const& algorithm, std::size_t k, std::size_t secondary_k)
+        -> std::size_t
+    {
+        if (algorithm.method == PageMethod::One || algorithm.method == PageMethod::Two) {
+            return k;
+        }
+        return k + secondary_k;
+    }
+
+    /// Number of postings in the lists of the distinct terms of `query` in `shard`.
+    [[nodiscard]] auto postings(Shard_Id shard, Query const& query) const -> std::size_t
+    {
+        auto terms = query.terms;
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        auto const& index = *m_indexes[shard.as_int()];
+        std::size_t postings = 0;
+        for (auto term: terms) {
+            postings += index[term].size();
+        }
+        return postings;
+    }
+
+  private:
+    [[nodiscard]] auto search_shard(
+        std::size_t shard,
+        Query const& query,
+        ShardedAlgorithm const& algorithm,
+        std::size_t k,
+        std::size_t secondary_k,
+        SharedThreshold& shared) const -> ShardResults
+    {
+        IndexCursors<Index, Wand> cursors{*m_indexes[shard], *m_wdata[shard], *m_scorers[shard]};
+        return paged_search(
+            cursors, query, m_indexes[shard]->num_docs(), algorithm, k, secondary_k, &shared);
+    }
+
+    std::vector<std::unique_ptr<Index>> m_indexes;
+    std::vector<std::unique_ptr<Wand>> m_wdata;
+    std::vector<std::unique_ptr<index_scorer<Wand>>> m_scorers{};
+};
+
+}  // namespace pisa
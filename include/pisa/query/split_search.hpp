@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "query/queries.hpp"
+#include "query/sharded_search.hpp"
+#include "topk_queue.hpp"
+
+namespace pisa {
+
+/// Cursors positioned at the first document of a range, as required by `paged_search`.
+template <typename Cursors>
+struct RangeCursors {
+    Cursors const& cursors;
+    std::uint64_t begin;
+
+    [[nodiscard]] auto scored(Query const& query) const
+    {
+        return skip_to_begin(cursors.scored(query));
+    }
+    [[nodiscard]] auto max_scored(Query const& query) const
+    {
+        return skip_to_begin(cursors.max_scored(query));
+    }
+    [[nodiscard]] auto block_max_scored(Query const& query) const
+    {
+        return skip_to_begin(cursors.block_max_scored(query));
+    }
+
+  private:
+    template <typename CursorRange>
+    [[nodiscard]] auto skip_to_begin(CursorRange range) const
+    {
+        for (auto& cursor: range) {
+            cursor.next_geq(begin);
+        }
+        return range;
+    }
+};
+
+/// Splits documents `[0, num_docs)` into `parts` consecutive ranges of nearly equal size.
+[[nodiscard]] inline auto split_documents(std::uint64_t num_docs, std::size_t parts)
+    -> std::vector<std::pair<std::uint64_t, std::uint64_t>>
+{
+    // Every range holds at least one document, and there is at least one range.
+    parts = std::clamp<std::uint64_t>(parts, 1, std::max<std::uint64_t>(num_docs, 1));
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+    for (std::size_t part = 0; part < parts; ++part) {
+        ranges.emplace_back(num_docs * part / parts, num_docs * (part + 1) / parts);
+    }
+    return ranges;
+}
+
+/// Executes `query` with `algorithm` on documents `[begin, end)` only, and returns its top `k`
+/// results in these documents. Ranges of a split query share their threshold through `shared`
+/// if it is not null.
+///
+/// \throws std::invalid_argument  if `algorithm` uses a next-page method
+template <typename Cursors>
+[[nodiscard]] auto range_search(
+    Cursors const& cursors,
+    Query const& query,
+    std::uint64_t begin,
+    std::uint64_t end,
+    ShardedAlgorithm const& algorithm,
+    std::size_t k,
+    SharedThreshold* shared) -> std::vector<std::pair<float, std::uint64_t>>
+{
+    if (algorithm.method != PageMethod::None) {
+        throw std::invalid_argument("Next-page methods cannot be split into document ranges");
+    }
+    RangeCursors<Cursors> range_cursors{cursors, begin};
+    return paged_search(range_cursors, query, end, algorithm, k, 0, shared).primary;
+}
+
+/// Merges the top `k` results of disjoint document ranges into the top `k` of all.
+[[nodiscard]] inline auto merge_ranges(
+    std::vector<std::vector<std::pair<float, std::uint64_t>>> const& ranges, std::size_t k)
+    -> std::vector<std::pair<float, std::uint64_t>>
+{
+    std::vector<std::pair<float, std::uint64_t>> merged;
+    for (auto const& results: ranges) {
+        merged.insert(merged.end(), results.begin(), results.end());
+    }
+    auto size = std::min(k, merged.size());
+    std::partial_sort(
+        merged.begin(), merged.begin() + size, merged.end(), [](auto const& lhs, auto const& rhs) {
+            return std::make_pair(-lhs.first, lhs.second) < std::make_pair(-rhs.first, rhs.second);
+        });
+    merged.resize(size);
+    return merged;
+}
+
+}  // namespace pisa
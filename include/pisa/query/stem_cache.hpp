@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tbb/enumerable_thread_specific.h>
+
+namespace pisa {
+
+using Stemmer_t = std::function<std::string(std::string)>;
+
+/// Memoizes a stemmer in a fixed-size open-addressing table with linear probing.
+///
+/// Terms and stems are stored inline in the slots, so the cache does not allocate once
+/// constructed. Terms and stems longer than `max_term_length` are stemmed but not cached.
+/// If all slots within the probing window are occupied, the entry in the first slot is
+/// replaced, which bounds the memory without tracking recency.
+///
+/// A cache must not be shared between threads; see `ThreadLocalStemCache`.
+class StemCache {
+  public:
+    static constexpr std::size_t max_term_length = 30;
+    static constexpr std::size_t probe_window = 8;
+    static constexpr std::size_t default_capacity = 1U << 16U;
+
+    explicit StemCache(Stemmer_t stemmer, std::size_t capacity = default_capacity)
+        : m_stemmer(std::move(stemmer))
+    {
+        std::size_t slot_count = probe_window;
+        while (slot_count < capacity) {
+            slot_count *= 2;
+        }
+        m_slots.resize(slot_count);
+        m_mask = slot_count - 1;
+    }
+
+    /// Returns the stem of `term`, which is valid until the next call.
+    [[nodiscard]] auto stem(std::string_view term) -> std::string_view
+    {
+        if (term.size() > max_term_length) {
+            return stem_uncached(term);
+        }
+        auto hash = std::hash<std::string_view>{}(term);
+        auto home = hash & m_mask;
+        for (std::size_t probe = 0; probe < probe_window; ++probe) {
+            auto& slot = m_slots[(home + probe) & m_mask];
+            if (not slot.occupied) {
+                return insert(slot, hash, term);
+            }
+            if (slot.hash == hash && slot.term() == term) {
+                ++m_hits;
+                return slot.stem();
+            }
+        }
+        return insert(m_slots[home], hash, term);
+    }
+
+    /// Same as `stem`: the stem is valid until the next call.
+    auto operator()(std::string_view term) -> std::string_view { return stem(term); }
+
+    [[nodiscard]] auto hits() const -> std::size_t { return m_hits; }
+    [[nodiscard]] auto misses() const -> std::size_t { return m_misses; }
+
+  private:
+    struct Slot {
+        std::uint64_t hash = 0;
+        std::uint8_t term_length = 0;
+        std::uint8_t stem_length = 0;
+        bool occupied = false;
+        std::array<char, max_term_length> term_data{};
+        std::array<char, max_term_length> stem_data{};
+
+        [[nodiscard]] auto term() const -> std::string_view
+        {
+            return std::string_view(term_data.data(), term_length);
+        }
+        [[nodiscard]] auto stem() const -> std::string_view
+        {
+            return std::string_view(stem_data.data(), stem_length);
+        }
+    };
+
+    auto stem_uncached(std::string_view term) -> std::string_view
+    {
+        ++m_misses;
+        m_uncached = m_stemmer(std::string(term));
+        return m_uncached;
+    }
+
+    auto insert(Slot& slot, std::uint64_t hash, std::string_view term) -> std::string_view
+    {
+        auto stem = stem_uncached(term);
+        if (stem.size() > max_term_length) {
+            return stem;
+        }
+        slot.hash = hash;
+        slot.occupied = true;
+        slot.term_length = term.size();
+        slot.stem_length = stem.size();
+        std::copy(term.begin(), term.end(), slot.term_data.begin());
+        std::copy(stem.begin(), stem.end(), slot.stem_data.begin());
+        return slot.stem();
+    }
+
+    Stemmer_t m_stemmer;
+    std::vector<Slot> m_slots{};
+    std::size_t m_mask = 0;
+    std::string m_uncached{};
+    std::size_t m_hits = 0;
+    std::size_t m_misses = 0;
+};
+
+/// Gives each thread its own `StemCache`, each with its own stemmer from `make_stemmer`.
+class ThreadLocalStemCache {
+  public:
+    explicit ThreadLocalStemCache(
+        std::function<Stemmer_t()> make_stemmer, std::size_t capacity = StemCache::default_capacity)
+        : m_caches([make_stemmer = std::move(make_stemmer), capacity] {
+              return StemCache(make_stemmer(), capacity);
+          })
+    {}
+
+    /// Returns the cache of the calling thread.
+    [[nodiscard]] auto local() -> StemCache& { return m_caches.local(); }
+
+    /// Returns the stem of `term`, which is valid until the next call of the calling thread.
+    auto operator()(std::string_view term) -> std::string_view { return local()(term); }
+
+    /// Sums the hits of all threads; must not be called while other threads use the caches.
+    [[nodiscard]] auto hits() const -> std::size_t
+    {
+        std::size_t hits = 0;
+        for (auto const& cache: m_caches) {
+            hits += cache.hits();
+        }
+        return hits;
+    }
+
+    /// Sums the misses of all threads; must not be called while other threads use the caches.
+    [[nodiscard]] auto misses() const -> std::size_t
+    {
+        std::size_t misses = 0;
+        for (auto const& cache: m_caches) {
+            misses += cache.misses();
+        }
+        return misses;
+    }
+
+    [[nodiscard]] auto hit_rate() const -> double
+    {
+        auto lookups = hits() + misses();
+        return lookups > 0 ? static_cast<double>(hits()) / lookups : 0.0;
+    }
+
+  private:
+    tbb::enumerable_thread_specific<StemCache> m_caches;
+};
+
+}  // namespace pisa
@@ -1,17 +1,19 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <optional>
 #include <unordered_set>
 
+#include "hashed_lexicon.hpp"
 #include "io.hpp"
 #include "memory_source.hpp"
-#include "payload_vector.hpp"
+#include "query/stem_cache.hpp"
+#include "string_table.hpp"
 
 namespace pisa {
 
 using term_id_type = uint32_t;
-using Stemmer_t = std::function<std::string(std::string)>;
 
 auto term_processor_builder(std::optional<std::string> const& type) -> std::function<Stemmer_t()>;
 
@@ -22,6 +24,9 @@ class TermProcessor {
     // Method implemented in constructor according to the specified stemmer.
     std::function<std::optional<term_id_type>(std::string)> _to_id;
 
+    // Shared by copies of the processor; each thread uses its own cache.
+    std::shared_ptr<ThreadLocalStemCache> stem_cache;
+
   public:
     TermProcessor(
         std::optional<std::string> const& terms_file,
@@ -29,14 +34,26 @@ class TermProcessor {
         std::optional<std::string> const& stemmer_type)
     {
         auto source = std::make_shared<MemorySource>(MemorySource::mapped_file(*terms_file));
-        auto terms = Payload_Vector<>::from(*source);
-        auto to_id = [source = std::move(source), terms](auto str) -> std::optional<term_id_type> {
-            // Note: the lexicographical order of the terms matters.
-            return pisa::binary_search(terms.begin(), terms.end(), std::string_view(str));
-        };
+        std::function<std::optional<term_id_type>(std::string_view)> to_id;
+        if (HashedLexicon::is_hashed_lexicon(*source)) {
+            auto lexicon = HashedLexicon::from(*source);
+            to_id = [source, lexicon](auto str) -> std::optional<term_id_type> {
+                return lexicon.find(str);
+            };
+        } else {
+            auto terms = Lexicon::from(*source);
+            to_id = [source, terms](auto str) -> std::optional<term_id_type> {
+                // Note: the lexicographical order of the terms matters.
+                return terms.find(str);
+            };
+        }
+
+        stem_cache = std::make_shared<ThreadLocalStemCache>(term_processor_builder(stemmer_type));
 
         // Implements '_to_id' method.
-        _to_id = [=](auto str) { return to_id(term_processor_builder(stemmer_type)()(str)); };
+        _to_id = [=, stem_cache = stem_cache](auto str) {
+            return to_id(stem_cache->local().stem(str));
+        };
         // Loads stopwords.
         if (stopwords_filename) {
             std::ifstream is(*stopwords_filename);
@@ -50,6 +67,8 @@ class TermProcessor {
 
     std::optional<term_id_type> operator()(std::string token) { return _to_id(token); }
 
+    [[nodiscard]] auto stem_cache_hit_rate() const -> double { return stem_cache->hit_rate(); }
+
     bool is_stopword(const term_id_type term) { return stopwords.find(term) != stopwords.end(); }
 
     std::vector<term_id_type> get_stopwords()
@@ -11,7 +11,9 @@
 #include <spdlog/spdlog.h>
 
 #include "binary_freq_collection.hpp"
+#include "memory_source.hpp"
 #include "recursive_graph_bisection.hpp"
+#include "string_table.hpp"
 #include "util/index_build_utils.hpp"
 #include "util/inverted_index_utils.hpp"
 #include "util/progress.hpp"
@@ -72,6 +74,31 @@ namespace detail {
 
 }  // namespace detail
 
+/// Writes a copy of a document lexicon with documents at their new positions, keeping the format
+/// of the input lexicon.
+inline auto reorder_lexicon(
+    std::string const& input_lexicon,
+    std::string const& output_lexicon,
+    gsl::span<std::uint32_t const> mapping)
+{
+    auto source = MemorySource::mapped_file(input_lexicon);
+    auto documents = Lexicon::from(source);
+    std::vector<std::string> reordered_documents(documents.size());
+    pisa::progress doc_reorder("Reordering documents vector", documents.size());
+    std::size_t i = 0;
+    documents.for_each([&](auto document) {
+        reordered_documents[mapping[i++]] = document;
+        doc_reorder.update(1);
+    });
+    if (documents.is_string_table()) {
+        encode_string_table(reordered_documents.begin(), reordered_documents.end())
+            .to_file(output_lexicon);
+    } else {
+        encode_payload_vector(reordered_documents.begin(), reordered_documents.end())
+            .to_file(output_lexicon);
+    }
+}
+
 [[nodiscard]] auto recursive_graph_bisection(RecursiveGraphBisectionOptions const& options) -> int
 {
     if (not options.output_basename && not options.output_fwd) {
@@ -113,16 +140,7 @@ namespace detail {
         reorder_inverted_index(options.input_basename, *options.output_basename, mapping);
 
         if (options.document_lexicon) {
-            auto doc_buffer = Payload_Vector_Buffer::from_file(*options.document_lexicon);
-            auto documents = Payload_Vector<std::string>(doc_buffer);
-            std::vector<std::string> reordered_documents(documents.size());
-            pisa::progress doc_reorder("Reordering documents vector", documents.size());
-            for (size_t i = 0; i < documents.size(); ++i) {
-                reordered_documents[mapping[i]] = documents[i];
-                doc_reorder.update(1);
-            }
-            encode_payload_vector(reordered_documents.begin(), reordered_documents.end())
-                .to_file(*options.reordered_document_lexicon);
+            reorder_lexicon(*options.document_lexicon, *options.reordered_document_lexicon, mapping);
         }
     }
     return 0;
@@ -167,23 +185,6 @@ inline auto reorder_postings(
     }
 }
 
-inline auto reorder_lexicon(
-    std::string const& input_lexicon,
-    std::string const& output_lexicon,
-    gsl::span<std::uint32_t const> mapping)
-
-{
-    auto doc_buffer = Payload_Vector_Buffer::from_file(input_lexicon);
-    auto documents = Payload_Vector<std::string>(doc_buffer);
-    std::vector<std::string> reordered_documents(documents.size());
-    pisa::progress doc_reorder("Reordering documents vector", documents.size());
-    for (size_t i = 0; i < documents.size(); ++i) {
-        reordered_documents[mapping[i]] = documents[i];
-        doc_reorder.update(1);
-    }
-    encode_payload_vector(reordered_documents.begin(), reordered_documents.end()).to_file(output_lexicon);
-}
-
 inline auto reorder_sizes(
     binary_collection const& input_sizes,
     std::uint64_t num_docs,
@@ -0,0 +1,655 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+#include <gsl/span>
+#include <spdlog/spdlog.h>
+
+#include "binary_collection.hpp"
+#include "build_index.hpp"
+#include "cursor/block_max_scored_cursor.hpp"
+#include "cursor/max_scored_cursor.hpp"
+#include "cursor/multi_segment_cursor.hpp"
+#include "cursor/scored_cursor.hpp"
+#include "hashed_lexicon.hpp"
+#include "io.hpp"
+#include "memory_source.hpp"
+#include "merge_index.hpp"
+#include "payload_vector.hpp"
+#include "query/queries.hpp"
+#include "scorer/scorer.hpp"
+#include "string_table.hpp"
+
+namespace pisa {
+
+/// Name and number of documents of one segment, as listed in the manifest.
+struct SegmentInfo {
+    std::string name;
+    std::uint32_t num_docs;
+
+    [[nodiscard]] auto operator==(SegmentInfo const& other) const -> bool
+    {
+        return name == other.name && num_docs == other.num_docs;
+    }
+};
+
+/// Exclusive or shared lock on a segment directory, released when destroyed.
+class SegmentLock {
+  public:
+    SegmentLock(std::string const& path, bool exclusive)
+        : m_fd(::open(path.c_str(), O_RDWR | O_CREAT, 0644))
+    {
+        if (m_fd < 0 || ::flock(m_fd, exclusive ? LOCK_EX : LOCK_SH) != 0) {
+            if (m_fd >= 0) {
+                ::close(m_fd);
+            }
+            throw std::runtime_error(fmt::format("Failed to lock {}", path));
+        }
+    }
+    SegmentLock(SegmentLock const&) = delete;
+    SegmentLock(SegmentLock&&) = delete;
+    SegmentLock& operator=(SegmentLock const&) = delete;
+    SegmentLock& operator=(SegmentLock&&) = delete;
+    ~SegmentLock()
+    {
+        ::flock(m_fd, LOCK_UN);
+        ::close(m_fd);
+    }
+
+  private:
+    int m_fd;
+};
+
+/// Directory of an index built incrementally out of immutable segments.
+///
+/// The directory contains:
+///  - `terms`: all terms seen so far, one per line; the line number is the global term ID;
+///  - `terms.hashlex`: a hashed lexicon of `terms`, used to parse queries;
+///  - `manifest`: the live segments in document order, one `name<TAB>num_docs` per line;
+///  - for each segment, its index, wand data, document lexicon, and a term map, which
+///    lists the global ID of each of its terms.
+///
+/// Segments are never modified. Adding or merging segments writes new files first and then
+/// replaces the manifest atomically while holding an exclusive lock, so that readers holding
+/// a shared lock always see a consistent set of segments.
+class SegmentDirectory {
+  public:
+    explicit SegmentDirectory(std::string path) : m_path(std::move(path))
+    {
+        boost::filesystem::create_directories(m_path);
+    }
+
+    [[nodiscard]] auto path() const -> std::string const& { return m_path; }
+    [[nodiscard]] auto terms_path() const -> std::string { return file("terms"); }
+    [[nodiscard]] auto term_lexicon_path() const -> std::string { return file("terms.hashlex"); }
+    [[nodiscard]] auto manifest_path() const -> std::string { return file("manifest"); }
+    [[nodiscard]] auto index_path(std::string const& segment) const -> std::string
+    {
+        return file(segment + ".index");
+    }
+    [[nodiscard]] auto wand_path(std::string const& segment) const -> std::string
+    {
+        return file(segment + ".wand");
+    }
+    [[nodiscard]] auto term_map_path(std::string const& segment) const -> std::string
+    {
+        return file(segment + ".termmap");
+    }
+    [[nodiscard]] auto documents_path(std::string const& segment) const -> std::string
+    {
+        return file(segment + ".doclex");
+    }
+
+    [[nodiscard]] auto lock_exclusive() const -> std::unique_ptr<SegmentLock>
+    {
+        return std::make_unique<SegmentLock>(file("lock"), true);
+    }
+    [[nodiscard]] auto lock_shared() const -> std::unique_ptr<SegmentLock>
+    {
+        return std::make_unique<SegmentLock>(file("lock"), false);
+    }
+
+    /// Reads the live segments from the manifest.
+    [[nodiscard]] auto segments() const -> std::vector<SegmentInfo>
+    {
+        std::vector<SegmentInfo> segments;
+        std::ifstream is(manifest_path());
+        std::string name;
+        std::uint32_t num_docs = 0;
+        while (is >> name >> num_docs) {
+            segments.push_back(SegmentInfo{name, num_docs});
+        }
+        return segments;
+    }
+
+    /// Replaces the manifest. Must be called with an exclusive lock.
+    void write_segments(gsl::span<SegmentInfo const> segments) const
+    {
+        auto tmp = manifest_path() + ".tmp";
+        {
+            std::ofstream os(tmp);
+            for (auto const& segment: segments) {
+                os << segment.name << '\t' << segment.num_docs << '\n';
+            }
+        }
+        boost::filesystem::rename(tmp, manifest_path());
+    }
+
+    /// Reserves a new unique segment name. Must be called with an exclusive lock.
+    [[nodiscard]] auto next_segment_name() const -> std::string
+    {
+        std::uint64_t sequence = 0;
+        std::ifstream(file("sequence")) >> sequence;
+        std::ofstream(file("sequence")) << sequence + 1 << '\n';
+        return fmt::format("seg-{:06d}", sequence);
+    }
+
+    /// Reads all terms, in the order of their global IDs.
+    [[nodiscard]] auto terms() const -> std::vector<std::string>
+    {
+        std::ifstream is(terms_path());
+        return std::vector<std::string>(
+            std::istream_iterator<io::Line>(is), std::istream_iterator<io::Line>());
+    }
+
+    /// Assigns global IDs to `terms`, appending those not seen before to the term list and
+    /// rebuilding the term lexicon. Must be called with an exclusive lock.
+    [[nodiscard]] auto register_terms(gsl::span<std::string const> terms) const
+        -> std::vector<std::uint32_t>
+    {
+        auto global_terms = this->terms();
+        std::unordered_map<std::string, std::uint32_t> ids;
+        for (std::uint32_t term = 0; term < global_terms.size(); ++term) {
+            ids.emplace(global_terms[term], term);
+        }
+        std::vector<std::uint32_t> term_map;
+        std::ofstream os(terms_path(), std::ios::app);
+        for (auto const& term: terms) {
+            auto [pos, inserted] = ids.emplace(term, global_terms.size());
+            if (inserted) {
+                global_terms.push_back(term);
+                os << term << '\n';
+            }
+            term_map.push_back(pos->second);
+        }
+        os.close();
+        auto tmp = term_lexicon_path() + ".tmp";
+        HashedLexiconBuilder(global_terms).to_file(tmp);
+        boost::filesystem::rename(tmp, term_lexicon_path());
+        return term_map;
+    }
+
+    /// Removes all files of `segment`.
+    void remove_segment(std::string const& segment) const
+    {
+        for (auto const& path: {index_path(segment),
+                                wand_path(segment),
+                                term_map_path(segment),
+                                documents_path(segment)}) {
+            boost::filesystem::remove(path);
+        }
+    }
+
+  private:
+    [[nodiscard]] auto file(std::string const& name) const -> std::string
+    {
+        return (boost::filesystem::path(m_path) / name).string();
+    }
+
+    std::string m_path;
+};
+
+/// Writes the term map of a segment: the global ID of each of its terms.
+inline void write_term_map(std::string const& path, gsl::span<std::uint32_t const> term_map)
+{
+    std::ofstream os(path, std::ios::binary);
+    os.write(
+        reinterpret_cast<char const*>(term_map.data()), term_map.size() * sizeof(std::uint32_t));
+}
+
+[[nodiscard]] inline auto read_term_map(std::string const& path) -> std::vector<std::uint32_t>
+{
+    std::ifstream is(path, std::ios::binary | std::ios::ate);
+    std::vector<std::uint32_t> term_map(is.tellg() / sizeof(std::uint32_t));
+    is.seekg(0);
+    is.read(reinterpret_cast<char*>(term_map.data()), term_map.size() * sizeof(std::uint32_t));
+    return term_map;
+}
+
+/// An index made of segments, each with its own index, wand data, and scorer, searched as one
+/// index in which the documents of each segment follow those of the previous ones.
+///
+/// Cursors over all segments are created with `scored`, `max_scored`, and `block_max_scored`,
+/// which take queries resolved against the global term lexicon, so that the segmented index
+/// can be searched by any query algorithm with `paged_search`. Terms are scored with the
+/// statistics of the segment in which they occur.
+template <typename Index, typename Wand>
+class SegmentedIndex {
+  public:
+    struct Segment {
+        SegmentInfo info;
+        std::uint32_t offset;
+        std::unique_ptr<Index> index;
+        std::unique_ptr<Wand> wdata;
+        std::unique_ptr<index_scorer<Wand>> scorer;
+        /// Pairs of global and local term IDs, sorted by global ID.
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> terms;
+        MemorySource documents_source;
+        Lexicon documents;
+
+        [[nodiscard]] auto local_term(std::uint32_t term) const -> std::optional<std::uint32_t>
+        {
+            auto pos = std::lower_bound(
+                terms.begin(), terms.end(), std::make_pair(term, std::uint32_t{0}));
+            if (pos != terms.end() && pos->first == term) {
+                return pos->second;
+            }
+            return std::nullopt;
+        }
+    };
+
+    /// Memory-maps the live segments of `dir`.
+    [[nodiscard]] static auto open(SegmentDirectory const& dir, ScorerParams const& scorer_params)
+        -> SegmentedIndex
+    {
+        auto lock = dir.lock_shared();
+        SegmentedIndex segmented;
+        for (auto const& info: dir.segments()) {
+            auto wdata =
+                std::make_unique<Wand>(MemorySource::mapped_file(dir.wand_path(info.name)));
+            auto scorer = scorer::from_params(scorer_params, *wdata);
+            std::vector<std::pair<std::uint32_t, std::uint32_t>> terms;
+            auto term_map = read_term_map(dir.term_map_path(info.name));
+            for (std::uint32_t term = 0; term < term_map.size(); ++term) {
+                terms.emplace_back(term_map[term], term);
+            }
+            std::sort(terms.begin(), terms.end());
+            auto documents_source = MemorySource::mapped_file(dir.documents_path(info.name));
+            auto documents = Lexicon::from(documents_source.span());
+            segmented.m_segments.push_back(Segment{
+                info,
+                segmented.m_num_docs,
+                std::make_unique<Index>(MemorySource::mapped_file(dir.index_path(info.name))),
+                std::move(wdata),
+                std::move(scorer),
+                std::move(terms),
+                std::move(documents_source),
+                std::move(documents)});
+            segmented.m_num_docs += info.num_docs;
+        }
+        return segmented;
+    }
+
+    [[nodiscard]] auto num_docs() const -> std::uint32_t { return m_num_docs; }
+    [[nodiscard]] auto segments() const -> gsl::span<Segment const> { return m_segments; }
+
+    /// Returns the title of `docid`.
+    [[nodiscard]] auto document(std::uint32_t docid) const -> std::string
+    {
+        auto pos = std::upper_bound(
+            m_segments.begin(), m_segments.end(), docid, [](auto docid, auto const& segment) {
+                return docid < segment.offset;
+            });
+        auto const& segment = *std::prev(pos);
+        return segment.documents[docid - segment.offset];
+    }
+
+    [[nodiscard]] auto scored(Query const& query) const
+    {
+        return make_cursors(query, [](Segment const& segment, auto term, float weight) {
+            return ScoredCursor<typename Index::document_enumerator>(
+                (*segment.index)[term], segment.scorer->term_scorer(term), weight);
+        });
+    }
+
+    [[nodiscard]] auto max_scored(Query const& query) const
+    {
+        return make_cursors(query, [](Segment const& segment, auto term, float weight) {
+            return MaxScoredCursor<typename Index::document_enumerator>(
+                (*segment.index)[term],
+                segment.scorer->term_scorer(term),
+                weight,
+                weight * segment.wdata->max_term_weight(term));
+        });
+    }
+
+    [[nodiscard]] auto block_max_scored(Query const& query) const
+    {
+        return make_cursors(query, [](Segment const& segment, auto term, float weight) {
+            return BlockMaxScoredCursor<typename Index::document_enumerator, Wand>(
+                (*segment.index)[term],
+                segment.scorer->term_scorer(term),
+                weight,
+                weight * segment.wdata->max_term_weight(term),
+                segment.wdata->getenum(term));
+        });
+    }
+
+  private:
+    SegmentedIndex() = default;
+
+    template <typename MakeCursor>
+    [[nodiscard]] auto make_cursors(Query const& query, MakeCursor make_cursor) const
+    {
+        using cursor_type = decltype(make_cursor(m_segments.front(), std::uint32_t{}, float{}));
+        std::vector<MultiSegmentCursor<cursor_type>> cursors;
+        auto terms = query.terms;
+        for (auto [term, freq]: query_freqs(terms)) {
+            float weight = freq;
+            std::vector<cursor_type> segment_cursors;
+            std::vector<std::uint32_t> offsets;
+            std::vector<std::uint32_t> ends;
+            for (auto const& segment: m_segments) {
+                if (auto local = segment.local_term(term); local) {
+                    segment_cursors.push_back(make_cursor(segment, *local, weight));
+                    offsets.push_back(segment.offset);
+                    ends.push_back(segment.offset + segment.info.num_docs);
+                }
+            }
+            cursors.emplace_back(
+                std::move(segment_cursors),
+                std::move(offsets),
+                std::move(ends),
+                m_num_docs,
+                weight);
+        }
+        return cursors;
+    }
+
+    std::vector<Segment> m_segments{};
+    std::uint32_t m_num_docs = 0;
+};
+
+/// Builds a new segment out of a forward index produced by `parse_collection`, and appends it
+/// to the manifest of `dir`.
+///
+/// Terms are resolved against the global term list using `<input_basename>.terms`, and the
+/// document titles are read from `<input_basename>.documents`.
+template <typename Index, typename Wand>
+auto add_segment(
+    SegmentDirectory const& dir,
+    std::string const& input_basename,
+    std::string const& seq_type,
+    ScorerParams const& scorer_params,
+    BlockSize block_size,
+    std::size_t batch_size,
+    std::size_t threads) -> SegmentInfo
+{
+    std::ifstream terms_is(input_basename + ".terms");
+    std::vector<std::string> terms(
+        std::istream_iterator<io::Line>(terms_is), std::istream_iterator<io::Line>{});
+    binary_collection collection(input_basename.c_str());
+    SegmentInfo info{"", *collection.begin()->begin()};
+
+    std::vector<std::uint32_t> term_map;
+    {
+        auto lock = dir.lock_exclusive();
+        info.name = dir.next_segment_name();
+        term_map = dir.register_terms(terms);
+    }
+    spdlog::info("Building segment {} with {} documents", info.name, info.num_docs);
+    write_term_map(dir.term_map_path(info.name), term_map);
+    std::ifstream documents_is(input_basename + ".documents");
+    encode_payload_vector(
+        std::istream_iterator<io::Line>(documents_is), std::istream_iterator<io::Line>())
+        .to_file(dir.documents_path(info.name));
+    build_index<Index, Wand>(
+        input_basename,
+        dir.index_path(info.name),
+        dir.wand_path(info.name),
+        seq_type,
+        scorer_params,
+        block_size,
+        batch_size,
+        threads,
+        terms.size());
+
+    auto lock = dir.lock_exclusive();
+    auto segments = dir.segments();
+    segments.push_back(info);
+    dir.write_segments(segments);
+    return info;
+}
+
+/// Selects `merge_factor` adjacent segments to merge, as the half-open range of their
+/// positions, or returns `std::nullopt` if no merge is needed.
+///
+/// Segments with `n` documents belong to tier `floor(log(n) / log(merge_factor))`. The first
+/// `merge_factor` adjacent segments of the lowest tier that has that many are merged, so that
+/// each document is merged about `log(N) / log(merge_factor)` times as the index grows.
+[[nodiscard]] inline auto
+select_compaction(gsl::span<SegmentInfo const> segments, std::size_t merge_factor)
+    -> std::optional<std::pair<std::size_t, std::size_t>>
+{
+    if (merge_factor < 2) {
+        throw std::invalid_argument("Merge factor must be at least 2");
+    }
+    auto tier = [merge_factor](std::uint32_t num_docs) {
+        std::size_t tier = 0;
+        for (std::uint64_t size = merge_factor; size <= num_docs; size *= merge_factor) {
+            ++tier;
+        }
+        return tier;
+    };
+    std::optional<std::pair<std::size_t, std::size_t>> selected;
+    std::size_t selected_tier = 0;
+    auto count = static_cast<std::size_t>(segments.size());
+    for (std::size_t first = 0; first < count;) {
+        auto run_tier = tier(segments[first].num_docs);
+        auto last = first + 1;
+        while (last < count && tier(segments[last].num_docs) == run_tier) {
+            ++last;
+        }
+        if (last - first >= merge_factor && (not selected || run_tier < selected_tier)) {
+            selected = std::make_pair(first, first + merge_factor);
+            selected_tier = run_tier;
+        }
+        first = last;
+    }
+    return selected;
+}
+
+/// Merges `segments` of `dir`, which must be adjacent in the manifest, into a new segment
+/// `name` whose documents are those of `segments` in order.
+///
+/// Posting lists are merged by `merge_indexes`, with the terms of the new segment sorted by
+/// global ID. The manifest is not modified.
+template <typename Index, typename Wand>
+void merge_segments(
+    SegmentDirectory const& dir,
+    gsl::span<SegmentInfo const> segments,
+    std::string const& name,
+    std::string const& seq_type,
+    ScorerParams const& scorer_params,
+    BlockSize block_size)
+{
+    std::vector<std::unique_ptr<Index>> indexes;
+    std::vector<std::unique_ptr<Wand>> wdata;
+    std::vector<std::vector<std::uint32_t>> term_maps;
+    std::vector<std::string> titles;
+    for (auto const& segment: segments) {
+        indexes.push_back(
+            std::make_unique<Index>(MemorySource::mapped_file(dir.index_path(segment.name))));
+        wdata.push_back(
+            std::make_unique<Wand>(MemorySource::mapped_file(dir.wand_path(segment.name))));
+        term_maps.push_back(read_term_map(dir.term_map_path(segment.name)));
+        auto documents_source = MemorySource::mapped_file(dir.documents_path(segment.name));
+        Lexicon::from(documents_source.span()).for_each([&](auto title) {
+            titles.emplace_back(title);
+        });
+    }
+
+    // Local IDs of each global term in each merged segment, or -1 if it does not occur there.
+    std::vector<std::uint32_t> term_map;
+    for (auto const& segment_term_map: term_maps) {
+        term_map.insert(term_map.end(), segment_term_map.begin(), segment_term_map.end());
+    }
+    std::sort(term_map.begin(), term_map.end());
+    term_map.erase(std::unique(term_map.begin(), term_map.end()), term_map.end());
+    std::vector<std::vector<std::int64_t>> local_terms(
+        segments.size(), std::vector<std::int64_t>(term_map.size(), -1));
+    for (std::size_t seg = 0; seg < term_maps.size(); ++seg) {
+        for (std::uint32_t term = 0; term < term_maps[seg].size(); ++term) {
+            auto pos = std::lower_bound(term_map.begin(), term_map.end(), term_maps[seg][term]);
+            local_terms[seg][std::distance(term_map.begin(), pos)] = term;
+        }
+    }
+
+    spdlog::info("Merging {} segments into {}", segments.size(), name);
+    write_term_map(dir.term_map_path(name), term_map);
+    encode_payload_vector(gsl::span<std::string const>(titles)).to_file(dir.documents_path(name));
+    std::vector<Index const*> index_ptrs;
+    std::vector<Wand const*> wdata_ptrs;
+    for (std::size_t seg = 0; seg < segments.size(); ++seg) {
+        index_ptrs.push_back(indexes[seg].get());
+        wdata_ptrs.push_back(wdata[seg].get());
+    }
+    merge_indexes<Index, Wand>(
+        index_ptrs,
+        wdata_ptrs,
+        local_terms,
+        term_map.size(),
+        dir.index_path(name),
+        dir.wand_path(name),
+        seq_type,
+        scorer_params,
+        block_size);
+}
+
+/// Performs one compaction step on `dir`: merges the segments chosen by `select_compaction`,
+/// or all segments if `merge_factor` is `std::nullopt`. Returns `false` if there was nothing
+/// to merge.
+///
+/// The lock is only held to choose the segments and to install the merged segment, so that
+/// segments can be added and searched while merging.
+template <typename Index, typename Wand>
+auto compact_segments(
+    SegmentDirectory const& dir,
+    std::string const& seq_type,
+    ScorerParams const& scorer_params,
+    BlockSize block_size,
+    std::optional<std::size_t> merge_factor) -> bool
+{
+    std::vector<SegmentInfo> merged;
+    std::string name;
+    {
+        auto lock = dir.lock_exclusive();
+        auto segments = dir.segments();
+        std::optional<std::pair<std::size_t, std::size_t>> range;
+        if (merge_factor) {
+            range = select_compaction(segments, *merge_factor);
+        } else if (segments.size() > 1) {
+            range = std::make_pair(std::size_t{0}, segments.size());
+        }
+        if (not range) {
+            return false;
+        }
+        merged.assign(
+            std::next(segments.begin(), range->first), std::next(segments.begin(), range->second));
+        name = dir.next_segment_name();
+    }
+
+    try {
+        merge_segments<Index, Wand>(dir, merged, name, seq_type, scorer_params, block_size);
+    } catch (...) {
+        dir.remove_segment(name);
+        throw;
+    }
+
+    auto lock = dir.lock_exclusive();
+    auto segments = dir.segments();
+    auto first = std::search(segments.begin(), segments.end(), merged.begin(), merged.end());
+    if (first == segments.end()) {
+        dir.remove_segment(name);
+        throw std::runtime_error("Merged segments were modified during compaction");
+    }
+    std::uint32_t num_docs = 0;
+    for (auto const& segment: merged) {
+        num_docs += segment.num_docs;
+    }
+    *first = SegmentInfo{name, num_docs};
+    segments.erase(std::next(first), std::next(first, merged.size()));
+    dir.write_segments(segments);
+    for (auto const& segment: merged) {
+        dir.remove_segment(segment.name);
+    }
+    return true;
+}
+
+/// Calls `compact` in a background thread every `interval`, as long as it returns `true`,
+/// until destroyed. Errors are logged and do not stop the compaction.
+class BackgroundCompaction {
+  public:
+    BackgroundCompaction(std::function<bool()> compact, std::chrono::milliseconds interval)
+        : m_compact(std::move(compact)), m_interval(interval), m_thread([this] { run(); })
+    {}
+    BackgroundCompaction(BackgroundCompaction const&) = delete;
+    BackgroundCompaction(BackgroundCompaction&&) = delete;
+    BackgroundCompaction& operator=(BackgroundCompaction const&) = delete;
+    BackgroundCompaction& operator=(BackgroundCompaction&&) = delete;
+    ~BackgroundCompaction()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_stop.notify_all();
+        m_thread.join();
+    }
+
+  private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (not m_stopped) {
+            lock.unlock();
+            try {
+                while (m_compact()) {
+                    if (stopped()) {
+                        return;
+                    }
+                }
+            } catch (std::exception const& err) {
+                spdlog::error("Compaction failed: {}", err.what());
+            }
+            lock.lock();
+            m_stop.wait_for(lock, m_interval, [this] { return m_stopped; });
+        }
+    }
+
+    [[nodiscard]] auto stopped() -> bool
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stopped;
+    }
+
+    std::function<bool()> m_compact;
+    std::chrono::milliseconds m_interval;
+    std::mutex m_mutex{};
+    std::condition_variable m_stop{};
+    bool m_stopped = false;
+    std::thread m_thread;
+};
+
+}  // namespace pisa
@@ -0,0 +1,530 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <fmt/format.h>
+#include <gsl/span>
+
+#include "payload_vector.hpp"
+
+namespace pisa {
+
+namespace string_table {
+
+    /// Bytes `PISASTBL` read as a little-endian integer.
+    constexpr std::uint64_t magic = 0x4c42545341534950;
+    constexpr std::uint64_t version = 1;
+
+    /// Number of consecutive strings sharing a restart point.
+    constexpr std::uint64_t default_block_size = 16;
+
+    struct Header {
+        std::uint64_t magic;
+        std::uint64_t version;
+        std::uint64_t size;
+        std::uint64_t block_size;
+        /// 1 if the strings are unique and lexicographically sorted, 0 otherwise.
+        std::uint64_t sorted;
+        std::uint64_t data_bytes;
+    };
+
+    [[nodiscard]] constexpr auto padded(std::size_t bytes) -> std::size_t
+    {
+        return (bytes + 7) & ~std::size_t{7};
+    }
+
+    inline void write_varint(std::uint32_t value, std::vector<std::byte>& out)
+    {
+        while (value >= 128) {
+            out.push_back(static_cast<std::byte>((value & 127) | 128));
+            value >>= 7;
+        }
+        out.push_back(static_cast<std::byte>(value));
+    }
+
+    [[nodiscard]] inline auto read_varint(std::byte const*& in) -> std::uint32_t
+    {
+        std::uint32_t value = 0;
+        for (unsigned int shift = 0;; shift += 7) {
+            auto byte = std::to_integer<std::uint32_t>(*in++);
+            value |= (byte & 127) << shift;
+            if (byte < 128) {
+                return value;
+            }
+        }
+    }
+
+    /// Decodes the first string of a block, which is stored in full.
+    inline void read_head(std::byte const*& ptr, std::string& value)
+    {
+        auto length = read_varint(ptr);
+        value.assign(reinterpret_cast<char const*>(ptr), length);
+        ptr += length;
+    }
+
+    /// Decodes a string following `value` in a block, replacing it.
+    inline void read_next(std::byte const*& ptr, std::string& value)
+    {
+        auto shared = read_varint(ptr);
+        auto length = read_varint(ptr);
+        value.resize(shared);
+        value.append(reinterpret_cast<char const*>(ptr), length);
+        ptr += length;
+    }
+
+}  // namespace string_table
+
+/// Encodes a string table one string at a time.
+///
+/// Only the encoded bytes are kept in memory, so a table of tens of millions of document titles
+/// can be built from a stream without materializing the strings.
+class StringTableBuilder {
+  public:
+    explicit StringTableBuilder(std::uint64_t block_size = string_table::default_block_size)
+        : m_block_size(block_size)
+    {
+        if (block_size == 0) {
+            throw std::invalid_argument("String table block size must be positive");
+        }
+    }
+
+    void push_back(std::string_view value)
+    {
+        if (value.size() > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::invalid_argument("String too long for a string table");
+        }
+        std::size_t shared = 0;
+        if (m_size % m_block_size == 0) {
+            m_offsets.push_back(m_data.size());
+        } else {
+            auto limit = std::min(value.size(), m_previous.size());
+            while (shared < limit && value[shared] == m_previous[shared]) {
+                ++shared;
+            }
+            string_table::write_varint(static_cast<std::uint32_t>(shared), m_data);
+        }
+        if (m_size > 0 && value <= m_previous) {
+            m_sorted = false;
+        }
+        string_table::write_varint(static_cast<std::uint32_t>(value.size() - shared), m_data);
+        std::transform(value.begin() + shared, value.end(), std::back_inserter(m_data), [](char ch) {
+            return static_cast<std::byte>(ch);
+        });
+        m_previous.assign(value);
+        ++m_size;
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t { return m_size; }
+
+    /// Whether all strings added so far are unique and lexicographically sorted.
+    [[nodiscard]] auto sorted() const -> bool { return m_sorted; }
+
+    /// Number of bytes written by `to_stream`.
+    [[nodiscard]] auto bytes() const -> std::size_t
+    {
+        return sizeof(string_table::Header) + (m_offsets.size() + 1) * sizeof(std::uint64_t)
+            + string_table::padded(m_data.size());
+    }
+
+    void to_stream(std::ostream& os) const
+    {
+        string_table::Header header{
+            string_table::magic,
+            string_table::version,
+            m_size,
+            m_block_size,
+            m_sorted ? 1U : 0U,
+            m_data.size()};
+        os.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        os.write(
+            reinterpret_cast<char const*>(m_offsets.data()), m_offsets.size() * sizeof(std::uint64_t));
+        std::uint64_t end = m_data.size();
+        os.write(reinterpret_cast<char const*>(&end), sizeof(end));
+        os.write(reinterpret_cast<char const*>(m_data.data()), m_data.size());
+        std::array<char, 8> padding{};
+        os.write(padding.data(), string_table::padded(m_data.size()) - m_data.size());
+    }
+
+    void to_file(std::string const& filename) const
+    {
+        std::ofstream os(filename, std::ios::binary);
+        to_stream(os);
+    }
+
+  private:
+    std::uint64_t m_block_size;
+    std::size_t m_size = 0;
+    bool m_sorted = true;
+    std::string m_previous{};
+    std::vector<std::uint64_t> m_offsets{};
+    std::vector<std::byte> m_data{};
+};
+
+template <typename InputIterator>
+auto encode_string_table(
+    InputIterator first,
+    InputIterator last,
+    std::uint64_t block_size = string_table::default_block_size) -> StringTableBuilder
+{
+    StringTableBuilder builder(block_size);
+    for (; first != last; ++first) {
+        builder.push_back(*first);
+    }
+    return builder;
+}
+
+/// Read-only table of strings, front-coded in blocks.
+///
+/// Strings are grouped into blocks of a fixed size. The first string of a block is a restart
+/// point stored in full, and each following string is stored as the length of the prefix it
+/// shares with its predecessor and the remaining suffix. Only one offset per block is stored,
+/// so accessing a string decodes at most one block, and iterating decodes each string once.
+///
+/// Sequences with long common prefixes, such as sorted terms, or document titles and URLs in
+/// crawl order, take a fraction of the space of a `Payload_Vector`. If the strings are sorted,
+/// the table also supports binary search and prefix queries.
+class StringTable {
+  public:
+    using size_type = std::size_t;
+
+    /// Forward iterator decoding strings sequentially.
+    class Iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::string const*;
+        using reference = std::string const&;
+
+        Iterator(StringTable const* table, size_type pos) : m_table(table), m_pos(pos)
+        {
+            if (m_pos < m_table->size()) {
+                m_ptr = m_table->block_data(m_pos / m_table->m_block_size);
+                string_table::read_head(m_ptr, m_value);
+                for (auto idx = m_pos - m_pos % m_table->m_block_size; idx < m_pos; ++idx) {
+                    string_table::read_next(m_ptr, m_value);
+                }
+            }
+        }
+
+        [[nodiscard]] auto operator*() const -> reference { return m_value; }
+        [[nodiscard]] auto operator->() const -> pointer { return &m_value; }
+
+        auto operator++() -> Iterator&
+        {
+            ++m_pos;
+            if (m_pos < m_table->size()) {
+                if (m_pos % m_table->m_block_size == 0) {
+                    string_table::read_head(m_ptr, m_value);
+                } else {
+                    string_table::read_next(m_ptr, m_value);
+                }
+            }
+            return *this;
+        }
+
+        [[nodiscard]] auto operator++(int) -> Iterator
+        {
+            auto copy = *this;
+            ++(*this);
+            return copy;
+        }
+
+        [[nodiscard]] auto index() const -> size_type { return m_pos; }
+
+        [[nodiscard]] auto operator==(Iterator const& other) const -> bool
+        {
+            return m_pos == other.m_pos;
+        }
+        [[nodiscard]] auto operator!=(Iterator const& other) const -> bool
+        {
+            return m_pos != other.m_pos;
+        }
+
+      private:
+        StringTable const* m_table;
+        size_type m_pos;
+        std::byte const* m_ptr = nullptr;
+        std::string m_value{};
+    };
+
+    template <typename ContiguousContainer>
+    [[nodiscard]] static auto from(ContiguousContainer&& mem) -> StringTable
+    {
+        return from(gsl::make_span(reinterpret_cast<std::byte const*>(mem.data()), mem.size()));
+    }
+
+    [[nodiscard]] static auto from(gsl::span<std::byte const> mem) -> StringTable
+    {
+        if (not is_string_table(mem)) {
+            throw std::runtime_error("Not a string table: invalid header");
+        }
+        string_table::Header header;
+        std::memcpy(&header, mem.data(), sizeof(header));
+        if (header.version != string_table::version) {
+            throw std::runtime_error(fmt::format(
+                "Unsupported string table version {} (expected {})",
+                header.version,
+                string_table::version));
+        }
+        if (header.block_size == 0) {
+            throw std::runtime_error("String table has block size 0");
+        }
+        auto block_count = (header.size + header.block_size - 1) / header.block_size;
+        auto [offsets, tail] =
+            split(mem.subspan(sizeof(header)), (block_count + 1) * sizeof(std::uint64_t));
+        auto [data, rest] = split(tail, string_table::padded(header.data_bytes));
+        return StringTable(header, cast_span<std::uint64_t>(offsets), data.first(header.data_bytes));
+    }
+
+    template <typename ContiguousContainer>
+    [[nodiscard]] static auto is_string_table(ContiguousContainer&& mem) -> bool
+    {
+        return is_string_table(
+            gsl::make_span(reinterpret_cast<std::byte const*>(mem.data()), mem.size()));
+    }
+
+    /// Checks whether the memory starts with a string table header.
+    [[nodiscard]] static auto is_string_table(gsl::span<std::byte const> mem) -> bool
+    {
+        std::uint64_t magic = 0;
+        if (mem.size() < sizeof(string_table::Header)) {
+            return false;
+        }
+        std::memcpy(&magic, mem.data(), sizeof(magic));
+        return magic == string_table::magic;
+    }
+
+    [[nodiscard]] auto size() const -> size_type { return m_size; }
+    [[nodiscard]] auto empty() const -> bool { return m_size == 0; }
+    [[nodiscard]] auto sorted() const -> bool { return m_sorted; }
+
+    /// Returns the string at `idx`.
+    ///
+    /// A restart point is viewed in place in the table memory. Any other string is decoded into
+    /// `buffer`, and the view is valid until the buffer is modified; reusing the buffer across
+    /// lookups avoids allocating once it has grown to the longest string.
+    [[nodiscard]] auto lookup(size_type idx, std::string& buffer) const -> std::string_view
+    {
+        if (idx >= m_size) {
+            throw std::out_of_range(
+                fmt::format("Index {} too large for string table of size {}", idx, m_size));
+        }
+        auto const* ptr = block_data(idx / m_block_size);
+        auto offset = idx % m_block_size;
+        if (offset == 0) {
+            auto length = string_table::read_varint(ptr);
+            return std::string_view(reinterpret_cast<char const*>(ptr), length);
+        }
+        string_table::read_head(ptr, buffer);
+        for (size_type pos = 0; pos < offset; ++pos) {
+            string_table::read_next(ptr, buffer);
+        }
+        return buffer;
+    }
+
+    /// Returns a copy of the string at `idx`; see `lookup` to avoid allocating.
+    [[nodiscard]] auto operator[](size_type idx) const -> std::string
+    {
+        std::string buffer;
+        return std::string(lookup(idx, buffer));
+    }
+
+    [[nodiscard]] auto begin() const -> Iterator { return Iterator(this, 0); }
+    [[nodiscard]] auto end() const -> Iterator { return Iterator(this, m_size); }
+
+    /// Returns the index of the first string that is not less than `value`.
+    ///
+    /// Requires the table to be sorted.
+    [[nodiscard]] auto lower_bound(std::string_view value) const -> size_type
+    {
+        require_sorted();
+        std::string head;
+        // Find the first block whose restart point is not less than the value.
+        size_type first = 0;
+        size_type count = m_offsets.size() - 1;
+        while (count > 0) {
+            auto step = count / 2;
+            auto const* ptr = block_data(first + step);
+            string_table::read_head(ptr, head);
+            if (head < value) {
+                first += step + 1;
+                count -= step + 1;
+            } else {
+                count = step;
+            }
+        }
+        if (first == 0) {
+            return 0;
+        }
+        // The value belongs to the preceding block, or is the restart point of the next one.
+        auto pos = (first - 1) * m_block_size;
+        auto block_end = std::min(pos + m_block_size, m_size);
+        auto const* ptr = block_data(first - 1);
+        std::string current;
+        string_table::read_head(ptr, current);
+        for (++pos; pos < block_end; ++pos) {
+            string_table::read_next(ptr, current);
+            if (current >= value) {
+                break;
+            }
+        }
+        return pos;
+    }
+
+    /// Returns the index of `value`, or `std::nullopt` if it is not in the table.
+    ///
+    /// Requires the table to be sorted.
+    [[nodiscard]] auto find(std::string_view value) const -> std::optional<size_type>
+    {
+        auto pos = lower_bound(value);
+        std::string buffer;
+        if (pos < m_size && lookup(pos, buffer) == value) {
+            return pos;
+        }
+        return std::nullopt;
+    }
+
+    /// Returns the half-open range of indices of the strings starting with `prefix`.
+    ///
+    /// Requires the table to be sorted.
+    [[nodiscard]] auto prefix(std::string_view prefix) const -> std::pair<size_type, size_type>
+    {
+        auto first = lower_bound(prefix);
+        std::string successor(prefix);
+        while (not successor.empty() && static_cast<unsigned char>(successor.back()) == 255) {
+            successor.pop_back();
+        }
+        if (successor.empty()) {
+            return {first, m_size};
+        }
+        successor.back() = static_cast<char>(static_cast<unsigned char>(successor.back()) + 1);
+        return {first, lower_bound(successor)};
+    }
+
+  private:
+    StringTable(
+        string_table::Header const& header,
+        gsl::span<std::uint64_t const> offsets,
+        gsl::span<std::byte const> data)
+        : m_size(header.size),
+          m_block_size(header.block_size),
+          m_sorted(header.sorted != 0U),
+          m_offsets(offsets),
+          m_data(data)
+    {}
+
+    void require_sorted() const
+    {
+        if (not m_sorted) {
+            throw std::logic_error("Binary search requires a sorted string table");
+        }
+    }
+
+    [[nodiscard]] auto block_data(size_type block) const -> std::byte const*
+    {
+        return m_data.data() + m_offsets[block];
+    }
+
+    size_type m_size;
+    size_type m_block_size;
+    bool m_sorted;
+    gsl::span<std::uint64_t const> m_offsets;
+    gsl::span<std::byte const> m_data;
+};
+
+/// Strings accessed by their position, stored either as a `StringTable` or a `Payload_Vector`.
+///
+/// The format is detected from the header, so document and term lexicons can be used
+/// interchangeably in either format.
+class Lexicon {
+  public:
+    template <typename ContiguousContainer>
+    [[nodiscard]] static auto from(ContiguousContainer&& mem) -> Lexicon
+    {
+        return from(gsl::make_span(reinterpret_cast<std::byte const*>(mem.data()), mem.size()));
+    }
+
+    [[nodiscard]] static auto from(gsl::span<std::byte const> mem) -> Lexicon
+    {
+        if (StringTable::is_string_table(mem)) {
+            return Lexicon(StringTable::from(mem));
+        }
+        return Lexicon(Payload_Vector<>::from(mem));
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t
+    {
+        return std::visit([](auto const& strings) -> std::size_t { return strings.size(); }, m_strings);
+    }
+
+    /// Returns the string at `idx`, viewed in place in a `Payload_Vector`. A `StringTable` may
+    /// decode it into `buffer`, in which case the view is valid until the buffer is modified.
+    [[nodiscard]] auto lookup(std::size_t idx, std::string& buffer) const -> std::string_view
+    {
+        if (auto const* table = std::get_if<StringTable>(&m_strings); table != nullptr) {
+            return table->lookup(idx, buffer);
+        }
+        return std::get<Payload_Vector<>>(m_strings)[idx];
+    }
+
+    /// Returns a copy of the string at `idx`; see `lookup` to avoid allocating.
+    [[nodiscard]] auto operator[](std::size_t idx) const -> std::string
+    {
+        std::string buffer;
+        return std::string(lookup(idx, buffer));
+    }
+
+    /// Returns the position of `value`, assuming the strings are sorted.
+    [[nodiscard]] auto find(std::string_view value) const -> std::optional<std::size_t>
+    {
+        if (auto const* table = std::get_if<StringTable>(&m_strings); table != nullptr) {
+            return table->find(value);
+        }
+        auto const& strings = std::get<Payload_Vector<>>(m_strings);
+        if (auto pos = pisa::binary_search(strings.begin(), strings.end(), value); pos) {
+            return static_cast<std::size_t>(*pos);
+        }
+        return std::nullopt;
+    }
+
+    /// Calls `fn` with each string in order.
+    template <typename Fn>
+    void for_each(Fn&& fn) const
+    {
+        std::visit(
+            [&](auto const& strings) {
+                for (auto const& value: strings) {
+                    fn(std::string_view(value));
+                }
+            },
+            m_strings);
+    }
+
+    [[nodiscard]] auto is_string_table() const -> bool
+    {
+        return std::holds_alternative<StringTable>(m_strings);
+    }
+
+  private:
+    template <typename Strings>
+    explicit Lexicon(Strings strings) : m_strings(std::move(strings))
+    {}
+
+    std::variant<Payload_Vector<>, StringTable> m_strings;
+};
+
+}  // namespace pisa
@@ -121,6 +121,25 @@ void write_feature_stats(
     }
 }
 
+/// Returns the number of documents of each shard estimated to be in the top `k` results of
+/// a query, given the query resolved against the global and the shard term lexicons.
+[[nodiscard]] inline auto taily_shard_estimates(
+    TailyStats const& global_stats,
+    gsl::span<TailyStats const> shard_stats,
+    ::pisa::Query const& global_query,
+    gsl::span<::pisa::Query const> shard_queries,
+    std::size_t k) -> std::vector<double>
+{
+    std::vector<taily::Query_Statistics> shards;
+    std::transform(
+        shard_stats.begin(),
+        shard_stats.end(),
+        shard_queries.begin(),
+        std::back_inserter(shards),
+        [](auto&& shard, auto&& query) { return shard.query_stats(query); });
+    return taily::score_shards(global_stats.query_stats(global_query), shards, k);
+}
+
 /// For each query, call `func` with a vector of shard scores.
 template <typename Fn>
 void taily_score_shards(
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "mappable/mappable_vector.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+
+namespace pisa {
+
+/// Physical order of the per-term lists of an index or WAND data file.
+///
+/// Lists are normally stored in term order. A file rewritten with a different order, e.g.,
+/// with frequently accessed lists first, stores the position of the list of each term after
+/// the structure itself, so that files without a layout are still read as before. An empty
+/// layout is the identity.
+class TermLayout {
+  public:
+    TermLayout() = default;
+
+    /// Layout that stores the list of term `order[pos]` at position `pos`.
+    ///
+    /// \throws std::invalid_argument  if `order` is not a permutation of term IDs
+    explicit TermLayout(std::vector<std::uint32_t> const& order)
+    {
+        std::vector<std::uint32_t> positions(order.size(), UINT32_MAX);
+        for (std::uint32_t pos = 0; pos < order.size(); ++pos) {
+            if (order[pos] >= order.size() || positions[order[pos]] != UINT32_MAX) {
+                throw std::invalid_argument(
+                    fmt::format("List order is not a permutation at position {}", pos));
+            }
+            positions[order[pos]] = pos;
+        }
+        m_positions.steal(positions);
+    }
+
+    [[nodiscard]] auto empty() const -> bool { return m_positions.size() == 0; }
+
+    void swap(TermLayout& other) { m_positions.swap(other.m_positions); }
+
+    /// Position of the list of `term` in the file.
+    [[nodiscard]] auto position(std::uint64_t term) const -> std::uint64_t
+    {
+        return m_positions.size() == 0 ? term : m_positions[term];
+    }
+
+    /// Maps the layout stored after the first `offset` bytes of `source`, if there is one.
+    void map_trailer(MemorySource const& source, std::size_t offset)
+    {
+        if (offset < source.size()) {
+            mapper::map(*this, source.data() + offset, source.map_flags());
+        }
+    }
+
+    template <typename Visitor>
+    void map(Visitor& visit)
+    {
+        visit(m_positions, "m_positions");
+    }
+
+  private:
+    mapper::mappable_vector<std::uint32_t> m_positions;
+};
+
+/// Writes `structure` to `file`, followed by `layout` unless it is empty.
+template <typename T>
+void freeze_with_layout(T& structure, TermLayout& layout, std::string const& file)
+{
+    std::ofstream os(file, std::ios::binary);
+    mapper::freeze(structure, os);
+    if (not layout.empty()) {
+        mapper::freeze(layout, os);
+    }
+}
+
+}  // namespace pisa
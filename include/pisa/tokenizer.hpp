@@ -2,9 +2,14 @@
 
 #include <algorithm>
 #include <cctype>
+#include <iterator>
 #include <string>
 #include <string_view>
 
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
 #include <boost/config/warning_disable.hpp>
 #include <boost/iterator/filter_iterator.hpp>
 #include <boost/iterator/transform_iterator.hpp>
@@ -81,4 +86,179 @@ class TermTokenizer {
     std::string_view::const_iterator last_;
 };
 
+namespace tokenizer {
+
+    [[nodiscard]] inline auto is_alpha(char ch) -> bool
+    {
+        auto lower = static_cast<unsigned char>(ch) | 0x20U;
+        return lower >= 'a' && lower <= 'z';
+    }
+
+    [[nodiscard]] inline auto is_alnum(char ch) -> bool
+    {
+        return is_alpha(ch) || (ch >= '0' && ch <= '9');
+    }
+
+    /// Returns the first position in `[first, last)` at which `is_alnum` equals `Alnum`.
+    ///
+    /// With SSE2, 16 characters are classified at a time; the remaining tail is scanned
+    /// one character at a time.
+    template <bool Alnum>
+    [[nodiscard]] auto find_class(char const* first, char const* last) -> char const*
+    {
+#if defined(__SSE2__)
+        // Bytes over 127 are negative in signed comparisons, so they are never alphanumeric.
+        auto const before_zero = _mm_set1_epi8('0' - 1);
+        auto const after_nine = _mm_set1_epi8('9' + 1);
+        auto const before_a = _mm_set1_epi8('a' - 1);
+        auto const after_z = _mm_set1_epi8('z' + 1);
+        auto const lowercase = _mm_set1_epi8(0x20);
+        while (last - first >= 16) {
+            auto chars = _mm_loadu_si128(reinterpret_cast<__m128i const*>(first));
+            auto digit = _mm_and_si128(
+                _mm_cmpgt_epi8(chars, before_zero), _mm_cmplt_epi8(chars, after_nine));
+            auto lower = _mm_or_si128(chars, lowercase);
+            auto alpha =
+                _mm_and_si128(_mm_cmpgt_epi8(lower, before_a), _mm_cmplt_epi8(lower, after_z));
+            auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(digit, alpha)));
+            if constexpr (not Alnum) {
+                mask = ~mask & 0xFFFFU;
+            }
+            if (mask != 0U) {
+                return first + __builtin_ctz(mask);
+            }
+            first += 16;
+        }
+#endif
+        return std::find_if(first, last, [](char ch) { return is_alnum(ch) == Alnum; });
+    }
+
+    struct Token {
+        TokenType type;
+        char const* first;
+        char const* last;
+    };
+
+    /// Finds the next valid token in `[first, last)`, following the rules of `tokens`:
+    /// the longest match wins, and characters not matched by any valid token are skipped.
+    /// If there are no more tokens, returns a `NotValid` token at `last`.
+    [[nodiscard]] inline auto next_token(char const* first, char const* last) -> Token
+    {
+        first = find_class<true>(first, last);
+        if (first == last) {
+            return {TokenType::NotValid, last, last};
+        }
+        auto run_end = find_class<false>(first, last);
+        if (run_end != last && *run_end == '.' && std::all_of(first, run_end, is_alpha)) {
+            auto end = std::next(run_end);
+            int groups = 1;
+            while (end != last && is_alpha(*end)) {
+                auto group_end = std::find_if_not(end, last, is_alpha);
+                if (group_end == last || *group_end != '.') {
+                    break;
+                }
+                end = std::next(group_end);
+                ++groups;
+            }
+            if (groups >= 2) {
+                return {TokenType::Abbreviature, first, end};
+            }
+        } else if (
+            run_end != last && *run_end == '\'' && std::next(run_end) != last
+            && is_alpha(*std::next(run_end))) {
+            auto end = std::find_if_not(std::next(run_end), last, is_alpha);
+            return {TokenType::Possessive, first, end};
+        }
+        return {TokenType::Term, first, run_end};
+    }
+
+}  // namespace tokenizer
+
+/// Produces the same terms as `TermTokenizer`, but scans character classes directly
+/// instead of running a lexer, and yields views instead of allocating strings.
+///
+/// Terms are views into the tokenized text, except for abbreviations, which are stripped of
+/// their dots into a buffer owned by the tokenizer. Therefore, a term is only valid until the
+/// iterator is incremented.
+class FastTermTokenizer {
+  public:
+    class iterator {
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::string_view const*;
+        using reference = std::string_view const&;
+
+        iterator() = default;
+        explicit iterator(FastTermTokenizer* tokenizer) : m_tokenizer(tokenizer) { ++*this; }
+
+        [[nodiscard]] auto operator*() const -> reference { return m_term; }
+        [[nodiscard]] auto operator->() const -> pointer { return &m_term; }
+
+        auto operator++() -> iterator&
+        {
+            if (not m_tokenizer->next(m_term)) {
+                m_tokenizer = nullptr;
+            }
+            return *this;
+        }
+
+        [[nodiscard]] auto operator==(iterator const& other) const -> bool
+        {
+            return m_tokenizer == other.m_tokenizer;
+        }
+        [[nodiscard]] auto operator!=(iterator const& other) const -> bool
+        {
+            return m_tokenizer != other.m_tokenizer;
+        }
+
+      private:
+        FastTermTokenizer* m_tokenizer = nullptr;
+        std::string_view m_term{};
+    };
+
+    explicit FastTermTokenizer(std::string_view text)
+        : m_text(text), m_pos(m_text.data()), m_last(m_text.data() + m_text.size())
+    {}
+
+    [[nodiscard]] auto begin() -> iterator
+    {
+        m_pos = m_text.data();
+        return iterator(this);
+    }
+
+    [[nodiscard]] auto end() -> iterator { return iterator(); }
+
+  private:
+    auto next(std::string_view& term) -> bool
+    {
+        auto token = tokenizer::next_token(m_pos, m_last);
+        m_pos = token.last;
+        switch (token.type) {
+        case TokenType::NotValid: return false;
+        case TokenType::Abbreviature:
+            m_buffer.clear();
+            std::copy_if(token.first, token.last, std::back_inserter(m_buffer), [](char ch) {
+                return ch != '.';
+            });
+            term = m_buffer;
+            return true;
+        case TokenType::Possessive: {
+            auto apostrophe = std::find(token.first, token.last, '\'');
+            term = std::string_view(token.first, std::distance(token.first, apostrophe));
+            return true;
+        }
+        default:
+            term = std::string_view(token.first, std::distance(token.first, token.last));
+            return true;
+        }
+    }
+
+    std::string_view m_text;
+    char const* m_pos;
+    char const* m_last;
+    std::string m_buffer{};
+};
+
 }  // namespace pisa
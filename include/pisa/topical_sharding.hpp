@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+#include <gsl/span>
+#include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+
+#include "binary_collection.hpp"
+#include "type_safe.hpp"
+#include "vec_map.hpp"
+
+namespace pisa {
+
+/// Sparse document vector: pairs of feature IDs and weights, sorted by feature ID.
+using SparseVector = std::vector<std::pair<std::uint32_t, float>>;
+
+/// Terms of a forward index used as features for clustering documents, with their IDF.
+class ClusteringFeatures {
+  public:
+    /// Selects at most `max_features` terms of `collection` with the highest document
+    /// frequency, skipping those that occur in more than a `max_df` fraction of documents.
+    [[nodiscard]] static auto
+    from_collection(binary_collection const& collection, std::size_t max_features, double max_df)
+        -> ClusteringFeatures
+    {
+        std::vector<std::uint32_t> document_frequencies;
+        std::vector<std::uint32_t> terms;
+        std::size_t document_count = 0;
+        for (auto it = ++collection.begin(); it != collection.end(); ++it) {
+            terms.assign(it->begin(), it->end());
+            std::sort(terms.begin(), terms.end());
+            terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+            if (not terms.empty() && terms.back() >= document_frequencies.size()) {
+                document_frequencies.resize(terms.back() + 1, 0);
+            }
+            for (auto term: terms) {
+                document_frequencies[term] += 1;
+            }
+            document_count += 1;
+        }
+
+        std::vector<std::uint32_t> candidates;
+        for (std::uint32_t term = 0; term < document_frequencies.size(); ++term) {
+            auto df = document_frequencies[term];
+            if (df > 0 && df <= max_df * document_count) {
+                candidates.push_back(term);
+            }
+        }
+        auto selected = std::min(max_features, candidates.size());
+        std::partial_sort(
+            candidates.begin(),
+            std::next(candidates.begin(), selected),
+            candidates.end(),
+            [&](auto lhs, auto rhs) {
+                return std::make_pair(document_frequencies[lhs], rhs)
+                    > std::make_pair(document_frequencies[rhs], lhs);
+            });
+        candidates.resize(selected);
+        std::sort(candidates.begin(), candidates.end());
+
+        ClusteringFeatures features;
+        features.m_features.resize(document_frequencies.size(), -1);
+        for (auto term: candidates) {
+            features.m_features[term] = features.m_idf.size();
+            features.m_idf.push_back(
+                std::log(static_cast<float>(document_count) / document_frequencies[term]));
+        }
+        return features;
+    }
+
+    /// Number of selected features.
+    [[nodiscard]] auto size() const -> std::size_t { return m_idf.size(); }
+
+    /// Returns the L2-normalized TF-IDF vector of `document` over the selected features.
+    template <typename Sequence>
+    [[nodiscard]] auto vectorize(Sequence const& document) const -> SparseVector
+    {
+        std::vector<std::uint32_t> features;
+        for (auto term: document) {
+            if (term < m_features.size() && m_features[term] >= 0) {
+                features.push_back(m_features[term]);
+            }
+        }
+        std::sort(features.begin(), features.end());
+        SparseVector vector;
+        for (auto first = features.begin(); first != features.end();) {
+            auto last = std::upper_bound(first, features.end(), *first);
+            auto tf = static_cast<float>(std::distance(first, last));
+            vector.emplace_back(*first, (1.0F + std::log(tf)) * m_idf[*first]);
+            first = last;
+        }
+        auto norm = std::sqrt(std::accumulate(
+            vector.begin(), vector.end(), 0.0F, [](float sum, auto const& entry) {
+                return sum + entry.second * entry.second;
+            }));
+        if (norm > 0) {
+            for (auto& entry: vector) {
+                entry.second /= norm;
+            }
+        }
+        return vector;
+    }
+
+  private:
+    std::vector<std::int32_t> m_features{};
+    std::vector<float> m_idf{};
+};
+
+/// Centroids of document clusters, each defining one topical shard.
+class TopicCentroids {
+  public:
+    TopicCentroids(std::size_t count, std::size_t dimensions)
+        : m_count(count), m_dimensions(dimensions), m_weights(count * dimensions, 0.0F)
+    {}
+
+    /// Clusters `sample` into `count` clusters with spherical k-means, running at most
+    /// `iterations` iterations, and returns their centroids.
+    [[nodiscard]] static auto fit(
+        gsl::span<SparseVector const> sample,
+        std::size_t count,
+        std::size_t dimensions,
+        std::size_t iterations,
+        std::uint64_t seed) -> TopicCentroids
+    {
+        auto sample_size = static_cast<std::size_t>(sample.size());
+        if (count == 0 || count > sample_size) {
+            throw std::invalid_argument(fmt::format(
+                "Cannot create {} clusters from a sample of {} documents", count, sample_size));
+        }
+        std::mt19937_64 rng(seed);
+        TopicCentroids centroids(count, dimensions);
+        centroids.seed(sample, rng);
+
+        std::vector<std::size_t> assignments(sample_size, count);
+        for (std::size_t iteration = 0; iteration < iterations; ++iteration) {
+            std::vector<std::uint8_t> changed(sample_size, 0);
+            tbb::parallel_for(std::size_t{0}, sample_size, [&](std::size_t doc) {
+                auto cluster = static_cast<std::size_t>(centroids.nearest(sample[doc]).as_int());
+                changed[doc] = static_cast<std::uint8_t>(cluster != assignments[doc]);
+                assignments[doc] = cluster;
+            });
+            auto moved = std::count(changed.begin(), changed.end(), 1);
+            spdlog::info("Iteration {}: {} documents moved", iteration + 1, moved);
+            if (moved == 0) {
+                break;
+            }
+            centroids.recompute(sample, assignments, rng);
+        }
+        return centroids;
+    }
+
+    /// Number of centroids.
+    [[nodiscard]] auto size() const -> std::size_t { return m_count; }
+
+    /// Returns the shard of the centroid most similar to `document`, or the first one if
+    /// `document` has no features.
+    [[nodiscard]] auto nearest(SparseVector const& document) const -> Shard_Id
+    {
+        std::size_t best = 0;
+        float best_similarity = -1.0F;
+        for (std::size_t cluster = 0; cluster < m_count; ++cluster) {
+            if (auto sim = similarity(cluster, document); sim > best_similarity) {
+                best = cluster;
+                best_similarity = sim;
+            }
+        }
+        return Shard_Id(best);
+    }
+
+  private:
+    [[nodiscard]] auto similarity(std::size_t cluster, SparseVector const& document) const
+        -> float
+    {
+        auto const* centroid = &m_weights[cluster * m_dimensions];
+        float similarity = 0.0F;
+        for (auto [feature, weight]: document) {
+            similarity += centroid[feature] * weight;
+        }
+        return similarity;
+    }
+
+    void set(std::size_t cluster, SparseVector const& vector)
+    {
+        auto* centroid = &m_weights[cluster * m_dimensions];
+        std::fill(centroid, centroid + m_dimensions, 0.0F);
+        for (auto [feature, weight]: vector) {
+            centroid[feature] = weight;
+        }
+    }
+
+    /// Chooses the initial centroids among `sample` with k-means++: each next centroid is
+    /// drawn with probability proportional to its squared distance to the closest centroid.
+    void seed(gsl::span<SparseVector const> sample, std::mt19937_64& rng)
+    {
+        auto sample_size = static_cast<std::size_t>(sample.size());
+        std::uniform_int_distribution<std::size_t> random_document(0, sample_size - 1);
+        std::vector<double> distances(sample_size, std::numeric_limits<double>::max());
+        auto next = random_document(rng);
+        for (std::size_t cluster = 0; cluster < m_count; ++cluster) {
+            set(cluster, sample[next]);
+            tbb::parallel_for(std::size_t{0}, sample_size, [&](std::size_t doc) {
+                // Squared Euclidean distance between unit vectors.
+                double distance = 2.0 - 2.0 * similarity(cluster, sample[doc]);
+                distances[doc] = std::min(distances[doc], std::max(distance, 0.0));
+            });
+            distances[next] = 0.0;
+            if (std::all_of(distances.begin(), distances.end(), [](double d) { return d <= 0; })) {
+                next = random_document(rng);
+            } else {
+                std::discrete_distribution<std::size_t> weighted(
+                    distances.begin(), distances.end());
+                next = weighted(rng);
+            }
+        }
+    }
+
+    /// Recomputes each centroid as the normalized sum of its members. A cluster left empty is
+    /// reseeded with a random document.
+    void recompute(
+        gsl::span<SparseVector const> sample,
+        std::vector<std::size_t> const& assignments,
+        std::mt19937_64& rng)
+    {
+        std::vector<std::vector<std::size_t>> members(m_count);
+        for (std::size_t doc = 0; doc < assignments.size(); ++doc) {
+            members[assignments[doc]].push_back(doc);
+        }
+        std::uniform_int_distribution<std::size_t> random_document(0, assignments.size() - 1);
+        for (auto& cluster_members: members) {
+            if (cluster_members.empty()) {
+                cluster_members.push_back(random_document(rng));
+            }
+        }
+        tbb::parallel_for(std::size_t{0}, m_count, [&](std::size_t cluster) {
+            auto* centroid = &m_weights[cluster * m_dimensions];
+            std::fill(centroid, centroid + m_dimensions, 0.0F);
+            for (auto doc: members[cluster]) {
+                for (auto [feature, weight]: sample[doc]) {
+                    centroid[feature] += weight;
+                }
+            }
+            float norm = std::sqrt(std::inner_product(
+                centroid, centroid + m_dimensions, centroid, 0.0F));
+            if (norm > 0) {
+                std::transform(centroid, centroid + m_dimensions, centroid, [norm](float weight) {
+                    return weight / norm;
+                });
+            }
+        });
+    }
+
+    std::size_t m_count;
+    std::size_t m_dimensions;
+    std::vector<float> m_weights;
+};
+
+/// Returns the vectors of `sample_size` documents of `collection` sampled uniformly at random,
+/// or of all documents if there are fewer.
+[[nodiscard]] inline auto sample_documents(
+    binary_collection const& collection,
+    ClusteringFeatures const& features,
+    std::size_t sample_size,
+    std::uint64_t seed) -> std::vector<SparseVector>
+{
+    std::mt19937_64 rng(seed);
+    std::vector<binary_collection::const_sequence> documents;
+    std::sample(
+        ++collection.begin(), collection.end(), std::back_inserter(documents), sample_size, rng);
+    std::vector<SparseVector> sample(documents.size());
+    tbb::parallel_for(std::size_t{0}, documents.size(), [&](std::size_t doc) {
+        sample[doc] = features.vectorize(documents[doc]);
+    });
+    return sample;
+}
+
+/// Assigns each document of `collection` to the shard of its nearest centroid.
+///
+/// Documents are read in batches of `batch_size` assigned in parallel, and `consume` is called
+/// with the shards of each batch in document order, so that memory usage does not depend on
+/// the size of the collection. Documents without any feature are spread across shards in a
+/// round-robin fashion.
+template <typename Fn>
+void assign_to_topics(
+    binary_collection const& collection,
+    ClusteringFeatures const& features,
+    TopicCentroids const& centroids,
+    std::size_t batch_size,
+    Fn consume)
+{
+    std::vector<binary_collection::const_sequence> batch;
+    std::vector<Shard_Id> shards;
+    std::size_t first_document = 0;
+    auto assign = [&] {
+        shards.resize(batch.size());
+        tbb::parallel_for(std::size_t{0}, batch.size(), [&](std::size_t pos) {
+            auto vector = features.vectorize(batch[pos]);
+            shards[pos] = vector.empty() ? Shard_Id((first_document + pos) % centroids.size())
+                                         : centroids.nearest(vector);
+        });
+        consume(gsl::span<Shard_Id const>(shards));
+        first_document += batch.size();
+        batch.clear();
+    };
+    for (auto it = ++collection.begin(); it != collection.end(); ++it) {
+        batch.push_back(*it);
+        if (batch.size() == batch_size) {
+            assign();
+        }
+    }
+    if (not batch.empty()) {
+        assign();
+    }
+}
+
+/// Returns the topical shard of each document of `collection`.
+[[nodiscard]] inline auto topical_mapping(
+    binary_collection const& collection,
+    ClusteringFeatures const& features,
+    TopicCentroids const& centroids,
+    std::size_t batch_size) -> VecMap<Document_Id, Shard_Id>
+{
+    VecMap<Document_Id, Shard_Id> mapping;
+    assign_to_topics(collection, features, centroids, batch_size, [&](auto shards) {
+        for (auto shard: shards) {
+            mapping.push_back(shard);
+        }
+    });
+    return mapping;
+}
+
+}  // namespace pisa
@@ -3,14 +3,48 @@
 #include "util/likely.hpp"
 #include "util/util.hpp"
 #include <algorithm>
+#include <atomic>
 
 namespace pisa {
 
 using Threshold = float;
+
+/// A threshold shared by several queues processing the same query, e.g., on different shards.
+///
+/// A queue that shares the threshold publishes its own threshold whenever it is full, and rejects
+/// any score that would not exceed the highest threshold published so far by any of the queues.
+/// The queue reads the shared threshold only when its own threshold changes, so scores are still
+/// checked against a single value.
+class SharedThreshold {
+  public:
+    explicit SharedThreshold(Threshold initial = 0) : m_threshold(initial) {}
+
+    [[nodiscard]] auto get() const noexcept -> Threshold
+    {
+        return m_threshold.load(std::memory_order_relaxed);
+    }
+
+    /// Raises the threshold to `threshold` unless it is already at least as high.
+    void raise(Threshold threshold) noexcept
+    {
+        auto current = m_threshold.load(std::memory_order_relaxed);
+        while (current < threshold
+               && not m_threshold.compare_exchange_weak(
+                   current, threshold, std::memory_order_relaxed)) {
+        }
+    }
+
+  private:
+    std::atomic<Threshold> m_threshold;
+};
+
 struct topk_queue {
     using entry_type = std::pair<float, uint64_t>;
 
-    explicit topk_queue(uint64_t k) : m_threshold(0), m_k(k) { m_q.reserve(m_k + 1); }
+    explicit topk_queue(uint64_t k) : m_threshold(0), m_effective_threshold(0), m_k(k)
+    {
+        m_q.reserve(m_k + 1);
+    }
     topk_queue(topk_queue const&) = default;
     topk_queue(topk_queue&&) noexcept = default;
     topk_queue& operator=(topk_queue const&) = default;
@@ -34,12 +68,12 @@ struct topk_queue {
         if (PISA_UNLIKELY(m_q.size() <= m_k)) {
             std::push_heap(m_q.begin(), m_q.end(), min_heap_order);
             if (PISA_UNLIKELY(m_q.size() == m_k)) {
-                m_threshold = m_q.front().first;
+                update_threshold();
             }
         } else {
             std::pop_heap(m_q.begin(), m_q.end(), min_heap_order);
             m_q.pop_back();
-            m_threshold = m_q.front().first;
+            update_threshold();
         }
         return true;
     }
@@ -54,7 +88,7 @@ struct topk_queue {
         if (PISA_UNLIKELY(m_q.size() <= m_k)) {
             std::push_heap(m_q.begin(), m_q.end(), min_heap_order);
             if (PISA_UNLIKELY(m_q.size() == m_k)) {
-                m_threshold = m_q.front().first;
+                update_threshold();
             }
         } else {
             std::pop_heap(m_q.begin(), m_q.end(), min_heap_order);
@@ -62,13 +96,13 @@ struct topk_queue {
             ejected_score = ejected.first;
             ejected_docid = ejected.second;
             m_q.pop_back();
-            m_threshold = m_q.front().first;
+            update_threshold();
         }
         return true;
     }
 
 
-    bool would_enter(float score) const { return score > m_threshold; }
+    bool would_enter(float score) const { return score > m_effective_threshold; }
 
     void finalize()
     {
@@ -84,14 +118,26 @@ struct topk_queue {
 
     [[nodiscard]] std::vector<entry_type> const& topk() const noexcept { return m_q; }
 
-    void set_threshold(Threshold t) noexcept { m_threshold = t; }
+    void set_threshold(Threshold t) noexcept
+    {
+        m_threshold = t;
+        sync_shared_threshold();
+    }
 
     Threshold threshold() const noexcept { return m_threshold; }
 
+    /// Shares the threshold with other queues; `shared` must outlive the processing.
+    void share_threshold(SharedThreshold* shared) noexcept
+    {
+        m_shared = shared;
+        sync_shared_threshold();
+    }
+
     void clear() noexcept
     {
         m_q.clear();
         m_threshold = 0;
+        sync_shared_threshold();
     }
 
     [[nodiscard]] size_t capacity() const noexcept { return m_k; }
@@ -99,9 +145,30 @@ struct topk_queue {
     [[nodiscard]] size_t size() const noexcept { return m_q.size(); }
 
   private:
+    void update_threshold()
+    {
+        m_threshold = m_q.front().first;
+        if (m_shared != nullptr) {
+            m_shared->raise(m_threshold);
+        }
+        sync_shared_threshold();
+    }
+
+    /// Recomputes the threshold that scores must exceed from the local and shared thresholds.
+    void sync_shared_threshold() noexcept
+    {
+        m_effective_threshold = m_threshold;
+        if (m_shared != nullptr) {
+            m_effective_threshold = std::max(m_effective_threshold, m_shared->get());
+        }
+    }
+
     float m_threshold;
+    /// The greater of `m_threshold` and the shared threshold when it was last read.
+    float m_effective_threshold;
     uint64_t m_k;
     std::vector<entry_type> m_q;
+    SharedThreshold* m_shared = nullptr;
 };
 
 }  // namespace pisa
@@ -5,13 +5,17 @@
 #include <unordered_set>
 
 #include "boost/variant.hpp"
+#include "gsl/span"
 #include "spdlog/spdlog.h"
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
 
 #include "binary_collection.hpp"
 #include "binary_freq_collection.hpp"
 #include "mappable/mappable_vector.hpp"
 #include "mappable/mapper.hpp"
 #include "memory_source.hpp"
+#include "term_layout.hpp"
 #include "util/progress.hpp"
 #include "util/util.hpp"
 #include "wand_data_compressed.hpp"
@@ -29,10 +33,116 @@ class wand_data {
   public:
     using wand_data_enumerator = typename block_wand_type::enumerator;
 
+    /// Limits on the number of lists scored concurrently during construction. The scored
+    /// lists are appended to the builder in term order before the next batch is read,
+    /// which bounds the memory held by intermediate block-max scores.
+    static constexpr size_t max_batch_terms = 16'384;
+    static constexpr size_t max_batch_postings = 1U << 24U;
+
+    /// Builds wand data from posting lists passed in batches, in term order.
+    ///
+    /// Term statistics are computed by the same worker that scores the term, which lets
+    /// us read each posting list only once. The scorer reads them through the wand data,
+    /// so the vectors are moved into place up front, and each worker writes only its own slots.
+    class builder {
+      public:
+        builder(
+            wand_data& wdata,
+            std::vector<uint32_t> doc_lens,
+            size_t num_terms,
+            const ScorerParams& scorer_params,
+            BlockSize block_size,
+            bool is_quantized)
+            : m_wdata(wdata),
+              m_block_size(block_size),
+              m_is_quantized(is_quantized),
+              m_block_builder(doc_lens.size(), m_params)
+        {
+            m_wdata.m_num_docs = doc_lens.size();
+            m_wdata.m_collection_len =
+                std::accumulate(doc_lens.begin(), doc_lens.end(), uint64_t(0));
+            m_wdata.m_avg_len = float(m_wdata.m_collection_len / double(m_wdata.m_num_docs));
+
+            std::vector<uint32_t> term_occurrence_counts(num_terms);
+            std::vector<uint32_t> term_posting_counts(num_terms);
+            m_occurrence_counts = term_occurrence_counts.data();
+            m_posting_counts = term_posting_counts.data();
+            m_wdata.m_doc_lens.steal(doc_lens);
+            m_wdata.m_term_occurrence_counts.steal(term_occurrence_counts);
+            m_wdata.m_term_posting_counts.steal(term_posting_counts);
+            m_max_term_weight.reserve(num_terms);
+
+            m_scorer = scorer::from_params(scorer_params, m_wdata);
+        }
+        builder(builder const&) = delete;
+        builder(builder&&) = delete;
+        builder& operator=(builder const&) = delete;
+        builder& operator=(builder&&) = delete;
+        ~builder() = default;
+
+        /// Scores the next batch of posting lists in parallel.
+        void add_posting_lists(gsl::span<binary_freq_collection::sequence const> lists)
+        {
+            std::vector<BlockMaxScores> blocks(lists.size());
+            tbb::parallel_for(
+                tbb::blocked_range<size_t>(0, lists.size()),
+                [&](tbb::blocked_range<size_t> const& range) {
+                    for (auto idx = range.begin(); idx != range.end(); ++idx) {
+                        auto const& seq = lists[idx];
+                        auto term_id = m_num_terms_added + idx;
+                        m_occurrence_counts[term_id] =
+                            std::accumulate(seq.freqs.begin(), seq.freqs.end(), 0);
+                        m_posting_counts[term_id] = seq.docs.size();
+                        blocks[idx] = m_block_builder.compute_blocks(
+                            seq, m_scorer->term_scorer(term_id), m_block_size);
+                    }
+                });
+            for (auto& list_blocks: blocks) {
+                auto v = m_block_builder.add_blocks(std::move(list_blocks));
+                m_max_term_weight.push_back(v);
+                m_wdata.m_index_max_term_weight = std::max(m_wdata.m_index_max_term_weight, v);
+            }
+            m_num_terms_added += lists.size();
+        }
+
+        void build()
+        {
+            if (m_num_terms_added != m_wdata.m_term_posting_counts.size()) {
+                throw std::logic_error(fmt::format(
+                    "Expected {} posting lists but {} were added",
+                    m_wdata.m_term_posting_counts.size(),
+                    m_num_terms_added));
+            }
+            if (m_is_quantized) {
+                LinearQuantizer quantizer(
+                    m_wdata.m_index_max_term_weight, configuration::get().quantization_bits);
+                for (auto&& w: m_max_term_weight) {
+                    w = quantizer(w);
+                }
+                m_block_builder.quantize_block_max_term_weights(m_wdata.m_index_max_term_weight);
+            }
+            m_block_builder.build(m_wdata.m_block_wand);
+            m_wdata.m_max_term_weight.steal(m_max_term_weight);
+        }
+
+      private:
+        wand_data& m_wdata;
+        BlockSize m_block_size;
+        bool m_is_quantized;
+        global_parameters m_params{};
+        typename block_wand_type::builder m_block_builder;
+        std::unique_ptr<index_scorer<wand_data>> m_scorer{};
+        uint32_t* m_occurrence_counts = nullptr;
+        uint32_t* m_posting_counts = nullptr;
+        size_t m_num_terms_added = 0;
+        std::vector<float> m_max_term_weight{};
+    };
+
     wand_data() = default;
     explicit wand_data(MemorySource source) : m_source(std::move(source))
     {
-        mapper::map(*this, m_source.data(), mapper::map_flags::warmup);
+        auto bytes = mapper::map(*this, m_source.data(), m_source.map_flags());
+        m_layout.map_trailer(m_source, bytes);
     }
 
     template <typename LengthsIterator>
@@ -44,76 +154,48 @@ class wand_data {
         BlockSize block_size,
         bool is_quantized,
         std::unordered_set<size_t> const& terms_to_drop)
-        : m_num_docs(num_docs)
     {
-        std::vector<uint32_t> doc_lens(num_docs);
-        std::vector<float> max_term_weight;
-        std::vector<uint32_t> term_occurrence_counts;
-        std::vector<uint32_t> term_posting_counts;
-        global_parameters params;
         spdlog::info("Reading sizes...");
-
+        std::vector<uint32_t> doc_lens(num_docs);
         for (size_t i = 0; i < num_docs; ++i) {
-            uint32_t len = *len_it++;
-            doc_lens[i] = len;
-            m_collection_len += len;
+            doc_lens[i] = *len_it++;
         }
 
-        m_avg_len = float(m_collection_len / double(num_docs));
-
-        typename block_wand_type::builder builder(coll, params);
-
+        size_t num_terms = coll.size();
+        auto num_dropped_terms = std::count_if(
+            terms_to_drop.begin(), terms_to_drop.end(), [&](auto term_id) {
+                return term_id < num_terms;
+            });
+        builder builder(
+            *this,
+            std::move(doc_lens),
+            num_terms - num_dropped_terms,
+            scorer_params,
+            block_size,
+            is_quantized);
         {
-            pisa::progress progress("Storing terms statistics", coll.size());
+            pisa::progress progress("Storing terms statistics and score upper bounds", num_terms);
+            std::vector<binary_freq_collection::sequence> batch;
+            size_t batch_postings = 0;
             size_t term_id = 0;
             for (auto const& seq: coll) {
-                if (terms_to_drop.find(term_id) != terms_to_drop.end()) {
-                    progress.update(1);
-                    term_id += 1;
-                    continue;
-                }
-
-                size_t term_occurrence_count = std::accumulate(seq.freqs.begin(), seq.freqs.end(), 0);
-                term_occurrence_counts.push_back(term_occurrence_count);
-                term_posting_counts.push_back(seq.docs.size());
-                term_id += 1;
                 progress.update(1);
-            }
-        }
-        m_doc_lens.steal(doc_lens);
-        m_term_occurrence_counts.steal(term_occurrence_counts);
-        m_term_posting_counts.steal(term_posting_counts);
-
-        auto scorer = scorer::from_params(scorer_params, *this);
-        {
-            pisa::progress progress("Storing score upper bounds", coll.size());
-            size_t term_id = 0;
-            size_t new_term_id = 0;
-            for (auto const& seq: coll) {
-                if (terms_to_drop.find(term_id) != terms_to_drop.end()) {
-                    progress.update(1);
-                    term_id += 1;
+                if (terms_to_drop.find(term_id++) != terms_to_drop.end()) {
                     continue;
                 }
-                auto v = builder.add_sequence(
-                    seq, coll, doc_lens, m_avg_len, scorer->term_scorer(new_term_id), block_size);
-                max_term_weight.push_back(v);
-                m_index_max_term_weight = std::max(m_index_max_term_weight, v);
-                term_id += 1;
-                new_term_id += 1;
-                progress.update(1);
-            }
-            if (is_quantized) {
-                LinearQuantizer quantizer(
-                    m_index_max_term_weight, configuration::get().quantization_bits);
-                for (auto&& w: max_term_weight) {
-                    w = quantizer(w);
+                batch.push_back(seq);
+                batch_postings += seq.docs.size();
+                if (batch.size() == max_batch_terms || batch_postings >= max_batch_postings) {
+                    builder.add_posting_lists(batch);
+                    batch.clear();
+                    batch_postings = 0;
                 }
-                builder.quantize_block_max_term_weights(m_index_max_term_weight);
+            }
+            if (not batch.empty()) {
+                builder.add_posting_lists(batch);
             }
         }
-        builder.build(m_block_wand);
-        m_max_term_weight.steal(max_term_weight);
+        builder.build();
     }
 
     float norm_len(uint64_t doc_id) const { return m_doc_lens[doc_id] / m_avg_len; }
@@ -139,11 +221,29 @@ class wand_data {
 
     wand_data_enumerator getenum(size_t i) const
     {
-        return m_block_wand.get_enum(i, index_max_term_weight());
+        return m_block_wand.get_enum(m_layout.position(i), index_max_term_weight());
     }
 
+    /// Block-max scores, whose lists are stored in the order given by `layout()`.
     const block_wand_type& get_block_wand() const { return m_block_wand; }
 
+    /// Order in which block-max scores are stored, see `TermLayout`.
+    [[nodiscard]] auto layout() const -> TermLayout const& { return m_layout; }
+
+    /// Stores the block-max scores of term `order[pos]` at position `pos`.
+    void reorder_lists(std::vector<std::uint32_t> const& order)
+    {
+        std::vector<std::uint32_t> physical_order(order.size());
+        for (std::size_t pos = 0; pos < order.size(); ++pos) {
+            physical_order[pos] = m_layout.position(order[pos]);
+        }
+        m_block_wand.reorder_lists(physical_order);
+        TermLayout(order).swap(m_layout);
+    }
+
+    /// Writes the WAND data to `file`, followed by its layout if it is not in term order.
+    void freeze(std::string const& file) { freeze_with_layout(*this, m_layout, file); }
+
     template <typename Visitor>
     void map(Visitor& visit)
     {
@@ -166,6 +266,7 @@ class wand_data {
     mapper::mappable_vector<uint32_t> m_term_occurrence_counts;
     mapper::mappable_vector<uint32_t> m_term_posting_counts;
     mapper::mappable_vector<float> m_max_term_weight;
+    TermLayout m_layout;
     MemorySource m_source;
 };
 
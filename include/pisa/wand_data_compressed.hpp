@@ -97,10 +97,14 @@ class wand_data_compressed {
     class builder {
       public:
         builder(binary_freq_collection const& coll, global_parameters const& params)
+            : builder(coll.num_docs(), params)
+        {}
+
+        builder(uint64_t num_docs, global_parameters const& params)
             : total_elements(0),
               total_blocks(0),
               params(params),
-              compressor_builder(coll.num_docs(), params)
+              compressor_builder(num_docs, params)
         {
             spdlog::info("Storing max weight for each list and for each block...");
         }
@@ -109,23 +113,33 @@ class wand_data_compressed {
         float add_sequence(
             binary_freq_collection::sequence const& seq,
             binary_freq_collection const& coll,
-            std::vector<uint32_t> const& doc_lens,
-            float avg_len,
+            [[maybe_unused]] std::vector<uint32_t> const& doc_lens,
+            [[maybe_unused]] float avg_len,
             Scorer scorer,
             BlockSize block_size)
         {
-            auto t = block_size.type() == typeid(FixedBlock)
-                ? static_block_partition(seq, scorer, boost::get<FixedBlock>(block_size).size)
-                : variable_block_partition(
-                    coll, seq, scorer, boost::get<VariableBlock>(block_size).lambda);
+            return add_blocks(compute_blocks(seq, scorer, block_size));
+        }
 
-            float max_score = *(std::max_element(t.second.begin(), t.second.end()));
+        /// Computes block-max scores of a list without modifying the builder; thread-safe.
+        template <typename Scorer>
+        [[nodiscard]] auto compute_blocks(
+            binary_freq_collection::sequence const& seq, Scorer scorer, BlockSize block_size) const
+            -> BlockMaxScores
+        {
+            return partition_blocks(seq, scorer, block_size);
+        }
+
+        /// Appends the blocks of the next list and returns its max score.
+        float add_blocks(BlockMaxScores blocks)
+        {
+            float max_score = *(std::max_element(blocks.scores.begin(), blocks.scores.end()));
             max_term_weight.push_back(max_score);
-            total_elements += seq.docs.size();
-            total_blocks += t.first.size();
+            total_elements += blocks.num_postings;
+            total_blocks += blocks.docids.size();
 
-            block_max_documents.push_back(std::move(t.first));
-            unquantized_block_max_scores.push_back(std::move(t.second));
+            block_max_documents.push_back(std::move(blocks.docids));
+            unquantized_block_max_scores.push_back(std::move(blocks.scores));
 
             return max_term_weight.back();
         }
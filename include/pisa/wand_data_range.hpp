@@ -37,48 +37,70 @@ class wand_data_range {
 
     class builder {
       public:
-        builder(binary_freq_collection const& coll, [[maybe_unused]] global_parameters const& params)
-            : blocks_num(ceil_div(coll.num_docs(), range_size)),
+        builder(binary_freq_collection const& coll, global_parameters const& params)
+            : builder(coll.num_docs(), params)
+        {
+            auto posting_lists = std::distance(coll.begin(), coll.end());
+            spdlog::info("Posting lists: {}.", posting_lists);
+        }
+
+        builder(uint64_t num_docs, [[maybe_unused]] global_parameters const& params)
+            : blocks_num(ceil_div(num_docs, range_size)),
               total_elements(0),
               blocks_start{0},
               block_max_term_weight{}
         {
-            auto posting_lists = std::distance(coll.begin(), coll.end());
             spdlog::info("Storing max weight for each list and for each block...");
             spdlog::info(
-                "Range size: {}. Number of docs: {}."
-                "Blocks per posting list: {}. Posting lists: {}.",
+                "Range size: {}. Number of docs: {}. Blocks per posting list: {}.",
                 range_size,
-                coll.num_docs(),
-                blocks_num,
-                posting_lists);
+                num_docs,
+                blocks_num);
         }
 
         template <typename Scorer>
         float add_sequence(
             binary_freq_collection::sequence const& term_seq,
             binary_freq_collection const& coll,
-            std::vector<uint32_t> const& doc_lens,
-            float avg_len,
+            [[maybe_unused]] std::vector<uint32_t> const& doc_lens,
+            [[maybe_unused]] float avg_len,
             Scorer scorer,
-            [[maybe_unused]] BlockSize block_size)
+            BlockSize block_size)
         {
-            float max_score = 0.0F;
+            return add_blocks(compute_blocks(term_seq, scorer, block_size));
+        }
 
-            std::vector<float> b_max(blocks_num, 0.0F);
+        /// Computes block-max scores of a list without modifying the builder; thread-safe.
+        /// Range blocks have implicit boundaries, so `docids` is left empty. Lists shorter
+        /// than `min_list_lenght` are not stored, so only their max score is returned.
+        template <typename Scorer>
+        [[nodiscard]] auto compute_blocks(
+            binary_freq_collection::sequence const& term_seq,
+            Scorer scorer,
+            [[maybe_unused]] BlockSize block_size) const -> BlockMaxScores
+        {
+            bool stored = term_seq.docs.size() >= min_list_lenght;
+            std::vector<float> b_max(stored ? blocks_num : 1, 0.0F);
             for (auto i = 0; i < term_seq.docs.size(); ++i) {
                 uint64_t docid = *(term_seq.docs.begin() + i);
                 uint64_t freq = *(term_seq.freqs.begin() + i);
                 float score = scorer(docid, freq);
-                max_score = std::max(max_score, score);
-                size_t pos = docid / range_size;
+                size_t pos = stored ? docid / range_size : 0;
                 float& bm = b_max[pos];
                 bm = std::max(bm, score);
             }
-            if (term_seq.docs.size() >= min_list_lenght) {
-                block_max_term_weight.insert(block_max_term_weight.end(), b_max.begin(), b_max.end());
-                blocks_start.push_back(b_max.size() + blocks_start.back());
-                total_elements += term_seq.docs.size();
+            return BlockMaxScores{term_seq.docs.size(), {}, std::move(b_max)};
+        }
+
+        /// Appends the blocks of the next list and returns its max score.
+        float add_blocks(BlockMaxScores blocks)
+        {
+            float max_score = *std::max_element(blocks.scores.begin(), blocks.scores.end());
+            if (blocks.num_postings >= min_list_lenght) {
+                block_max_term_weight.insert(
+                    block_max_term_weight.end(), blocks.scores.begin(), blocks.scores.end());
+                blocks_start.push_back(blocks.scores.size() + blocks_start.back());
+                total_elements += blocks.num_postings;
             } else {
                 blocks_start.push_back(blocks_start.back());
             }
@@ -20,9 +20,11 @@ class wand_data_raw {
     class builder {
       public:
         builder(binary_freq_collection const& coll, global_parameters const& params)
+            : builder(coll.num_docs(), params)
+        {}
+
+        builder([[maybe_unused]] uint64_t num_docs, [[maybe_unused]] global_parameters const& params)
         {
-            (void)coll;
-            (void)params;
             spdlog::info("Storing max weight for each list and for each block...");
             total_elements = 0;
             total_blocks = 0;
@@ -34,24 +36,35 @@ class wand_data_raw {
         float add_sequence(
             binary_freq_collection::sequence const& seq,
             binary_freq_collection const& coll,
-            std::vector<uint32_t> const& doc_lens,
-            float avg_len,
+            [[maybe_unused]] std::vector<uint32_t> const& doc_lens,
+            [[maybe_unused]] float avg_len,
             Scorer scorer,
             BlockSize block_size)
         {
-            auto t = block_size.type() == typeid(FixedBlock)
-                ? static_block_partition(seq, scorer, boost::get<FixedBlock>(block_size).size)
-                : variable_block_partition(
-                    coll, seq, scorer, boost::get<VariableBlock>(block_size).lambda);
+            return add_blocks(compute_blocks(seq, scorer, block_size));
+        }
 
-            block_max_term_weight.insert(
-                block_max_term_weight.end(), t.second.begin(), t.second.end());
-            block_docid.insert(block_docid.end(), t.first.begin(), t.first.end());
-            max_term_weight.push_back(*(std::max_element(t.second.begin(), t.second.end())));
-            blocks_start.push_back(t.first.size() + blocks_start.back());
+        /// Computes block-max scores of a list without modifying the builder; thread-safe.
+        template <typename Scorer>
+        [[nodiscard]] auto compute_blocks(
+            binary_freq_collection::sequence const& seq, Scorer scorer, BlockSize block_size) const
+            -> BlockMaxScores
+        {
+            return partition_blocks(seq, scorer, block_size);
+        }
 
-            total_elements += seq.docs.size();
-            total_blocks += t.first.size();
+        /// Appends the blocks of the next list and returns its max score.
+        float add_blocks(BlockMaxScores blocks)
+        {
+            block_max_term_weight.insert(
+                block_max_term_weight.end(), blocks.scores.begin(), blocks.scores.end());
+            block_docid.insert(block_docid.end(), blocks.docids.begin(), blocks.docids.end());
+            max_term_weight.push_back(
+                *(std::max_element(blocks.scores.begin(), blocks.scores.end())));
+            blocks_start.push_back(blocks.docids.size() + blocks_start.back());
+
+            total_elements += blocks.num_postings;
+            total_blocks += blocks.docids.size();
             effective_list++;
             return max_term_weight.back();
         }
@@ -136,6 +149,30 @@ class wand_data_raw {
             m_block_docid);
     }
 
+    /// Moves the blocks of the list at position `order[pos]` to position `pos`.
+    void reorder_lists(std::vector<std::uint32_t> const& order)
+    {
+        std::vector<uint64_t> blocks_start{0};
+        std::vector<float> block_max_term_weight;
+        std::vector<uint32_t> block_docid;
+        block_max_term_weight.reserve(m_block_max_term_weight.size());
+        block_docid.reserve(m_block_docid.size());
+        for (auto list: order) {
+            auto first = m_blocks_start[list];
+            auto last = m_blocks_start[list + 1];
+            block_max_term_weight.insert(
+                block_max_term_weight.end(),
+                m_block_max_term_weight.begin() + first,
+                m_block_max_term_weight.begin() + last);
+            block_docid.insert(
+                block_docid.end(), m_block_docid.begin() + first, m_block_docid.begin() + last);
+            blocks_start.push_back(block_docid.size());
+        }
+        m_blocks_start.steal(blocks_start);
+        m_block_max_term_weight.steal(block_max_term_weight);
+        m_block_docid.steal(block_docid);
+    }
+
     template <typename Visitor>
     void map(Visitor& visit)
     {
@@ -55,7 +55,6 @@ std::pair<std::vector<uint32_t>, std::vector<float>> static_block_partition(
 
 template <typename Scorer>
 std::pair<std::vector<uint32_t>, std::vector<float>> variable_block_partition(
-    binary_freq_collection const& coll,
     binary_freq_collection::sequence const& seq,
     Scorer scorer,
     const float lambda,
@@ -82,4 +81,24 @@ std::pair<std::vector<uint32_t>, std::vector<float>> variable_block_partition(
     return std::make_pair(p.docids, p.max_values);
 }
 
+/// Block-max scores of a single posting list.
+///
+/// These are computed by a builder's `compute_blocks` independently of the builder state,
+/// so that many lists can be scored concurrently and then appended in term order.
+struct BlockMaxScores {
+    std::size_t num_postings = 0;
+    std::vector<uint32_t> docids;
+    std::vector<float> scores;
+};
+
+template <typename Scorer>
+BlockMaxScores
+partition_blocks(binary_freq_collection::sequence const& seq, Scorer scorer, BlockSize block_size)
+{
+    auto t = block_size.type() == typeid(FixedBlock)
+        ? static_block_partition(seq, scorer, boost::get<FixedBlock>(block_size).size)
+        : variable_block_partition(seq, scorer, boost::get<VariableBlock>(block_size).lambda);
+    return BlockMaxScores{seq.docs.size(), std::move(t.first), std::move(t.second)};
+}
+
 }  // namespace pisa
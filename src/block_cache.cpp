@@ -0,0 +1,376 @@
+#include "block_cache.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+namespace pisa {
+
+namespace {
+
+    enum BlockState : std::uint8_t { Absent = 0, Loaded = 1, Referenced = 2, Pinned = 4 };
+
+    constexpr std::size_t direct_io_alignment = 4096;
+
+    [[noreturn]] void throw_errno(int error, std::string const& what)
+    {
+        throw std::system_error(error, std::generic_category(), what);
+    }
+
+    /// Reads `length` bytes at `offset`, stopping early only at the end of the file.
+    void read_fully(int fd, char* buffer, std::size_t length, std::size_t offset)
+    {
+        while (length > 0) {
+            auto bytes = ::pread(fd, buffer, length, offset);
+            if (bytes < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw_errno(errno, "pread");
+            }
+            if (bytes == 0) {
+                return;
+            }
+            buffer += bytes;
+            offset += bytes;
+            length -= bytes;
+        }
+    }
+
+    /// Memory-backed file source: `data()` is only valid for memory loaded by the cache.
+    struct BlockCacheSource {
+        std::shared_ptr<BlockCache> cache;
+
+        [[nodiscard]] auto data() const -> char const* { return cache->data(); }
+        [[nodiscard]] auto size() const -> std::size_t { return cache->size(); }
+    };
+
+}  // namespace
+
+/// Submission and completion queues of an io_uring instance, set up with raw system calls.
+struct BlockCache::Ring {
+    explicit Ring(unsigned int entries)
+    {
+        io_uring_params params{};
+        fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            throw_errno(errno, "io_uring_setup");
+        }
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0U;
+        if (single_mmap) {
+            sq_size = cq_size = std::max(sq_size, cq_size);
+        }
+        sq_ring = map(sq_size, IORING_OFF_SQ_RING);
+        cq_ring = single_mmap ? sq_ring : map(cq_size, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(map(sqes_size, IORING_OFF_SQES));
+
+        auto* sq = static_cast<char*>(sq_ring);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto* cq = static_cast<char*>(cq_ring);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        capacity = params.sq_entries;
+    }
+    Ring(Ring const&) = delete;
+    Ring(Ring&&) = delete;
+    Ring& operator=(Ring const&) = delete;
+    Ring& operator=(Ring&&) = delete;
+    ~Ring()
+    {
+        ::munmap(sqes, sqes_size);
+        if (cq_ring != sq_ring) {
+            ::munmap(cq_ring, cq_size);
+        }
+        ::munmap(sq_ring, sq_size);
+        ::close(fd);
+    }
+
+    [[nodiscard]] auto map(std::size_t size, off_t offset) -> void*
+    {
+        void* ptr = ::mmap(
+            nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        if (ptr == MAP_FAILED) {
+            throw_errno(errno, "io_uring mmap");
+        }
+        return ptr;
+    }
+
+    /// Queues a read of `length` bytes at `offset` of `file` into `buffer`.
+    void
+    queue_read(int file, char* buffer, std::size_t length, std::size_t offset, std::uint64_t tag)
+    {
+        auto tail = *sq_tail;
+        auto index = tail & sq_mask;
+        auto& sqe = sqes[index];
+        sqe = io_uring_sqe{};
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<std::uint64_t>(buffer);
+        sqe.len = static_cast<std::uint32_t>(length);
+        sqe.off = offset;
+        sqe.user_data = tag;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    /// Submits `count` queued reads and waits for all of them, calling `fn(tag, result)` for
+    /// each completion.
+    template <typename Fn>
+    void submit_and_wait(unsigned int count, Fn fn)
+    {
+        unsigned int submitted = 0;
+        unsigned int completed = 0;
+        while (completed < count) {
+            auto result = ::syscall(
+                __NR_io_uring_enter,
+                fd,
+                count - submitted,
+                count - completed,
+                IORING_ENTER_GETEVENTS,
+                nullptr,
+                0);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw_errno(errno, "io_uring_enter");
+            }
+            submitted += static_cast<unsigned int>(result);
+            auto head = *cq_head;
+            while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                auto const& cqe = cqes[head & cq_mask];
+                fn(cqe.user_data, cqe.res);
+                ++head;
+                ++completed;
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    int fd = -1;
+    unsigned int capacity = 0;
+    std::size_t sq_size = 0;
+    std::size_t cq_size = 0;
+    std::size_t sqes_size = 0;
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+
+BlockCache::BlockCache(
+    std::string const& file, std::size_t capacity, std::size_t block_size, unsigned int queue_depth)
+    : m_block_size(block_size), m_capacity(capacity)
+{
+    if (block_size == 0 || block_size % direct_io_alignment != 0) {
+        throw std::invalid_argument(fmt::format(
+            "Block size must be a multiple of {}: {}", direct_io_alignment, block_size));
+    }
+    m_fd = ::open(file.c_str(), O_RDONLY | O_DIRECT);
+    if (m_fd < 0 && errno == EINVAL) {
+        spdlog::warn("Direct I/O is not supported for {}, reading through the page cache", file);
+        m_fd = ::open(file.c_str(), O_RDONLY);
+    }
+    if (m_fd < 0) {
+        throw_errno(errno, file);
+    }
+    struct stat status {};
+    if (::fstat(m_fd, &status) != 0) {
+        auto error = errno;
+        ::close(m_fd);
+        throw_errno(error, file);
+    }
+    m_size = status.st_size;
+    auto num_blocks = (m_size + m_block_size - 1) / m_block_size;
+    m_buffer_size = std::max<std::size_t>(num_blocks * m_block_size, m_block_size);
+    void* data = ::mmap(
+        nullptr,
+        m_buffer_size,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+        -1,
+        0);
+    if (data == MAP_FAILED) {
+        auto error = errno;
+        ::close(m_fd);
+        throw_errno(error, "mmap");
+    }
+    m_data = static_cast<char*>(data);
+    m_state.resize(num_blocks, Absent);
+    m_last_used.resize(num_blocks, 0);
+    try {
+        m_ring = std::make_unique<Ring>(queue_depth);
+    } catch (std::system_error const& error) {
+        spdlog::warn("io_uring is not available ({}), reading with pread", error.what());
+    }
+}
+
+BlockCache::~BlockCache()
+{
+    m_ring.reset();
+    ::munmap(m_data, m_buffer_size);
+    ::close(m_fd);
+}
+
+void BlockCache::load(gsl::span<gsl::span<char const> const> ranges)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_epoch += 1;
+    std::vector<std::size_t> missing;
+    for (auto range: ranges) {
+        if (range.empty()) {
+            continue;
+        }
+        auto first = static_cast<std::size_t>(range.data() - m_data) / m_block_size;
+        auto last =
+            static_cast<std::size_t>(range.data() + range.size() - 1 - m_data) / m_block_size;
+        for (auto block = first; block <= last; ++block) {
+            if (m_last_used[block] == m_epoch) {
+                continue;
+            }
+            m_last_used[block] = m_epoch;
+            if ((m_state[block] & Loaded) != 0) {
+                m_state[block] |= Referenced;
+                m_stats.hits += 1;
+            } else {
+                missing.push_back(block);
+                m_stats.misses += 1;
+            }
+        }
+    }
+    auto capacity_blocks = m_capacity / m_block_size;
+    while (m_resident_blocks + missing.size() > capacity_blocks && evict_one()) {
+    }
+    read_blocks(missing);
+}
+
+void BlockCache::pin(gsl::span<char const> range)
+{
+    if (range.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto first = static_cast<std::size_t>(range.data() - m_data) / m_block_size;
+    auto last = static_cast<std::size_t>(range.data() + range.size() - 1 - m_data) / m_block_size;
+    std::vector<std::size_t> missing;
+    for (auto block = first; block <= last; ++block) {
+        if ((m_state[block] & Loaded) == 0) {
+            missing.push_back(block);
+        }
+    }
+    read_blocks(missing);
+    for (auto block = first; block <= last; ++block) {
+        m_state[block] |= Pinned;
+    }
+}
+
+void BlockCache::read_blocks(std::vector<std::size_t> const& blocks)
+{
+    auto length = [&](std::size_t block) {
+        // Direct reads must cover whole sectors, even past the end of the file.
+        auto end = std::min((block + 1) * m_block_size, m_size);
+        auto bytes = end - block * m_block_size;
+        return (bytes + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment;
+    };
+    if (m_ring == nullptr) {
+        for (auto block: blocks) {
+            read_fully(m_fd, m_data + block * m_block_size, length(block), block * m_block_size);
+        }
+    } else {
+        for (std::size_t begin = 0; begin < blocks.size(); begin += m_ring->capacity) {
+            auto end = std::min<std::size_t>(begin + m_ring->capacity, blocks.size());
+            for (auto pos = begin; pos < end; ++pos) {
+                auto block = blocks[pos];
+                m_ring->queue_read(
+                    m_fd,
+                    m_data + block * m_block_size,
+                    length(block),
+                    block * m_block_size,
+                    block);
+            }
+            m_ring->submit_and_wait(end - begin, [&](std::uint64_t block, std::int32_t result) {
+                if (result < 0) {
+                    throw_errno(-result, "io_uring read");
+                }
+                auto requested = length(block);
+                if (static_cast<std::size_t>(result) < requested) {
+                    // Short reads end at the end of the file, or are completed synchronously.
+                    auto offset = block * m_block_size + result;
+                    read_fully(m_fd, m_data + offset, requested - result, offset);
+                }
+            });
+        }
+    }
+    for (auto block: blocks) {
+        m_state[block] = Loaded | Referenced;
+        m_stats.bytes_read += length(block);
+    }
+    m_resident_blocks += blocks.size();
+}
+
+auto BlockCache::evict_one() -> bool
+{
+    for (std::size_t step = 0; step < 2 * m_state.size(); ++step) {
+        auto block = m_clock_hand;
+        m_clock_hand = (m_clock_hand + 1) % m_state.size();
+        auto& state = m_state[block];
+        if ((state & Loaded) == 0 || (state & Pinned) != 0 || m_last_used[block] == m_epoch) {
+            continue;
+        }
+        if ((state & Referenced) != 0) {
+            state &= ~Referenced;
+            continue;
+        }
+        ::madvise(m_data + block * m_block_size, m_block_size, MADV_DONTNEED);
+        state = Absent;
+        m_resident_blocks -= 1;
+        m_stats.evictions += 1;
+        return true;
+    }
+    return false;
+}
+
+auto BlockCache::stats() const -> Stats
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void BlockCache::reset_stats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats = Stats{};
+}
+
+auto MemorySource::from_block_cache(std::shared_ptr<BlockCache> cache) -> MemorySource
+{
+    MemorySource source(BlockCacheSource{std::move(cache)});
+    source.m_load_policy = LoadPolicy::Lazy;
+    return source;
+}
+
+}  // namespace pisa
@@ -0,0 +1,207 @@
+#include "decoded_block_cache.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace pisa {
+
+namespace {
+
+    enum SlotState : std::uint8_t { Referenced = 1, HasFreqs = 2 };
+
+    constexpr std::size_t max_shards = 64;
+
+    /// CLOCK needs a few blocks per shard to spare recently used blocks.
+    constexpr std::size_t min_shard_blocks = 16;
+
+    /// Bytes used by a slot besides its documents and frequencies, including its hash entry.
+    constexpr std::size_t slot_overhead = 64;
+
+    [[nodiscard]] auto make_key(std::uint32_t term, std::uint32_t block) -> std::uint64_t
+    {
+        return (static_cast<std::uint64_t>(term) << 32U) | block;
+    }
+
+}  // namespace
+
+/// A part of the cache with its own lock, CLOCK hand, and counts.
+struct DecodedBlockCache::Shard {
+    std::mutex mutex;
+    std::size_t capacity = 0;
+    std::size_t block_size = 0;
+    std::unordered_map<std::uint64_t, std::uint32_t> slots;
+    std::vector<std::uint64_t> keys;
+    std::vector<std::uint8_t> state;
+    std::vector<std::uint32_t> freqs_offsets;
+    /// Documents followed by frequencies of each slot.
+    std::vector<std::uint32_t> postings;
+    std::size_t clock_hand = 0;
+    Stats stats;
+
+    [[nodiscard]] auto docs(std::uint32_t slot) -> std::uint32_t*
+    {
+        return &postings[2 * slot * block_size];
+    }
+
+    [[nodiscard]] auto freqs(std::uint32_t slot) -> std::uint32_t*
+    {
+        return &postings[(2 * slot + 1) * block_size];
+    }
+
+    /// Returns an empty slot, evicting the first unreferenced block if the shard is full.
+    [[nodiscard]] auto free_slot() -> std::uint32_t
+    {
+        if (keys.size() < capacity) {
+            keys.push_back(0);
+            state.push_back(0);
+            freqs_offsets.push_back(0);
+            postings.resize(postings.size() + 2 * block_size);
+            return keys.size() - 1;
+        }
+        while ((state[clock_hand] & Referenced) != 0) {
+            state[clock_hand] &= ~Referenced;
+            clock_hand = (clock_hand + 1) % capacity;
+        }
+        auto slot = static_cast<std::uint32_t>(clock_hand);
+        clock_hand = (clock_hand + 1) % capacity;
+        slots.erase(keys[slot]);
+        ++stats.evictions;
+        return slot;
+    }
+};
+
+DecodedBlockCache::DecodedBlockCache(
+    std::size_t budget, std::size_t block_size, std::size_t min_blocks)
+    : m_block_size(block_size), m_min_blocks(min_blocks)
+{
+    std::size_t blocks = budget / (2 * block_size * sizeof(std::uint32_t) + slot_overhead);
+    if (blocks == 0) {
+        throw std::invalid_argument(
+            fmt::format("Decoded block cache of {} bytes cannot hold a single block", budget));
+    }
+    m_num_shards = std::clamp<std::size_t>(blocks / min_shard_blocks, 1, max_shards);
+    m_shards = std::make_unique<Shard[]>(m_num_shards);
+    for (std::size_t idx = 0; idx < m_num_shards; ++idx) {
+        m_shards[idx].capacity = blocks / m_num_shards + (idx < blocks % m_num_shards ? 1 : 0);
+        m_shards[idx].block_size = block_size;
+        m_shards[idx].slots.reserve(m_shards[idx].capacity);
+    }
+}
+
+DecodedBlockCache::~DecodedBlockCache() = default;
+
+auto DecodedBlockCache::capacity() const -> std::size_t
+{
+    std::size_t blocks = 0;
+    for (std::size_t idx = 0; idx < m_num_shards; ++idx) {
+        blocks += m_shards[idx].capacity;
+    }
+    return blocks;
+}
+
+auto DecodedBlockCache::shard(std::uint64_t key) const -> Shard&
+{
+    // Consecutive blocks of a term go to different shards.
+    return m_shards[(key * 0x9E3779B97F4A7C15ULL >> 32U) % m_num_shards];
+}
+
+auto DecodedBlockCache::find_docs(
+    std::uint32_t term, std::uint32_t block, std::uint32_t* docs, std::uint32_t size)
+    -> std::optional<std::uint32_t>
+{
+    auto key = make_key(term, block);
+    auto& shard = this->shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto pos = shard.slots.find(key);
+    if (pos == shard.slots.end()) {
+        ++shard.stats.misses;
+        return std::nullopt;
+    }
+    ++shard.stats.hits;
+    auto slot = pos->second;
+    shard.state[slot] |= Referenced;
+    std::copy_n(shard.docs(slot), size, docs);
+    return shard.freqs_offsets[slot];
+}
+
+void DecodedBlockCache::insert_docs(
+    std::uint32_t term,
+    std::uint32_t block,
+    std::uint32_t const* docs,
+    std::uint32_t size,
+    std::uint32_t freqs_offset)
+{
+    auto key = make_key(term, block);
+    auto& shard = this->shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.slots.count(key) > 0) {
+        // Another query decoded the same block concurrently.
+        return;
+    }
+    auto slot = shard.free_slot();
+    shard.slots.emplace(key, slot);
+    shard.keys[slot] = key;
+    shard.state[slot] = 0;
+    shard.freqs_offsets[slot] = freqs_offset;
+    std::copy_n(docs, size, shard.docs(slot));
+}
+
+auto DecodedBlockCache::find_freqs(
+    std::uint32_t term, std::uint32_t block, std::uint32_t* freqs, std::uint32_t size) -> bool
+{
+    auto key = make_key(term, block);
+    auto& shard = this->shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto pos = shard.slots.find(key);
+    if (pos == shard.slots.end() || (shard.state[pos->second] & HasFreqs) == 0) {
+        ++shard.stats.misses;
+        return false;
+    }
+    ++shard.stats.hits;
+    auto slot = pos->second;
+    shard.state[slot] |= Referenced;
+    std::copy_n(shard.freqs(slot), size, freqs);
+    return true;
+}
+
+void DecodedBlockCache::insert_freqs(
+    std::uint32_t term, std::uint32_t block, std::uint32_t const* freqs, std::uint32_t size)
+{
+    auto key = make_key(term, block);
+    auto& shard = this->shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto pos = shard.slots.find(key);
+    if (pos == shard.slots.end()) {
+        return;
+    }
+    auto slot = pos->second;
+    shard.state[slot] |= HasFreqs;
+    std::copy_n(freqs, size, shard.freqs(slot));
+}
+
+auto DecodedBlockCache::stats() const -> Stats
+{
+    Stats stats;
+    for (std::size_t idx = 0; idx < m_num_shards; ++idx) {
+        std::lock_guard<std::mutex> lock(m_shards[idx].mutex);
+        stats.hits += m_shards[idx].stats.hits;
+        stats.misses += m_shards[idx].stats.misses;
+        stats.evictions += m_shards[idx].stats.evictions;
+    }
+    return stats;
+}
+
+void DecodedBlockCache::reset_stats()
+{
+    for (std::size_t idx = 0; idx < m_num_shards; ++idx) {
+        std::lock_guard<std::mutex> lock(m_shards[idx].mutex);
+        m_shards[idx].stats = Stats{};
+    }
+}
+
+}  // namespace pisa
@@ -1,13 +1,221 @@
 #include "memory_source.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <exception>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
 #include "io.hpp"
+#include "mappable/mapper.hpp"
 
 namespace pisa {
 
 constexpr std::string_view EMPTY_MEMORY = "Empty memory source";
 
+namespace {
+
+    /// Read-only mapping of a whole file, created with additional `mmap` flags.
+    class MappedFile {
+      public:
+        MappedFile(std::string const& file, int flags)
+        {
+            int fd = ::open(file.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::system_error(errno, std::generic_category(), file);
+            }
+            struct stat status {};
+            if (::fstat(fd, &status) != 0) {
+                auto error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), file);
+            }
+            m_size = status.st_size;
+            if (m_size > 0) {
+                void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED | flags, fd, 0);
+                auto error = errno;
+                ::close(fd);
+                if (data == MAP_FAILED) {
+                    throw std::system_error(error, std::generic_category(), file);
+                }
+                m_data = static_cast<char const*>(data);
+            } else {
+                ::close(fd);
+            }
+        }
+        MappedFile(MappedFile const&) = delete;
+        MappedFile(MappedFile&& other) noexcept
+            : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0))
+        {}
+        MappedFile& operator=(MappedFile const&) = delete;
+        MappedFile& operator=(MappedFile&& other) noexcept
+        {
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+            return *this;
+        }
+        ~MappedFile()
+        {
+            if (m_data != nullptr) {
+                ::munmap(const_cast<char*>(m_data), m_size);
+            }
+        }
+
+        [[nodiscard]] auto data() const -> char const* { return m_data; }
+        [[nodiscard]] auto size() const -> std::size_t { return m_size; }
+
+      private:
+        char const* m_data = nullptr;
+        std::size_t m_size = 0;
+    };
+
+    [[nodiscard]] auto page_size() -> std::size_t
+    {
+        static std::size_t const size = ::sysconf(_SC_PAGESIZE);
+        return size;
+    }
+
+    /// Returns the page-aligned range covering `memory`.
+    [[nodiscard]] auto page_range(gsl::span<char const> memory) -> std::pair<char*, std::size_t>
+    {
+        auto begin = reinterpret_cast<std::uintptr_t>(memory.data());
+        auto first = begin - begin % page_size();
+        return {reinterpret_cast<char*>(first), begin + memory.size() - first};
+    }
+
+    /// Touches one byte of each page of `memory`, with all available threads.
+    void prefault(gsl::span<char const> memory)
+    {
+        auto pages = (memory.size() + page_size() - 1) / page_size();
+        tbb::parallel_for(tbb::blocked_range<std::size_t>(0, pages), [&](auto const& range) {
+            volatile char sink = 0;
+            for (auto page = range.begin(); page != range.end(); ++page) {
+                sink = memory[page * page_size()];
+            }
+            (void)sink;
+        });
+    }
+
+    /// Gives `advice` to the kernel about `memory`. Advice is only a hint, so a failure is
+    /// reported but not fatal.
+    void advise(gsl::span<char const> memory, int advice, std::string_view name)
+    {
+        if (memory.empty()) {
+            return;
+        }
+        auto [first, length] = page_range(memory);
+        if (::madvise(first, length, advice) != 0) {
+            spdlog::warn("madvise({}) failed: {}", name, std::strerror(errno));
+        }
+    }
+
+}  // namespace
+
+auto parse_load_policy(std::string const& name) -> LoadPolicy
+{
+    if (name == "warmup") {
+        return LoadPolicy::Warmup;
+    }
+    if (name == "lazy") {
+        return LoadPolicy::Lazy;
+    }
+    if (name == "parallel") {
+        return LoadPolicy::Parallel;
+    }
+    if (name == "populate") {
+        return LoadPolicy::Populate;
+    }
+    if (name == "willneed") {
+        return LoadPolicy::WillNeed;
+    }
+    if (name == "hugepage") {
+        return LoadPolicy::HugePage;
+    }
+    if (name == "random") {
+        return LoadPolicy::Random;
+    }
+    throw std::invalid_argument(fmt::format("Unknown load policy: {}", name));
+}
+
+auto resident_bytes(gsl::span<char const> memory) -> std::size_t
+{
+    if (memory.empty()) {
+        return 0;
+    }
+    auto [first, length] = page_range(memory);
+    std::vector<unsigned char> resident((length + page_size() - 1) / page_size());
+    if (::mincore(first, length, resident.data()) != 0) {
+        throw std::system_error(errno, std::generic_category(), "mincore");
+    }
+    auto begin = reinterpret_cast<std::uintptr_t>(memory.data());
+    auto end = begin + memory.size();
+    std::size_t bytes = 0;
+    for (std::size_t page = 0; page < resident.size(); ++page) {
+        if ((resident[page] & 1U) != 0U) {
+            auto page_begin = reinterpret_cast<std::uintptr_t>(first) + page * page_size();
+            bytes += std::min(end, page_begin + page_size()) - std::max(begin, page_begin);
+        }
+    }
+    return bytes;
+}
+
+auto lock_memory(gsl::span<char const> memory) -> std::size_t
+{
+    if (not memory.empty() && ::mlock(memory.data(), memory.size()) != 0) {
+        throw std::system_error(errno, std::generic_category(), "mlock");
+    }
+    return memory.size();
+}
+
+void evict_from_page_cache(gsl::span<char const> memory, std::string const& file)
+{
+    advise(memory, MADV_DONTNEED, "MADV_DONTNEED");
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), file);
+    }
+    if (::fdatasync(fd) != 0) {
+        spdlog::warn("Cannot flush {}: {}", file, std::strerror(errno));
+    }
+    if (int err = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED); err != 0) {
+        spdlog::warn("Cannot drop {} from page cache: {}", file, std::strerror(err));
+    }
+    ::close(fd);
+}
+
+auto io_counters() -> IoCounters
+{
+    IoCounters counters;
+    struct rusage usage {};
+    if (::getrusage(RUSAGE_SELF, &usage) == 0) {
+        counters.major_faults = usage.ru_majflt;
+    }
+    std::ifstream is("/proc/self/io");
+    std::string key;
+    std::uint64_t value = 0;
+    while (is >> key >> value) {
+        if (key == "read_bytes:") {
+            counters.read_bytes = value;
+        }
+    }
+    return counters;
+}
+
 auto MemorySource::from_vector(std::vector<char> vec) -> MemorySource
 {
     return MemorySource(std::move(vec));
@@ -31,11 +239,58 @@ auto MemorySource::mapped_file(boost::filesystem::path file) -> MemorySource
     return MemorySource(mio::mmap_source(file.string().c_str()));
 }
 
+auto MemorySource::mapped_file(std::string const& file, LoadPolicy policy) -> MemorySource
+{
+    return MemorySource::mapped_file(io::resolve_path(file), policy);
+}
+
+auto MemorySource::mapped_file(boost::filesystem::path file, LoadPolicy policy) -> MemorySource
+{
+    if (not boost::filesystem::exists(file)) {
+        throw io::NoSuchFile(file.string());
+    }
+    auto source = [&] {
+        if (policy == LoadPolicy::Populate) {
+#ifdef MAP_POPULATE
+            return MemorySource(MappedFile(file.string(), MAP_POPULATE));
+#else
+            spdlog::warn("MAP_POPULATE is not supported on this platform");
+#endif
+        }
+        return MemorySource(mio::mmap_source(file.string().c_str()));
+    }();
+    source.m_load_policy = policy;
+    switch (policy) {
+    case LoadPolicy::Parallel: prefault(source.span()); break;
+    case LoadPolicy::WillNeed: advise(source.span(), MADV_WILLNEED, "MADV_WILLNEED"); break;
+    case LoadPolicy::HugePage:
+#ifdef MADV_HUGEPAGE
+        advise(source.span(), MADV_HUGEPAGE, "MADV_HUGEPAGE");
+#else
+        spdlog::warn("MADV_HUGEPAGE is not supported on this platform");
+#endif
+        break;
+    case LoadPolicy::Random: advise(source.span(), MADV_RANDOM, "MADV_RANDOM"); break;
+    default: break;
+    }
+    return source;
+}
+
 auto MemorySource::is_mapped() noexcept -> bool
 {
     return m_source != nullptr;
 }
 
+auto MemorySource::load_policy() const noexcept -> LoadPolicy
+{
+    return m_load_policy;
+}
+
+auto MemorySource::map_flags() const noexcept -> std::uint64_t
+{
+    return m_load_policy == LoadPolicy::Warmup ? mapper::map_flags::warmup : 0;
+}
+
 auto MemorySource::data() const -> pointer
 {
     if (m_source == nullptr) {
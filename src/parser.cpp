@@ -150,10 +150,12 @@ record_parser(std::string const& type, std::istream& is)
     std::abort();
 }
 
-void parse_plaintext_content(std::string&& content, std::function<void(std::string&&)> process)
+void parse_plaintext_content(std::string&& content, std::function<void(std::string_view)> process)
 {
-    TermTokenizer tokenizer(content);
-    std::for_each(tokenizer.begin(), tokenizer.end(), process);
+    FastTermTokenizer tokenizer(content);
+    for (auto term: tokenizer) {
+        process(term);
+    }
 }
 
 [[nodiscard]] auto is_http(std::string_view content) -> bool
@@ -166,7 +168,7 @@ void parse_plaintext_content(std::string&& content, std::function<void(std::stri
     return std::string_view(&*start, 4) == "HTTP"sv;
 }
 
-void parse_html_content(std::string&& content, std::function<void(std::string&&)> process)
+void parse_html_content(std::string&& content, std::function<void(std::string_view)> process)
 {
     content = parsing::html::cleantext([&]() {
         auto pos = content.begin();
@@ -187,11 +189,13 @@ void parse_html_content(std::string&& content, std::function<void(std::string&&)
     if (content.empty()) {
         return;
     }
-    TermTokenizer tokenizer(content);
-    std::for_each(tokenizer.begin(), tokenizer.end(), process);
+    FastTermTokenizer tokenizer(content);
+    for (auto term: tokenizer) {
+        process(term);
+    }
 }
 
-std::function<void(std::string&& constent, std::function<void(std::string&&)>)>
+std::function<void(std::string&& constent, std::function<void(std::string_view)>)>
 content_parser(std::optional<std::string> const& type)
 {
     if (not type) {
@@ -0,0 +1,209 @@
+#include "query/cost_model.hpp"
+
+#include <cmath>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+namespace pisa {
+
+namespace {
+
+    /// Solves `matrix * x = rhs` by Gaussian elimination with partial pivoting. Variables whose
+    /// pivot vanishes are set to 0.
+    template <std::size_t N>
+    [[nodiscard]] auto
+    solve(std::array<std::array<double, N>, N> matrix, std::array<double, N> rhs)
+        -> std::array<double, N>
+    {
+        for (std::size_t col = 0; col < N; ++col) {
+            std::size_t pivot = col;
+            for (std::size_t row = col + 1; row < N; ++row) {
+                if (std::abs(matrix[row][col]) > std::abs(matrix[pivot][col])) {
+                    pivot = row;
+                }
+            }
+            std::swap(matrix[col], matrix[pivot]);
+            std::swap(rhs[col], rhs[pivot]);
+            if (std::abs(matrix[col][col]) < 1e-12) {
+                continue;
+            }
+            for (std::size_t row = col + 1; row < N; ++row) {
+                double factor = matrix[row][col] / matrix[col][col];
+                for (std::size_t idx = col; idx < N; ++idx) {
+                    matrix[row][idx] -= factor * matrix[col][idx];
+                }
+                rhs[row] -= factor * rhs[col];
+            }
+        }
+        std::array<double, N> solution{};
+        for (std::size_t col = N; col-- > 0;) {
+            if (std::abs(matrix[col][col]) < 1e-12) {
+                continue;
+            }
+            double value = rhs[col];
+            for (std::size_t idx = col + 1; idx < N; ++idx) {
+                value -= matrix[col][idx] * solution[idx];
+            }
+            solution[col] = value / matrix[col][col];
+        }
+        return solution;
+    }
+
+}  // namespace
+
+CostModel::CostModel(time_prediction::predictor decode) : m_decode(std::move(decode)) {}
+
+auto CostModel::read(std::istream& is) -> CostModel
+{
+    CostModel model;
+    std::string line;
+    while (std::getline(is, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        if (not(fields >> name)) {
+            continue;
+        }
+        if (name == "decode") {
+            std::vector<std::pair<std::string, float>> values;
+            std::string feature;
+            float value = 0;
+            while (fields >> feature >> value) {
+                values.emplace_back(feature, value);
+            }
+            model.m_decode = time_prediction::predictor(values);
+            continue;
+        }
+        Weights weights{};
+        std::size_t count = 0;
+        double weight = 0;
+        while (fields >> weight) {
+            if (count < weights.size()) {
+                weights[count] = weight;
+            }
+            ++count;
+        }
+        if (count != weights.size()) {
+            throw std::invalid_argument(fmt::format(
+                "Expected {} weights for {} but got {}", weights.size(), name, count));
+        }
+        model.m_weights.emplace_back(name, weights);
+    }
+    return model;
+}
+
+void CostModel::write(std::ostream& os) const
+{
+    os << "decode\tbias\t" << m_decode.bias();
+    for (std::size_t idx = 0; idx < time_prediction::num_features; ++idx) {
+        auto feature = static_cast<time_prediction::feature_type>(idx);
+        os << '\t' << time_prediction::feature_name(feature) << '\t' << m_decode[feature];
+    }
+    os << '\n';
+    for (auto const& [name, weights]: m_weights) {
+        os << name;
+        for (auto weight: weights) {
+            os << fmt::format("\t{}", weight);
+        }
+        os << '\n';
+    }
+}
+
+auto CostModel::algorithms() const -> std::vector<std::string>
+{
+    std::vector<std::string> names;
+    for (auto const& entry: m_weights) {
+        names.push_back(entry.first);
+    }
+    return names;
+}
+
+void CostModel::fit(
+    std::string const& algorithm,
+    gsl::span<QueryCostFeatures const> features,
+    gsl::span<double const> times)
+{
+    if (features.size() != times.size()) {
+        throw std::invalid_argument(
+            fmt::format("Got {} feature vectors but {} times", features.size(), times.size()));
+    }
+    constexpr std::size_t N = QueryCostFeatures::Count;
+
+    // Features differ by orders of magnitude, so they are scaled to at most 1 before solving.
+    std::array<double, N> scale{};
+    for (auto const& query: features) {
+        for (std::size_t idx = 0; idx < N; ++idx) {
+            scale[idx] = std::max(scale[idx], std::abs(query.values[idx]));
+        }
+    }
+    std::array<std::array<double, N>, N> gram{};
+    std::array<double, N> moments{};
+    for (std::size_t query = 0; query < features.size(); ++query) {
+        std::array<double, N> row{};
+        for (std::size_t idx = 0; idx < N; ++idx) {
+            row[idx] = scale[idx] > 0 ? features[query].values[idx] / scale[idx] : 0;
+        }
+        for (std::size_t lhs = 0; lhs < N; ++lhs) {
+            for (std::size_t rhs = 0; rhs < N; ++rhs) {
+                gram[lhs][rhs] += row[lhs] * row[rhs];
+            }
+            moments[lhs] += row[lhs] * times[query];
+        }
+    }
+    // A small ridge keeps correlated features, such as postings and decoding time, stable.
+    for (std::size_t idx = 0; idx < N; ++idx) {
+        gram[idx][idx] += 1e-6 * features.size();
+    }
+    auto solution = solve(gram, moments);
+    Weights weights{};
+    for (std::size_t idx = 0; idx < N; ++idx) {
+        weights[idx] = scale[idx] > 0 ? solution[idx] / scale[idx] : 0;
+    }
+
+    auto pos = std::find_if(m_weights.begin(), m_weights.end(), [&](auto const& entry) {
+        return entry.first == algorithm;
+    });
+    if (pos == m_weights.end()) {
+        m_weights.emplace_back(algorithm, weights);
+    } else {
+        pos->second = weights;
+    }
+}
+
+auto CostModel::predict(std::string const& algorithm, QueryCostFeatures const& features) const
+    -> double
+{
+    auto pos = std::find_if(m_weights.begin(), m_weights.end(), [&](auto const& entry) {
+        return entry.first == algorithm;
+    });
+    if (pos == m_weights.end()) {
+        throw std::out_of_range(fmt::format("No cost model for {}", algorithm));
+    }
+    return std::inner_product(
+        pos->second.begin(), pos->second.end(), features.values.begin(), 0.0);
+}
+
+auto CostModel::cheapest(QueryCostFeatures const& features) const
+    -> std::pair<std::string const&, double>
+{
+    if (m_weights.empty()) {
+        throw std::logic_error("Cost model has no algorithms");
+    }
+    std::size_t best = 0;
+    double best_cost = 0;
+    for (std::size_t idx = 0; idx < m_weights.size(); ++idx) {
+        auto const& weights = m_weights[idx].second;
+        auto cost =
+            std::inner_product(weights.begin(), weights.end(), features.values.begin(), 0.0);
+        if (idx == 0 || cost < best_cost) {
+            best = idx;
+            best_cost = cost;
+        }
+    }
+    return {m_weights[best].first, best_cost};
+}
+
+}  // namespace pisa
@@ -0,0 +1,105 @@
+#include "query/query_scheduler.hpp"
+
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+namespace pisa {
+
+auto parse_scheduling_policy(std::string const& name) -> SchedulingPolicy
+{
+    if (name == "fifo") {
+        return SchedulingPolicy::Fifo;
+    }
+    if (name == "spjf") {
+        return SchedulingPolicy::ShortestPredictedFirst;
+    }
+    throw std::invalid_argument(fmt::format("Unknown scheduling policy: {}", name));
+}
+
+QueryScheduler::QueryScheduler(std::size_t threads, SchedulingPolicy policy, double aging)
+    : m_policy(policy), m_aging(aging)
+{
+    if (threads == 0) {
+        throw std::invalid_argument("Scheduler needs at least one thread");
+    }
+    for (std::size_t idx = 0; idx < threads; ++idx) {
+        m_workers.emplace_back([this] { work(); });
+    }
+}
+
+QueryScheduler::~QueryScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_task_available.notify_all();
+    for (auto& worker: m_workers) {
+        worker.join();
+    }
+}
+
+auto QueryScheduler::key(double cost) const -> double
+{
+    auto waited_from = std::chrono::duration<double, std::micro>(
+                           std::chrono::steady_clock::now() - m_start)
+                           .count();
+    if (m_policy == SchedulingPolicy::Fifo) {
+        return waited_from;
+    }
+    // Comparing `cost - aging * (now - submitted)` of two tasks at any time is the same as
+    // comparing `cost + aging * submitted`, which does not change while they wait.
+    return cost + m_aging * waited_from;
+}
+
+void QueryScheduler::submit(double cost, std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push(Task{key(cost), m_sequence++, std::move(task)});
+    }
+    m_task_available.notify_one();
+}
+
+void QueryScheduler::submit(double cost, std::vector<std::function<void()>> tasks)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto job_key = key(cost);
+        for (auto& task: tasks) {
+            m_tasks.push(Task{job_key, m_sequence++, std::move(task)});
+        }
+    }
+    m_task_available.notify_all();
+}
+
+void QueryScheduler::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_tasks.empty() && m_running == 0; });
+}
+
+void QueryScheduler::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_task_available.wait(lock, [this] { return m_stopping || not m_tasks.empty(); });
+        if (m_tasks.empty()) {
+            return;
+        }
+        // The top of a priority queue is const, but the task is removed right after.
+        auto task = std::move(const_cast<Task&>(m_tasks.top()).run);
+        m_tasks.pop();
+        ++m_running;
+        lock.unlock();
+        task();
+        lock.lock();
+        --m_running;
+        if (m_tasks.empty() && m_running == 0) {
+            m_idle.notify_all();
+        }
+    }
+}
+
+}  // namespace pisa
@@ -0,0 +1,402 @@
+#include "query/query_server.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+#include <variant>
+
+#include <fmt/format.h>
+
+namespace pisa {
+
+namespace {
+
+    /// Reads the values of a flat JSON object.
+    class JsonReader {
+      public:
+        using Value = std::variant<std::nullptr_t, bool, double, std::string>;
+
+        explicit JsonReader(std::string_view text) : m_text(text) {}
+
+        /// Calls `fn` with the key, value, and text of the value of each field.
+        template <typename Fn>
+        void for_each_field(Fn fn)
+        {
+            skip_whitespace();
+            expect('{');
+            skip_whitespace();
+            if (peek() == '}') {
+                ++m_pos;
+            } else {
+                while (true) {
+                    skip_whitespace();
+                    auto key = read_string();
+                    skip_whitespace();
+                    expect(':');
+                    skip_whitespace();
+                    auto start = m_pos;
+                    auto value = read_value();
+                    fn(key, value, m_text.substr(start, m_pos - start));
+                    skip_whitespace();
+                    if (peek() == ',') {
+                        ++m_pos;
+                        continue;
+                    }
+                    expect('}');
+                    break;
+                }
+            }
+            skip_whitespace();
+            if (m_pos != m_text.size()) {
+                fail("unexpected text after the object");
+            }
+        }
+
+      private:
+        [[noreturn]] void fail(std::string_view what) const
+        {
+            throw std::invalid_argument(
+                fmt::format("Invalid request at position {}: {}", m_pos, what));
+        }
+
+        [[nodiscard]] auto peek() const -> char
+        {
+            return m_pos < m_text.size() ? m_text[m_pos] : '\0';
+        }
+
+        void skip_whitespace()
+        {
+            while (m_pos < m_text.size()
+                   && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+                ++m_pos;
+            }
+        }
+
+        void expect(char c)
+        {
+            if (peek() != c) {
+                fail(fmt::format("expected '{}'", c));
+            }
+            ++m_pos;
+        }
+
+        void expect_word(std::string_view word)
+        {
+            if (m_text.substr(m_pos, word.size()) != word) {
+                fail("unknown value");
+            }
+            m_pos += word.size();
+        }
+
+        [[nodiscard]] auto read_hex() -> std::uint32_t
+        {
+            if (m_pos + 4 > m_text.size()) {
+                fail("truncated escape");
+            }
+            std::uint32_t code = 0;
+            for (int idx = 0; idx < 4; ++idx) {
+                char c = m_text[m_pos++];
+                code <<= 4U;
+                if (c >= '0' && c <= '9') {
+                    code |= c - '0';
+                } else if (c >= 'a' && c <= 'f') {
+                    code |= c - 'a' + 10;
+                } else if (c >= 'A' && c <= 'F') {
+                    code |= c - 'A' + 10;
+                } else {
+                    fail("invalid escape");
+                }
+            }
+            return code;
+        }
+
+        static void append_utf8(std::string& out, std::uint32_t code)
+        {
+            if (code < 0x80) {
+                out.push_back(static_cast<char>(code));
+            } else if (code < 0x800) {
+                out.push_back(static_cast<char>(0xC0 | (code >> 6U)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3FU)));
+            } else if (code < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (code >> 12U)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 6U) & 0x3FU)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3FU)));
+            } else {
+                out.push_back(static_cast<char>(0xF0 | (code >> 18U)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 12U) & 0x3FU)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 6U) & 0x3FU)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3FU)));
+            }
+        }
+
+        [[nodiscard]] auto read_string() -> std::string
+        {
+            expect('"');
+            std::string value;
+            while (true) {
+                if (m_pos >= m_text.size()) {
+                    fail("unterminated string");
+                }
+                char c = m_text[m_pos++];
+                if (c == '"') {
+                    return value;
+                }
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    --m_pos;
+                    fail("control characters must be escaped");
+                }
+                if (c != '\\') {
+                    value.push_back(c);
+                    continue;
+                }
+                if (m_pos >= m_text.size()) {
+                    fail("unterminated string");
+                }
+                switch (char escaped = m_text[m_pos++]; escaped) {
+                case '"':
+                case '\\':
+                case '/': value.push_back(escaped); break;
+                case 'b': value.push_back('\b'); break;
+                case 'f': value.push_back('\f'); break;
+                case 'n': value.push_back('\n'); break;
+                case 'r': value.push_back('\r'); break;
+                case 't': value.push_back('\t'); break;
+                case 'u': {
+                    auto code = read_hex();
+                    // Characters outside the basic plane are escaped as a surrogate pair.
+                    if (code >= 0xDC00 && code < 0xE000) {
+                        fail("unpaired low surrogate");
+                    }
+                    if (code >= 0xD800 && code < 0xDC00) {
+                        if (m_text.substr(m_pos, 2) != "\\u") {
+                            fail("unpaired high surrogate");
+                        }
+                        m_pos += 2;
+                        auto low = read_hex();
+                        if (low < 0xDC00 || low >= 0xE000) {
+                            fail("unpaired high surrogate");
+                        }
+                        code = 0x10000 + ((code - 0xD800) << 10U) + (low - 0xDC00);
+                    }
+                    append_utf8(value, code);
+                    break;
+                }
+                default: fail("invalid escape");
+                }
+            }
+        }
+
+        [[nodiscard]] auto read_value() -> Value
+        {
+            switch (peek()) {
+            case '"': return read_string();
+            case 't': expect_word("true"); return true;
+            case 'f': expect_word("false"); return false;
+            case 'n': expect_word("null"); return nullptr;
+            case '{':
+            case '[': fail("nested values are not supported");
+            default: break;
+            }
+            return read_number();
+        }
+
+        /// Reads a number following the JSON grammar, so that its text can be echoed back.
+        [[nodiscard]] auto read_number() -> double
+        {
+            auto start = m_pos;
+            auto is_digit = [this] { return std::isdigit(static_cast<unsigned char>(peek())); };
+            auto digits = [&] {
+                if (not is_digit()) {
+                    m_pos = start;
+                    fail("invalid value");
+                }
+                while (is_digit()) {
+                    ++m_pos;
+                }
+            };
+            if (peek() == '-') {
+                ++m_pos;
+            }
+            // Leading zeros are not allowed.
+            if (peek() == '0') {
+                ++m_pos;
+            } else {
+                digits();
+            }
+            if (peek() == '.') {
+                ++m_pos;
+                digits();
+            }
+            if (peek() == 'e' || peek() == 'E') {
+                ++m_pos;
+                if (peek() == '+' || peek() == '-') {
+                    ++m_pos;
+                }
+                digits();
+            }
+            try {
+                return std::stod(std::string(m_text.substr(start, m_pos - start)));
+            } catch (std::out_of_range const&) {
+                m_pos = start;
+                fail("number out of range");
+            }
+        }
+
+        std::string_view m_text;
+        std::size_t m_pos = 0;
+    };
+
+    [[nodiscard]] auto as_string(std::string const& key, JsonReader::Value const& value)
+        -> std::string
+    {
+        if (auto const* str = std::get_if<std::string>(&value); str != nullptr) {
+            return *str;
+        }
+        throw std::invalid_argument(fmt::format("Field {} must be a string", key));
+    }
+
+    [[nodiscard]] auto as_count(std::string const& key, JsonReader::Value const& value)
+        -> std::size_t
+    {
+        if (auto const* number = std::get_if<double>(&value);
+            number != nullptr && *number >= 0 && std::floor(*number) == *number) {
+            return static_cast<std::size_t>(*number);
+        }
+        throw std::invalid_argument(
+            fmt::format("Field {} must be a non-negative integer", key));
+    }
+
+    [[nodiscard]] auto escape(std::string_view text) -> std::string
+    {
+        std::string escaped;
+        escaped.reserve(text.size() + 2);
+        escaped.push_back('"');
+        for (char c: text) {
+            switch (c) {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    escaped += fmt::format("\\u{:04x}", static_cast<int>(c));
+                } else {
+                    escaped.push_back(c);
+                }
+            }
+        }
+        escaped.push_back('"');
+        return escaped;
+    }
+
+}  // namespace
+
+auto parse_request(std::string_view line) -> ServerRequest
+{
+    ServerRequest request;
+    JsonReader(line).for_each_field(
+        [&](std::string const& key, JsonReader::Value const& value, std::string_view text) {
+            if (std::holds_alternative<std::nullptr_t>(value)) {
+                return;
+            }
+            if (key == "id") {
+                if (std::holds_alternative<bool>(value)) {
+                    throw std::invalid_argument("Field id must be a string or a number");
+                }
+                request.id = std::string(text);
+            } else if (key == "session") {
+                request.session = as_string(key, value);
+            } else if (key == "query") {
+                request.query = as_string(key, value);
+            } else if (key == "algorithm") {
+                request.algorithm = as_string(key, value);
+            } else if (key == "k") {
+                request.k = as_count(key, value);
+            } else if (key == "page") {
+                request.page = as_count(key, value);
+            }
+        });
+    if (request.page == 0) {
+        throw std::invalid_argument("Pages start from 1");
+    }
+    return request;
+}
+
+auto format_response(
+    ServerRequest const& request,
+    std::size_t first_rank,
+    std::vector<ServerResult> const& results,
+    bool from_session,
+    double usecs) -> std::string
+{
+    std::string response = "{";
+    if (request.id) {
+        response += fmt::format("\"id\":{},", *request.id);
+    }
+    if (request.session) {
+        response += fmt::format("\"session\":{},", escape(*request.session));
+    }
+    response += fmt::format(
+        "\"page\":{},\"from_session\":{},\"usec\":{:.1f},\"results\":[",
+        request.page,
+        from_session,
+        usecs);
+    for (std::size_t pos = 0; pos < results.size(); ++pos) {
+        response += fmt::format(
+            "{}{{\"rank\":{},\"document\":{},\"score\":{}}}",
+            pos == 0 ? "" : ",",
+            first_rank + pos,
+            escape(results[pos].document),
+            results[pos].score);
+    }
+    response += "]}";
+    return response;
+}
+
+auto format_error(std::optional<std::string> const& id, std::string_view message) -> std::string
+{
+    if (id) {
+        return fmt::format("{{\"id\":{},\"error\":{}}}", *id, escape(message));
+    }
+    return fmt::format("{{\"error\":{}}}", escape(message));
+}
+
+SessionStore::SessionStore(std::size_t capacity) : m_capacity(capacity) {}
+
+void SessionStore::put(std::string const& session, NextPage page)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_capacity == 0) {
+        return;
+    }
+    if (auto pos = m_positions.find(session); pos != m_positions.end()) {
+        m_entries.erase(pos->second);
+        m_positions.erase(pos);
+    }
+    m_entries.emplace_front(session, std::move(page));
+    m_positions[session] = m_entries.begin();
+    if (m_entries.size() > m_capacity) {
+        m_positions.erase(m_entries.back().first);
+        m_entries.pop_back();
+    }
+}
+
+auto SessionStore::get(std::string const& session) -> std::optional<NextPage>
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto pos = m_positions.find(session);
+    if (pos == m_positions.end()) {
+        return std::nullopt;
+    }
+    m_entries.splice(m_entries.begin(), m_entries, pos->second);
+    return pos->second->second;
+}
+
+auto SessionStore::size() const -> std::size_t
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+}  // namespace pisa
@@ -0,0 +1,157 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "block_freq_index.hpp"
+#include "codec/block_codecs.hpp"
+#include "query/algorithm.hpp"
+#include "query/batch_search.hpp"
+#include "query/sharded_search.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+#include "test_common.hpp"
+
+using namespace pisa;
+
+using index_type = block_freq_index<interpolative_block>;
+using WandType = wand_data<wand_data_raw>;
+
+struct BatchFixture {
+    static constexpr std::uint32_t num_docs = 10'000;
+    static constexpr std::uint32_t num_terms = 20;
+
+    BatchFixture()
+    {
+        std::mt19937 rng(1729);
+        build_random_index(random_collection(rng, num_docs, num_terms), index, wdata);
+
+        queries = random_queries(rng, num_terms, 30, 5);
+    }
+
+    index_type index;
+    WandType wdata;
+    std::vector<Query> queries;
+};
+
+TEST_CASE("Decode blocks independently of the enumerator", "[batch]")
+{
+    BatchFixture data;
+    for (std::uint32_t term = 0; term < BatchFixture::num_terms; ++term) {
+        auto list = data.index[term];
+        auto expected = data.index[term];
+        std::vector<std::uint32_t> docs(interpolative_block::block_size);
+        std::vector<std::uint32_t> freqs(interpolative_block::block_size);
+        for (std::uint64_t block = 0; block < list.num_blocks(); ++block) {
+            auto const* freqs_data = list.decode_docs(block, docs.data());
+            list.decode_freqs(block, freqs_data, freqs.data());
+            for (std::uint32_t pos = 0; pos < list.block_length(block); ++pos) {
+                REQUIRE(docs[pos] == expected.docid());
+                REQUIRE(freqs[pos] == expected.freq());
+                expected.next();
+            }
+        }
+        REQUIRE(expected.position() == list.size());
+    }
+}
+
+TEST_CASE("Shared posting lists decode only the blocks reached", "[batch]")
+{
+    BatchFixture data;
+    for (std::uint32_t term = 0; term < BatchFixture::num_terms; ++term) {
+        SharedPostingList<index_type::document_enumerator> list(data.index[term]);
+        // Every other block, in reverse order.
+        std::vector<std::uint64_t> blocks;
+        for (std::uint64_t block = 0; block < list.num_blocks(); block += 2) {
+            blocks.push_back(block);
+        }
+        std::reverse(blocks.begin(), blocks.end());
+        for (auto block: blocks) {
+            auto const* docs = list.docs(block);
+            auto const* freqs = list.freqs(block);
+            auto expected = data.index[term];
+            expected.move(block * interpolative_block::block_size);
+            for (std::uint32_t pos = 0; pos < list.block_length(block); ++pos) {
+                REQUIRE(docs[pos] == expected.docid());
+                REQUIRE(freqs[pos] == expected.freq());
+                expected.next();
+            }
+            REQUIRE(list.docs(block) == docs);
+        }
+        REQUIRE(list.decoded_blocks() == blocks.size());
+    }
+}
+
+TEST_CASE("Group queries by shared terms", "[batch]")
+{
+    std::vector<Query> queries(6);
+    queries[0].terms = {1, 2};
+    queries[1].terms = {3};
+    queries[2].terms = {2, 4};
+    queries[3].terms = {};
+    queries[4].terms = {3, 5};
+    queries[5].terms = {2};
+    using Batches = std::vector<std::vector<std::size_t>>;
+    REQUIRE(group_queries(queries, 3) == Batches{{0, 2, 5}, {1, 4, 3}});
+    REQUIRE(group_queries(queries, 4) == Batches{{0, 2, 5, 1}, {4, 3}});
+    REQUIRE(group_queries(queries, 0).size() == 6);
+    REQUIRE(group_queries(gsl::span<Query const>{}, 3).empty());
+}
+
+TEST_CASE("Batched queries return the results of single queries", "[batch][query]")
+{
+    BatchFixture data;
+    std::size_t const k = 10;
+    auto scorer = scorer::from_params(ScorerParams("bm25"), data.wdata);
+    IndexCursors<index_type, WandType> cursors{data.index, data.wdata, *scorer};
+
+    auto name = GENERATE(
+        std::string("wand"),
+        std::string("wand_method_2"),
+        std::string("block_max_wand"),
+        std::string("block_max_wand_method_3"),
+        std::string("maxscore"),
+        std::string("block_max_maxscore"),
+        std::string("ranked_and"),
+        std::string("ranked_or"));
+    CAPTURE(name);
+    auto algorithm = ShardedAlgorithm::parse(name);
+    auto batch_size = GENERATE(std::size_t{1}, std::size_t{7}, std::size_t{30});
+    CAPTURE(batch_size);
+
+    std::size_t total_blocks = 0;
+    for (std::uint32_t term = 0; term < BatchFixture::num_terms; ++term) {
+        total_blocks += data.index[term].num_blocks();
+    }
+    std::size_t decoded_blocks = 0;
+    for (auto const& positions: group_queries(data.queries, batch_size)) {
+        std::vector<Query> batch_queries;
+        for (auto qid: positions) {
+            batch_queries.push_back(data.queries[qid]);
+        }
+        QueryBatch<index_type, WandType> batch(data.index, data.wdata, *scorer, batch_queries);
+        for (auto const& query: batch_queries) {
+            auto expected =
+                paged_search(cursors, query, data.index.num_docs(), algorithm, k, k, nullptr);
+            auto actual =
+                paged_search(batch, query, data.index.num_docs(), algorithm, k, k, nullptr);
+            REQUIRE(actual.primary == expected.primary);
+            REQUIRE(actual.secondary == expected.secondary);
+        }
+        // Running the queries again decodes nothing more.
+        auto decoded = batch.decoded_blocks();
+        for (auto const& query: batch_queries) {
+            static_cast<void>(
+                paged_search(batch, query, data.index.num_docs(), algorithm, k, k, nullptr));
+        }
+        REQUIRE(batch.decoded_blocks() == decoded);
+        decoded_blocks += decoded;
+    }
+    if (batch_size == 30) {
+        // A single batch decodes each block at most once.
+        REQUIRE(decoded_blocks <= total_blocks);
+    }
+}
@@ -0,0 +1,133 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "test_generic_sequence.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "block_cache.hpp"
+#include "block_freq_index.hpp"
+#include "codec/block_codecs.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "temporary_directory.hpp"
+
+using namespace pisa;
+
+TEST_CASE("Block cache reads and evicts blocks", "[block_cache]")
+{
+    Temporary_Directory tmpdir;
+    auto filename = (tmpdir.path() / "file").string();
+    std::mt19937 rng(1729);
+    std::vector<char> contents(1'000'000);
+    std::generate(contents.begin(), contents.end(), [&] { return static_cast<char>(rng()); });
+    {
+        std::ofstream os(filename, std::ios::binary);
+        os.write(contents.data(), contents.size());
+    }
+
+    std::size_t block_size = 16 * 1024;
+    BlockCache cache(filename, 8 * block_size, block_size, 8);
+    REQUIRE(cache.size() == contents.size());
+
+    auto range = [&](std::size_t offset, std::size_t size) {
+        return gsl::span<char const>(cache.data() + offset, size);
+    };
+    auto check = [&](std::size_t offset, std::size_t size) {
+        REQUIRE(std::equal(
+            cache.data() + offset, cache.data() + offset + size, contents.begin() + offset));
+    };
+
+    SECTION("Reads ranges, counting hits and misses")
+    {
+        std::vector<gsl::span<char const>> ranges{range(100, 10), range(block_size - 5, 10)};
+        cache.load(ranges);
+        check(100, 10);
+        check(block_size - 5, 10);
+        REQUIRE(cache.stats().misses == 2);
+        REQUIRE(cache.stats().hits == 0);
+        cache.load(ranges);
+        REQUIRE(cache.stats().hits == 2);
+        REQUIRE(cache.stats().hit_rate() == Approx(0.5));
+
+        // The last block ends before a full block, and before a full sector.
+        std::vector<gsl::span<char const>> tail{range(contents.size() - 3, 3)};
+        cache.load(tail);
+        check(contents.size() - 3, 3);
+    }
+
+    SECTION("Evicts blocks over capacity, except pinned ones")
+    {
+        cache.pin(range(0, 10));
+        std::uniform_int_distribution<std::size_t> offset_dist(0, contents.size() - 1000);
+        for (int query = 0; query < 200; ++query) {
+            std::vector<gsl::span<char const>> ranges;
+            for (int idx = 0; idx < 3; ++idx) {
+                ranges.push_back(range(offset_dist(rng), 1000));
+            }
+            cache.load(ranges);
+            for (auto r: ranges) {
+                check(r.data() - cache.data(), r.size());
+            }
+            check(0, 10);
+        }
+        REQUIRE(cache.stats().evictions > 0);
+        REQUIRE(cache.stats().bytes_read > cache.capacity());
+    }
+
+    REQUIRE_THROWS_AS(BlockCache(filename, 1 << 20, 1000), std::invalid_argument);
+}
+
+TEST_CASE("Cached block index", "[block_cache][index]")
+{
+    using collection_type = block_freq_index<interpolative_block>;
+    global_parameters params;
+    uint64_t universe = 20000;
+    typename collection_type::builder builder(universe, params);
+    std::vector<std::vector<uint64_t>> documents(50);
+    std::vector<std::vector<uint64_t>> frequencies(50);
+    for (std::size_t term = 0; term < documents.size(); ++term) {
+        double avg_gap = 1.1 + double(rand()) / RAND_MAX * 10;
+        auto n = uint64_t(universe / avg_gap);
+        documents[term] = random_sequence(universe, n, true);
+        frequencies[term].resize(n);
+        std::generate(frequencies[term].begin(), frequencies[term].end(), [] {
+            return (rand() % 256) + 1;
+        });
+        builder.add_posting_list(n, documents[term].begin(), frequencies[term].begin(), 0);
+    }
+    Temporary_Directory tmpdir;
+    auto filename = (tmpdir.path() / "index").string();
+    {
+        collection_type index;
+        builder.build(index);
+        mapper::freeze(index, filename.c_str());
+    }
+
+    auto cache = std::make_shared<BlockCache>(filename, 64 * 1024, 16 * 1024);
+    auto index = open_cached_index<collection_type>(cache);
+    REQUIRE(index.size() == documents.size());
+    REQUIRE(index.num_docs() == universe);
+
+    std::mt19937 rng(4104);
+    std::uniform_int_distribution<std::uint32_t> term_dist(0, documents.size() - 1);
+    for (int idx = 0; idx < 100; ++idx) {
+        Query query;
+        query.terms = {term_dist(rng), term_dist(rng), term_dist(rng)};
+        load_posting_lists(*cache, index, gsl::make_span(&query, 1));
+        for (auto term: query.terms) {
+            auto cursor = index[term];
+            REQUIRE(cursor.size() == documents[term].size());
+            for (std::size_t pos = 0; pos < documents[term].size(); ++pos, cursor.next()) {
+                REQUIRE(cursor.docid() == documents[term][pos]);
+                REQUIRE(cursor.freq() == frequencies[term][pos]);
+            }
+            REQUIRE(cursor.docid() == universe);
+        }
+    }
+    REQUIRE(cache->stats().evictions > 0);
+    REQUIRE(cache->stats().hits > 0);
+}
@@ -40,6 +40,23 @@ void test_block_posting_list_ops(
         MY_REQUIRE_EQUAL(docs[i], e.docid(), "i = " << i << " size = " << n);
         MY_REQUIRE_EQUAL(freqs[i], e.freq(), "i = " << i << " size = " << n);
     }
+    // Forward skips within a block and across many blocks, reading only some frequencies.
+    for (uint64_t skip: {2, 50, 1000, 5000}) {
+        e.reset();
+        for (size_t step = 0;; ++step) {
+            uint64_t lower_bound = e.docid() + rand() % skip;
+            e.next_geq(lower_bound);
+            auto pos = std::lower_bound(docs.begin(), docs.end(), lower_bound) - docs.begin();
+            if (pos == static_cast<std::ptrdiff_t>(n)) {
+                REQUIRE(universe == e.docid());
+                break;
+            }
+            MY_REQUIRE_EQUAL(docs[pos], e.docid(), "lower_bound = " << lower_bound);
+            if (step % 3 == 0) {
+                MY_REQUIRE_EQUAL(freqs[pos], e.freq(), "lower_bound = " << lower_bound);
+            }
+        }
+    }
     e.reset();
     e.next_geq(docs.back() + 1);
     REQUIRE(universe == e.docid());
@@ -0,0 +1,63 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "build_index.hpp"
+#include "compress.hpp"
+#include "invert.hpp"
+#include "temporary_directory.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+#include "test_common.hpp"
+
+using namespace pisa;
+
+void test_build_index(std::string const& encoding)
+{
+    Temporary_Directory tmpdir;
+    auto fwd = (tmpdir.path() / "fwd").string();
+    uint32_t num_terms = 500;
+    std::mt19937 rng(1729);
+    write_forward_index(fwd, random_documents(rng, 5'000, num_terms, 100));
+    ScorerParams scorer_params("bm25");
+    BlockSize block_size = FixedBlock(64);
+
+    auto inv = (tmpdir.path() / "inv").string();
+    auto expected_index = (tmpdir.path() / "expected.idx").string();
+    auto expected_wand = (tmpdir.path() / "expected.wand").string();
+    invert::invert_forward_index(fwd, inv, 1'000, 2, num_terms);
+    compress(inv, std::nullopt, encoding, expected_index, scorer_params, false, false);
+    create_wand_data(expected_wand, inv, block_size, scorer_params, false, false, false, {});
+
+    auto actual_index = (tmpdir.path() / "actual.idx").string();
+    auto actual_wand = (tmpdir.path() / "actual.wand").string();
+    build_index(
+        fwd,
+        encoding,
+        actual_index,
+        actual_wand,
+        scorer_params,
+        block_size,
+        false,
+        false,
+        1'000,
+        2,
+        num_terms);
+
+    REQUIRE(read_file(actual_index) == read_file(expected_index));
+    REQUIRE(read_file(actual_wand) == read_file(expected_wand));
+}
+
+TEST_CASE("Build bit-vector index and wand data from forward index", "[build_index]")
+{
+    test_build_index("ef");
+}
+
+TEST_CASE("Build block index and wand data from forward index", "[build_index]")
+{
+    test_build_index("block_simdbp");
+}
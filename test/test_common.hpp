@@ -1,10 +1,25 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <numeric>
+#include <random>
 #include <stack>
 #include <stdint.h>
+#include <string>
 #include <vector>
 
+#include <gsl/span>
+
+#include "binary_freq_collection.hpp"
+#include "global_parameters.hpp"
+#include "query/queries.hpp"
+#include "scorer/scorer.hpp"
+#include "wand_utils.hpp"
+
 #define _STRINGIZE_I(x) #x
 #define _STRINGIZE(x) _STRINGIZE_I(x)
 
@@ -21,3 +36,129 @@ inline std::vector<bool> random_bit_vector(size_t n = 10000, double density = 0.
     }
     return v;
 }
+
+/// Posting lists of random documents and frequencies.
+struct RandomCollection {
+    std::uint32_t num_docs;
+    std::vector<std::vector<std::uint32_t>> documents;
+    std::vector<std::vector<std::uint32_t>> frequencies;
+    std::vector<std::uint32_t> document_sizes;
+};
+
+/// Generates `num_terms` posting lists over `num_docs` documents. Each term occurs in a random
+/// fraction of 1% to 30% of the documents, and at least in the last one, with frequencies from
+/// 1 to 5.
+inline auto random_collection(std::mt19937& rng, std::uint32_t num_docs, std::uint32_t num_terms)
+    -> RandomCollection
+{
+    RandomCollection collection{
+        num_docs,
+        std::vector<std::vector<std::uint32_t>>(num_terms),
+        std::vector<std::vector<std::uint32_t>>(num_terms),
+        std::vector<std::uint32_t>(num_docs, 0)};
+    std::uniform_real_distribution<double> density_dist(0.01, 0.3);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    std::uniform_int_distribution<std::uint32_t> freq_dist(1, 5);
+    for (std::uint32_t term = 0; term < num_terms; ++term) {
+        auto density = density_dist(rng);
+        auto& documents = collection.documents[term];
+        auto& frequencies = collection.frequencies[term];
+        for (std::uint32_t doc = 0; doc < num_docs; ++doc) {
+            if (dist(rng) < density || (documents.empty() && doc + 1 == num_docs)) {
+                documents.push_back(doc);
+                frequencies.push_back(freq_dist(rng));
+                collection.document_sizes[doc] += frequencies.back();
+            }
+        }
+    }
+    return collection;
+}
+
+/// Builds `index` from `collection`, and its BM25 wand data with blocks of 5 postings.
+template <typename Index, typename Wand>
+void build_random_index(RandomCollection const& collection, Index& index, Wand& wdata)
+{
+    pisa::global_parameters params;
+    typename Index::builder builder(collection.num_docs, params);
+    std::vector<pisa::binary_freq_collection::sequence> lists;
+    for (std::size_t term = 0; term < collection.documents.size(); ++term) {
+        auto const& documents = collection.documents[term];
+        auto const& frequencies = collection.frequencies[term];
+        std::uint64_t freqs_sum =
+            std::accumulate(frequencies.begin(), frequencies.end(), std::uint64_t(0));
+        builder.add_posting_list(
+            documents.size(), documents.begin(), frequencies.begin(), freqs_sum);
+        lists.push_back(pisa::binary_freq_collection::sequence{
+            {documents.data(), documents.data() + documents.size()},
+            {frequencies.data(), frequencies.data() + frequencies.size()}});
+    }
+    builder.build(index);
+    typename Wand::builder wand_builder(
+        wdata,
+        collection.document_sizes,
+        collection.documents.size(),
+        ScorerParams("bm25"),
+        pisa::BlockSize(pisa::FixedBlock(5)),
+        false);
+    wand_builder.add_posting_lists(lists);
+    wand_builder.build();
+}
+
+/// Generates `count` queries of 1 to `max_length` terms drawn from `num_terms` terms.
+inline auto random_queries(
+    std::mt19937& rng, std::uint32_t num_terms, std::size_t count, std::size_t max_length)
+    -> std::vector<pisa::Query>
+{
+    std::uniform_int_distribution<std::uint32_t> term_dist(0, num_terms - 1);
+    std::uniform_int_distribution<std::size_t> length_dist(1, max_length);
+    std::vector<pisa::Query> queries;
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        pisa::Query query;
+        std::generate_n(std::back_inserter(query.terms), length_dist(rng), [&] {
+            return term_dist(rng);
+        });
+        queries.push_back(query);
+    }
+    return queries;
+}
+
+/// Generates `num_docs` documents of 1 to `max_length` random terms, followed by the term
+/// `doc % num_terms`, so that every term occurs if `num_docs >= num_terms`.
+inline auto random_documents(
+    std::mt19937& rng, std::uint32_t num_docs, std::uint32_t num_terms, std::uint32_t max_length)
+    -> std::vector<std::vector<std::uint32_t>>
+{
+    std::uniform_int_distribution<std::uint32_t> length_dist(1, max_length);
+    std::uniform_int_distribution<std::uint32_t> term_dist(0, num_terms - 1);
+    std::vector<std::vector<std::uint32_t>> documents(num_docs);
+    for (std::uint32_t doc = 0; doc < num_docs; ++doc) {
+        documents[doc].resize(length_dist(rng));
+        std::generate(documents[doc].begin(), documents[doc].end(), [&] { return term_dist(rng); });
+        documents[doc].push_back(doc % num_terms);
+    }
+    return documents;
+}
+
+/// Writes `documents`, given as sequences of term IDs, as the forward index `basename`.
+inline void write_forward_index(
+    std::string const& basename, gsl::span<std::vector<std::uint32_t> const> documents)
+{
+    std::ofstream os(basename);
+    auto write = [&](gsl::span<std::uint32_t const> seq) {
+        auto size = static_cast<std::uint32_t>(seq.size());
+        os.write(reinterpret_cast<char const*>(&size), sizeof(size));
+        os.write(reinterpret_cast<char const*>(seq.data()), seq.size() * sizeof(std::uint32_t));
+    };
+    std::uint32_t num_docs = documents.size();
+    write(gsl::make_span(&num_docs, 1));
+    for (auto const& document: documents) {
+        write(document);
+    }
+}
+
+/// Reads the whole file `filename`.
+inline auto read_file(std::string const& filename) -> std::vector<char>
+{
+    std::ifstream is(filename, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+}
@@ -0,0 +1,103 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <fstream>
+#include <numeric>
+#include <vector>
+
+#include "test_generic_sequence.hpp"
+
+#include "binary_freq_collection.hpp"
+#include "compress.hpp"
+#include "index_types.hpp"
+#include "io.hpp"
+#include "mappable/mapper.hpp"
+#include "temporary_directory.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+void write_sequence(std::ofstream& os, std::vector<uint32_t> const& seq)
+{
+    auto size = static_cast<uint32_t>(seq.size());
+    os.write(reinterpret_cast<char const*>(&size), sizeof(size));
+    os.write(reinterpret_cast<char const*>(seq.data()), seq.size() * sizeof(uint32_t));
+}
+
+void write_random_collection(std::string const& basename, uint32_t num_docs, std::size_t num_terms)
+{
+    std::ofstream docs(basename + ".docs");
+    std::ofstream freqs(basename + ".freqs");
+    write_sequence(docs, {num_docs});
+    for (std::size_t term = 0; term < num_terms; ++term) {
+        double avg_gap = 1.1 + double(rand()) / RAND_MAX * 100;
+        auto n = std::max<uint64_t>(1, uint64_t(num_docs / avg_gap));
+        auto seq = random_sequence(num_docs, n, true);
+        std::vector<uint32_t> doc_seq(seq.begin(), seq.end());
+        std::vector<uint32_t> freq_seq(n);
+        std::generate(freq_seq.begin(), freq_seq.end(), []() { return (rand() % 256) + 1; });
+        write_sequence(docs, doc_seq);
+        write_sequence(freqs, freq_seq);
+    }
+}
+
+template <typename Index>
+void test_compress_posting_lists(binary_freq_collection const& input)
+{
+    pisa::global_parameters params;
+    typename Index::builder serial_builder(input.num_docs(), params);
+    for (auto const& plist: input) {
+        uint64_t freqs_sum = std::accumulate(plist.freqs.begin(), plist.freqs.end(), uint64_t(0));
+        serial_builder.add_posting_list(
+            plist.docs.size(), plist.docs.begin(), plist.freqs.begin(), freqs_sum);
+    }
+    typename Index::builder parallel_builder(input.num_docs(), params);
+    {
+        pisa::progress progress("Create index", input.size());
+        compress_posting_lists<typename Index::builder, wand_data<wand_data_raw>>(
+            input, parallel_builder, std::nullopt, progress);
+    }
+
+    Temporary_Directory tmpdir;
+    auto serial_path = (tmpdir.path() / "serial").string();
+    auto parallel_path = (tmpdir.path() / "parallel").string();
+    {
+        Index serial_index;
+        serial_builder.build(serial_index);
+        pisa::mapper::freeze(serial_index, serial_path.c_str());
+        Index parallel_index;
+        parallel_builder.build(parallel_index);
+        pisa::mapper::freeze(parallel_index, parallel_path.c_str());
+    }
+    std::ifstream serial(serial_path, std::ios::binary);
+    std::ifstream parallel(parallel_path, std::ios::binary);
+    std::vector<char> serial_bytes(
+        (std::istreambuf_iterator<char>(serial)), std::istreambuf_iterator<char>());
+    std::vector<char> parallel_bytes(
+        (std::istreambuf_iterator<char>(parallel)), std::istreambuf_iterator<char>());
+    REQUIRE(serial_bytes == parallel_bytes);
+}
+
+TEST_CASE("Parallel compression produces the same index as serial compression")
+{
+    Temporary_Directory tmpdir;
+    auto basename = (tmpdir.path() / "coll").string();
+    write_random_collection(basename, 10'000, 100);
+    binary_freq_collection input(basename.c_str());
+
+    test_compress_posting_lists<pisa::ef_index>(input);
+    test_compress_posting_lists<pisa::single_index>(input);
+    test_compress_posting_lists<pisa::pefuniform_index>(input);
+    test_compress_posting_lists<pisa::pefopt_index>(input);
+    test_compress_posting_lists<pisa::block_optpfor_index>(input);
+    test_compress_posting_lists<pisa::block_varintg8iu_index>(input);
+    test_compress_posting_lists<pisa::block_streamvbyte_index>(input);
+    test_compress_posting_lists<pisa::block_maskedvbyte_index>(input);
+    test_compress_posting_lists<pisa::block_interpolative_index>(input);
+    test_compress_posting_lists<pisa::block_qmx_index>(input);
+    test_compress_posting_lists<pisa::block_varintgb_index>(input);
+    test_compress_posting_lists<pisa::block_simple8b_index>(input);
+    test_compress_posting_lists<pisa::block_simple16_index>(input);
+    test_compress_posting_lists<pisa::block_simdbp_index>(input);
+}
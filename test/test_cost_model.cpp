@@ -0,0 +1,153 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "binary_freq_collection.hpp"
+#include "block_freq_index.hpp"
+#include "codec/block_codecs.hpp"
+#include "query/cost_model.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+using index_type = block_freq_index<interpolative_block>;
+using WandType = wand_data<wand_data_raw>;
+
+TEST_CASE("Cost model fits linear costs", "[cost_model]")
+{
+    std::mt19937 rng(1729);
+    std::uniform_real_distribution<double> terms_dist(1, 8);
+    std::uniform_real_distribution<double> postings_dist(1'000, 1'000'000);
+    std::vector<QueryCostFeatures> features(200);
+    std::vector<double> wand_times;
+    std::vector<double> maxscore_times;
+    for (auto& query: features) {
+        query[QueryCostFeatures::Bias] = 1;
+        query[QueryCostFeatures::Terms] = terms_dist(rng);
+        query[QueryCostFeatures::Postings] = postings_dist(rng);
+        query[QueryCostFeatures::Essential] = postings_dist(rng);
+        wand_times.push_back(
+            50 + 10 * query[QueryCostFeatures::Terms] + 0.001 * query[QueryCostFeatures::Postings]);
+        maxscore_times.push_back(20 + 0.002 * query[QueryCostFeatures::Essential]);
+    }
+
+    CostModel model;
+    model.fit("wand", features, wand_times);
+    model.fit("maxscore", features, maxscore_times);
+    REQUIRE(model.algorithms() == std::vector<std::string>{"wand", "maxscore"});
+    for (std::size_t idx = 0; idx < features.size(); ++idx) {
+        REQUIRE(model.predict("wand", features[idx]) == Approx(wand_times[idx]).epsilon(0.01));
+        REQUIRE(
+            model.predict("maxscore", features[idx]) == Approx(maxscore_times[idx]).epsilon(0.01));
+        auto [name, cost] = model.cheapest(features[idx]);
+        REQUIRE(name == (wand_times[idx] < maxscore_times[idx] ? "wand" : "maxscore"));
+        REQUIRE(cost == Approx(std::min(wand_times[idx], maxscore_times[idx])).epsilon(0.01));
+    }
+    REQUIRE_THROWS_AS(model.predict("ranked_or", features[0]), std::out_of_range);
+    REQUIRE_THROWS_AS(
+        model.fit("wand", features, gsl::make_span(wand_times).first(10)), std::invalid_argument);
+    REQUIRE_THROWS_AS(CostModel().cheapest(features[0]), std::logic_error);
+
+    SECTION("Read and write")
+    {
+        time_prediction::predictor decode({{"bias", 1.5F}, {"n", 0.25F}});
+        CostModel with_decode(decode);
+        with_decode.fit("wand", features, wand_times);
+        std::stringstream stream;
+        with_decode.write(stream);
+        auto read = CostModel::read(stream);
+        REQUIRE(read.algorithms() == std::vector<std::string>{"wand"});
+        REQUIRE(read.decode().bias() == 1.5F);
+        REQUIRE(read.decode()[time_prediction::feature_type::n] == 0.25F);
+        REQUIRE(
+            read.predict("wand", features[0])
+            == Approx(with_decode.predict("wand", features[0])));
+
+        std::istringstream invalid("wand\t1\t2\n");
+        REQUIRE_THROWS_AS(CostModel::read(invalid), std::invalid_argument);
+    }
+}
+
+TEST_CASE("Query cost features", "[cost_model][index]")
+{
+    std::mt19937 rng(4104);
+    std::uint32_t const num_docs = 5000;
+    std::vector<double> densities{0.5, 0.2, 0.05, 0.01};
+    std::uint32_t const num_terms = densities.size();
+
+    global_parameters params;
+    index_type::builder builder(num_docs, params);
+    std::vector<std::uint32_t> document_sizes(num_docs, 0);
+    std::vector<std::vector<std::uint32_t>> documents(num_terms);
+    std::vector<std::vector<std::uint32_t>> frequencies(num_terms);
+    std::vector<binary_freq_collection::sequence> lists;
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    std::uniform_int_distribution<std::uint32_t> freq_dist(1, 5);
+    for (std::uint32_t term = 0; term < num_terms; ++term) {
+        for (std::uint32_t doc = 0; doc < num_docs; ++doc) {
+            if (dist(rng) < densities[term]) {
+                documents[term].push_back(doc);
+                frequencies[term].push_back(freq_dist(rng));
+                document_sizes[doc] += frequencies[term].back();
+            }
+        }
+        std::uint64_t freqs_sum = std::accumulate(
+            frequencies[term].begin(), frequencies[term].end(), std::uint64_t(0));
+        builder.add_posting_list(
+            documents[term].size(), documents[term].begin(), frequencies[term].begin(), freqs_sum);
+        lists.push_back(binary_freq_collection::sequence{
+            {documents[term].data(), documents[term].data() + documents[term].size()},
+            {frequencies[term].data(), frequencies[term].data() + frequencies[term].size()}});
+    }
+    index_type index;
+    builder.build(index);
+    WandType wdata;
+    WandType::builder wand_builder(
+        wdata,
+        std::move(document_sizes),
+        num_terms,
+        ScorerParams("bm25"),
+        BlockSize(FixedBlock(64)),
+        false);
+    wand_builder.add_posting_lists(lists);
+    wand_builder.build();
+
+    Query query;
+    query.terms = {0, 1, 3};
+    double postings = documents[0].size() + documents[1].size() + documents[3].size();
+    time_prediction::predictor decode({{"n", 2.0F}});
+
+    auto features = query_cost_features(index, wdata, query, 10, 0, decode);
+    REQUIRE(features[QueryCostFeatures::Bias] == 1);
+    REQUIRE(features[QueryCostFeatures::Terms] == 3);
+    REQUIRE(features[QueryCostFeatures::Postings] == postings);
+    REQUIRE(features[QueryCostFeatures::Shortest] == documents[3].size());
+    REQUIRE(features[QueryCostFeatures::Decode] == Approx(2 * postings));
+    REQUIRE(features[QueryCostFeatures::AboveThreshold] < postings);
+    REQUIRE(features[QueryCostFeatures::Essential] <= postings);
+
+    auto threshold = estimate_threshold(wdata, query, 10);
+    REQUIRE(threshold > 0);
+    REQUIRE(
+        threshold
+        <= std::max(
+            {wdata.max_term_weight(0), wdata.max_term_weight(1), wdata.max_term_weight(3)}));
+
+    // Without a threshold, all lists are essential; above all max scores, none is.
+    auto unpruned = query_cost_features(index, wdata, query, 10, 1e-9, decode);
+    REQUIRE(unpruned[QueryCostFeatures::Essential] == postings);
+    REQUIRE(unpruned[QueryCostFeatures::AboveThreshold] == Approx(postings));
+    auto pruned = query_cost_features(index, wdata, query, 10, 1e9, decode);
+    REQUIRE(pruned[QueryCostFeatures::Essential] == 0);
+    REQUIRE(pruned[QueryCostFeatures::AboveThreshold] == 0);
+
+    auto empty = query_cost_features(index, wdata, Query{}, 10, 0, decode);
+    REQUIRE(empty[QueryCostFeatures::Terms] == 0);
+    REQUIRE(empty[QueryCostFeatures::Postings] == 0);
+}
@@ -0,0 +1,142 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "test_generic_sequence.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+
+#include "block_freq_index.hpp"
+#include "codec/block_codecs.hpp"
+#include "decoded_block_cache.hpp"
+
+using namespace pisa;
+
+TEST_CASE("Decoded block cache", "[decoded_block_cache]")
+{
+    std::uint32_t const block_size = 128;
+    // Room for fewer than 100 blocks, with the overhead of each block.
+    DecodedBlockCache cache(100 * block_size * 2 * sizeof(std::uint32_t), block_size, 1);
+    REQUIRE(cache.capacity() > 50);
+    REQUIRE(cache.capacity() <= 100);
+    REQUIRE_THROWS_AS(DecodedBlockCache(100, block_size), std::invalid_argument);
+
+    std::vector<std::uint32_t> docs(block_size);
+    std::vector<std::uint32_t> freqs(block_size);
+    std::vector<std::uint32_t> out(block_size);
+    std::iota(docs.begin(), docs.end(), 7);
+    std::iota(freqs.begin(), freqs.end(), 100);
+
+    REQUIRE_FALSE(cache.find_docs(3, 5, out.data(), block_size));
+    cache.insert_freqs(3, 5, freqs.data(), block_size);
+    REQUIRE_FALSE(cache.find_freqs(3, 5, out.data(), block_size));
+
+    cache.insert_docs(3, 5, docs.data(), block_size, 42);
+    REQUIRE(cache.find_docs(3, 5, out.data(), block_size) == std::optional<std::uint32_t>(42));
+    REQUIRE(out == docs);
+    REQUIRE_FALSE(cache.find_docs(5, 3, out.data(), block_size));
+    REQUIRE_FALSE(cache.find_freqs(3, 5, out.data(), block_size));
+    cache.insert_freqs(3, 5, freqs.data(), block_size);
+    REQUIRE(cache.find_freqs(3, 5, out.data(), block_size));
+    REQUIRE(out == freqs);
+
+    auto stats = cache.stats();
+    REQUIRE(stats.hits == 2);
+    REQUIRE(stats.misses == 4);
+    REQUIRE(stats.evictions == 0);
+
+    SECTION("Referenced blocks survive eviction")
+    {
+        for (std::uint32_t term = 100; term < 1100; ++term) {
+            cache.insert_docs(term, 0, docs.data(), block_size, 0);
+            REQUIRE(cache.find_docs(3, 5, out.data(), block_size));
+        }
+        REQUIRE(cache.stats().evictions >= 1000 - cache.capacity());
+        std::size_t cached = 0;
+        for (std::uint32_t term = 100; term < 1100; ++term) {
+            if (cache.find_docs(term, 0, out.data(), block_size)) {
+                ++cached;
+            }
+        }
+        REQUIRE(cached < cache.capacity());
+        REQUIRE(cached > 0);
+    }
+
+    SECTION("Reset statistics")
+    {
+        cache.reset_stats();
+        REQUIRE(cache.stats().hits == 0);
+        REQUIRE(cache.stats().misses == 0);
+    }
+}
+
+TEST_CASE("Enumerators share decoded blocks", "[decoded_block_cache][index]")
+{
+    using collection_type = block_freq_index<interpolative_block>;
+    global_parameters params;
+    uint64_t universe = 100'000;
+    typename collection_type::builder builder(universe, params);
+    std::vector<std::vector<uint64_t>> documents(30);
+    std::vector<std::vector<uint64_t>> frequencies(30);
+    for (std::size_t term = 0; term < documents.size(); ++term) {
+        uint64_t n = term % 3 == 0 ? 100 : 1 + rand() % 20'000;
+        documents[term] = random_sequence(universe, n, true);
+        frequencies[term].resize(n);
+        std::generate(frequencies[term].begin(), frequencies[term].end(), [] {
+            return (rand() % 256) + 1;
+        });
+        builder.add_posting_list(n, documents[term].begin(), frequencies[term].begin(), 0);
+    }
+    collection_type index;
+    builder.build(index);
+
+    auto min_blocks = GENERATE(std::size_t(1), DecodedBlockCache::default_min_blocks);
+    auto cache = std::make_shared<DecodedBlockCache>(
+        400'000, interpolative_block::block_size, min_blocks);
+    index.set_decoded_block_cache(cache);
+    REQUIRE_THROWS_AS(
+        index.set_decoded_block_cache(std::make_shared<DecodedBlockCache>(200'000, 64)),
+        std::invalid_argument);
+
+    // Assertions are not thread-safe, so this returns whether the list was decoded correctly.
+    auto check = [&](std::size_t term, std::uint64_t seed) {
+        std::mt19937 rng(seed);
+        auto cursor = index[term];
+        auto const& docs = documents[term];
+        std::size_t pos = 0;
+        while (pos < docs.size()) {
+            if (cursor.docid() != docs[pos]) {
+                return false;
+            }
+            if (rng() % 2 == 0 && cursor.freq() != frequencies[term][pos]) {
+                return false;
+            }
+            if (rng() % 4 == 0) {
+                auto target = docs[pos] + rng() % 1000 + 1;
+                cursor.next_geq(target);
+                pos = std::lower_bound(docs.begin(), docs.end(), target) - docs.begin();
+            } else {
+                cursor.next();
+                ++pos;
+            }
+        }
+        return cursor.docid() == universe;
+    };
+
+    // Half of the queries are for the first four terms, and the others for any term.
+    std::vector<char> correct(300);
+    tbb::parallel_for(std::size_t(0), correct.size(), [&](std::size_t query) {
+        correct[query] = check(query % 2 == 0 ? query % 8 / 2 : query % documents.size(), query);
+    });
+    REQUIRE(std::all_of(correct.begin(), correct.end(), [](char c) { return c != 0; }));
+    for (std::size_t term = 0; term < documents.size(); ++term) {
+        REQUIRE(check(term, term));
+    }
+    auto stats = cache->stats();
+    REQUIRE(stats.hits > 0);
+    REQUIRE(stats.evictions > 0);
+}
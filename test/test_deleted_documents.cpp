@@ -0,0 +1,187 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "cursor/deletion_filtered_cursor.hpp"
+#include "cursor/scored_cursor.hpp"
+#include "deleted_documents.hpp"
+#include "index_types.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "query/algorithm.hpp"
+#include "query/sharded_search.hpp"
+#include "temporary_directory.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+#include "test_common.hpp"
+
+using namespace pisa;
+
+using WandType = wand_data<wand_data_raw>;
+
+/// Deletes each document with probability `rate`, and all documents in `[first, last)`.
+auto random_deletions(
+    std::mt19937& rng,
+    std::uint64_t num_docs,
+    double rate,
+    std::uint64_t first,
+    std::uint64_t last) -> std::set<std::uint64_t>
+{
+    std::bernoulli_distribution coin(rate);
+    std::set<std::uint64_t> deleted;
+    for (std::uint64_t doc = 0; doc < num_docs; ++doc) {
+        if (coin(rng) || (doc >= first && doc < last)) {
+            deleted.insert(doc);
+        }
+    }
+    return deleted;
+}
+
+void build_deleted(
+    DeletedDocuments& deleted, std::uint64_t num_docs, std::set<std::uint64_t> const& docids)
+{
+    DeletedDocuments::builder builder(num_docs);
+    for (auto doc: docids) {
+        builder.remove(doc);
+    }
+    builder.build(deleted);
+}
+
+TEST_CASE("Deleted documents", "[deleted]")
+{
+    std::mt19937 rng(1729);
+    std::uint64_t num_docs = GENERATE(1, 63, 64, 10'000, 20'000);
+    CAPTURE(num_docs);
+    auto expected = random_deletions(rng, num_docs, 0.3, num_docs / 5, num_docs * 9 / 10);
+    DeletedDocuments deleted;
+    build_deleted(deleted, num_docs, expected);
+
+    auto check = [&](DeletedDocuments const& deleted) {
+        REQUIRE(deleted.num_docs() == num_docs);
+        REQUIRE(deleted.count() == expected.size());
+        for (std::uint64_t doc = 0; doc < num_docs + 2; ++doc) {
+            REQUIRE(deleted.is_deleted(doc) == (expected.count(doc) > 0));
+            auto next = doc;
+            while (expected.count(next) > 0) {
+                ++next;
+            }
+            REQUIRE(deleted.next_live(doc) == std::min(next, num_docs));
+        }
+    };
+    check(deleted);
+
+    SECTION("Freeze and map")
+    {
+        Temporary_Directory tmpdir;
+        auto filename = (tmpdir.path() / "deleted").string();
+        mapper::freeze(deleted, filename.c_str());
+        check(DeletedDocuments(MemorySource::mapped_file(filename)));
+    }
+
+    SECTION("Extend")
+    {
+        DeletedDocuments::builder builder(deleted);
+        builder.remove(num_docs - 1);
+        expected.insert(num_docs - 1);
+        DeletedDocuments extended;
+        builder.build(extended);
+        check(extended);
+        REQUIRE_THROWS_AS(builder.remove(num_docs), std::out_of_range);
+    }
+}
+
+TEST_CASE("Query processing skips deleted documents", "[deleted][query]")
+{
+    std::mt19937 rng(4104);
+    std::size_t const k = 10;
+    std::size_t const secondary_k = 10;
+    uint32_t const num_docs = 10'000;
+    uint32_t const num_terms = 30;
+
+    single_index index;
+    WandType wdata;
+    build_random_index(random_collection(rng, num_docs, num_terms), index, wdata);
+    auto scorer = scorer::from_params(ScorerParams("bm25"), wdata);
+    IndexCursors<single_index, WandType> cursors{index, wdata, *scorer};
+
+    auto rate = GENERATE(0.01, 0.1, 0.3);
+    CAPTURE(rate);
+    auto deleted_docids = random_deletions(rng, num_docs, rate, 3'000, 8'500);
+    DeletedDocuments deleted;
+    build_deleted(deleted, num_docs, deleted_docids);
+    DeletionFilteredCursors<IndexCursors<single_index, WandType>> filtered{cursors, deleted};
+
+    auto queries = random_queries(rng, num_terms, 30, 4);
+
+    /// Scores of all documents of `query` that are not deleted, in decreasing order.
+    auto expected_scores = [&](Query const& query) {
+        topk_queue topk(num_docs);
+        ranked_or_query ranked_or(topk);
+        ranked_or(make_scored_cursors(index, *scorer, query), num_docs);
+        topk.finalize();
+        std::vector<float> scores;
+        for (auto [score, docid]: topk.topk()) {
+            if (deleted_docids.count(docid) == 0) {
+                scores.push_back(score);
+            }
+        }
+        return scores;
+    };
+    auto check_page = [](std::vector<std::pair<float, std::uint64_t>> const& page,
+                         std::vector<float> const& expected,
+                         std::size_t first,
+                         std::size_t count) {
+        auto last = std::min(expected.size(), first + count);
+        auto size = first < last ? last - first : 0;
+        REQUIRE(page.size() == size);
+        for (std::size_t pos = 0; pos < size; ++pos) {
+            REQUIRE(page[pos].first == Approx(expected[first + pos]).epsilon(0.01));
+        }
+    };
+    auto check_live = [&](std::vector<std::pair<float, std::uint64_t>> const& page) {
+        for (auto [score, docid]: page) {
+            REQUIRE(deleted_docids.count(docid) == 0);
+        }
+    };
+
+    auto algorithm = GENERATE(
+        std::string("wand"),
+        std::string("block_max_wand"),
+        std::string("maxscore"),
+        std::string("block_max_maxscore"),
+        std::string("ranked_or"),
+        std::string("wand_method_1"),
+        std::string("wand_method_2"),
+        std::string("wand_method_3"),
+        std::string("block_max_wand_method_1"),
+        std::string("block_max_wand_method_2"),
+        std::string("block_max_wand_method_3"));
+    CAPTURE(algorithm);
+    auto parsed = ShardedAlgorithm::parse(algorithm);
+    for (auto const& query: queries) {
+        auto expected = expected_scores(query);
+        if (parsed.method == PageMethod::None) {
+            auto results =
+                paged_search(filtered, query, num_docs, parsed, k + secondary_k, 0, nullptr);
+            check_live(results.primary);
+            check_page(results.primary, expected, 0, k + secondary_k);
+            continue;
+        }
+        auto results = paged_search(filtered, query, num_docs, parsed, k, secondary_k, nullptr);
+        check_live(results.primary);
+        check_live(results.secondary);
+        check_page(results.primary, expected, 0, k);
+        if (parsed.method == PageMethod::Three) {
+            check_page(results.secondary, expected, k, secondary_k);
+        } else {
+            for (auto [score, docid]: results.secondary) {
+                REQUIRE(score <= results.primary.back().first);
+            }
+        }
+    }
+}
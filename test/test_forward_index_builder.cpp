@@ -2,7 +2,9 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <random>
 #include <string>
+#include <unordered_map>
 
 #include <boost/filesystem.hpp>
 #include <catch2/catch.hpp>
@@ -90,7 +92,7 @@ void write_lines(std::string const& filename, gsl::span<T>&& elements)
 
 TEST_CASE("Build forward index batch", "[parsing][forward_index]")
 {
-    auto identity = [](std::string const& term) -> std::string { return term; };
+    auto identity = [](std::string_view term) { return term; };
 
     GIVEN("a few test records")
     {
@@ -269,10 +271,77 @@ TEST_CASE("Merge forward index batches", "[parsing][forward_index]")
     }
 }
 
+TEST_CASE("Merge many forward index batches", "[parsing][forward_index]")
+{
+    Temporary_Directory tmpdir;
+    auto output_file = (tmpdir.path() / "fwd").string();
+    std::mt19937 rng(1729);
+    std::uniform_int_distribution<int> term_dist(0, 4'999);
+    std::size_t batch_count = 7;
+    std::size_t documents_per_batch = 50;
+
+    GIVEN("Batches with random overlapping terms")
+    {
+        std::vector<std::vector<std::string>> expected_documents;
+        for (std::size_t batch = 0; batch < batch_count; ++batch) {
+            std::vector<std::string> titles;
+            std::unordered_map<std::string, uint32_t> term_ids;
+            std::vector<std::string> terms;
+            std::vector<std::vector<uint32_t>> collection;
+            for (std::size_t doc = 0; doc < documents_per_batch; ++doc) {
+                titles.push_back(fmt::format("Doc{}.{}", batch, doc));
+                std::vector<std::string> document(100);
+                std::generate(document.begin(), document.end(), [&] {
+                    return fmt::format("term{}", term_dist(rng));
+                });
+                std::vector<uint32_t> document_term_ids;
+                for (auto const& term: document) {
+                    auto [pos, inserted] = term_ids.emplace(term, terms.size());
+                    if (inserted) {
+                        terms.push_back(term);
+                    }
+                    document_term_ids.push_back(pos->second);
+                }
+                collection.push_back(std::move(document_term_ids));
+                expected_documents.push_back(std::move(document));
+            }
+            write_batch(
+                Forward_Index_Builder::batch_file(output_file, batch), titles, terms, collection);
+        }
+
+        WHEN("Merging function is called")
+        {
+            Forward_Index_Builder builder;
+            builder.merge(output_file, batch_count * documents_per_batch, batch_count);
+
+            THEN("Terms are sorted and unique")
+            {
+                auto terms = load_lines(output_file + ".terms");
+                REQUIRE(std::is_sorted(terms.begin(), terms.end()));
+                REQUIRE(std::adjacent_find(terms.begin(), terms.end()) == terms.end());
+            }
+            THEN("Documents map to the original terms")
+            {
+                auto terms = load_lines(output_file + ".terms");
+                binary_collection coll((output_file).c_str());
+                std::vector<std::vector<std::string>> documents;
+                for (auto seq_iter = ++coll.begin(); seq_iter != coll.end(); ++seq_iter) {
+                    std::vector<std::string> document;
+                    for (auto term_id: *seq_iter) {
+                        document.push_back(terms.at(term_id));
+                    }
+                    documents.push_back(std::move(document));
+                }
+                REQUIRE(documents == expected_documents);
+            }
+        }
+    }
+}
+
 TEST_CASE("Parse HTML content", "[parsing][forward_index][unit]")
 {
     std::vector<std::string> vec;
-    auto map_word = [&](std::string&& word) { vec.push_back(word); };
+    auto map_word = [&](std::string_view word) { vec.emplace_back(word); };
     SECTION("empty")
     {
         parse_html_content(
@@ -0,0 +1,107 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <rapidcheck.h>
+
+#include "hashed_lexicon.hpp"
+
+using namespace pisa;
+
+namespace {
+
+auto build_lexicon(std::vector<std::string> const& terms, bool store_terms) -> std::string
+{
+    std::ostringstream os;
+    HashedLexiconBuilder(terms, store_terms).to_stream(os);
+    return os.str();
+}
+
+}  // namespace
+
+TEST_CASE("Hashed lexicon resolves all terms", "[hashed_lexicon][prop]")
+{
+    rc::check([](std::vector<std::string> terms, bool store_terms) {
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        auto buffer = build_lexicon(terms, store_terms);
+        auto lexicon = HashedLexicon::from(buffer);
+        REQUIRE(lexicon.size() == terms.size());
+        REQUIRE(lexicon.has_terms() == store_terms);
+        for (std::uint32_t term_id = 0; term_id < terms.size(); ++term_id) {
+            REQUIRE(lexicon.find(terms[term_id]) == std::optional<std::uint32_t>(term_id));
+            if (store_terms) {
+                REQUIRE(lexicon.term(term_id) == terms[term_id]);
+            }
+        }
+    });
+}
+
+TEST_CASE("Hashed lexicon rejects missing terms", "[hashed_lexicon][unit]")
+{
+    std::vector<std::string> terms;
+    for (int idx = 0; idx < 10'000; ++idx) {
+        terms.push_back(std::to_string(idx));
+    }
+    auto buffer = build_lexicon(terms, false);
+    auto lexicon = HashedLexicon::from(buffer);
+    for (int idx = 10'000; idx < 20'000; ++idx) {
+        REQUIRE_FALSE(lexicon.find(std::to_string(idx)).has_value());
+    }
+    REQUIRE_FALSE(lexicon.find("").has_value());
+    REQUIRE_THROWS_AS(lexicon.term(0), std::logic_error);
+}
+
+TEST_CASE("Hashed lexicon does not depend on term order", "[hashed_lexicon][unit]")
+{
+    std::vector<std::string> terms{"zebra", "apple", "mango", "banana"};
+    auto buffer = build_lexicon(terms, false);
+    auto lexicon = HashedLexicon::from(buffer);
+    REQUIRE(lexicon.find("zebra") == std::optional<std::uint32_t>(0));
+    REQUIRE(lexicon.find("banana") == std::optional<std::uint32_t>(3));
+    REQUIRE_THROWS_AS(build_lexicon(terms, true), std::invalid_argument);
+}
+
+TEST_CASE("Hashed lexicon rejects duplicates", "[hashed_lexicon][unit]")
+{
+    REQUIRE_THROWS_AS(build_lexicon({"a", "b", "a"}, false), std::invalid_argument);
+}
+
+TEST_CASE("Empty hashed lexicon", "[hashed_lexicon][unit]")
+{
+    auto buffer = build_lexicon({}, true);
+    auto lexicon = HashedLexicon::from(buffer);
+    REQUIRE(lexicon.size() == 0);
+    REQUIRE_FALSE(lexicon.find("a").has_value());
+    REQUIRE(lexicon.prefix("a") == std::pair<std::uint32_t, std::uint32_t>(0, 0));
+}
+
+TEST_CASE("Prefix lookup in hashed lexicon", "[hashed_lexicon][prop]")
+{
+    rc::check([](std::vector<std::string> terms, std::string prefix) {
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        auto buffer = build_lexicon(terms, true);
+        auto lexicon = HashedLexicon::from(buffer);
+        auto first = std::lower_bound(terms.begin(), terms.end(), prefix);
+        auto last = std::find_if(first, terms.end(), [&](auto const& term) {
+            return term.compare(0, prefix.size(), prefix) != 0;
+        });
+        REQUIRE(lexicon.terms().lower_bound(prefix) == std::distance(terms.begin(), first));
+        REQUIRE(
+            lexicon.prefix(prefix)
+            == std::pair<std::uint32_t, std::uint32_t>(
+                std::distance(terms.begin(), first), std::distance(terms.begin(), last)));
+    });
+}
+
+TEST_CASE("Reject invalid hashed lexicon", "[hashed_lexicon][unit]")
+{
+    std::string buffer(64, '\0');
+    REQUIRE_FALSE(HashedLexicon::is_hashed_lexicon(buffer));
+    REQUIRE_THROWS_AS(HashedLexicon::from(buffer), std::runtime_error);
+}
@@ -253,6 +253,7 @@ TEST_CASE("Invert collection", "[invert][unit]")
         uint32_t batch_size = GENERATE(1, 2, 3, 4, 5);
         uint32_t threads = GENERATE(1, 2, 3, 4, 5);
         bool with_lex = GENERATE(false, true);
+        std::size_t memory_budget = GENERATE(0, 1, 300, 1'000'000);
         auto collection_filename = (tmpdir.path() / "fwd").string();
         {
             std::vector<uint32_t> collection_data{
@@ -272,15 +273,20 @@ TEST_CASE("Invert collection", "[invert][unit]")
                     .to_file((tmpdir.path() / "fwd.termlex").string());
             }
         }
-        WHEN("Run inverting with batch size " << batch_size << " and " << threads << " threads")
+        WHEN("Run inverting with batch size " << batch_size << ", " << threads
+                                               << " threads, and memory budget " << memory_budget)
         {
             auto index_basename = (tmpdir.path() / "idx").string();
             std::optional<std::uint32_t> term_count{};
             if (not with_lex) {
                 term_count = 10;
             }
+            std::optional<std::size_t> budget{};
+            if (memory_budget > 0) {
+                budget = memory_budget;
+            }
             invert::invert_forward_index(
-                collection_filename, index_basename, batch_size, threads, term_count);
+                collection_filename, index_basename, batch_size, threads, term_count, budget);
             THEN("Index is stored in binary_freq_collection format")
             {
                 std::vector<uint32_t> document_data{
@@ -327,10 +333,25 @@ TEST_CASE("Invert collection", "[invert][unit]")
                 REQUIRE(f == frequency_data);
                 REQUIRE(s == size_data);
                 auto batch_files = pisa::ls(tmpdir.path().string(), [](auto const& filename) {
-                    return filename.find("batch") != std::string::npos;
+                    return filename.find("batch") != std::string::npos
+                        || filename.find(".pass.") != std::string::npos;
                 });
                 REQUIRE(batch_files.empty());
             }
         }
     }
 }
+
+TEST_CASE("Plan the merge of runs within the memory budget", "[invert][unit]")
+{
+    uint32_t run_count = GENERATE(1, 2, 15, 100, 10'000);
+    std::size_t memory_budget = GENERATE(1, 300, 1U << 20U, 64U << 20U);
+    CAPTURE(run_count, memory_budget);
+    auto plan = invert::plan_run_merge(run_count, memory_budget);
+    REQUIRE(plan.fan_in <= run_count);
+    REQUIRE(plan.fan_in >= std::min<uint32_t>(run_count, 2));
+    REQUIRE((plan.fan_in + 1) * plan.buffer_size <= memory_budget);
+    if (memory_budget >= 3 * invert::min_run_buffer_size) {
+        REQUIRE(plan.buffer_size >= invert::min_run_buffer_size);
+    }
+}
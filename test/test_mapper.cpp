@@ -74,3 +74,14 @@ TEST_CASE("complex_struct_map")
 
     std::remove("temp.bin");
 }
+
+TEST_CASE("regions_of")
+{
+    complex_struct s;
+    s.init();
+    auto regions = pisa::mapper::regions_of(s);
+    REQUIRE(regions.size() == 1);
+    REQUIRE(regions[0].name == "m_b");
+    REQUIRE(regions[0].data == reinterpret_cast<const char*>(s.m_b.data()));
+    REQUIRE(regions[0].size == 2 * sizeof(uint32_t));
+}
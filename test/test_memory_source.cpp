@@ -2,6 +2,10 @@
 #include "catch2/catch.hpp"
 
 #include <fstream>
+#include <system_error>
+
+#include <linux/magic.h>
+#include <sys/vfs.h>
 
 #include "pisa/io.hpp"
 #include "pisa/memory_source.hpp"
@@ -50,3 +54,56 @@ TEST_CASE("Non-empty memory source", "[mmap][io]")
     REQUIRE_THROWS_AS(source.subspan(12), std::out_of_range);
     REQUIRE_THROWS_AS(source.subspan(1, source.size()), std::out_of_range);
 }
+
+TEST_CASE("Load policies", "[mmap][io]")
+{
+    Temporary_Directory temp;
+    auto file_path = (temp.path() / "file");
+    std::string contents(100'000, 'x');
+    {
+        std::ofstream os(file_path.string());
+        os << contents;
+    }
+    auto name = GENERATE(
+        std::string("warmup"),
+        std::string("lazy"),
+        std::string("parallel"),
+        std::string("populate"),
+        std::string("willneed"),
+        std::string("hugepage"),
+        std::string("random"));
+    CAPTURE(name);
+    auto policy = pisa::parse_load_policy(name);
+    auto source = MemorySource::mapped_file(file_path, policy);
+    REQUIRE(source.load_policy() == policy);
+    REQUIRE(source.map_flags() == (policy == pisa::LoadPolicy::Warmup ? 1U : 0U));
+    REQUIRE(std::string(source.begin(), source.end()) == contents);
+    REQUIRE(pisa::resident_bytes(source.span()) == contents.size());
+    REQUIRE(pisa::resident_bytes(source.subspan(10, 20)) == 20);
+    REQUIRE(pisa::lock_memory(source.subspan(0, 100)) == 100);
+    REQUIRE_THROWS_AS(pisa::parse_load_policy("eager"), std::invalid_argument);
+}
+
+TEST_CASE("Evicting from page cache", "[mmap][io]")
+{
+    Temporary_Directory temp;
+    auto file_path = (temp.path() / "file");
+    std::string contents(100'000, 'x');
+    {
+        std::ofstream os(file_path.string());
+        os << contents;
+    }
+    auto source = MemorySource::mapped_file(file_path, pisa::LoadPolicy::Parallel);
+    REQUIRE(pisa::resident_bytes(source.span()) == contents.size());
+    pisa::evict_from_page_cache(source.span(), file_path.string());
+    struct statfs fs {};
+    REQUIRE(::statfs(file_path.c_str(), &fs) == 0);
+    if (fs.f_type != TMPFS_MAGIC && fs.f_type != RAMFS_MAGIC) {
+        REQUIRE(pisa::resident_bytes(source.span()) < contents.size());
+    }
+    REQUIRE(std::string(source.begin(), source.end()) == contents);
+    REQUIRE(pisa::resident_bytes(source.span()) == contents.size());
+    REQUIRE_THROWS_AS(
+        pisa::evict_from_page_cache(source.span(), (temp.path() / "missing").string()),
+        std::system_error);
+}
@@ -0,0 +1,164 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "block_posting_list.hpp"
+#include "build_index.hpp"
+#include "codec/block_codecs.hpp"
+#include "index_types.hpp"
+#include "memory_source.hpp"
+#include "merge_index.hpp"
+#include "temporary_directory.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+#include "test_common.hpp"
+
+using namespace pisa;
+
+using WandType = wand_data<wand_data_raw>;
+
+TEST_CASE("Merged block posting lists copy aligned blocks", "[merge_index]")
+{
+    using posting_list_type = block_posting_list<interpolative_block>;
+    std::mt19937 rng(1729);
+    std::uniform_int_distribution<uint32_t> gap_dist(1, 20);
+    std::uniform_int_distribution<uint32_t> freq_dist(1, 50);
+    auto random_list = [&](std::size_t size) {
+        std::vector<uint32_t> documents;
+        std::vector<uint32_t> frequencies;
+        uint32_t doc = 0;
+        for (std::size_t pos = 0; pos < size; ++pos) {
+            doc += gap_dist(rng);
+            documents.push_back(doc);
+            frequencies.push_back(freq_dist(rng));
+        }
+        return std::make_pair(documents, frequencies);
+    };
+
+    // Sizes of the input lists, and the number of blocks expected to be copied.
+    auto [sizes, expected_copies] = GENERATE(table<std::vector<std::size_t>, std::size_t>(
+        {{{1000}, 7},
+         {{512, 700}, 3 + 5},
+         {{500, 700}, 3},
+         {{256, 256, 10}, 1 + 1},
+         {{10, 20, 30}, 0}}));
+    CAPTURE(sizes);
+
+    std::vector<std::vector<uint8_t>> encoded_lists;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> documents;
+    std::vector<uint32_t> frequencies;
+    uint32_t offset = 0;
+    for (auto size: sizes) {
+        auto [list_documents, list_frequencies] = random_list(size);
+        encoded_lists.emplace_back();
+        posting_list_type::write(
+            encoded_lists.back(), size, list_documents.begin(), list_frequencies.begin());
+        offsets.push_back(offset);
+        for (auto doc: list_documents) {
+            documents.push_back(doc + offset);
+        }
+        frequencies.insert(frequencies.end(), list_frequencies.begin(), list_frequencies.end());
+        offset += list_documents.back() + 1;
+    }
+    std::vector<posting_list_type::document_enumerator> lists;
+    for (auto const& encoded: encoded_lists) {
+        lists.emplace_back(encoded.data(), offset);
+    }
+
+    std::vector<uint8_t> expected;
+    posting_list_type::write(expected, documents.size(), documents.begin(), frequencies.begin());
+    std::vector<uint8_t> merged;
+    auto copies = posting_list_type::write_merged(merged, lists, offsets, documents, frequencies);
+    REQUIRE(copies == expected_copies);
+    REQUIRE(merged == expected);
+}
+
+void test_merge_indexes(std::string const& encoding)
+{
+    Temporary_Directory tmpdir;
+    uint32_t num_terms = 300;
+    std::size_t num_docs = 3'000;
+    std::vector<std::size_t> boundaries{0, 1'000, 1'700, num_docs};
+    std::mt19937 rng(4104);
+    // Every term occurs at least once in each part.
+    auto documents = random_documents(rng, num_docs, num_terms, 100);
+    ScorerParams scorer_params("bm25");
+    BlockSize block_size = FixedBlock(64);
+    auto build = [&](std::string const& name, std::size_t first, std::size_t last) {
+        auto fwd = (tmpdir.path() / name).string();
+        write_forward_index(fwd, gsl::make_span(documents).subspan(first, last - first));
+        build_index(
+            fwd,
+            encoding,
+            fwd + ".idx",
+            fwd + ".wand",
+            scorer_params,
+            block_size,
+            false,
+            false,
+            1'000,
+            2,
+            num_terms);
+        return fwd;
+    };
+    auto expected = build("full", 0, num_docs);
+
+    /**/
+    if (false) {  // NOLINT
+#define LOOP_BODY(R, DATA, T)                                                                  \
+    }                                                                                          \
+    else if (encoding == BOOST_PP_STRINGIZE(T))                                                \
+    {                                                                                          \
+        using index_type = BOOST_PP_CAT(T, _index);                                            \
+        std::vector<std::unique_ptr<index_type>> indexes;                                      \
+        std::vector<std::unique_ptr<WandType>> wdata;                                          \
+        std::vector<index_type const*> index_ptrs;                                             \
+        std::vector<WandType const*> wdata_ptrs;                                               \
+        for (std::size_t part = 0; part + 1 < boundaries.size(); ++part) {                     \
+            auto basename = build(                                                             \
+                "part" + std::to_string(part), boundaries[part], boundaries[part + 1]);        \
+            indexes.push_back(                                                                 \
+                std::make_unique<index_type>(MemorySource::mapped_file(basename + ".idx")));   \
+            wdata.push_back(                                                                   \
+                std::make_unique<WandType>(MemorySource::mapped_file(basename + ".wand")));    \
+            index_ptrs.push_back(indexes.back().get());                                        \
+            wdata_ptrs.push_back(wdata.back().get());                                          \
+        }                                                                                      \
+        std::vector<std::int64_t> terms(num_terms);                                            \
+        std::iota(terms.begin(), terms.end(), 0);                                              \
+        auto merged = (tmpdir.path() / "merged").string();                                     \
+        auto copies = merge_indexes<index_type, WandType>(                                     \
+            index_ptrs,                                                                        \
+            wdata_ptrs,                                                                        \
+            std::vector<std::vector<std::int64_t>>(indexes.size(), terms),                     \
+            num_terms,                                                                         \
+            merged + ".idx",                                                                   \
+            merged + ".wand",                                                                  \
+            encoding,                                                                          \
+            scorer_params,                                                                     \
+            block_size);                                                                       \
+        REQUIRE((copies > 0) == (encoding == "block_interpolative"));                          \
+        REQUIRE(read_file(merged + ".idx") == read_file(expected + ".idx"));                   \
+        REQUIRE(read_file(merged + ".wand") == read_file(expected + ".wand"));                 \
+        /**/
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+    }
+}
+
+TEST_CASE("Merge block indexes", "[merge_index]")
+{
+    test_merge_indexes("block_interpolative");
+}
+
+TEST_CASE("Merge bit-vector indexes", "[merge_index]")
+{
+    test_merge_indexes("ef");
+}
@@ -2,6 +2,7 @@
 
 #include <catch2/catch.hpp>
 
+#include "hashed_lexicon.hpp"
 #include "query/algorithm.hpp"
 #include "temporary_directory.hpp"
 
@@ -27,10 +28,11 @@ TEST_CASE("Compute parsing function")
 {
     Temporary_Directory tmpdir;
 
+    std::vector<std::string> terms{"a", "account", "he", "she", "usa", "world"};
     auto lexfile = tmpdir.path() / "lex";
-    encode_payload_vector(
-        gsl::make_span(std::vector<std::string>{"a", "account", "he", "she", "usa", "world"}))
-        .to_file(lexfile.string());
+    encode_payload_vector(gsl::make_span(terms)).to_file(lexfile.string());
+    auto hashed_lexfile = tmpdir.path() / "hashed_lex";
+    HashedLexiconBuilder(terms).to_file(hashed_lexfile.string());
     auto stopwords_filename = tmpdir.path() / "stop";
     {
         std::ofstream os(stopwords_filename.string());
@@ -62,6 +64,18 @@ TEST_CASE("Compute parsing function")
             REQUIRE(queries[0].term_weights.empty());
         }
     }
+    WHEN("With hashed terms and stopwords. No stemmer")
+    {
+        auto parse = resolve_query_parser(
+            queries, hashed_lexfile.string(), stopwords_filename.string(), std::nullopt);
+        THEN("Parse query IDs")
+        {
+            parse("1:a he usa unknown");
+            REQUIRE(queries[0].id == std::optional<std::string>("1"));
+            REQUIRE(queries[0].terms == std::vector<term_id_type>{2, 4});
+            REQUIRE(queries[0].term_weights.empty());
+        }
+    }
     WHEN("With terms, stopwords, and stemmer")
     {
         auto parse =
@@ -79,10 +93,11 @@ TEST_CASE("Compute parsing function")
 TEST_CASE("Load stopwords in term processor with all stopwords present in the lexicon")
 {
     Temporary_Directory tmpdir;
+    std::vector<std::string> terms{"a", "account", "he", "she", "usa", "world"};
     auto lexfile = tmpdir.path() / "lex";
-    encode_payload_vector(
-        gsl::make_span(std::vector<std::string>{"a", "account", "he", "she", "usa", "world"}))
-        .to_file(lexfile.string());
+    encode_payload_vector(gsl::make_span(terms)).to_file(lexfile.string());
+    auto hashed_lexfile = tmpdir.path() / "hashed_lex";
+    HashedLexiconBuilder(terms).to_file(hashed_lexfile.string());
 
     auto stopwords_filename = (tmpdir.path() / "stopwords").string();
     std::ofstream is(stopwords_filename);
@@ -92,6 +107,11 @@ TEST_CASE("Load stopwords in term processor with all stopwords present in the le
     TermProcessor tprocessor(
         std::make_optional(lexfile.string()), std::make_optional(stopwords_filename), std::nullopt);
     REQUIRE(tprocessor.get_stopwords() == std::vector<std::uint32_t>{0, 2, 3});
+    TermProcessor hashed_tprocessor(
+        std::make_optional(hashed_lexfile.string()),
+        std::make_optional(stopwords_filename),
+        std::nullopt);
+    REQUIRE(hashed_tprocessor.get_stopwords() == std::vector<std::uint32_t>{0, 2, 3});
 }
 
 TEST_CASE("Load stopwords in term processor with some stopwords not present in the lexicon")
@@ -0,0 +1,164 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "block_freq_index.hpp"
+#include "codec/block_codecs.hpp"
+#include "query/algorithm.hpp"
+#include "query/query_scheduler.hpp"
+#include "query/sharded_search.hpp"
+#include "query/split_search.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+#include "test_common.hpp"
+
+using namespace pisa;
+
+using index_type = block_freq_index<interpolative_block>;
+using WandType = wand_data<wand_data_raw>;
+
+/// Runs tasks of the given costs on a single worker, which is busy while they are submitted,
+/// and returns the order in which they ran.
+auto run_order(
+    SchedulingPolicy policy,
+    double aging,
+    std::vector<double> const& costs,
+    std::chrono::milliseconds interval = std::chrono::milliseconds(0)) -> std::vector<std::size_t>
+{
+    std::vector<std::size_t> order;
+    QueryScheduler scheduler(1, policy, aging);
+    std::atomic_bool release = false;
+    scheduler.submit(0, [&] {
+        while (not release) {
+            std::this_thread::yield();
+        }
+    });
+    for (std::size_t idx = 0; idx < costs.size(); ++idx) {
+        scheduler.submit(costs[idx], [&order, idx] { order.push_back(idx); });
+        std::this_thread::sleep_for(interval);
+    }
+    release = true;
+    scheduler.wait();
+    return order;
+}
+
+TEST_CASE("Scheduling policies", "[scheduler]")
+{
+    REQUIRE(parse_scheduling_policy("fifo") == SchedulingPolicy::Fifo);
+    REQUIRE(parse_scheduling_policy("spjf") == SchedulingPolicy::ShortestPredictedFirst);
+    REQUIRE_THROWS_AS(parse_scheduling_policy("lifo"), std::invalid_argument);
+    REQUIRE_THROWS_AS(QueryScheduler(0, SchedulingPolicy::Fifo), std::invalid_argument);
+
+    std::vector<double> costs{500, 20, 300, 10, 40};
+    SECTION("FIFO runs tasks in submission order")
+    {
+        REQUIRE(
+            run_order(SchedulingPolicy::Fifo, 1.0, costs)
+            == std::vector<std::size_t>{0, 1, 2, 3, 4});
+    }
+    SECTION("Shortest predicted job first")
+    {
+        REQUIRE(
+            run_order(SchedulingPolicy::ShortestPredictedFirst, 0.0, costs)
+            == std::vector<std::size_t>{3, 1, 4, 2, 0});
+    }
+    SECTION("Aging lets expensive tasks that waited long run first")
+    {
+        // The second task is cheaper by 1000 us, but submitted at least 5 ms later.
+        std::vector<double> two_costs{1010, 10};
+        auto interval = std::chrono::milliseconds(5);
+        REQUIRE(
+            run_order(SchedulingPolicy::ShortestPredictedFirst, 0.0, two_costs, interval)
+            == std::vector<std::size_t>{1, 0});
+        REQUIRE(
+            run_order(SchedulingPolicy::ShortestPredictedFirst, 1.0, two_costs, interval)
+            == std::vector<std::size_t>{0, 1});
+    }
+}
+
+TEST_CASE("Split documents", "[scheduler]")
+{
+    using Ranges = std::vector<std::pair<std::uint64_t, std::uint64_t>>;
+    REQUIRE(split_documents(10, 3) == Ranges{{0, 3}, {3, 6}, {6, 10}});
+    REQUIRE(split_documents(2, 4) == Ranges{{0, 1}, {1, 2}});
+    REQUIRE(split_documents(10, 0) == Ranges{{0, 10}});
+}
+
+TEST_CASE("Split queries return the results of whole queries", "[scheduler][query]")
+{
+    std::mt19937 rng(1729);
+    std::uint32_t const num_docs = 10'000;
+    std::uint32_t const num_terms = 20;
+    std::size_t const k = 10;
+
+    index_type index;
+    WandType wdata;
+    build_random_index(random_collection(rng, num_docs, num_terms), index, wdata);
+    auto scorer = scorer::from_params(ScorerParams("bm25"), wdata);
+    IndexCursors<index_type, WandType> cursors{index, wdata, *scorer};
+
+    auto queries = random_queries(rng, num_terms, 20, 5);
+
+    auto name = GENERATE(
+        std::string("wand"),
+        std::string("block_max_wand"),
+        std::string("maxscore"),
+        std::string("block_max_maxscore"),
+        std::string("ranked_or"));
+    CAPTURE(name);
+    auto algorithm = ShardedAlgorithm::parse(name);
+    auto ranges = split_documents(num_docs, 4);
+
+    // Ranges run concurrently, so results are checked after all queries finished.
+    std::vector<std::vector<std::vector<std::pair<float, std::uint64_t>>>> range_results(
+        queries.size(), std::vector<std::vector<std::pair<float, std::uint64_t>>>(ranges.size()));
+    std::vector<std::unique_ptr<SharedThreshold>> thresholds;
+    {
+        QueryScheduler scheduler(3, SchedulingPolicy::ShortestPredictedFirst);
+        for (std::size_t qid = 0; qid < queries.size(); ++qid) {
+            thresholds.push_back(std::make_unique<SharedThreshold>());
+            std::vector<std::function<void()>> tasks;
+            for (std::size_t part = 0; part < ranges.size(); ++part) {
+                tasks.emplace_back([&, qid, part] {
+                    range_results[qid][part] = range_search(
+                        cursors,
+                        queries[qid],
+                        ranges[part].first,
+                        ranges[part].second,
+                        algorithm,
+                        k,
+                        thresholds[qid].get());
+                });
+            }
+            scheduler.submit(queries[qid].terms.size(), std::move(tasks));
+        }
+        scheduler.wait();
+    }
+
+    for (std::size_t qid = 0; qid < queries.size(); ++qid) {
+        auto expected = paged_search(cursors, queries[qid], num_docs, algorithm, k, 0, nullptr);
+        auto merged = merge_ranges(range_results[qid], k);
+        REQUIRE(merged.size() == expected.primary.size());
+        for (std::size_t pos = 0; pos < merged.size(); ++pos) {
+            REQUIRE(merged[pos].first == Approx(expected.primary[pos].first));
+        }
+    }
+    REQUIRE_THROWS_AS(
+        range_search(
+            cursors,
+            queries[0],
+            0,
+            num_docs,
+            ShardedAlgorithm::parse("wand_method_1"),
+            k,
+            nullptr),
+        std::invalid_argument);
+}
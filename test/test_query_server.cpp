@@ -0,0 +1,143 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "query/query_server.hpp"
+
+using namespace pisa;
+
+TEST_CASE("Parse server requests", "[server]")
+{
+    SECTION("All fields")
+    {
+        auto request = parse_request(
+            R"( {"id": 7, "session": "s1", "query": "new york", "k": 10, )"
+            R"("algorithm": "block_max_wand_method_3", "page": 2} )");
+        REQUIRE(request.id == std::optional<std::string>("7"));
+        REQUIRE(request.session == std::optional<std::string>("s1"));
+        REQUIRE(request.query == std::optional<std::string>("new york"));
+        REQUIRE(request.k == std::optional<std::size_t>(10));
+        REQUIRE(request.algorithm == std::optional<std::string>("block_max_wand_method_3"));
+        REQUIRE(request.page == 2);
+    }
+    SECTION("Defaults, null and unknown fields")
+    {
+        auto request = parse_request(R"({"id": "q-1", "k": null, "trace": true, "x": -1.5e3})");
+        REQUIRE(request.id == std::optional<std::string>(R"("q-1")"));
+        REQUIRE_FALSE(request.session);
+        REQUIRE_FALSE(request.query);
+        REQUIRE_FALSE(request.k);
+        REQUIRE(request.page == 1);
+        REQUIRE(parse_request("{}").page == 1);
+    }
+    SECTION("Numeric ids are echoed as given")
+    {
+        for (std::string id: {"0", "-0", "12", "-3.25", "1e5", "2.5E-3", "0.5e+2"}) {
+            CAPTURE(id);
+            REQUIRE(parse_request(R"({"id": )" + id + "}").id == std::optional<std::string>(id));
+        }
+    }
+    SECTION("Escapes")
+    {
+        auto request = parse_request(R"({"query": "a \"b\"\\c\/\n\u00e9\ud83d\ude00"})");
+        REQUIRE(request.query == std::optional<std::string>("a \"b\"\\c/\n\xC3\xA9\xF0\x9F\x98\x80"));
+    }
+    SECTION("Invalid requests")
+    {
+        std::vector<std::string> invalid{
+            "",
+            "query",
+            R"({"query": "unterminated})",
+            R"({"query": 1})",
+            R"({"k": -1})",
+            R"({"k": 2.5})",
+            R"({"page": 0})",
+            R"({"page": "2"})",
+            R"({"id": true})",
+            R"({"query": ["a"]})",
+            R"({"k": 10,})",
+            R"({"k": 10} x)",
+            R"({"k": 1-})",
+            R"({"query": "\x"})",
+            R"({"id": +1})",
+            R"({"id": 01})",
+            R"({"id": .5})",
+            R"({"id": 1.})",
+            R"({"id": 1e})",
+            R"({"id": -})",
+            R"({"id": 1e400})",
+            "{\"id\": \"a\tb\"}",
+            R"({"id": "\udc00"})",
+            R"({"id": "\ud83d"})",
+            R"({"id": "\ud83dx"})",
+            R"({"id": "\ud83d\u0041"})",
+        };
+        for (auto const& line: invalid) {
+            CAPTURE(line);
+            REQUIRE_THROWS_AS(parse_request(line), std::invalid_argument);
+        }
+    }
+}
+
+TEST_CASE("Format server responses", "[server]")
+{
+    auto request = parse_request(R"({"id": 3, "session": "s\"1", "page": 2})");
+    std::vector<ServerResult> results{{"doc\t1", 2.5}, {"doc2", 1.25}};
+    REQUIRE(
+        format_response(request, 10, results, true, 12.34)
+        == R"({"id":3,"session":"s\"1","page":2,"from_session":true,"usec":12.3,"results":[)"
+           R"({"rank":10,"document":"doc\t1","score":2.5},)"
+           R"({"rank":11,"document":"doc2","score":1.25}]})");
+    REQUIRE(
+        format_response(ServerRequest{}, 0, {}, false, 1)
+        == R"({"page":1,"from_session":false,"usec":1.0,"results":[]})");
+    REQUIRE(format_error(std::string("\"a\""), "bad\n") == R"({"id":"a","error":"bad\n"})");
+    REQUIRE(format_error(std::nullopt, "bad") == R"({"error":"bad"})");
+}
+
+TEST_CASE("Session store", "[server]")
+{
+    auto page = [](std::uint64_t docid) {
+        return NextPage{"query", "wand", 10, {{1.0F, docid}}};
+    };
+    SessionStore sessions(2);
+    REQUIRE_FALSE(sessions.get("a"));
+    sessions.put("a", page(1));
+    sessions.put("b", page(2));
+    REQUIRE(sessions.get("a")->results[0].second == 1);
+    sessions.put("c", page(3));
+    REQUIRE(sessions.size() == 2);
+    REQUIRE_FALSE(sessions.get("b"));
+    REQUIRE(sessions.get("a")->results[0].second == 1);
+    sessions.put("c", page(4));
+    REQUIRE(sessions.size() == 2);
+    REQUIRE(sessions.get("c")->results[0].second == 4);
+
+    SECTION("Without capacity, nothing is retained")
+    {
+        SessionStore none(0);
+        none.put("a", page(1));
+        REQUIRE_FALSE(none.get("a"));
+    }
+    SECTION("Concurrent sessions")
+    {
+        SessionStore shared(1000);
+        std::vector<std::thread> threads;
+        for (std::uint64_t thread = 0; thread < 4; ++thread) {
+            threads.emplace_back([&, thread] {
+                for (std::uint64_t idx = 0; idx < 250; ++idx) {
+                    shared.put(std::to_string(thread * 1000 + idx), page(idx));
+                    static_cast<void>(shared.get(std::to_string(thread * 1000)));
+                }
+            });
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+        REQUIRE(shared.size() == 1000);
+        REQUIRE(shared.get("3249")->results[0].second == 249);
+    }
+}
@@ -0,0 +1,229 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+
+#include "cursor/scored_cursor.hpp"
+#include "index_types.hpp"
+#include "query/algorithm.hpp"
+#include "query/sharded_search.hpp"
+#include "segmented_index.hpp"
+#include "temporary_directory.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+#include "test_common.hpp"
+
+using namespace pisa;
+
+using WandType = wand_data<wand_data_raw>;
+using IndexType = ef_index;
+using Segments = SegmentedIndex<IndexType, WandType>;
+
+uint32_t const segment_terms = 40;
+uint32_t const term_shift = 20;
+
+/// Writes a forward index of `num_docs` documents whose terms are `term<N>`, with `N` between
+/// `first_term` and `first_term + segment_terms`.
+void write_segment(
+    std::mt19937& rng, std::string const& basename, uint32_t num_docs, uint32_t first_term)
+{
+    write_forward_index(basename, random_documents(rng, num_docs, segment_terms, 30));
+    std::ofstream documents(basename + ".documents");
+    for (uint32_t doc = 0; doc < num_docs; ++doc) {
+        documents << fmt::format("{}-{}\n", first_term, doc);
+    }
+    std::ofstream terms(basename + ".terms");
+    for (uint32_t term = 0; term < segment_terms; ++term) {
+        terms << fmt::format("term{}\n", first_term + term);
+    }
+}
+
+/// Adds `count` segments with overlapping vocabularies to `dir`.
+void add_segments(
+    std::mt19937& rng, SegmentDirectory const& dir, Temporary_Directory& tmpdir, int count)
+{
+    for (int segment = 0; segment < count; ++segment) {
+        auto fwd = (tmpdir.path() / fmt::format("fwd{}", segment)).string();
+        write_segment(rng, fwd, 300 + 100 * segment, term_shift * segment);
+        add_segment<IndexType, WandType>(
+            dir, fwd, "ef", ScorerParams("bm25"), FixedBlock(5), 200, 2);
+    }
+}
+
+/// All scores of `query`, as retrieved by exhaustive search on each segment.
+auto exhaustive_scores(Segments const& index, Query const& query) -> std::vector<float>
+{
+    std::vector<float> scores;
+    for (auto const& segment: index.segments()) {
+        Query local;
+        for (auto term: query.terms) {
+            if (auto local_term = segment.local_term(term); local_term) {
+                local.terms.push_back(*local_term);
+            }
+        }
+        topk_queue topk(segment.info.num_docs);
+        ranked_or_query ranked_or(topk);
+        ranked_or(
+            make_scored_cursors(*segment.index, *segment.scorer, local), segment.info.num_docs);
+        topk.finalize();
+        for (auto [score, docid]: topk.topk()) {
+            scores.push_back(score);
+        }
+    }
+    std::sort(scores.begin(), scores.end(), std::greater<>());
+    return scores;
+}
+
+void check_page(
+    std::vector<ShardedResult> const& page,
+    std::vector<float> const& expected,
+    std::size_t first,
+    std::size_t count)
+{
+    auto last = std::min(expected.size(), first + count);
+    auto size = first < last ? last - first : 0;
+    REQUIRE(page.size() == size);
+    for (std::size_t pos = 0; pos < size; ++pos) {
+        REQUIRE(page[pos].score == Approx(expected[first + pos]).epsilon(0.01));
+    }
+}
+
+auto search(Segments const& index, Query const& query, std::string const& algorithm, std::size_t k)
+{
+    auto results = paged_search(
+        index, query, index.num_docs(), ShardedAlgorithm::parse(algorithm), k, k, nullptr);
+    return merge_shard_results(gsl::make_span(&results, 1), k, k);
+}
+
+TEST_CASE("Select segments to compact", "[segments]")
+{
+    auto segments = [](std::vector<std::uint32_t> sizes) {
+        std::vector<SegmentInfo> infos;
+        for (auto size: sizes) {
+            infos.push_back(SegmentInfo{"", size});
+        }
+        return infos;
+    };
+    using Range = std::optional<std::pair<std::size_t, std::size_t>>;
+    REQUIRE(select_compaction(segments({}), 3) == Range{});
+    REQUIRE(select_compaction(segments({5, 5}), 3) == Range{});
+    REQUIRE(select_compaction(segments({5, 5, 5, 5}), 3) == Range({0, 3}));
+    REQUIRE(select_compaction(segments({30, 30, 30, 5, 5, 5}), 3) == Range({3, 6}));
+    REQUIRE(select_compaction(segments({30, 30, 30, 5, 5}), 3) == Range({0, 3}));
+    REQUIRE(select_compaction(segments({100, 5, 5, 30, 5, 5}), 3) == Range{});
+    REQUIRE_THROWS_AS(select_compaction(segments({5}), 1), std::invalid_argument);
+}
+
+TEST_CASE("Segmented search matches exhaustive search", "[segments][query]")
+{
+    std::mt19937 rng(1729);
+    std::size_t const k = 10;
+    Temporary_Directory tmpdir;
+    SegmentDirectory dir((tmpdir.path() / "segments").string());
+    add_segments(rng, dir, tmpdir, 3);
+
+    REQUIRE(dir.terms().size() == segment_terms + 2 * term_shift);
+    REQUIRE(dir.segments().size() == 3);
+    auto index = Segments::open(dir, ScorerParams("bm25"));
+    REQUIRE(index.num_docs() == 1200);
+    REQUIRE(index.document(0) == "0-0");
+    REQUIRE(index.document(300) == "20-0");
+    REQUIRE(index.document(1199) == "40-499");
+
+    auto queries = random_queries(rng, segment_terms + 2 * term_shift, 50, 4);
+    auto algorithm = GENERATE(
+        std::string("wand"),
+        std::string("block_max_wand"),
+        std::string("maxscore"),
+        std::string("block_max_maxscore"),
+        std::string("ranked_or"),
+        std::string("wand_method_3"),
+        std::string("block_max_wand_method_3"));
+    CAPTURE(algorithm);
+    for (auto const& query: queries) {
+        auto expected = exhaustive_scores(index, query);
+        auto pages = search(index, query, algorithm, k);
+        check_page(pages.first_page, expected, 0, k);
+        check_page(pages.second_page, expected, k, k);
+    }
+
+    SECTION("Methods 1 and 2 return an exact first page")
+    {
+        for (auto method: {"wand_method_1", "wand_method_2", "block_max_wand_method_2"}) {
+            CAPTURE(method);
+            for (auto const& query: queries) {
+                auto pages = search(index, query, method, k);
+                check_page(pages.first_page, exhaustive_scores(index, query), 0, k);
+                REQUIRE(pages.second_page.size() <= k);
+            }
+        }
+    }
+}
+
+TEST_CASE("Compaction merges segments", "[segments]")
+{
+    std::mt19937 rng(4104);
+    Temporary_Directory tmpdir;
+    SegmentDirectory dir((tmpdir.path() / "segments").string());
+    add_segments(rng, dir, tmpdir, 4);
+    auto num_terms = static_cast<std::uint32_t>(dir.terms().size());
+
+    auto postings = [&] {
+        auto index = Segments::open(dir, ScorerParams("bm25"));
+        std::vector<std::vector<std::pair<std::uint32_t, std::uint32_t>>> postings;
+        for (std::uint32_t term = 0; term < num_terms; ++term) {
+            auto cursors = index.scored(Query{{}, {term}, {}});
+            auto& cursor = cursors.front();
+            postings.emplace_back();
+            for (; cursor.docid() < index.num_docs(); cursor.next()) {
+                postings.back().emplace_back(cursor.docid(), cursor.freq());
+            }
+            REQUIRE(postings.back().size() == cursor.size());
+        }
+        return postings;
+    };
+    auto documents = [&] {
+        auto index = Segments::open(dir, ScorerParams("bm25"));
+        std::vector<std::string> documents;
+        for (std::uint32_t doc = 0; doc < index.num_docs(); ++doc) {
+            documents.push_back(index.document(doc));
+        }
+        return documents;
+    };
+    auto expected_postings = postings();
+    auto expected_documents = documents();
+    auto names = dir.segments();
+
+    REQUIRE_FALSE(compact_segments<IndexType, WandType>(
+        dir, "ef", ScorerParams("bm25"), FixedBlock(5), 10));
+    REQUIRE(compact_segments<IndexType, WandType>(
+        dir, "ef", ScorerParams("bm25"), FixedBlock(5), std::nullopt));
+    REQUIRE_FALSE(compact_segments<IndexType, WandType>(
+        dir, "ef", ScorerParams("bm25"), FixedBlock(5), std::nullopt));
+
+    REQUIRE(dir.segments().size() == 1);
+    REQUIRE(dir.segments().front().num_docs == 300 + 400 + 500 + 600);
+    for (auto const& segment: names) {
+        REQUIRE_FALSE(boost::filesystem::exists(dir.index_path(segment.name)));
+    }
+    REQUIRE(postings() == expected_postings);
+    REQUIRE(documents() == expected_documents);
+
+    SECTION("Merged segment is scored with its own statistics")
+    {
+        auto index = Segments::open(dir, ScorerParams("bm25"));
+        auto const& segment = index.segments()[0];
+        REQUIRE(segment.wdata->num_docs() == index.num_docs());
+        for (auto const& query: random_queries(rng, num_terms, 50, 4)) {
+            auto pages = search(index, query, "block_max_wand", 10);
+            check_page(pages.first_page, exhaustive_scores(index, query), 0, 10);
+        }
+    }
+}
@@ -0,0 +1,294 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "cursor/scored_cursor.hpp"
+#include "index_types.hpp"
+#include "query/algorithm.hpp"
+#include "query/selective_search.hpp"
+#include "query/sharded_search.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+#include "test_common.hpp"
+
+using namespace pisa;
+
+using WandType = wand_data<wand_data_raw>;
+
+/// Three random shards, and a searcher over them.
+struct TestShards {
+    TestShards(std::mt19937& rng, uint32_t num_terms)
+        : searcher(build(rng, num_terms, index_ptrs, wand_ptrs))
+    {}
+
+    /// All results of `query` in all shards, as retrieved by exhaustive search.
+    [[nodiscard]] auto exhaustive(Query const& query) const -> std::vector<ShardedResult>
+    {
+        std::vector<ShardedResult> results;
+        for (std::size_t shard = 0; shard < index_ptrs.size(); ++shard) {
+            auto scorer = scorer::from_params(ScorerParams("bm25"), *wand_ptrs[shard]);
+            topk_queue topk(index_ptrs[shard]->num_docs());
+            ranked_or_query ranked_or(topk);
+            ranked_or(
+                make_scored_cursors(*index_ptrs[shard], *scorer, query),
+                index_ptrs[shard]->num_docs());
+            topk.finalize();
+            for (auto [score, docid]: topk.topk()) {
+                results.push_back(ShardedResult{score, Shard_Id(shard), docid});
+            }
+        }
+        std::sort(results.begin(), results.end(), [](auto const& lhs, auto const& rhs) {
+            return lhs.score > rhs.score;
+        });
+        return results;
+    }
+
+    std::vector<single_index const*> index_ptrs{};
+    std::vector<WandType const*> wand_ptrs{};
+    ShardedSearcher<single_index, WandType> searcher;
+
+  private:
+    static auto build(
+        std::mt19937& rng,
+        uint32_t num_terms,
+        std::vector<single_index const*>& index_ptrs,
+        std::vector<WandType const*>& wand_ptrs) -> ShardedSearcher<single_index, WandType>
+    {
+        std::vector<std::unique_ptr<single_index>> indexes(3);
+        std::vector<std::unique_ptr<WandType>> wdata(3);
+        for (std::size_t shard = 0; shard < indexes.size(); ++shard) {
+            indexes[shard] = std::make_unique<single_index>();
+            wdata[shard] = std::make_unique<WandType>();
+            build_random_index(
+                random_collection(rng, 500 + 100 * shard, num_terms),
+                *indexes[shard],
+                *wdata[shard]);
+            index_ptrs.push_back(indexes[shard].get());
+            wand_ptrs.push_back(wdata[shard].get());
+        }
+        return ShardedSearcher<single_index, WandType>(
+            std::move(indexes), std::move(wdata), ScorerParams("bm25"));
+    }
+};
+
+TEST_CASE("Queues sharing a threshold", "[sharded]")
+{
+    SharedThreshold shared(1.0F);
+    topk_queue first(2);
+    topk_queue second(2);
+    first.share_threshold(&shared);
+    second.share_threshold(&shared);
+    REQUIRE_FALSE(second.would_enter(1.0F));
+    REQUIRE(second.insert(1.5F, 1));
+    REQUIRE(first.insert(4.0F, 2));
+    REQUIRE(first.insert(3.0F, 3));
+    REQUIRE(shared.get() == 3.0F);
+    // The second queue reads the raised threshold once its own threshold changes.
+    REQUIRE(second.insert(2.0F, 4));
+    REQUIRE(second.threshold() == 1.5F);
+    REQUIRE_FALSE(second.would_enter(2.5F));
+    REQUIRE(second.would_enter(3.5F));
+    second.finalize();
+    REQUIRE(second.topk() == std::vector<topk_queue::entry_type>{{2.0F, 4}, {1.5F, 1}});
+}
+
+TEST_CASE("Merge shard results", "[sharded]")
+{
+    std::vector<ShardResults> shards{
+        ShardResults{{{5.0F, 1}, {3.0F, 2}}, {{2.5F, 4}, {0.0F, 0}}},
+        ShardResults{{{4.0F, 7}, {3.0F, 1}}, {{1.0F, 9}}},
+    };
+    auto pages = merge_shard_results(shards, 3, 3);
+    REQUIRE(
+        pages.first_page
+        == std::vector<ShardedResult>{{5.0F, Shard_Id(0), 1}, {4.0F, Shard_Id(1), 7}, {3.0F, Shard_Id(0), 2}});
+    REQUIRE(
+        pages.second_page
+        == std::vector<ShardedResult>{{3.0F, Shard_Id(1), 1}, {2.5F, Shard_Id(0), 4}, {1.0F, Shard_Id(1), 9}});
+}
+
+TEST_CASE("Parse sharded algorithm", "[sharded]")
+{
+    REQUIRE(ShardedAlgorithm::parse("wand").method == PageMethod::None);
+    auto parsed = ShardedAlgorithm::parse("block_max_wand_method_3");
+    REQUIRE(parsed.name == "block_max_wand");
+    REQUIRE(parsed.method == PageMethod::Three);
+    REQUIRE_THROWS_AS(ShardedAlgorithm::parse("maxscore_method_1"), std::invalid_argument);
+    REQUIRE_THROWS_AS(ShardedAlgorithm::parse("wand_method_4"), std::invalid_argument);
+    REQUIRE_THROWS_AS(ShardedAlgorithm::parse("unknown"), std::invalid_argument);
+}
+
+TEST_CASE("Sharded search matches exhaustive search", "[sharded][query]")
+{
+    std::mt19937 rng(1729);
+    std::size_t const k = 10;
+    std::size_t const secondary_k = 10;
+    uint32_t const num_terms = 40;
+
+    TestShards shards(rng, num_terms);
+    auto const& searcher = shards.searcher;
+    auto queries = random_queries(rng, num_terms, 50, 4);
+
+    auto expected_scores = [&](Query const& query) {
+        std::vector<float> scores;
+        for (auto const& result: shards.exhaustive(query)) {
+            scores.push_back(result.score);
+        }
+        return scores;
+    };
+    auto check_page = [](std::vector<ShardedResult> const& page,
+                         std::vector<float> const& expected,
+                         std::size_t first,
+                         std::size_t count) {
+        auto last = std::min(expected.size(), first + count);
+        auto size = first < last ? last - first : 0;
+        REQUIRE(page.size() == size);
+        for (std::size_t pos = 0; pos < size; ++pos) {
+            REQUIRE(page[pos].score == Approx(expected[first + pos]).epsilon(0.01));
+        }
+    };
+
+    auto algorithm = GENERATE(
+        std::string("wand"),
+        std::string("block_max_wand"),
+        std::string("maxscore"),
+        std::string("block_max_maxscore"),
+        std::string("ranked_or"),
+        std::string("wand_method_3"),
+        std::string("block_max_wand_method_3"));
+    CAPTURE(algorithm);
+    auto parsed = ShardedAlgorithm::parse(algorithm);
+    for (auto const& query: queries) {
+        std::vector<Query> shard_queries(searcher.shard_count(), query);
+        auto expected = expected_scores(query);
+        auto pages = searcher.search(shard_queries, parsed, k, secondary_k);
+        check_page(pages.first_page, expected, 0, k);
+        check_page(pages.second_page, expected, k, secondary_k);
+    }
+
+    SECTION("Methods 1 and 2 return an exact first page")
+    {
+        for (auto method: {"wand_method_1", "wand_method_2", "block_max_wand_method_2"}) {
+            CAPTURE(method);
+            for (auto const& query: queries) {
+                std::vector<Query> shard_queries(searcher.shard_count(), query);
+                auto expected = expected_scores(query);
+                auto pages = searcher.search(
+                    shard_queries, ShardedAlgorithm::parse(method), k, secondary_k);
+                check_page(pages.first_page, expected, 0, k);
+                REQUIRE(pages.second_page.size() <= secondary_k);
+                for (auto const& result: pages.second_page) {
+                    REQUIRE(result.score <= pages.first_page.back().score);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Select shards from estimates", "[sharded][selective]")
+{
+    std::vector<double> first_page{0.2, 3.0, 0.5, 1.2};
+    std::vector<double> second_page{0.9, 5.0, 1.5, 2.0};
+    auto selection = select_shards(first_page, second_page, 1.0);
+    REQUIRE(selection.first_page == std::vector<Shard_Id>{Shard_Id(1), Shard_Id(3)});
+    REQUIRE(selection.second_page == std::vector<Shard_Id>{Shard_Id(2)});
+
+    selection = select_shards(first_page, second_page, 4.0);
+    REQUIRE(selection.first_page == std::vector<Shard_Id>{Shard_Id(1)});
+    REQUIRE(selection.second_page.empty());
+
+    REQUIRE_THROWS_AS(
+        select_shards(first_page, gsl::span<double const>(second_page).first(2), 1.0),
+        std::invalid_argument);
+}
+
+TEST_CASE("Selective search", "[sharded][selective][query]")
+{
+    std::mt19937 rng(4104);
+    std::size_t const k = 10;
+    std::size_t const secondary_k = 10;
+    uint32_t const num_terms = 40;
+    TestShards shards(rng, num_terms);
+    auto queries = random_queries(rng, num_terms, 50, 4);
+
+    auto algorithm = GENERATE(
+        std::string("wand"), std::string("maxscore"), std::string("block_max_wand_method_3"));
+    CAPTURE(algorithm);
+    auto parsed = ShardedAlgorithm::parse(algorithm);
+
+    for (auto const& query: queries) {
+        std::vector<Query> shard_queries(shards.searcher.shard_count(), query);
+        auto exhaustive = shards.exhaustive(query);
+        std::size_t postings = 0;
+        for (std::size_t shard = 0; shard < shards.searcher.shard_count(); ++shard) {
+            postings += shards.searcher.postings(Shard_Id(shard), query);
+        }
+
+        {
+            INFO("All shards selected for the first page");
+            ShardSelection selection{{Shard_Id(0), Shard_Id(1), Shard_Id(2)}, {}};
+            SelectiveQuery selective(
+                shards.searcher, shard_queries, selection, parsed, k, secondary_k);
+            auto exact = shards.searcher.search(shard_queries, parsed, k, secondary_k);
+            REQUIRE(selective.first_page().size() == exact.first_page.size());
+            REQUIRE(selective.second_page().size() == exact.second_page.size());
+            for (std::size_t pos = 0; pos < exact.first_page.size(); ++pos) {
+                REQUIRE(selective.first_page()[pos].score == exact.first_page[pos].score);
+            }
+            for (std::size_t pos = 0; pos < exact.second_page.size(); ++pos) {
+                REQUIRE(selective.second_page()[pos].score == exact.second_page[pos].score);
+            }
+            REQUIRE(selective.cost().shards == 3);
+            REQUIRE(selective.cost().postings == postings);
+        }
+
+        {
+            INFO("Additional shards searched for the second page");
+            ShardSelection selection{{Shard_Id(0)}, {Shard_Id(1), Shard_Id(2)}};
+            SelectiveQuery selective(
+                shards.searcher, shard_queries, selection, parsed, k, secondary_k);
+            auto const& first_page = selective.first_page();
+            REQUIRE(selective.cost().shards == 1);
+            REQUIRE(selective.cost().postings == shards.searcher.postings(Shard_Id(0), query));
+            REQUIRE(selective.cost().exhaustive_shards == 3);
+            REQUIRE(selective.cost().exhaustive_postings == postings);
+
+            std::vector<ShardedResult> expected_first;
+            std::copy_if(
+                exhaustive.begin(),
+                exhaustive.end(),
+                std::back_inserter(expected_first),
+                [](auto const& result) { return result.shard == Shard_Id(0); });
+            expected_first.resize(std::min(expected_first.size(), k));
+            REQUIRE(first_page.size() == expected_first.size());
+            for (std::size_t pos = 0; pos < first_page.size(); ++pos) {
+                REQUIRE(first_page[pos].score == Approx(expected_first[pos].score).epsilon(0.01));
+            }
+
+            auto const& second_page = selective.second_page();
+            REQUIRE(selective.cost().shards == 3);
+            REQUIRE(selective.cost().postings == postings);
+            std::vector<ShardedResult> expected_second;
+            std::copy_if(
+                exhaustive.begin(),
+                exhaustive.end(),
+                std::back_inserter(expected_second),
+                [&](auto const& result) {
+                    auto shown = [&](auto const& r) {
+                        return r.shard == result.shard && r.docid == result.docid;
+                    };
+                    return std::none_of(first_page.begin(), first_page.end(), shown);
+                });
+            expected_second.resize(std::min(expected_second.size(), secondary_k));
+            REQUIRE(second_page.size() == expected_second.size());
+            for (std::size_t pos = 0; pos < second_page.size(); ++pos) {
+                REQUIRE(
+                    second_page[pos].score == Approx(expected_second[pos].score).epsilon(0.01));
+            }
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "query/stem_cache.hpp"
+
+using namespace pisa;
+
+TEST_CASE("Stem cache returns stems of the wrapped stemmer", "[stem_cache][unit]")
+{
+    std::size_t stemmer_calls = 0;
+    auto stemmer = [&](std::string term) {
+        ++stemmer_calls;
+        return term.substr(0, term.size() / 2 + 1);
+    };
+    std::size_t capacity = GENERATE(8, 64, 4096);
+    StemCache cache(stemmer, capacity);
+
+    std::mt19937 rng(1729);
+    std::uniform_int_distribution<int> term_dist(0, 999);
+    std::uniform_int_distribution<int> repeat_dist(1, 40);
+    std::vector<std::string> terms;
+    for (int idx = 0; idx < 10'000; ++idx) {
+        auto term = std::to_string(term_dist(rng));
+        terms.push_back(std::string(repeat_dist(rng), 'x') + term);
+    }
+    for (auto const& term: terms) {
+        CAPTURE(term);
+        REQUIRE(cache.stem(term) == term.substr(0, term.size() / 2 + 1));
+    }
+    REQUIRE(cache.hits() + cache.misses() == terms.size());
+    REQUIRE(cache.misses() == stemmer_calls);
+    if (capacity == 4096) {
+        REQUIRE(cache.hits() > 0);
+    }
+}
+
+TEST_CASE("Stem cache hits repeated terms", "[stem_cache][unit]")
+{
+    StemCache cache([](std::string term) { return term + "s"; });
+    REQUIRE(cache("word") == "words");
+    REQUIRE(cache.misses() == 1);
+    REQUIRE(cache.hits() == 0);
+    REQUIRE(cache("word") == "words");
+    REQUIRE(cache.misses() == 1);
+    REQUIRE(cache.hits() == 1);
+    std::string long_term(StemCache::max_term_length + 1, 'a');
+    REQUIRE(cache(long_term) == long_term + "s");
+    REQUIRE(cache(long_term) == long_term + "s");
+    REQUIRE(cache.misses() == 3);
+}
+
+TEST_CASE("Thread-local stem cache sums statistics", "[stem_cache][unit]")
+{
+    ThreadLocalStemCache cache([] { return [](std::string term) { return term; }; });
+    REQUIRE(cache("a") == "a");
+    REQUIRE(cache("a") == "a");
+    REQUIRE(cache("b") == "b");
+    REQUIRE(cache.hits() == 1);
+    REQUIRE(cache.misses() == 2);
+    REQUIRE(cache.hit_rate() == Approx(1.0 / 3));
+}
@@ -0,0 +1,122 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <rapidcheck.h>
+
+#include "string_table.hpp"
+
+using namespace pisa;
+
+namespace {
+
+auto encode(std::vector<std::string> const& values, std::uint64_t block_size) -> std::string
+{
+    std::ostringstream os;
+    auto builder = encode_string_table(values.begin(), values.end(), block_size);
+    builder.to_stream(os);
+    REQUIRE(os.str().size() == builder.bytes());
+    return os.str();
+}
+
+}  // namespace
+
+TEST_CASE("String table random access and iteration", "[string_table][prop]")
+{
+    rc::check([](std::vector<std::string> values, std::uint64_t block_size) {
+        block_size = block_size % 32 + 1;
+        auto buffer = encode(values, block_size);
+        auto table = StringTable::from(buffer);
+        REQUIRE(table.size() == values.size());
+        for (std::size_t idx = 0; idx < values.size(); ++idx) {
+            REQUIRE(table[idx] == values[idx]);
+        }
+        std::string decoded;
+        for (auto idx = values.size(); idx > 0; --idx) {
+            auto value = table.lookup(idx - 1, decoded);
+            REQUIRE(value == values[idx - 1]);
+            if ((idx - 1) % block_size == 0) {
+                // Restart points are viewed in the table memory without being copied.
+                REQUIRE(value.data() >= buffer.data());
+                REQUIRE(value.data() + value.size() <= buffer.data() + buffer.size());
+            }
+        }
+        REQUIRE(std::vector<std::string>(table.begin(), table.end()) == values);
+        REQUIRE_THROWS_AS(table[values.size()], std::out_of_range);
+        REQUIRE_THROWS_AS(table.lookup(values.size(), decoded), std::out_of_range);
+    });
+}
+
+TEST_CASE("Sorted string table lookups", "[string_table][prop]")
+{
+    rc::check([](std::vector<std::string> values, std::string value) {
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+        auto buffer = encode(values, string_table::default_block_size);
+        auto table = StringTable::from(buffer);
+        REQUIRE(table.sorted());
+
+        auto first = std::lower_bound(values.begin(), values.end(), value);
+        auto last = std::find_if(first, values.end(), [&](auto const& current) {
+            return current.compare(0, value.size(), value) != 0;
+        });
+        REQUIRE(table.lower_bound(value) == std::distance(values.begin(), first));
+        REQUIRE(
+            table.prefix(value)
+            == std::pair<std::size_t, std::size_t>(
+                std::distance(values.begin(), first), std::distance(values.begin(), last)));
+        if (first != values.end() && *first == value) {
+            REQUIRE(table.find(value) == std::distance(values.begin(), first));
+        } else {
+            REQUIRE_FALSE(table.find(value).has_value());
+        }
+    });
+}
+
+TEST_CASE("Unsorted string table rejects binary search", "[string_table][unit]")
+{
+    auto buffer = encode({"b", "a"}, 16);
+    auto table = StringTable::from(buffer);
+    REQUIRE_FALSE(table.sorted());
+    REQUIRE_THROWS_AS(table.find("a"), std::logic_error);
+}
+
+TEST_CASE("String table is smaller than payload vector for titles", "[string_table][unit]")
+{
+    std::vector<std::string> titles;
+    for (int idx = 0; idx < 10'000; ++idx) {
+        titles.push_back(fmt::format("clueweb09-en0000-{:02}-{:05}", idx / 1000, idx % 1000));
+    }
+    auto buffer = encode(titles, string_table::default_block_size);
+    std::ostringstream payload_vector;
+    encode_payload_vector(gsl::make_span(titles)).to_stream(payload_vector);
+    REQUIRE(buffer.size() * 3 < payload_vector.str().size());
+}
+
+TEST_CASE("Lexicon reads both formats", "[string_table][unit]")
+{
+    std::vector<std::string> values{"a", "account", "he", "she", "usa", "world"};
+    auto table_buffer = encode(values, 4);
+    std::ostringstream os;
+    encode_payload_vector(gsl::make_span(values)).to_stream(os);
+    auto payload_buffer = os.str();
+    for (auto const& buffer: {table_buffer, payload_buffer}) {
+        auto lexicon = Lexicon::from(buffer);
+        REQUIRE(lexicon.is_string_table() == (buffer == table_buffer));
+        REQUIRE(lexicon.size() == values.size());
+        std::vector<std::string> read;
+        std::string decoded;
+        lexicon.for_each([&](auto value) { read.emplace_back(value); });
+        REQUIRE(read == values);
+        for (std::size_t idx = 0; idx < values.size(); ++idx) {
+            REQUIRE(lexicon[idx] == values[idx]);
+            REQUIRE(lexicon.lookup(idx, decoded) == values[idx]);
+            REQUIRE(lexicon.find(values[idx]) == idx);
+        }
+        REQUIRE_FALSE(lexicon.find("b").has_value());
+    }
+}
@@ -0,0 +1,132 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "block_freq_index.hpp"
+#include "codec/block_codecs.hpp"
+#include "hot_cold_layout.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "temporary_directory.hpp"
+#include "term_layout.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+#include "test_common.hpp"
+
+using namespace pisa;
+
+using index_type = block_freq_index<interpolative_block>;
+using WandType = wand_data<wand_data_raw>;
+
+TEST_CASE("Term layout must be a permutation", "[layout]")
+{
+    REQUIRE(TermLayout().empty());
+    REQUIRE(TermLayout().position(7) == 7);
+    TermLayout layout(std::vector<std::uint32_t>{2, 0, 1});
+    REQUIRE(layout.position(0) == 1);
+    REQUIRE(layout.position(1) == 2);
+    REQUIRE(layout.position(2) == 0);
+    REQUIRE_THROWS_AS(TermLayout(std::vector<std::uint32_t>{0, 0, 1}), std::invalid_argument);
+    REQUIRE_THROWS_AS(TermLayout(std::vector<std::uint32_t>{0, 3, 1}), std::invalid_argument);
+}
+
+TEST_CASE("Term accesses from a block profile", "[layout]")
+{
+    std::istringstream is("2\t3\t4\n0\t1\n\n2\t1\n");
+    auto accesses = term_accesses_from_profile(is, 3);
+    REQUIRE(accesses == std::vector<std::uint64_t>{1, 0, 8});
+    std::istringstream out_of_range("3\t1\n");
+    REQUIRE_THROWS_AS(term_accesses_from_profile(out_of_range, 3), std::out_of_range);
+}
+
+TEST_CASE("Hot/cold layout keeps term IDs", "[layout][index]")
+{
+    std::mt19937 rng(1729);
+    std::uint32_t const num_docs = 2000;
+    std::uint32_t const num_terms = 100;
+    auto collection = random_collection(rng, num_docs, num_terms);
+    auto const& documents = collection.documents;
+    auto const& frequencies = collection.frequencies;
+
+    Temporary_Directory tmpdir;
+    auto index_filename = (tmpdir.path() / "index").string();
+    auto wand_filename = (tmpdir.path() / "wand").string();
+    auto hot_index_filename = (tmpdir.path() / "hot.index").string();
+    auto hot_wand_filename = (tmpdir.path() / "hot.wand").string();
+    {
+        index_type index;
+        WandType wdata;
+        build_random_index(collection, index, wdata);
+        mapper::freeze(index, index_filename.c_str());
+        mapper::freeze(wdata, wand_filename.c_str());
+    }
+
+    index_type index(MemorySource::mapped_file(index_filename));
+    WandType wdata(MemorySource::mapped_file(wand_filename));
+    REQUIRE(index.layout().empty());
+
+    std::vector<Query> queries;
+    std::uniform_int_distribution<std::uint32_t> term_dist(0, 9);
+    for (int idx = 0; idx < 20; ++idx) {
+        Query query;
+        query.terms = {term_dist(rng) * 7, term_dist(rng) * 7};
+        queries.push_back(query);
+    }
+    auto accesses = term_accesses_from_queries(queries, num_terms);
+    auto order = hot_cold_order(index, accesses);
+    write_with_layout(index, order, hot_index_filename);
+    {
+        WandType hot_wdata(MemorySource::mapped_file(wand_filename));
+        hot_wdata.reorder_lists(order);
+        hot_wdata.freeze(hot_wand_filename);
+    }
+
+    index_type hot_index(MemorySource::mapped_file(hot_index_filename));
+    WandType hot_wdata(MemorySource::mapped_file(hot_wand_filename));
+    REQUIRE(hot_index.size() == num_terms);
+    REQUIRE(hot_index.num_docs() == num_docs);
+    REQUIRE(not hot_index.layout().empty());
+    REQUIRE(not hot_wdata.layout().empty());
+
+    // Every accessed list is stored before every list that is never accessed.
+    auto const* base = hot_index.posting_list_memory(order.front()).data();
+    std::ptrdiff_t last_hot_offset = 0;
+    std::ptrdiff_t first_cold_offset = PTRDIFF_MAX;
+    for (std::uint32_t term = 0; term < num_terms; ++term) {
+        auto offset = hot_index.posting_list_memory(term).data() - base;
+        REQUIRE(offset >= 0);
+        if (accesses[term] > 0) {
+            last_hot_offset = std::max(last_hot_offset, offset);
+        } else {
+            first_cold_offset = std::min(first_cold_offset, offset);
+        }
+    }
+    REQUIRE(last_hot_offset < first_cold_offset);
+
+    for (std::uint32_t term = 0; term < num_terms; ++term) {
+        auto cursor = hot_index[term];
+        REQUIRE(cursor.size() == documents[term].size());
+        for (std::size_t pos = 0; pos < documents[term].size(); ++pos, cursor.next()) {
+            REQUIRE(cursor.docid() == documents[term][pos]);
+            REQUIRE(cursor.freq() == frequencies[term][pos]);
+        }
+        REQUIRE(cursor.docid() == num_docs);
+
+        REQUIRE(hot_wdata.max_term_weight(term) == wdata.max_term_weight(term));
+        REQUIRE(hot_wdata.term_posting_count(term) == wdata.term_posting_count(term));
+        auto expected = wdata.getenum(term);
+        auto actual = hot_wdata.getenum(term);
+        for (auto doc: documents[term]) {
+            expected.next_geq(doc);
+            actual.next_geq(doc);
+            REQUIRE(actual.docid() == expected.docid());
+            REQUIRE(actual.score() == expected.score());
+        }
+    }
+}
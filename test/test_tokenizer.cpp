@@ -6,6 +6,7 @@
 #include <boost/iterator/filter_iterator.hpp>
 #include <boost/spirit/include/lex_lexertl.hpp>
 #include <gsl/span>
+#include <rapidcheck.h>
 
 #include "payload_vector.hpp"
 #include "query/queries.hpp"
@@ -24,6 +25,29 @@ TEST_CASE("TermTokenizer")
             "a", "1", "12", "w0rd", "token", "izer", "pup", "USa", "us", "hel", "lo"});
 }
 
+TEST_CASE("FastTermTokenizer")
+{
+    std::string str("a 1 12 w0rd, token-izer. pup's, U.S.a., us., hel.lo");
+    FastTermTokenizer tokenizer(str);
+    REQUIRE(
+        std::vector<std::string>(tokenizer.begin(), tokenizer.end())
+        == std::vector<std::string>{
+            "a", "1", "12", "w0rd", "token", "izer", "pup", "USa", "us", "hel", "lo"});
+}
+
+TEST_CASE("FastTermTokenizer produces the same terms as TermTokenizer")
+{
+    std::string alphabet("aBz09.'' ,-\n\xC3\xA9");
+    rc::check([&] {
+        auto text = *rc::gen::container<std::string>(rc::gen::elementOf(alphabet));
+        TermTokenizer expected(text);
+        FastTermTokenizer actual(text);
+        REQUIRE(
+            std::vector<std::string>(actual.begin(), actual.end())
+            == std::vector<std::string>(expected.begin(), expected.end()));
+    });
+}
+
 TEST_CASE("Parse query terms to ids")
 {
     Temporary_Directory tmpdir;
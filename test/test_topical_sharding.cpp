@@ -0,0 +1,108 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "binary_collection.hpp"
+#include "temporary_directory.hpp"
+#include "topical_sharding.hpp"
+
+using namespace pisa;
+
+void write_collection(std::string const& path, std::vector<std::vector<std::uint32_t>> const& documents)
+{
+    std::ofstream os(path, std::ios::binary);
+    auto write = [&](std::uint32_t value) {
+        os.write(reinterpret_cast<char const*>(&value), sizeof(value));
+    };
+    write(1);
+    write(documents.size());
+    for (auto const& document: documents) {
+        write(document.size());
+        for (auto term: document) {
+            write(term);
+        }
+    }
+}
+
+TEST_CASE("Clustering features", "[topical_sharding]")
+{
+    Temporary_Directory tmpdir;
+    auto path = (tmpdir.path() / "fwd").string();
+    write_collection(path, {{0, 1, 1, 2}, {0, 2}, {0, 3, 3}, {0, 1}, {4}});
+    binary_collection collection(path.c_str());
+
+    SECTION("Terms occurring in too many documents are skipped")
+    {
+        auto features = ClusteringFeatures::from_collection(collection, 10, 0.5);
+        REQUIRE(features.size() == 4);
+        REQUIRE(features.vectorize(std::vector<std::uint32_t>{0}).empty());
+    }
+    SECTION("The most frequent terms are selected")
+    {
+        auto features = ClusteringFeatures::from_collection(collection, 2, 0.5);
+        REQUIRE(features.size() == 2);
+        REQUIRE(features.vectorize(std::vector<std::uint32_t>{3, 4}).empty());
+        auto vector = features.vectorize(std::vector<std::uint32_t>{2, 1, 1, 3});
+        REQUIRE(vector.size() == 2);
+        REQUIRE(vector[0].first == 0);
+        REQUIRE(vector[1].first == 1);
+        REQUIRE(vector[0].second > vector[1].second);
+        REQUIRE(
+            vector[0].second * vector[0].second + vector[1].second * vector[1].second
+            == Approx(1.0));
+    }
+}
+
+TEST_CASE("Topical shards", "[topical_sharding]")
+{
+    std::mt19937 rng(271828);
+    std::uniform_int_distribution<std::uint32_t> topic_term(0, 19);
+    std::uniform_int_distribution<std::uint32_t> common_term(60, 69);
+    std::uniform_int_distribution<std::size_t> length(5, 20);
+    std::size_t const topic_count = 3;
+    std::vector<std::vector<std::uint32_t>> documents;
+    std::vector<std::size_t> topics;
+    for (std::size_t doc = 0; doc < 600; ++doc) {
+        auto topic = doc % topic_count;
+        std::vector<std::uint32_t> document;
+        std::generate_n(std::back_inserter(document), length(rng), [&] {
+            return topic * 20 + topic_term(rng);
+        });
+        document.push_back(common_term(rng));
+        documents.push_back(document);
+        topics.push_back(topic);
+    }
+    documents.emplace_back();
+
+    Temporary_Directory tmpdir;
+    auto path = (tmpdir.path() / "fwd").string();
+    write_collection(path, documents);
+    binary_collection collection(path.c_str());
+
+    auto features = ClusteringFeatures::from_collection(collection, 100, 0.5);
+    auto sample = sample_documents(collection, features, 90, 17);
+    REQUIRE(sample.size() == 90);
+    auto centroids = TopicCentroids::fit(sample, topic_count, features.size(), 10, 17);
+    REQUIRE(centroids.size() == topic_count);
+
+    auto batch_size = GENERATE(std::size_t{7}, std::size_t{1000});
+    auto mapping = topical_mapping(collection, features, centroids, batch_size);
+    REQUIRE(mapping.size() == documents.size());
+    std::vector<Shard_Id> topic_shards(topic_count);
+    for (std::size_t topic = 0; topic < topic_count; ++topic) {
+        topic_shards[topic] = mapping[Document_Id(topic)];
+    }
+    std::sort(topic_shards.begin(), topic_shards.end());
+    REQUIRE(std::unique(topic_shards.begin(), topic_shards.end()) == topic_shards.end());
+    for (std::size_t doc = 0; doc < topics.size(); ++doc) {
+        REQUIRE(mapping[Document_Id(doc)] == mapping[Document_Id(topics[doc])]);
+    }
+
+    REQUIRE_THROWS_AS(
+        TopicCentroids::fit(sample, sample.size() + 1, features.size(), 10, 17),
+        std::invalid_argument);
+}
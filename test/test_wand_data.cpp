@@ -2,6 +2,7 @@
 #include "catch2/catch.hpp"
 
 #include <functional>
+#include <type_traits>
 
 #include <range/v3/view/iota.hpp>
 #include <range/v3/view/zip.hpp>
@@ -9,10 +10,13 @@
 
 #include "test_common.hpp"
 
+#include "configuration.hpp"
 #include "index_types.hpp"
+#include "linear_quantizer.hpp"
 #include "pisa_config.hpp"
 #include "query/queries.hpp"
 #include "wand_data.hpp"
+#include "wand_data_compressed.hpp"
 #include "wand_data_range.hpp"
 
 #include "scorer/scorer.hpp"
@@ -128,3 +132,84 @@ TEST_CASE("wand_data_range")
         }
     }
 }
+
+TEMPLATE_TEST_CASE(
+    "Parallel wand data matches the serial builder",
+    "[wand_data]",
+    wand_data_raw,
+    wand_data_compressed<>,
+    (wand_data_range<64, 1024>))
+{
+    tbb::task_scheduler_init init;
+    using WandType = wand_data<TestType>;
+
+    binary_freq_collection const collection(PISA_SOURCE_DIR "/test/test_data/test_collection");
+    binary_collection document_sizes(PISA_SOURCE_DIR "/test/test_data/test_collection.sizes");
+    std::unordered_set<size_t> dropped_term_ids{0, 3};
+    auto block_size = GENERATE(BlockSize(FixedBlock(5)), BlockSize(VariableBlock(12.0)));
+    auto quantized = GENERATE(false, true);
+    CAPTURE(block_size.which());
+    CAPTURE(quantized);
+    WandType wdata(
+        document_sizes.begin()->begin(),
+        collection.num_docs(),
+        collection,
+        ScorerParams("bm25"),
+        block_size,
+        quantized,
+        dropped_term_ids);
+
+    // Lists are added one at a time to the block-max builder, in term order.
+    global_parameters params;
+    typename TestType::builder serial(collection.num_docs(), params);
+    auto scorer = scorer::from_params(ScorerParams("bm25"), wdata);
+    std::vector<float> max_term_weights;
+    size_t term_id = 0;
+    size_t new_term_id = 0;
+    for (auto const& seq: collection) {
+        if (dropped_term_ids.find(term_id++) != dropped_term_ids.end()) {
+            continue;
+        }
+        REQUIRE(wdata.term_posting_count(new_term_id) == seq.docs.size());
+        REQUIRE(
+            wdata.term_occurrence_count(new_term_id)
+            == std::accumulate(seq.freqs.begin(), seq.freqs.end(), 0));
+        max_term_weights.push_back(serial.add_sequence(
+            seq, collection, {}, wdata.avg_len(), scorer->term_scorer(new_term_id), block_size));
+        new_term_id += 1;
+    }
+    REQUIRE(new_term_id == collection.size() - dropped_term_ids.size());
+    auto index_max_term_weight =
+        *std::max_element(max_term_weights.begin(), max_term_weights.end());
+    REQUIRE(wdata.index_max_term_weight() == index_max_term_weight);
+    if (quantized) {
+        LinearQuantizer quantizer(index_max_term_weight, configuration::get().quantization_bits);
+        for (auto&& w: max_term_weights) {
+            w = quantizer(w);
+        }
+        serial.quantize_block_max_term_weights(index_max_term_weight);
+    }
+    TestType expected;
+    serial.build(expected);
+
+    term_id = 0;
+    new_term_id = 0;
+    for (auto const& seq: collection) {
+        if (dropped_term_ids.find(term_id++) != dropped_term_ids.end()) {
+            continue;
+        }
+        REQUIRE(wdata.max_term_weight(new_term_id) == max_term_weights[new_term_id]);
+        // Range blocks are stored only for long enough lists.
+        if (not std::is_same_v<TestType, wand_data_range<64, 1024>> || seq.docs.size() >= 1024) {
+            auto actual_enum = wdata.getenum(new_term_id);
+            auto expected_enum = expected.get_enum(new_term_id, index_max_term_weight);
+            for (auto docid: seq.docs) {
+                actual_enum.next_geq(docid);
+                expected_enum.next_geq(docid);
+                REQUIRE(actual_enum.docid() == expected_enum.docid());
+                REQUIRE(actual_enum.score() == expected_enum.score());
+            }
+        }
+        new_term_id += 1;
+    }
+}
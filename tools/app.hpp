@@ -12,6 +12,7 @@
 #include <spdlog/spdlog.h>
 
 #include "io.hpp"
+#include "memory_source.hpp"
 #include "query/queries.hpp"
 #include "scorer/scorer.hpp"
 #include "sharding.hpp"
@@ -79,6 +80,9 @@ namespace arg {
 
         [[nodiscard]] auto index_filename() const -> std::string const& { return m_index; }
 
+        /// Transform paths for `shard`.
+        void apply_shard(Shard_Id shard) { m_index = expand_shard(m_index, shard); }
+
       private:
         std::string m_index;
     };
@@ -126,6 +130,10 @@ namespace arg {
 
       protected:
         [[nodiscard]] auto terms_option() const -> CLI::Option* { return m_terms_option; }
+        [[nodiscard]] auto term_lexicon() const -> std::optional<std::string> const&
+        {
+            return m_term_lexicon;
+        }
         void override_term_lexicon(std::string term_lexicon) { m_term_lexicon = term_lexicon; }
 
       private:
@@ -230,6 +238,41 @@ namespace arg {
         CLI::Option* m_option;
     };
 
+    struct Loading {
+        explicit Loading(CLI::App* app)
+        {
+            app->add_option(
+                   "--load-policy",
+                   m_load_policy,
+                   "How memory-mapped structures are loaded: warmup, lazy, parallel, populate, "
+                   "willneed, hugepage, or random",
+                   true)
+                ->check(CLI::IsMember(
+                    {"warmup", "lazy", "parallel", "populate", "willneed", "hugepage", "random"}));
+            app->add_option(
+                "--mlock",
+                m_locked,
+                "Structures to lock in memory: wand, index, or a member such as index.m_endpoints");
+            app->add_flag(
+                "--load-report", m_report, "Report load times and resident bytes of structures");
+        }
+
+        [[nodiscard]] auto load_policy() const -> ::pisa::LoadPolicy
+        {
+            return parse_load_policy(m_load_policy);
+        }
+        [[nodiscard]] auto locked_structures() const -> std::vector<std::string> const&
+        {
+            return m_locked;
+        }
+        [[nodiscard]] auto load_report() const -> bool { return m_report; }
+
+      private:
+        std::string m_load_policy = "warmup";
+        std::vector<std::string> m_locked;
+        bool m_report = false;
+    };
+
     struct Verbose {
         explicit Verbose(CLI::App* app)
         {
@@ -288,6 +331,11 @@ namespace arg {
                 ->required();
             app->add_option(
                 "--term-count", m_term_count, "Number of distinct terms in the forward index");
+            app->add_option(
+                "--memory-budget",
+                m_memory_budget_mb,
+                "Memory budget in MB; batches are sized to fit it and spilled as compressed "
+                "runs, and --batch-size is ignored");
         }
 
         [[nodiscard]] auto input_basename() const -> std::string { return m_input_basename; }
@@ -296,6 +344,13 @@ namespace arg {
         {
             return m_term_count;
         }
+        [[nodiscard]] auto memory_budget() const -> std::optional<std::size_t>
+        {
+            if (m_memory_budget_mb) {
+                return *m_memory_budget_mb * 1024 * 1024;
+            }
+            return std::nullopt;
+        }
 
         /// Transform paths for `shard`.
         void apply_shard(Shard_Id shard)
@@ -308,6 +363,7 @@ namespace arg {
         std::string m_input_basename{};
         std::string m_output_basename{};
         std::optional<std::uint32_t> m_term_count{};
+        std::optional<std::size_t> m_memory_budget_mb{};
     };
 
     struct Compress {
@@ -410,6 +466,66 @@ namespace arg {
         std::string m_terms_to_drop_filename;
     };
 
+    struct BuildIndex {
+        explicit BuildIndex(CLI::App* app) : m_params("")
+        {
+            app->add_option("-i,--input", m_input_basename, "Forward index basename")->required();
+            app->add_option("-o,--output", m_output, "Output inverted index")->required();
+            app->add_option("-w,--wand", m_wand_data_path, "Output WAND data filename")
+                ->required();
+            app->add_option(
+                "--term-count", m_term_count, "Number of distinct terms in the forward index");
+            auto block_group = app->add_option_group("blocks");
+            auto block_size_opt = block_group->add_option(
+                "-b,--block-size", m_fixed_block_size, "Block size for fixed-length blocks");
+            auto block_lambda_opt =
+                block_group
+                    ->add_option("-l,--lambda", m_lambda, "Lambda parameter for variable blocks")
+                    ->excludes(block_size_opt);
+            block_group->require_option();
+
+            app->add_flag("--compress", m_compress, "Compress additional data");
+            add_scorer_options(app, *this, ScorerMode::Required);
+            app->add_flag("--range", m_range, "Create docid-range based data")
+                ->excludes(block_size_opt)
+                ->excludes(block_lambda_opt);
+        }
+
+        [[nodiscard]] auto input_basename() const -> std::string { return m_input_basename; }
+        [[nodiscard]] auto output() const -> std::string { return m_output; }
+        [[nodiscard]] auto wand_data_path() const -> std::string { return m_wand_data_path; }
+        [[nodiscard]] auto term_count() const -> std::optional<std::uint32_t>
+        {
+            return m_term_count;
+        }
+        [[nodiscard]] auto scorer_params() const { return m_params; }
+        [[nodiscard]] auto block_size() const -> BlockSize
+        {
+            if (m_lambda) {
+                spdlog::info("Lambda {}", *m_lambda);
+                return VariableBlock(*m_lambda);
+            }
+            spdlog::info("Fixed block size: {}", *m_fixed_block_size);
+            return FixedBlock(*m_fixed_block_size);
+        }
+        [[nodiscard]] auto compress() const -> bool { return m_compress; }
+        [[nodiscard]] auto range() const -> bool { return m_range; }
+
+        template <typename T>
+        friend CLI::Option* add_scorer_options(CLI::App* app, T& args, ScorerMode scorer_mode);
+
+      private:
+        std::optional<float> m_lambda{};
+        std::optional<uint64_t> m_fixed_block_size{};
+        std::string m_input_basename;
+        std::string m_output;
+        std::string m_wand_data_path;
+        std::optional<std::uint32_t> m_term_count{};
+        ScorerParams m_params;
+        bool m_compress = false;
+        bool m_range = false;
+    };
+
     struct ReorderDocuments {
         explicit ReorderDocuments(CLI::App* app)
         {
@@ -593,9 +709,14 @@ struct Args: public T... {
 
 using InvertArgs = Args<arg::Invert, arg::Threads, arg::BatchSize<100'000>>;
 using ReorderDocuments = Args<arg::ReorderDocuments, arg::Threads>;
-using CompressArgs =
-    pisa::Args<arg::Compress, arg::Encoding, arg::Quantize<arg::ScorerMode::Optional>>;
-using CreateWandDataArgs = pisa::Args<arg::CreateWandData>;
+using CompressArgs = pisa::Args<
+    arg::Compress,
+    arg::Encoding,
+    arg::Quantize<arg::ScorerMode::Optional>,
+    arg::Threads>;
+using BuildIndexArgs =
+    pisa::Args<arg::BuildIndex, arg::Encoding, arg::Threads, arg::BatchSize<100'000>>;
+using CreateWandDataArgs = pisa::Args<arg::CreateWandData, arg::Threads>;
 
 struct TailyStatsArgs: pisa::Args<arg::WandData<arg::WandMode::Required>, arg::Scorer> {
     explicit TailyStatsArgs(CLI::App* app)
@@ -648,6 +769,137 @@ struct TailyRankArgs: pisa::Args<arg::Query<arg::QueryMode::Ranked>> {
     std::string m_shard_term_lexicon;
 };
 
+/// Arguments of queries executed on all shards at once. Index, wand data, and term lexicon
+/// paths are shard basenames, expanded for each shard with `apply_shard`.
+struct ShardedQueryArgs: pisa::Args<
+                             arg::Index,
+                             arg::WandData<arg::WandMode::Required>,
+                             arg::Query<arg::QueryMode::Ranked>,
+                             arg::Algorithm,
+                             arg::Scorer,
+                             arg::Thresholds,
+                             arg::Threads> {
+    explicit ShardedQueryArgs(CLI::App* app)
+        : pisa::Args<
+            arg::Index,
+            arg::WandData<arg::WandMode::Required>,
+            arg::Query<arg::QueryMode::Ranked>,
+            arg::Algorithm,
+            arg::Scorer,
+            arg::Thresholds,
+            arg::Threads>(app)
+    {
+        arg::Query<arg::QueryMode::Ranked>::terms_option()->required(true);
+        app->add_option("--secondary-k", m_secondary_k, "Size of secondary heap/queue.")->required();
+        app->add_flag("--quantized", m_quantized, "Quantized scores");
+    }
+
+    [[nodiscard]] auto secondary_k() const -> std::uint64_t { return m_secondary_k; }
+    [[nodiscard]] auto quantized() const -> bool { return m_quantized; }
+
+    /// Transform paths for `shard`.
+    void apply_shard(Shard_Id shard)
+    {
+        arg::Index::apply_shard(shard);
+        arg::WandData<arg::WandMode::Required>::apply_shard(shard);
+        override_term_lexicon(expand_shard(*term_lexicon(), shard));
+    }
+
+  private:
+    std::uint64_t m_secondary_k = 0;
+    bool m_quantized = false;
+};
+
+/// Arguments of queries executed only on the shards selected with Taily.
+struct SelectiveQueryArgs: ShardedQueryArgs {
+    explicit SelectiveQueryArgs(CLI::App* app) : ShardedQueryArgs(app)
+    {
+        app->add_option("--global-stats", m_global_stats, "Global Taily statistics")->required();
+        app->add_option("--shard-stats", m_shard_stats, "Shard-level Taily statistics")->required();
+        app->add_option("--global-terms", m_global_term_lexicon, "Global term lexicon")->required();
+        app->add_option(
+            "--cutoff",
+            m_cutoff,
+            "Minimum estimated number of top documents in a shard to search it",
+            true);
+    }
+
+    [[nodiscard]] auto global_stats() const -> std::string const& { return m_global_stats; }
+    [[nodiscard]] auto shard_stats() const -> std::string const& { return m_shard_stats; }
+    [[nodiscard]] auto cutoff() const -> double { return m_cutoff; }
+
+    /// Queries resolved against the global term lexicon.
+    [[nodiscard]] auto global_queries() const -> std::vector<::pisa::Query>
+    {
+        auto args = *this;
+        args.override_term_lexicon(m_global_term_lexicon);
+        return args.queries();
+    }
+
+  private:
+    std::string m_global_stats;
+    std::string m_shard_stats;
+    std::string m_global_term_lexicon;
+    double m_cutoff = 1.0;
+};
+
+/// Arguments of building segments in a segment directory.
+struct SegmentBuildArgs: pisa::Args<arg::Encoding, arg::Scorer, arg::Threads> {
+    explicit SegmentBuildArgs(CLI::App* app)
+        : pisa::Args<arg::Encoding, arg::Scorer, arg::Threads>(app)
+    {
+        app->add_option("-d,--dir", m_directory, "Segment directory")->required();
+        app->add_option(
+            "-b,--block-size", m_block_size, "Block size of the WAND data of segments", true);
+    }
+
+    [[nodiscard]] auto directory() const -> std::string const& { return m_directory; }
+    [[nodiscard]] auto block_size() const -> BlockSize { return FixedBlock(m_block_size); }
+
+  private:
+    std::string m_directory;
+    std::uint64_t m_block_size = 64;
+};
+
+/// Arguments of queries executed on a segmented index.
+struct SegmentedQueryArgs: pisa::Args<
+                               arg::Encoding,
+                               arg::Query<arg::QueryMode::Ranked>,
+                               arg::Algorithm,
+                               arg::Scorer,
+                               arg::Threads> {
+    explicit SegmentedQueryArgs(CLI::App* app)
+        : pisa::Args<
+            arg::Encoding,
+            arg::Query<arg::QueryMode::Ranked>,
+            arg::Algorithm,
+            arg::Scorer,
+            arg::Threads>(app)
+    {
+        app->add_option("-d,--dir", m_directory, "Segment directory")->required();
+        app->add_option("--secondary-k", m_secondary_k, "Size of secondary heap/queue.")->required();
+    }
+
+    [[nodiscard]] auto directory() const -> std::string const& { return m_directory; }
+    [[nodiscard]] auto secondary_k() const -> std::uint64_t { return m_secondary_k; }
+
+    /// Queries resolved against `--terms` if given, or otherwise against `term_lexicon`,
+    /// the lexicon of the segment directory.
+    [[nodiscard]] auto segment_queries(std::string const& term_lexicon) const
+        -> std::vector<::pisa::Query>
+    {
+        auto args = *this;
+        if (not args.term_lexicon()) {
+            args.override_term_lexicon(term_lexicon);
+        }
+        return args.queries();
+    }
+
+  private:
+    std::string m_directory;
+    std::uint64_t m_secondary_k = 0;
+};
+
 struct TailyThresholds: pisa::Args<arg::Query<arg::QueryMode::Ranked>> {
     explicit TailyThresholds(CLI::App* app) : pisa::Args<arg::Query<arg::QueryMode::Ranked>>(app)
     {
@@ -0,0 +1,36 @@
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+
+#include "CLI/CLI.hpp"
+#include "app.hpp"
+#include "build_index.hpp"
+
+int main(int argc, char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+    CLI::App app{"Builds a compressed inverted index and WAND data from a forward index."};
+    pisa::BuildIndexArgs args(&app);
+    CLI11_PARSE(app, argc, argv);
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, args.threads() + 1);
+    spdlog::info("Number of worker threads: {}", args.threads());
+    try {
+        pisa::build_index(
+            args.input_basename(),
+            args.index_encoding(),
+            args.output(),
+            args.wand_data_path(),
+            args.scorer_params(),
+            args.block_size(),
+            args.range(),
+            args.compress(),
+            args.batch_size(),
+            args.threads(),
+            args.term_count());
+        return 0;
+    } catch (pisa::io::NoSuchFile err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+}
@@ -0,0 +1,92 @@
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+
+#include "binary_collection.hpp"
+#include "sharding.hpp"
+#include "topical_sharding.hpp"
+#include "vec_map.hpp"
+
+using namespace pisa;
+
+int main(int argc, char** argv)
+{
+    std::string input_basename;
+    std::string output_basename;
+    int shard_count = 0;
+    std::size_t sample_size = 100'000;
+    std::size_t max_features = 100'000;
+    double max_df = 0.1;
+    std::size_t iterations = 10;
+    std::size_t batch_size = 100'000;
+    std::uint64_t seed = 0;
+    int threads = std::thread::hardware_concurrency();
+
+    CLI::App app{"Clusters the documents of a forward index into topical shards."};
+    app.add_option("-i,--input", input_basename, "Forward index basename")->required();
+    app.add_option(
+           "-o,--output",
+           output_basename,
+           "Basename of the files listing the document titles of each shard")
+        ->required();
+    app.add_option("-s,--shards", shard_count, "Number of shards")->required();
+    app.add_option("--sample", sample_size, "Number of documents sampled for clustering", true);
+    app.add_option("--features", max_features, "Maximum number of terms used as features", true);
+    app.add_option(
+        "--max-df", max_df, "Maximum fraction of documents containing a feature term", true);
+    app.add_option("--iterations", iterations, "Maximum number of k-means iterations", true);
+    app.add_option("--batch-size", batch_size, "Number of documents assigned at once", true);
+    app.add_option("--seed", seed, "Random seed", true);
+    app.add_option("-j,--threads", threads, "Thread count");
+    CLI11_PARSE(app, argc, argv);
+
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, threads + 1);
+    spdlog::info("Number of worker threads: {}", threads);
+
+    try {
+        binary_collection collection(input_basename.c_str());
+
+        spdlog::info("Selecting features");
+        auto features = ClusteringFeatures::from_collection(collection, max_features, max_df);
+        spdlog::info("Selected {} features", features.size());
+
+        spdlog::info("Sampling documents");
+        auto sample = sample_documents(collection, features, sample_size, seed);
+        spdlog::info("Clustering {} documents into {} shards", sample.size(), shard_count);
+        auto centroids =
+            TopicCentroids::fit(sample, shard_count, features.size(), iterations, seed);
+        sample.clear();
+        sample.shrink_to_fit();
+
+        spdlog::info("Assigning documents to shards");
+        std::ifstream titles(fmt::format("{}.documents", input_basename));
+        VecMap<Shard_Id, std::ofstream> outputs;
+        for (Shard_Id shard{0}; shard < Shard_Id(shard_count); ++shard) {
+            outputs.emplace_back(format_shard(output_basename, shard));
+        }
+        VecMap<Shard_Id, std::size_t> shard_sizes(shard_count, 0);
+        assign_to_topics(collection, features, centroids, batch_size, [&](auto shards) {
+            std::string title;
+            for (auto shard: shards) {
+                if (not std::getline(titles, title)) {
+                    throw std::runtime_error("Fewer document titles than documents");
+                }
+                outputs[shard] << title << '\n';
+                shard_sizes[shard] += 1;
+            }
+        });
+        for (Shard_Id shard{0}; shard < Shard_Id(shard_count); ++shard) {
+            spdlog::info("Shard {}: {} documents", shard.as_int(), shard_sizes[shard]);
+        }
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+    return 0;
+}
@@ -13,6 +13,7 @@
 #include "app.hpp"
 #include "index_types.hpp"
 #include "intersection.hpp"
+#include "memory_source.hpp"
 #include "pisa/cursor/scored_cursor.hpp"
 #include "pisa/query/queries.hpp"
 #include "wand_data_raw.hpp"
@@ -29,22 +30,14 @@ void intersect(
     IntersectionType intersection_type,
     std::optional<std::uint8_t> max_term_count = std::nullopt)
 {
-    IndexType index;
-    mio::mmap_source m(index_filename.c_str());
-    mapper::map(index, m);
-
-    WandType wdata;
-
-    mio::mmap_source md;
-    if (wand_data_filename) {
-        std::error_code error;
-        md.map(*wand_data_filename, error);
-        if (error) {
-            spdlog::error("error mapping file: {}, exiting...", error.message());
-            std::abort();
+    IndexType index(MemorySource::mapped_file(index_filename, LoadPolicy::Lazy));
+
+    WandType const wdata = [&] {
+        if (wand_data_filename) {
+            return WandType(MemorySource::mapped_file(*wand_data_filename));
         }
-        mapper::map(wdata, md, mapper::map_flags::warmup);
-    }
+        return WandType{};
+    }();
 
     std::size_t qid = 0U;
 
@@ -0,0 +1,122 @@
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <CLI/CLI.hpp>
+#include <mio/mmap.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "deleted_documents.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "string_table.hpp"
+
+using namespace pisa;
+
+/// Deletes the documents whose titles are listed in `titles_file`, one per line.
+void delete_titles(
+    DeletedDocuments::builder& builder, Lexicon const& documents, std::string const& titles_file)
+{
+    std::unordered_map<std::string, std::uint64_t> docids;
+    std::uint64_t docid = 0;
+    documents.for_each([&](std::string_view title) { docids.emplace(title, docid++); });
+    std::ifstream is(titles_file);
+    std::string title;
+    std::size_t missing = 0;
+    while (std::getline(is, title)) {
+        if (auto pos = docids.find(title); pos != docids.end()) {
+            builder.remove(pos->second);
+        } else {
+            missing += 1;
+        }
+    }
+    if (missing > 0) {
+        spdlog::warn("{} titles not found in the document lexicon", missing);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+
+    std::string output;
+    std::optional<std::string> input;
+    std::optional<std::uint64_t> num_docs;
+    std::optional<std::string> documents_file;
+    std::optional<std::string> docids_file;
+    std::optional<std::string> titles_file;
+    std::optional<double> rate;
+    std::uint64_t seed = 0;
+
+    CLI::App app{"Marks documents of an index as deleted, without rebuilding the index."};
+    app.add_option("-o,--output", output, "Output deleted documents file")->required();
+    auto* input_opt =
+        app.add_option("-i,--input", input, "Deleted documents file to add the deletions to");
+    auto* num_docs_opt = app.add_option("-n,--num-docs", num_docs, "Number of documents");
+    auto* documents_opt = app.add_option("--documents", documents_file, "Document lexicon");
+    app.add_option("--docids", docids_file, "File with the IDs of the documents to delete");
+    app.add_option("--titles", titles_file, "File with the titles of the documents to delete")
+        ->needs(documents_opt);
+    app.add_option("--random", rate, "Deletes each document with this probability")
+        ->check(CLI::Range(0.0, 1.0));
+    app.add_option("--seed", seed, "Seed of the random deletions", true);
+    input_opt->excludes(num_docs_opt);
+    CLI11_PARSE(app, argc, argv);
+
+    try {
+        std::optional<Lexicon> documents;
+        std::optional<mio::mmap_source> documents_source;
+        if (documents_file) {
+            documents_source.emplace(documents_file->c_str());
+            documents = Lexicon::from(*documents_source);
+            if (not num_docs) {
+                num_docs = documents->size();
+            }
+        }
+        std::optional<DeletedDocuments> base;
+        if (input) {
+            base.emplace(MemorySource::mapped_file(*input));
+            num_docs = base->num_docs();
+        }
+        if (not num_docs) {
+            throw std::invalid_argument(
+                "The number of documents is required without a document lexicon or input file");
+        }
+        auto builder = base ? DeletedDocuments::builder(*base)
+                            : DeletedDocuments::builder(*num_docs);
+        if (docids_file) {
+            std::ifstream is(*docids_file);
+            std::uint64_t docid = 0;
+            while (is >> docid) {
+                builder.remove(docid);
+            }
+        }
+        if (titles_file) {
+            delete_titles(builder, *documents, *titles_file);
+        }
+        if (rate) {
+            std::mt19937_64 rng(seed);
+            std::bernoulli_distribution coin(*rate);
+            for (std::uint64_t docid = 0; docid < *num_docs; ++docid) {
+                if (coin(rng)) {
+                    builder.remove(docid);
+                }
+            }
+        }
+        DeletedDocuments deleted;
+        builder.build(deleted);
+        spdlog::info("{} of {} documents are deleted", deleted.count(), deleted.num_docs());
+        mapper::freeze(deleted, output.c_str());
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+    return 0;
+}
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <iostream>
 #include <optional>
 #include <thread>
@@ -17,12 +18,16 @@
 #include "accumulator/lazy_accumulator.hpp"
 #include "app.hpp"
 #include "cursor/block_max_scored_cursor.hpp"
+#include "cursor/deletion_filtered_cursor.hpp"
 #include "cursor/max_scored_cursor.hpp"
 #include "cursor/scored_cursor.hpp"
 #include "index_types.hpp"
 #include "io.hpp"
+#include "memory_residency.hpp"
 #include "query/algorithm.hpp"
+#include "query/sharded_search.hpp"
 #include "scorer/scorer.hpp"
+#include "string_table.hpp"
 #include "util/util.hpp"
 #include "wand_data_compressed.hpp"
 #include "wand_data_raw.hpp"
@@ -42,18 +47,52 @@ void evaluate_queries(
     uint64_t secondary_k,
     std::string const& documents_filename,
     ScorerParams const& scorer_params,
+    std::optional<std::string> const& deleted_filename,
+    LoadPolicy load_policy,
+    std::vector<std::string> const& locked_structures,
+    bool load_report,
     std::string const& run_id,
     std::string const& iteration)
 {
-    IndexType index(MemorySource::mapped_file(index_filename));
-    WandType const wdata(MemorySource::mapped_file(wand_data_filename));
+    auto index_start = std::chrono::steady_clock::now();
+    IndexType index(MemorySource::mapped_file(index_filename, load_policy));
+    lock_structure("index", index, locked_structures);
+    if (load_report) {
+        log_residency("index", index, index_start);
+    }
+    auto wand_start = std::chrono::steady_clock::now();
+    WandType wdata(MemorySource::mapped_file(wand_data_filename, load_policy));
+    lock_structure("wand", wdata, locked_structures);
+    if (load_report) {
+        log_residency("wand", wdata, wand_start);
+    }
 
     auto scorer = scorer::from_params(scorer_params, wdata);
     std::function<std::tuple<
         std::vector<std::pair<float, uint64_t>>,
         std::vector<std::pair<float, uint64_t>>>(Query)> query_fun;
 
-    if (query_type == "wand") {
+    std::optional<DeletedDocuments> deleted;
+    IndexCursors<IndexType, WandType> index_cursors{index, wdata, *scorer};
+    if (deleted_filename) {
+        deleted.emplace(MemorySource::mapped_file(*deleted_filename));
+        if (deleted->num_docs() != index.num_docs()) {
+            throw std::invalid_argument(fmt::format(
+                "Deleted documents are given for {} documents but the index has {}",
+                deleted->num_docs(),
+                index.num_docs()));
+        }
+        spdlog::info("Filtering {} deleted documents", deleted->count());
+        auto algorithm = ShardedAlgorithm::parse(query_type);
+        auto paged_k = algorithm.method == PageMethod::None ? 0 : secondary_k;
+        query_fun = [&, algorithm, paged_k](Query query) {
+            DeletionFilteredCursors<IndexCursors<IndexType, WandType>> cursors{
+                index_cursors, *deleted};
+            auto results =
+                paged_search(cursors, query, index.num_docs(), algorithm, k, paged_k, nullptr);
+            return std::make_tuple(std::move(results.primary), std::move(results.secondary));
+        };
+    } else if (query_type == "wand") {
         query_fun = [&](Query query) {
             topk_queue topk(k);
             topk_queue secondary(0);
@@ -148,7 +187,8 @@ void evaluate_queries(
     }
 
     auto source = std::make_shared<mio::mmap_source>(documents_filename.c_str());
-    auto docmap = Payload_Vector<>::from(*source);
+    auto docmap = Lexicon::from(*source);
+    std::string title;
 
     std::vector<std::vector<std::pair<float, uint64_t>>> raw_results(queries.size());
 
@@ -162,7 +202,7 @@ void evaluate_queries(
                 "{}\t{}\t{}\t{}\t{}\t{}\n",
                 qid.value_or(std::to_string(query_idx)),
                 iteration,
-                docmap[result.second],
+                docmap.lookup(result.second, title),
                 rank,
                 result.first,
                 run_id);
@@ -173,7 +213,7 @@ void evaluate_queries(
                 "{}\t{}\t{}\t{}\t{}\t{}\n",
                 qid.value_or(std::to_string(query_idx)),
                 iteration,
-                docmap[result.second],
+                docmap.lookup(result.second, title),
                 rank + res_count,
                 result.first,
                 run_id);
@@ -194,6 +234,7 @@ int main(int argc, const char** argv)
     std::string run_id = "R0";
     bool quantized = false;
     uint64_t secondary_k = 0;
+    std::optional<std::string> deleted_file;
 
     App<arg::Index,
         arg::WandData<arg::WandMode::Required>,
@@ -201,12 +242,17 @@ int main(int argc, const char** argv)
         arg::Algorithm,
         arg::Scorer,
         arg::Thresholds,
-        arg::Threads>
+        arg::Threads,
+        arg::Loading>
         app{"Retrieves query results in TREC format."};
     app.add_option("-r,--run", run_id, "Run identifier");
     app.add_option("--documents", documents_file, "Document lexicon")->required();
     app.add_flag("--quantized", quantized, "Quantized scores");
     app.add_option("--secondary-k", secondary_k, "Size of secondary heap/queue.")->required();
+    app.add_option(
+        "--deleted",
+        deleted_file,
+        "Deleted documents to filter out; not supported by and, or, and ranked_or_taat");
  
     CLI11_PARSE(app, argc, argv);
 
@@ -230,6 +276,10 @@ int main(int argc, const char** argv)
         secondary_k,
         documents_file,
         app.scorer_params(),
+        deleted_file,
+        app.load_policy(),
+        app.locked_structures(),
+        app.load_report(),
         run_id,
         iteration);
 
@@ -6,7 +6,6 @@
 #include "boost/algorithm/string/split.hpp"
 #include <boost/functional/hash.hpp>
 
-#include "mio/mmap.hpp"
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
 
@@ -16,6 +15,7 @@
 #include "cursor/max_scored_cursor.hpp"
 #include "index_types.hpp"
 #include "io.hpp"
+#include "memory_source.hpp"
 #include "query/algorithm.hpp"
 #include "util/util.hpp"
 #include "wand_data_compressed.hpp"
@@ -63,23 +63,11 @@ void kt_thresholds(
     bool all_pairs,
     bool all_triples)
 {
-    IndexType index;
-    mio::mmap_source m(index_filename.c_str());
-    mapper::map(index, m);
-
-    WandType wdata;
+    IndexType index(MemorySource::mapped_file(index_filename, LoadPolicy::Lazy));
+    WandType wdata(MemorySource::mapped_file(wand_data_filename));
 
     auto scorer = scorer::from_params(scorer_params, wdata);
 
-    mio::mmap_source md;
-    std::error_code error;
-    md.map(wand_data_filename, error);
-    if (error) {
-        spdlog::error("error mapping file: {}, exiting...", error.message());
-        std::abort();
-    }
-    mapper::map(wdata, md, mapper::map_flags::warmup);
-
     using Pair = std::set<uint32_t>;
     std::unordered_set<Pair, boost::hash<Pair>> pairs_set;
 
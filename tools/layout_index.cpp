@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "app.hpp"
+#include "hot_cold_layout.hpp"
+#include "index_types.hpp"
+#include "memory_source.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+using wand_raw_index = wand_data<wand_data_raw>;
+
+template <typename IndexType>
+void layout(
+    std::string const& index_filename,
+    std::optional<std::string> const& wand_data_filename,
+    std::optional<std::string> const& profile_filename,
+    std::vector<Query> const& queries,
+    std::string const& output,
+    std::optional<std::string> const& output_wand)
+{
+    if constexpr (std::is_same_v<typename IndexType::index_layout_tag, BlockIndexTag>) {
+        IndexType index(MemorySource::mapped_file(index_filename));
+        auto accesses = [&] {
+            if (profile_filename) {
+                std::ifstream is(*profile_filename);
+                return term_accesses_from_profile(is, index.size());
+            }
+            return term_accesses_from_queries(queries, index.size());
+        }();
+        auto order = hot_cold_order(index, accesses);
+
+        std::size_t hot_lists = 0;
+        std::size_t hot_bytes = 0;
+        std::size_t total_bytes = 0;
+        for (std::uint32_t term = 0; term < index.size(); ++term) {
+            auto bytes = index.posting_list_memory(term).size();
+            total_bytes += bytes;
+            if (accesses[term] > 0) {
+                ++hot_lists;
+                hot_bytes += bytes;
+            }
+        }
+        spdlog::info(
+            "{} of {} posting lists are accessed, with {} of {} bytes ({:.1f}%) stored first",
+            hot_lists,
+            index.size(),
+            hot_bytes,
+            total_bytes,
+            100.0 * hot_bytes / std::max<std::size_t>(total_bytes, 1));
+
+        write_with_layout(index, order, output);
+        spdlog::info("Index written to {}", output);
+        if (wand_data_filename) {
+            wand_raw_index wdata(MemorySource::mapped_file(*wand_data_filename));
+            wdata.reorder_lists(order);
+            wdata.freeze(*output_wand);
+            spdlog::info("WAND data written to {}", *output_wand);
+        }
+    } else {
+        throw std::invalid_argument("Only block-compressed indexes can be laid out");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+
+    std::optional<std::string> profile_filename;
+    std::string output;
+    std::optional<std::string> output_wand;
+
+    App<arg::Index, arg::WandData<arg::WandMode::Optional>, arg::Query<arg::QueryMode::Unranked>>
+        app{"Rewrites an index so that the posting lists accessed most often, according to a "
+            "query log or a block profile, are stored first."};
+    app.add_option(
+        "--profile", profile_filename, "Block access counts written by profile_queries");
+    app.add_option("-o,--output", output, "Output inverted index")->required();
+    app.add_option("--output-wand", output_wand, "Output WAND data, in the same order");
+    CLI11_PARSE(app, argc, argv);
+
+    try {
+        if (app.wand_data_path().has_value() != output_wand.has_value()) {
+            throw std::invalid_argument("--wand and --output-wand must be given together");
+        }
+        if (app.is_wand_compressed()) {
+            throw std::invalid_argument("Only raw WAND data can be laid out");
+        }
+        std::vector<Query> queries;
+        if (not profile_filename) {
+            queries = app.queries();
+        }
+        auto const& encoding = app.index_encoding();
+        /**/
+        if (false) {  // NOLINT
+#define LOOP_BODY(R, DATA, T)                                                                  \
+    }                                                                                          \
+    else if (encoding == BOOST_PP_STRINGIZE(T))                                                \
+    {                                                                                          \
+        layout<BOOST_PP_CAT(T, _index)>(                                                       \
+            app.index_filename(),                                                              \
+            app.wand_data_path(),                                                              \
+            profile_filename,                                                                  \
+            queries,                                                                           \
+            output,                                                                            \
+            output_wand);                                                                      \
+        /**/
+
+            BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+        } else {
+            spdlog::error("Unknown type {}", encoding);
+            return 1;
+        }
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+    return 0;
+}
@@ -2,8 +2,10 @@
 #include <mio/mmap.hpp>
 #include <spdlog/spdlog.h>
 
+#include "hashed_lexicon.hpp"
 #include "io.hpp"
 #include "payload_vector.hpp"
+#include "string_table.hpp"
 
 using namespace pisa;
 
@@ -13,12 +15,30 @@ int main(int argc, char** argv)
     std::string lexicon_file;
     std::size_t idx;
     std::string value;
+    bool hashed = false;
+    bool store_terms = false;
+    bool front_coded = false;
 
     CLI::App app{"Build, print, or query lexicon"};
     app.require_subcommand();
     auto build = app.add_subcommand("build", "Build a lexicon");
     build->add_option("input", text_file, "Input text file")->required();
     build->add_option("output", lexicon_file, "Output file")->required();
+    auto hashed_flag = build->add_flag(
+        "--hashed", hashed, "Build a lexicon with a minimal perfect hash for constant-time rlookup");
+    build
+        ->add_flag(
+            "--store-terms",
+            store_terms,
+            "Store the front-coded terms in a hashed lexicon to support lookup, print, and prefix")
+        ->needs(hashed_flag);
+    build
+        ->add_flag(
+            "--front-coded",
+            front_coded,
+            "Build a front-coded string table, which is much smaller for sorted terms and for "
+            "document titles or URLs with common prefixes")
+        ->excludes(hashed_flag);
     auto lookup = app.add_subcommand("lookup", "Retrieve the payload at index");
     lookup->add_option("lexicon", lexicon_file, "Lexicon file path")->required();
     lookup->add_option("idx", idx, "Index of requested element")->required();
@@ -27,17 +47,101 @@ int main(int argc, char** argv)
     rlookup->add_option("value", value, "Requested value")->required();
     auto print = app.add_subcommand("print", "Print elements line by line");
     print->add_option("lexicon", lexicon_file, "Lexicon file path")->required();
+    auto prefix = app.add_subcommand("prefix", "Print the indices and terms starting with a prefix");
+    prefix->add_option("lexicon", lexicon_file, "Lexicon file path")->required();
+    prefix->add_option("prefix", value, "Requested prefix")->required();
     CLI11_PARSE(app, argc, argv);
 
     try {
         if (*build) {
             std::ifstream is(text_file);
+            if (hashed) {
+                std::vector<std::string> terms(
+                    std::istream_iterator<io::Line>(is), std::istream_iterator<io::Line>{});
+                HashedLexiconBuilder(terms, store_terms).to_file(lexicon_file);
+                return 0;
+            }
+            if (front_coded) {
+                encode_string_table(
+                    std::istream_iterator<io::Line>(is), std::istream_iterator<io::Line>())
+                    .to_file(lexicon_file);
+                return 0;
+            }
             encode_payload_vector(
                 std::istream_iterator<io::Line>(is), std::istream_iterator<io::Line>())
                 .to_file(lexicon_file);
             return 0;
         }
         mio::mmap_source m(lexicon_file.c_str());
+        if (HashedLexicon::is_hashed_lexicon(m)) {
+            auto lexicon = HashedLexicon::from(m);
+            if (*print) {
+                for (std::uint32_t term_id = 0; term_id < lexicon.size(); ++term_id) {
+                    std::cout << lexicon.term(term_id) << '\n';
+                }
+                return 0;
+            }
+            if (*lookup) {
+                if (idx < lexicon.size()) {
+                    std::cout << lexicon.term(idx) << '\n';
+                    return 0;
+                }
+                spdlog::error(
+                    "Requested index {} too large for lexicon of size {}", idx, lexicon.size());
+                return 1;
+            }
+            if (*rlookup) {
+                if (auto pos = lexicon.find(value); pos) {
+                    std::cout << *pos << '\n';
+                    return 0;
+                }
+                spdlog::error("Requested term {} was not found", value);
+                return 1;
+            }
+            if (*prefix) {
+                auto [first, last] = lexicon.prefix(value);
+                for (auto term_id = first; term_id < last; ++term_id) {
+                    std::cout << term_id << '\t' << lexicon.term(term_id) << '\n';
+                }
+                return 0;
+            }
+            return 1;
+        }
+        if (StringTable::is_string_table(m)) {
+            auto lexicon = StringTable::from(m);
+            if (*print) {
+                for (auto const& elem: lexicon) {
+                    std::cout << elem << '\n';
+                }
+                return 0;
+            }
+            if (*lookup) {
+                if (idx < lexicon.size()) {
+                    std::cout << lexicon[idx] << '\n';
+                    return 0;
+                }
+                spdlog::error(
+                    "Requested index {} too large for table of size {}", idx, lexicon.size());
+                return 1;
+            }
+            if (*rlookup) {
+                if (auto pos = lexicon.find(value); pos) {
+                    std::cout << *pos << '\n';
+                    return 0;
+                }
+                spdlog::error("Requested term {} was not found", value);
+                return 1;
+            }
+            if (*prefix) {
+                auto [first, last] = lexicon.prefix(value);
+                auto iter = StringTable::Iterator(&lexicon, first);
+                for (; iter.index() < last; ++iter) {
+                    std::cout << iter.index() << '\t' << *iter << '\n';
+                }
+                return 0;
+            }
+            return 1;
+        }
         auto lexicon = Payload_Vector<>::from(m);
         if (*print) {
             for (auto const& elem: lexicon) {
@@ -62,8 +166,15 @@ int main(int argc, char** argv)
             spdlog::error("Requested term {} was not found", value);
             return 1;
         }
+        if (*prefix) {
+            auto first = std::lower_bound(lexicon.begin(), lexicon.end(), std::string_view(value));
+            for (; first != lexicon.end() && (*first).substr(0, value.size()) == value; ++first) {
+                std::cout << std::distance(lexicon.begin(), first) << '\t' << *first << '\n';
+            }
+            return 0;
+        }
         return 1;
-    } catch (std::runtime_error const& err) {
+    } catch (std::exception const& err) {
         spdlog::error("{}", err.what());
         return 0;
     }
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+
+#include "app.hpp"
+#include "index_types.hpp"
+#include "io.hpp"
+#include "memory_source.hpp"
+#include "merge_index.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+using wand_raw_index = wand_data<wand_data_raw>;
+
+/// Returns the local ID of each term of the merged index in each input, or -1 if the term does
+/// not occur there, and writes the sorted union of the input lexicons to `output_terms`.
+[[nodiscard]] auto merge_lexicons(
+    std::vector<std::string> const& term_files, std::string const& output_terms)
+    -> std::vector<std::vector<std::int64_t>>
+{
+    std::vector<std::vector<std::string>> lexicons;
+    std::vector<std::string> terms;
+    for (auto const& file: term_files) {
+        lexicons.push_back(io::read_string_vector(file));
+        terms.insert(terms.end(), lexicons.back().begin(), lexicons.back().end());
+    }
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    std::vector<std::vector<std::int64_t>> local_terms(
+        lexicons.size(), std::vector<std::int64_t>(terms.size(), -1));
+    for (std::size_t idx = 0; idx < lexicons.size(); ++idx) {
+        for (std::size_t local = 0; local < lexicons[idx].size(); ++local) {
+            auto pos = std::lower_bound(terms.begin(), terms.end(), lexicons[idx][local]);
+            local_terms[idx][std::distance(terms.begin(), pos)] = local;
+        }
+    }
+    std::ofstream os(output_terms);
+    for (auto const& term: terms) {
+        os << term << '\n';
+    }
+    return local_terms;
+}
+
+template <typename IndexType>
+void merge(
+    std::string const& encoding,
+    std::vector<std::string> const& index_files,
+    std::vector<std::string> const& wand_files,
+    std::vector<std::vector<std::int64_t>> local_terms,
+    std::string const& output,
+    std::string const& output_wand,
+    ScorerParams const& scorer_params,
+    std::uint64_t block_size)
+{
+    std::vector<std::unique_ptr<IndexType>> indexes;
+    std::vector<std::unique_ptr<wand_raw_index>> wdata;
+    std::vector<IndexType const*> index_ptrs;
+    std::vector<wand_raw_index const*> wdata_ptrs;
+    for (std::size_t idx = 0; idx < index_files.size(); ++idx) {
+        indexes.push_back(
+            std::make_unique<IndexType>(MemorySource::mapped_file(index_files[idx])));
+        wdata.push_back(
+            std::make_unique<wand_raw_index>(MemorySource::mapped_file(wand_files[idx])));
+        index_ptrs.push_back(indexes.back().get());
+        wdata_ptrs.push_back(wdata.back().get());
+    }
+    if (local_terms.empty()) {
+        // Without lexicons, inputs share term IDs.
+        std::size_t term_count = 0;
+        for (auto const& index: indexes) {
+            term_count = std::max(term_count, index->size());
+        }
+        for (auto const& index: indexes) {
+            local_terms.emplace_back(term_count, -1);
+            std::iota(local_terms.back().begin(), local_terms.back().begin() + index->size(), 0);
+        }
+    }
+    auto term_count = local_terms.front().size();
+    spdlog::info("Merged index has {} terms", term_count);
+    merge_indexes<IndexType, wand_raw_index>(
+        index_ptrs,
+        wdata_ptrs,
+        local_terms,
+        term_count,
+        output,
+        output_wand,
+        encoding,
+        scorer_params,
+        FixedBlock(block_size));
+}
+
+int main(int argc, char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+
+    std::vector<std::string> index_files;
+    std::vector<std::string> wand_files;
+    std::vector<std::string> term_files;
+    std::vector<std::string> document_files;
+    std::string output;
+    std::string output_wand;
+    std::string output_terms;
+    std::string output_documents;
+    std::uint64_t block_size = 64;
+
+    pisa::App<arg::Encoding, arg::Scorer, arg::Threads> app{
+        "Merges inverted indexes of consecutive document ranges, copying compressed blocks "
+        "whenever possible."};
+    app.add_option("-i,--index", index_files, "Input inverted indexes, in document order")
+        ->required();
+    app.add_option("-w,--wand", wand_files, "WAND data of the input indexes")->required();
+    app.add_option("-o,--output", output, "Output inverted index")->required();
+    app.add_option("--output-wand", output_wand, "Output WAND data filename")->required();
+    app.add_option("-b,--block-size", block_size, "Block size of the output WAND data", true);
+    auto* terms = app.add_option("--terms", term_files, "Term lexicons of the input indexes");
+    auto* out_terms = app.add_option("--output-terms", output_terms, "Output term lexicon");
+    terms->needs(out_terms);
+    out_terms->needs(terms);
+    auto* documents =
+        app.add_option("--documents", document_files, "Document lexicons of the input indexes");
+    auto* out_documents =
+        app.add_option("--output-documents", output_documents, "Output document lexicon");
+    documents->needs(out_documents);
+    out_documents->needs(documents);
+    CLI11_PARSE(app, argc, argv);
+
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, app.threads() + 1);
+    spdlog::info("Number of worker threads: {}", app.threads());
+
+    try {
+        if (wand_files.size() != index_files.size()
+            || (not term_files.empty() && term_files.size() != index_files.size())
+            || (not document_files.empty() && document_files.size() != index_files.size())) {
+            throw std::invalid_argument("Every input index needs its own WAND data and lexicons");
+        }
+        std::vector<std::vector<std::int64_t>> local_terms;
+        if (not term_files.empty()) {
+            local_terms = merge_lexicons(term_files, output_terms);
+        }
+        if (not document_files.empty()) {
+            std::ofstream os(output_documents);
+            for (auto const& file: document_files) {
+                for (auto const& title: io::read_string_vector(file)) {
+                    os << title << '\n';
+                }
+            }
+        }
+        auto const& encoding = app.index_encoding();
+        /**/
+        if (false) {  // NOLINT
+#define LOOP_BODY(R, DATA, T)                                                                  \
+    }                                                                                          \
+    else if (encoding == BOOST_PP_STRINGIZE(T))                                                \
+    {                                                                                          \
+        merge<BOOST_PP_CAT(T, _index)>(                                                        \
+            encoding,                                                                          \
+            index_files,                                                                       \
+            wand_files,                                                                        \
+            std::move(local_terms),                                                            \
+            output,                                                                            \
+            output_wand,                                                                       \
+            app.scorer_params(),                                                               \
+            block_size);                                                                       \
+        /**/
+
+            BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+        } else {
+            spdlog::error("Unknown type {}", encoding);
+            return 1;
+        }
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+    return 0;
+}
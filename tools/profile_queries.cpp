@@ -7,8 +7,6 @@
 #include "boost/lexical_cast.hpp"
 #include "spdlog/spdlog.h"
 
-#include "mio/mmap.hpp"
-
 #include "cursor/cursor.hpp"
 #include "cursor/max_scored_cursor.hpp"
 #include "cursor/scored_cursor.hpp"
@@ -71,11 +69,10 @@ void profile(
 {
     using namespace pisa;
 
-    typename add_profiling<IndexType>::type index;
     using WandType = wand_data<wand_data_raw>;
     spdlog::info("Loading index from {}", index_filename);
-    mio::mmap_source m(index_filename);
-    mapper::map(index, m);
+    typename add_profiling<IndexType>::type index(
+        MemorySource::mapped_file(index_filename, LoadPolicy::Lazy));
 
     WandType const wdata = [&] {
         if (wand_data_filename) {
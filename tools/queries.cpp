@@ -1,4 +1,8 @@
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <numeric>
 #include <optional>
@@ -11,17 +15,25 @@
 #include <spdlog/sinks/null_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
 
 #include "accumulator/lazy_accumulator.hpp"
 #include "app.hpp"
+#include "block_cache.hpp"
 #include "cursor/block_max_scored_cursor.hpp"
 #include "cursor/cursor.hpp"
+#include "cursor/deletion_filtered_cursor.hpp"
 #include "cursor/max_scored_cursor.hpp"
 #include "cursor/scored_cursor.hpp"
+#include "decoded_block_cache.hpp"
 #include "index_types.hpp"
 #include "mappable/mapper.hpp"
+#include "memory_residency.hpp"
 #include "memory_source.hpp"
 #include "query/algorithm.hpp"
+#include "query/batch_search.hpp"
+#include "query/cost_model.hpp"
+#include "query/sharded_search.hpp"
 #include "scorer/scorer.hpp"
 #include "timer.hpp"
 #include "topk_queue.hpp"
@@ -40,10 +52,33 @@ void extract_times(
     std::string const& index_type,
     std::string const& query_type,
     size_t runs,
+    std::function<void()> const& evict,
     std::ostream& os)
 {
     std::vector<std::size_t> times(runs);
     for (auto&& [qid, query]: enumerate(queries)) {
+        if (evict) {
+            // Every run reads the index from storage, so they are all timed.
+            IoCounters io;
+            for (auto& time: times) {
+                evict();
+                auto before = io_counters();
+                time = run_with_timer<std::chrono::microseconds>([&]() {
+                           do_not_optimize_away(fn(query, thresholds[qid]));
+                       }).count();
+                auto after = io_counters();
+                io.major_faults += after.major_faults - before.major_faults;
+                io.read_bytes += after.read_bytes - before.read_bytes;
+            }
+            auto mean = std::accumulate(times.begin(), times.end(), std::size_t{0}) / runs;
+            os << fmt::format(
+                "{}\t{}\t{}\t{}\n",
+                query.id.value_or(std::to_string(qid)),
+                mean,
+                io.major_faults / runs,
+                io.read_bytes / runs);
+            continue;
+        }
         do_not_optimize_away(fn(query, thresholds[qid]));
         std::generate(times.begin(), times.end(), [&fn, &q = query, &t = thresholds[qid]]() {
             return run_with_timer<std::chrono::microseconds>(
@@ -64,15 +99,21 @@ void op_perftest(
     std::string const& query_type,
     size_t runs,
     uint64_t k,
-    bool safe)
+    bool safe,
+    std::function<void()> const& evict)
 {
     std::vector<double> query_times;
     std::size_t num_reruns = 0;
+    IoCounters io;
     spdlog::info("Safe: {}", safe);
 
     for (size_t run = 0; run <= runs; ++run) {
         size_t idx = 0;
         for (auto const& query: queries) {
+            if (evict) {
+                evict();
+            }
+            auto before = io_counters();
             auto usecs = run_with_timer<std::chrono::microseconds>([&]() {
                 uint64_t result = query_func(query, thresholds[idx]);
                 if (safe && result < k) {
@@ -81,7 +122,11 @@ void op_perftest(
                 }
                 do_not_optimize_away(result);
             });
-            if (run != 0) {  // first run is not timed
+            // The first run is not timed, unless each query starts with a cold cache.
+            if (run != 0 || evict) {
+                auto after = io_counters();
+                io.major_faults += after.major_faults - before.major_faults;
+                io.read_bytes += after.read_bytes - before.read_bytes;
                 query_times.push_back(usecs.count());
             }
             idx += 1;
@@ -108,90 +153,438 @@ void op_perftest(
         spdlog::info("95% quantile: {}", q95);
         spdlog::info("99% quantile: {}", q99);
         spdlog::info("Num. reruns: {}", num_reruns);
+        double major_faults = static_cast<double>(io.major_faults) / query_times.size();
+        double read_bytes = static_cast<double>(io.read_bytes) / query_times.size();
+        spdlog::info("Major page faults per query: {:.1f}", major_faults);
+        spdlog::info("Bytes read per query: {:.0f}", read_bytes);
 
         stats_line()("type", index_type)("query", query_type)("avg", avg)("q50", q50)("q90", q90)(
-            "q95", q95)("q99", q99);
+            "q95", q95)("q99", q99)("cold", static_cast<bool>(evict))(
+            "major_faults", major_faults)("read_bytes", read_bytes);
     }
 }
 
+using QueryFun = std::function<uint64_t(Query, Threshold)>;
+
+/// Returns the mean time of each query in microseconds over `runs` runs, which follow an
+/// untimed run unless each query starts with a cold cache.
+auto time_queries(
+    QueryFun const& query_fun,
+    std::vector<Query> const& queries,
+    std::vector<Threshold> const& thresholds,
+    std::size_t runs,
+    std::function<void()> const& evict) -> std::vector<double>
+{
+    std::vector<double> times(queries.size(), 0.0);
+    std::size_t first_timed = evict ? 1 : 0;
+    for (std::size_t run = first_timed; run <= runs; ++run) {
+        for (std::size_t qid = 0; qid < queries.size(); ++qid) {
+            if (evict) {
+                evict();
+            }
+            auto usecs = run_with_timer<std::chrono::microseconds>(
+                [&]() { do_not_optimize_away(query_fun(queries[qid], thresholds[qid])); });
+            if (run != 0) {
+                times[qid] += usecs.count();
+            }
+        }
+    }
+    for (auto& time: times) {
+        time /= runs;
+    }
+    return times;
+}
+
+/// Times `queries` with each of `query_funs`, fits a cost model to the times, and writes it
+/// to `output`.
+void fit_cost_model(
+    std::vector<std::pair<std::string, QueryFun>> const& query_funs,
+    std::vector<Query> const& queries,
+    std::vector<Threshold> const& thresholds,
+    std::vector<QueryCostFeatures> const& features,
+    time_prediction::predictor const& decode,
+    std::string const& output,
+    std::function<void()> const& evict)
+{
+    CostModel model(decode);
+    for (auto const& [name, query_fun]: query_funs) {
+        auto times = time_queries(query_fun, queries, thresholds, 2, evict);
+        model.fit(name, features, times);
+        double mean = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+        double error = 0;
+        for (std::size_t qid = 0; qid < queries.size(); ++qid) {
+            error += std::abs(model.predict(name, features[qid]) - times[qid]);
+        }
+        spdlog::info(
+            "{}: mean {:.1f} us, mean absolute error of the fit {:.1f} us",
+            name,
+            mean,
+            error / queries.size());
+    }
+    std::ofstream os(output);
+    model.write(os);
+    spdlog::info("Cost model written to {}", output);
+}
+
+/// Runs `queries` with the algorithm of `model` predicted to be the cheapest for each of them,
+/// and compares the latency with that of each algorithm alone.
+///
+/// `query_funs` execute the algorithms of the model, in the same order.
+void auto_perftest(
+    CostModel const& model,
+    std::vector<std::pair<std::string, QueryFun>> const& query_funs,
+    std::function<QueryCostFeatures(Query const&, Threshold)> const& features_of,
+    std::vector<Query> const& queries,
+    std::vector<Threshold> const& thresholds,
+    std::string const& index_type,
+    std::size_t runs,
+    std::function<void()> const& evict)
+{
+    auto position_of = [&](std::string const& name) {
+        return std::find_if(
+                   query_funs.begin(),
+                   query_funs.end(),
+                   [&](auto const& entry) { return entry.first == name; })
+            - query_funs.begin();
+    };
+    auto mean_of = [](std::vector<double> const& times) {
+        return std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+    };
+
+    std::vector<std::vector<double>> times;
+    std::size_t best_fixed = 0;
+    for (auto const& [name, query_fun]: query_funs) {
+        times.push_back(time_queries(query_fun, queries, thresholds, runs, evict));
+        spdlog::info("{}: mean {:.1f} us", name, mean_of(times.back()));
+        if (mean_of(times.back()) < mean_of(times[best_fixed])) {
+            best_fixed = times.size() - 1;
+        }
+    }
+
+    // The time to compute the features and predict the costs is part of each query.
+    QueryFun auto_fun = [&](Query query, Threshold threshold) {
+        auto choice = position_of(model.cheapest(features_of(query, threshold)).first);
+        return query_funs[choice].second(query, threshold);
+    };
+    auto auto_times = time_queries(auto_fun, queries, thresholds, runs, evict);
+
+    double prediction_error = 0;
+    double oracle = 0;
+    std::vector<std::size_t> chosen(query_funs.size(), 0);
+    for (std::size_t qid = 0; qid < queries.size(); ++qid) {
+        auto [name, cost] = model.cheapest(features_of(queries[qid], thresholds[qid]));
+        auto choice = position_of(name);
+        chosen[choice] += 1;
+        auto measured = times[choice][qid];
+        prediction_error += std::abs(cost - measured) / std::max(measured, 1.0);
+        double fastest = measured;
+        for (auto const& algorithm_times: times) {
+            fastest = std::min(fastest, algorithm_times[qid]);
+        }
+        oracle += fastest;
+    }
+    prediction_error /= queries.size();
+    oracle /= queries.size();
+    double avg = mean_of(auto_times);
+    double best_fixed_avg = mean_of(times[best_fixed]);
+
+    spdlog::info("---- {} auto", index_type);
+    spdlog::info("Mean: {}", avg);
+    spdlog::info(
+        "Best fixed algorithm: {}, mean: {}", query_funs[best_fixed].first, best_fixed_avg);
+    spdlog::info("Fastest algorithm per query (oracle), mean: {}", oracle);
+    spdlog::info("Mean relative prediction error: {:.3f}", prediction_error);
+    for (std::size_t idx = 0; idx < query_funs.size(); ++idx) {
+        spdlog::info("Chose {} for {} queries", query_funs[idx].first, chosen[idx]);
+    }
+
+    stats_line()("type", index_type)("query", "auto")("avg", avg)(
+        "best_fixed", query_funs[best_fixed].first)("best_fixed_avg", best_fixed_avg)(
+        "oracle_avg", oracle)("prediction_error", prediction_error);
+}
+
+/// Compares the throughput of executing each query on its own with executing batches of
+/// `batch_size` queries sharing their posting lists, each block of which a batch decodes once.
+/// Batched times include grouping the queries and setting up their shared lists.
 template <typename IndexType, typename WandType>
-void perftest(
-    const std::string& index_filename,
-    const std::optional<std::string>& wand_data_filename,
-    const std::vector<Query>& queries,
-    const std::optional<std::string>& thresholds_filename,
-    std::string const& type,
+void batch_perftest(
+    IndexType const& index,
+    WandType const& wdata,
+    index_scorer<WandType> const& scorer,
+    DeletedDocuments const* deleted,
+    std::vector<Query> const& queries,
+    std::string const& index_type,
     std::string const& query_type,
     uint64_t k,
     uint64_t secondary_k,
-    const ScorerParams& scorer_params,
-    bool extract,
-    bool safe)
+    std::size_t batch_size,
+    size_t runs,
+    std::function<void(gsl::span<Query const>)> const& load)
+{
+    auto algorithm = ShardedAlgorithm::parse(query_type);
+    auto paged_k = algorithm.method == PageMethod::None ? 0 : secondary_k;
+    auto search = [&](auto const& cursors, Query const& query) {
+        if (deleted != nullptr) {
+            DeletionFilteredCursors<std::decay_t<decltype(cursors)>> filtered{cursors, *deleted};
+            return paged_search(filtered, query, index.num_docs(), algorithm, k, paged_k, nullptr);
+        }
+        return paged_search(cursors, query, index.num_docs(), algorithm, k, paged_k, nullptr);
+    };
+
+    IndexCursors<IndexType, WandType> cursors{index, wdata, scorer};
+    auto run_single = [&] {
+        for (auto const& query: queries) {
+            if (load) {
+                load(gsl::make_span(&query, 1));
+            }
+            do_not_optimize_away(search(cursors, query).primary.size());
+        }
+    };
+    std::size_t num_batches = 0;
+    std::size_t shared_lists = 0;
+    std::size_t decoded_blocks = 0;
+    auto run_batched = [&] {
+        auto batches = group_queries(queries, batch_size);
+        num_batches = batches.size();
+        shared_lists = 0;
+        decoded_blocks = 0;
+        std::vector<Query> batch_queries;
+        for (auto const& positions: batches) {
+            batch_queries.clear();
+            for (auto qid: positions) {
+                batch_queries.push_back(queries[qid]);
+            }
+            if (load) {
+                load(batch_queries);
+            }
+            QueryBatch<IndexType, WandType> batch(index, wdata, scorer, batch_queries);
+            for (auto const& query: batch_queries) {
+                do_not_optimize_away(search(batch, query).primary.size());
+            }
+            shared_lists += batch.num_shared();
+            decoded_blocks += batch.decoded_blocks();
+        }
+    };
+
+    // The first run of each path is not timed.
+    double single_usecs = 0;
+    double batch_usecs = 0;
+    for (size_t run = 0; run <= runs; ++run) {
+        auto single = run_with_timer<std::chrono::microseconds>(run_single).count();
+        auto batched = run_with_timer<std::chrono::microseconds>(run_batched).count();
+        if (run != 0) {
+            single_usecs += single;
+            batch_usecs += batched;
+        }
+    }
+    double executed = static_cast<double>(queries.size() * runs);
+    double per_query_qps = executed / (single_usecs / 1.0e6);
+    double batch_qps = executed / (batch_usecs / 1.0e6);
+
+    spdlog::info("---- {} {} in batches of {}", index_type, query_type, batch_size);
+    spdlog::info("Per-query throughput: {:.1f} queries/s", per_query_qps);
+    spdlog::info("Batched throughput: {:.1f} queries/s", batch_qps);
+    spdlog::info("Speedup: {:.3f}", batch_qps / per_query_qps);
+    spdlog::info("Shared posting lists per batch: {:.2f}", double(shared_lists) / num_batches);
+    spdlog::info("Decoded blocks per query: {:.1f}", double(decoded_blocks) / queries.size());
+
+    stats_line()("type", index_type)("query", query_type)("batch_size", batch_size)(
+        "per_query_qps", per_query_qps)("batch_qps", batch_qps)(
+        "shared_lists", shared_lists)("decoded_blocks", decoded_blocks);
+}
+
+/// Options of the `queries` benchmark.
+struct PerftestOptions {
+    std::string index_filename;
+    std::optional<std::string> wand_data_filename;
+    std::vector<Query> queries;
+    std::optional<std::string> thresholds_filename;
+    /// Index encoding, as reported in the statistics.
+    std::string type;
+    /// Algorithms to benchmark, separated by colons.
+    std::string query_type;
+    std::uint64_t k = 0;
+    std::uint64_t secondary_k = 0;
+    ScorerParams scorer_params{""};
+    std::optional<std::string> deleted_filename;
+    LoadPolicy load_policy = LoadPolicy::Warmup;
+    std::vector<std::string> locked_structures;
+    bool load_report = false;
+    std::optional<std::size_t> block_cache_size;
+    std::optional<std::size_t> decoded_cache_size;
+    bool cold = false;
+    std::optional<std::string> cost_model_filename;
+    std::optional<std::string> fit_cost_model_filename;
+    std::optional<std::string> decode_model_filename;
+    std::optional<std::size_t> batch_size;
+    bool extract = false;
+    bool safe = false;
+};
+
+template <typename IndexType, typename WandType>
+void perftest(PerftestOptions const& options)
 {
-    spdlog::info("Loading index from {}", index_filename);
-    IndexType index(MemorySource::mapped_file(index_filename));
-
-    spdlog::info("Warming up posting lists");
-    std::unordered_set<term_id_type> warmed_up;
-    for (auto const& q: queries) {
-        for (auto t: q.terms) {
-            if (!warmed_up.count(t)) {
-                index.warmup(t);
-                warmed_up.insert(t);
+    if (options.cold && options.block_cache_size) {
+        throw std::invalid_argument("The block cache does not read through the page cache");
+    }
+    if (options.cold && not options.locked_structures.empty()) {
+        throw std::invalid_argument("Locked structures cannot be evicted from the page cache");
+    }
+    spdlog::info("Loading index from {}", options.index_filename);
+    auto index_start = std::chrono::steady_clock::now();
+    std::shared_ptr<BlockCache> cache;
+    if (options.block_cache_size) {
+        if constexpr (!std::is_same_v<typename IndexType::index_layout_tag, BlockIndexTag>) {
+            throw std::invalid_argument("Block cache supports only block-compressed indexes");
+        }
+        cache = std::make_shared<BlockCache>(
+            options.index_filename, *options.block_cache_size * 1024 * 1024);
+        spdlog::info(
+            "Reading posting lists through a {} MiB block cache with {}",
+            *options.block_cache_size,
+            cache->uses_io_uring() ? "io_uring" : "pread");
+    }
+    IndexType index = [&] {
+        if constexpr (std::is_same_v<typename IndexType::index_layout_tag, BlockIndexTag>) {
+            if (cache) {
+                return open_cached_index<IndexType>(cache);
             }
         }
+        return IndexType(MemorySource::mapped_file(options.index_filename, options.load_policy));
+    }();
+    std::shared_ptr<DecodedBlockCache> decoded_cache;
+    if (options.decoded_cache_size) {
+        if constexpr (std::is_same_v<typename IndexType::index_layout_tag, BlockIndexTag>) {
+            decoded_cache = std::make_shared<DecodedBlockCache>(
+                *options.decoded_cache_size * 1024 * 1024, IndexType::block_codec_type::block_size);
+            index.set_decoded_block_cache(decoded_cache);
+            spdlog::info("Sharing decoded blocks in {} MiB", *options.decoded_cache_size);
+        } else {
+            throw std::invalid_argument(
+                "Decoded block cache supports only block-compressed indexes");
+        }
+    }
+    lock_structure("index", index, options.locked_structures);
+    if (options.load_report) {
+        log_residency("index", index, index_start);
     }
 
-    WandType const wdata = [&] {
-        if (wand_data_filename) {
-            return WandType(MemorySource::mapped_file(*wand_data_filename));
+    // The whole index is already in memory with the first three policies, and a lazy index
+    // is read only by queries. Cached posting lists are read before each query instead, and
+    // a cold run evicts them.
+    if (not cache && not options.cold && options.load_policy != LoadPolicy::Warmup
+        && options.load_policy != LoadPolicy::Parallel
+        && options.load_policy != LoadPolicy::Populate && options.load_policy != LoadPolicy::Lazy) {
+        spdlog::info("Warming up posting lists");
+        std::vector<term_id_type> terms;
+        for (auto const& q: options.queries) {
+            terms.insert(terms.end(), q.terms.begin(), q.terms.end());
+        }
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        tbb::parallel_for(std::size_t(0), terms.size(), [&](std::size_t idx) {
+            index.warmup(terms[idx]);
+        });
+    }
+
+    auto wand_start = std::chrono::steady_clock::now();
+    WandType wdata = [&] {
+        if (options.wand_data_filename) {
+            return WandType(
+                MemorySource::mapped_file(*options.wand_data_filename, options.load_policy));
         }
         return WandType{};
     }();
+    if (options.wand_data_filename) {
+        lock_structure("wand", wdata, options.locked_structures);
+        if (options.load_report) {
+            log_residency("wand", wdata, wand_start);
+        }
+    }
 
-    std::vector<Threshold> thresholds(queries.size(), 0.0);
-    if (thresholds_filename) {
+    std::vector<Threshold> thresholds(options.queries.size(), 0.0);
+    if (options.thresholds_filename) {
         std::string t;
-        std::ifstream tin(*thresholds_filename);
+        std::ifstream tin(*options.thresholds_filename);
         size_t idx = 0;
         while (std::getline(tin, t)) {
             thresholds[idx] = std::stof(t);
             idx += 1;
         }
-        if (idx != queries.size()) {
+        if (idx != options.queries.size()) {
             throw std::invalid_argument("Invalid thresholds file.");
         }
     }
 
-    auto scorer = scorer::from_params(scorer_params, wdata);
+    auto scorer = scorer::from_params(options.scorer_params, wdata);
+
+    std::optional<DeletedDocuments> deleted;
+    if (options.deleted_filename) {
+        if (not options.wand_data_filename) {
+            throw std::invalid_argument("Deleted documents can only be filtered with WAND data");
+        }
+        deleted.emplace(MemorySource::mapped_file(*options.deleted_filename));
+        if (deleted->num_docs() != index.num_docs()) {
+            throw std::invalid_argument(fmt::format(
+                "Deleted documents are given for {} documents but the index has {}",
+                deleted->num_docs(),
+                index.num_docs()));
+        }
+        spdlog::info("Filtering {} deleted documents", deleted->count());
+        if (options.thresholds_filename) {
+            // Thresholds of the full index may exceed the scores of the remaining documents.
+            spdlog::warn("Thresholds are ignored when filtering deleted documents");
+        }
+    }
+    IndexCursors<IndexType, WandType> index_cursors{index, wdata, *scorer};
+
+    std::function<void()> evict;
+    if (options.cold) {
+        spdlog::info("Evicting the index and WAND data from the page cache before each query");
+        evict = [&] {
+            evict_structure(index, options.index_filename);
+            if (options.wand_data_filename) {
+                evict_structure(wdata, *options.wand_data_filename);
+            }
+        };
+    }
 
-    spdlog::info("Performing {} queries", type);
-    spdlog::info("K: {}", k);
+    spdlog::info("Performing {} queries", options.type);
+    spdlog::info("K: {}", options.k);
 
     std::vector<std::string> query_types;
-    boost::algorithm::split(query_types, query_type, boost::is_any_of(":"));
+    boost::algorithm::split(query_types, options.query_type, boost::is_any_of(":"));
 
-    for (auto&& t: query_types) {
-        spdlog::info("Query type: {}", t);
-        std::function<uint64_t(Query, Threshold)> query_fun;
-        if (t == "and") {
-            query_fun = [&](Query query, Threshold) {
+    // Returns the function executing queries with algorithm `t`, or nothing if it is unknown.
+    auto select_query_fun = [&](std::string const& t) -> std::function<uint64_t(Query, Threshold)> {
+        if (deleted) {
+            auto algorithm = ShardedAlgorithm::parse(t);
+            auto paged_k = algorithm.method == PageMethod::None ? 0 : options.secondary_k;
+            return [&, algorithm, paged_k](Query query, Threshold) {
+                DeletionFilteredCursors<IndexCursors<IndexType, WandType>> cursors{
+                    index_cursors, *deleted};
+                auto results = paged_search(
+                    cursors, query, index.num_docs(), algorithm, options.k, paged_k, nullptr);
+                return results.primary.size();
+            };
+        } else if (t == "and") {
+            return [&](Query query, Threshold) {
                 and_query and_q;
                 return and_q(make_cursors(index, query), index.num_docs()).size();
             };
         } else if (t == "or") {
-            query_fun = [&](Query query, Threshold) {
+            return [&](Query query, Threshold) {
                 or_query<false> or_q;
                 return or_q(make_cursors(index, query), index.num_docs());
             };
         } else if (t == "or_freq") {
-            query_fun = [&](Query query, Threshold) {
+            return [&](Query query, Threshold) {
                 or_query<true> or_q;
                 return or_q(make_cursors(index, query), index.num_docs());
             };
-        } else if (t == "wand" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+        } else if (t == "wand" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
                 topk_queue secondary(0);
                 cyclic_queue cyclic(0);
@@ -200,45 +593,45 @@ void perftest(
                 topk.finalize();
                 return topk.topk().size();
             };
-        } else if (t == "wand_method_1" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+        } else if (t == "wand_method_1" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
-                topk_queue secondary(secondary_k);
-                cyclic_queue cyclic(secondary_k);
+                topk_queue secondary(options.secondary_k);
+                cyclic_queue cyclic(options.secondary_k);
                 wand_query wand_q(topk, secondary, cyclic);
                 wand_q.method_one(make_max_scored_cursors(index, wdata, *scorer, query), index.num_docs());
                 topk.finalize();
                 cyclic.finalize(); // Method 1 uses cyclic to hold results
                 return topk.topk().size();
             };
-        } else if (t == "wand_method_2" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+        } else if (t == "wand_method_2" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
-                topk_queue secondary(secondary_k);
-                cyclic_queue cyclic(secondary_k);
+                topk_queue secondary(options.secondary_k);
+                cyclic_queue cyclic(options.secondary_k);
                 wand_query wand_q(topk, secondary, cyclic);
                 wand_q.method_two(make_max_scored_cursors(index, wdata, *scorer, query), index.num_docs());
                 topk.finalize();
                 secondary.finalize(); // Method 2 uses secondary to hold results
                 return topk.topk().size();
             };
-        } else if (t == "wand_method_2" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+        } else if (t == "wand_method_3" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
-                topk_queue secondary(secondary_k);
-                cyclic_queue cyclic(secondary_k);
+                topk_queue secondary(options.secondary_k);
+                cyclic_queue cyclic(options.secondary_k);
                 wand_query wand_q(topk, secondary, cyclic);
                 wand_q.method_three(make_max_scored_cursors(index, wdata, *scorer, query), index.num_docs());
                 topk.finalize();
                 secondary.finalize(); // Method 3 uses secondary to hold results
                 return topk.topk().size();
             };
-        } else if (t == "block_max_wand" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+        } else if (t == "block_max_wand" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
                 topk_queue secondary(0);
                 cyclic_queue cyclic(0);
@@ -248,12 +641,12 @@ void perftest(
                 topk.finalize();
                 return topk.topk().size();
             };
-        } else if (t == "block_max_wand_method_1" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+        } else if (t == "block_max_wand_method_1" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
-                topk_queue secondary(secondary_k);
-                cyclic_queue cyclic(secondary_k);
+                topk_queue secondary(options.secondary_k);
+                cyclic_queue cyclic(options.secondary_k);
                 block_max_wand_query block_max_wand_q(topk, secondary, cyclic);
                 block_max_wand_q.method_one(
                     make_block_max_scored_cursors(index, wdata, *scorer, query), index.num_docs());
@@ -261,12 +654,12 @@ void perftest(
                 cyclic.finalize(); // Method 1 uses cyclic to hold results
                 return topk.topk().size();
             };
-         } else if (t == "block_max_wand_method_2" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+         } else if (t == "block_max_wand_method_2" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
-                topk_queue secondary(secondary_k);
-                cyclic_queue cyclic(secondary_k);
+                topk_queue secondary(options.secondary_k);
+                cyclic_queue cyclic(options.secondary_k);
                 block_max_wand_query block_max_wand_q(topk, secondary, cyclic);
                 block_max_wand_q.method_two(
                     make_block_max_scored_cursors(index, wdata, *scorer, query), index.num_docs());
@@ -274,12 +667,12 @@ void perftest(
                 secondary.finalize(); // Method 2 uses secondary to hold results
                 return topk.topk().size();
             };
-         } else if (t == "block_max_wand_method_3" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+         } else if (t == "block_max_wand_method_3" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
-                topk_queue secondary(secondary_k);
-                cyclic_queue cyclic(secondary_k);
+                topk_queue secondary(options.secondary_k);
+                cyclic_queue cyclic(options.secondary_k);
                 block_max_wand_query block_max_wand_q(topk, secondary, cyclic);
                 block_max_wand_q.method_three(
                     make_block_max_scored_cursors(index, wdata, *scorer, query), index.num_docs());
@@ -287,9 +680,9 @@ void perftest(
                 secondary.finalize(); // Method 3 uses secondary to hold results
                 return topk.topk().size();
             };
-        } else if (t == "block_max_maxscore" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+        } else if (t == "block_max_maxscore" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
                 block_max_maxscore_query block_max_maxscore_q(topk);
                 block_max_maxscore_q(
@@ -297,18 +690,18 @@ void perftest(
                 topk.finalize();
                 return topk.topk().size();
             };
-        } else if (t == "ranked_and" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+        } else if (t == "ranked_and" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
                 ranked_and_query ranked_and_q(topk);
                 ranked_and_q(make_scored_cursors(index, *scorer, query), index.num_docs());
                 topk.finalize();
                 return topk.topk().size();
             };
-        } else if (t == "block_max_ranked_and" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+        } else if (t == "block_max_ranked_and" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
                 block_max_ranked_and_query block_max_ranked_and_q(topk);
                 block_max_ranked_and_q(
@@ -316,56 +709,212 @@ void perftest(
                 topk.finalize();
                 return topk.topk().size();
             };
-        } else if (t == "ranked_or" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+        } else if (t == "ranked_or" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
                 ranked_or_query ranked_or_q(topk);
                 ranked_or_q(make_scored_cursors(index, *scorer, query), index.num_docs());
                 topk.finalize();
                 return topk.topk().size();
             };
-        } else if (t == "maxscore" && wand_data_filename) {
-            query_fun = [&](Query query, Threshold t) {
-                topk_queue topk(k);
+        } else if (t == "maxscore" && options.wand_data_filename) {
+            return [&](Query query, Threshold t) {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
                 maxscore_query maxscore_q(topk);
                 maxscore_q(make_max_scored_cursors(index, wdata, *scorer, query), index.num_docs());
                 topk.finalize();
                 return topk.topk().size();
             };
-        } else if (t == "ranked_or_taat" && wand_data_filename) {
+        } else if (t == "ranked_or_taat" && options.wand_data_filename) {
             Simple_Accumulator accumulator(index.num_docs());
-            topk_queue topk(k);
-            ranked_or_taat_query ranked_or_taat_q(topk);
-            query_fun = [&, ranked_or_taat_q, accumulator](Query query, Threshold t) mutable {
+            return [&, accumulator](Query query, Threshold t) mutable {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
+                ranked_or_taat_query ranked_or_taat_q(topk);
                 ranked_or_taat_q(
                     make_scored_cursors(index, *scorer, query), index.num_docs(), accumulator);
                 topk.finalize();
                 return topk.topk().size();
             };
-        } else if (t == "ranked_or_taat_lazy" && wand_data_filename) {
+        } else if (t == "ranked_or_taat_lazy" && options.wand_data_filename) {
             Lazy_Accumulator<4> accumulator(index.num_docs());
-            topk_queue topk(k);
-            ranked_or_taat_query ranked_or_taat_q(topk);
-            query_fun = [&, ranked_or_taat_q, accumulator](Query query, Threshold t) mutable {
+            return [&, accumulator](Query query, Threshold t) mutable {
+                topk_queue topk(options.k);
                 topk.set_threshold(t);
+                ranked_or_taat_query ranked_or_taat_q(topk);
                 ranked_or_taat_q(
                     make_scored_cursors(index, *scorer, query), index.num_docs(), accumulator);
                 topk.finalize();
                 return topk.topk().size();
             };
         } else {
+            return {};
+        }
+    };
+    auto make_query_fun = [&](std::string const& t) {
+        auto query_fun = select_query_fun(t);
+        if constexpr (std::is_same_v<typename IndexType::index_layout_tag, BlockIndexTag>) {
+            if (cache && query_fun) {
+                query_fun = [&, query_fun = std::move(query_fun)](Query query, Threshold t) {
+                    load_posting_lists(*cache, index, gsl::make_span(&query, 1));
+                    return query_fun(query, t);
+                };
+            }
+        }
+        return query_fun;
+    };
+
+    std::optional<CostModel> cost_model;
+    if (options.cost_model_filename) {
+        std::ifstream is(*options.cost_model_filename);
+        cost_model = CostModel::read(is);
+    }
+    auto decode = [&] {
+        if (cost_model) {
+            return cost_model->decode();
+        }
+        std::vector<std::pair<std::string, float>> values{{"n", 1.0F}};
+        if (options.decode_model_filename) {
+            // A decoding time predictor is a list of feature names and weights.
+            values.clear();
+            std::ifstream is(*options.decode_model_filename);
+            std::string feature;
+            float weight = 0;
+            while (is >> feature >> weight) {
+                values.emplace_back(feature, weight);
+            }
+        }
+        return time_prediction::predictor(values);
+    }();
+    auto features_of = [&](Query const& query, Threshold threshold) {
+        return query_cost_features(index, wdata, query, options.k, threshold, decode);
+    };
+    auto make_query_funs = [&](std::vector<std::string> const& algorithms) {
+        if (not options.wand_data_filename) {
+            throw std::invalid_argument("Cost prediction requires WAND data");
+        }
+        std::vector<std::pair<std::string, QueryFun>> query_funs;
+        for (auto const& algorithm: algorithms) {
+            auto query_fun = make_query_fun(algorithm);
+            if (not query_fun) {
+                throw std::invalid_argument(
+                    fmt::format("Unsupported query type in cost model: {}", algorithm));
+            }
+            query_funs.emplace_back(algorithm, std::move(query_fun));
+        }
+        return query_funs;
+    };
+
+    if (options.fit_cost_model_filename) {
+        auto query_funs = make_query_funs(query_types);
+        std::vector<QueryCostFeatures> features;
+        for (std::size_t qid = 0; qid < options.queries.size(); ++qid) {
+            features.push_back(features_of(options.queries[qid], thresholds[qid]));
+        }
+        fit_cost_model(
+            query_funs,
+            options.queries,
+            thresholds,
+            features,
+            decode,
+            *options.fit_cost_model_filename,
+            evict);
+        return;
+    }
+
+    for (auto&& t: query_types) {
+        spdlog::info("Query type: {}", t);
+        if (t == "auto") {
+            if (not cost_model) {
+                throw std::invalid_argument("The auto algorithm requires a cost model");
+            }
+            auto query_funs = make_query_funs(cost_model->algorithms());
+            auto_perftest(
+                *cost_model,
+                query_funs,
+                features_of,
+                options.queries,
+                thresholds,
+                options.type,
+                2,
+                evict);
+            continue;
+        }
+        if (options.batch_size) {
+            if constexpr (std::is_same_v<typename IndexType::index_layout_tag, BlockIndexTag>) {
+                if (not options.wand_data_filename) {
+                    throw std::invalid_argument("Batched queries require WAND data");
+                }
+                if (options.cold) {
+                    throw std::invalid_argument("Batched queries are not run with a cold cache");
+                }
+                std::function<void(gsl::span<Query const>)> load;
+                if (cache) {
+                    load = [&](gsl::span<Query const> batch) {
+                        load_posting_lists(*cache, index, batch);
+                    };
+                }
+                batch_perftest(
+                    index,
+                    wdata,
+                    *scorer,
+                    deleted ? &*deleted : nullptr,
+                    options.queries,
+                    options.type,
+                    t,
+                    options.k,
+                    options.secondary_k,
+                    *options.batch_size,
+                    2,
+                    load);
+                continue;
+            } else {
+                throw std::invalid_argument(
+                    "Batched queries support only block-compressed indexes");
+            }
+        }
+        auto query_fun = make_query_fun(t);
+        if (not query_fun) {
             spdlog::error("Unsupported query type: {}", t);
             break;
         }
-        if (extract) {
-            extract_times(query_fun, queries, thresholds, type, t, 2, std::cout);
+        if (options.extract) {
+            extract_times(
+                query_fun, options.queries, thresholds, options.type, t, 2, evict, std::cout);
         } else {
-            op_perftest(query_fun, queries, thresholds, type, t, 2, k, safe);
+            op_perftest(
+                query_fun,
+                options.queries,
+                thresholds,
+                options.type,
+                t,
+                2,
+                options.k,
+                options.safe,
+                evict);
         }
     }
+    if (cache) {
+        auto stats = cache->stats();
+        spdlog::info(
+            "Block cache: hit rate {:.3f} ({} hits, {} misses), {} evictions, {} bytes read",
+            stats.hit_rate(),
+            stats.hits,
+            stats.misses,
+            stats.evictions,
+            stats.bytes_read);
+    }
+    if (decoded_cache) {
+        auto stats = decoded_cache->stats();
+        spdlog::info(
+            "Decoded block cache: hit rate {:.3f} ({} hits, {} misses), {} evictions",
+            stats.hit_rate(),
+            stats.hits,
+            stats.misses,
+            stats.evictions);
+    }
 }
 
 using wand_raw_index = wand_data<wand_data_raw>;
@@ -378,14 +927,23 @@ int main(int argc, const char** argv)
     bool silent = false;
     bool safe = false;
     bool quantized = false;
+    bool cold = false;
+    std::optional<std::string> cost_model_file;
+    std::optional<std::string> fit_cost_model_file;
+    std::optional<std::string> decode_model_file;
     uint64_t secondary_k = 0;
+    std::optional<std::string> deleted_file;
+    std::optional<std::size_t> block_cache_size;
+    std::optional<std::size_t> decoded_cache_size;
+    std::optional<std::size_t> batch_size;
 
     App<arg::Index,
         arg::WandData<arg::WandMode::Optional>,
         arg::Query<arg::QueryMode::Ranked>,
         arg::Algorithm,
         arg::Scorer,
-        arg::Thresholds>
+        arg::Thresholds,
+        arg::Loading>
         app{"Benchmarks queries on a given index."};
     app.add_flag("--quantized", quantized, "Quantized scores");
     app.add_flag("--extract", extract, "Extract individual query times");
@@ -393,6 +951,42 @@ int main(int argc, const char** argv)
     app.add_flag("--safe", safe, "Rerun if not enough results with pruning.")
         ->needs(app.thresholds_option());
     app.add_option("--secondary-k", secondary_k, "Size of secondary heap/queue.")->required();
+    app.add_option(
+        "--deleted",
+        deleted_file,
+        "Deleted documents to filter out; not supported by and, or, and ranked_or_taat");
+    app.add_option(
+        "--block-cache",
+        block_cache_size,
+        "Read posting lists with direct I/O into a cache of this many MiB");
+    app.add_option(
+        "--decoded-cache",
+        decoded_cache_size,
+        "Share decoded blocks of long posting lists between queries in this many MiB");
+    app.add_flag(
+        "--cold",
+        cold,
+        "Evict the index and WAND data from the page cache before each query, and report "
+        "major page faults and bytes read");
+    app.add_option(
+        "--cost-model",
+        cost_model_file,
+        "Cost model with which the auto algorithm chooses an algorithm per query");
+    auto* fit_option = app.add_option(
+        "--fit-cost-model",
+        fit_cost_model_file,
+        "Fit a cost model of the given algorithms to the query times, and write it to this file");
+    app.add_option(
+           "--decode-model",
+           decode_model_file,
+           "Decoding time predictor, as lines of feature names and weights")
+        ->needs(fit_option);
+    app.add_option(
+           "--batch-size",
+           batch_size,
+           "Compare the throughput of single queries with batches of this many queries sharing "
+           "the decoding of their posting lists")
+        ->excludes(fit_option);
     CLI11_PARSE(app, argc, argv);
 
     if (silent) {
@@ -401,21 +995,32 @@ int main(int argc, const char** argv)
         spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
     }
     if (extract) {
-        std::cout << "qid\tusec\n";
+        std::cout << (cold ? "qid\tusec\tmajor_faults\tread_bytes\n" : "qid\tusec\n");
     }
 
-    auto params = std::make_tuple(
-        app.index_filename(),
-        app.wand_data_path(),
-        app.queries(),
-        app.thresholds_file(),
-        app.index_encoding(),
-        app.algorithm(),
-        app.k(),
-        secondary_k,
-        app.scorer_params(),
-        extract,
-        safe);
+    PerftestOptions options;
+    options.index_filename = app.index_filename();
+    options.wand_data_filename = app.wand_data_path();
+    options.queries = app.queries();
+    options.thresholds_filename = app.thresholds_file();
+    options.type = app.index_encoding();
+    options.query_type = app.algorithm();
+    options.k = app.k();
+    options.secondary_k = secondary_k;
+    options.scorer_params = app.scorer_params();
+    options.deleted_filename = deleted_file;
+    options.load_policy = app.load_policy();
+    options.locked_structures = app.locked_structures();
+    options.load_report = app.load_report();
+    options.block_cache_size = block_cache_size;
+    options.decoded_cache_size = decoded_cache_size;
+    options.cold = cold;
+    options.cost_model_filename = cost_model_file;
+    options.fit_cost_model_filename = fit_cost_model_file;
+    options.decode_model_filename = decode_model_file;
+    options.batch_size = batch_size;
+    options.extract = extract;
+    options.safe = safe;
     /**/
     if (false) {
 #define LOOP_BODY(R, DATA, T)                                                                        \
@@ -424,12 +1029,12 @@ int main(int argc, const char** argv)
     {                                                                                                \
         if (app.is_wand_compressed()) {                                                              \
             if (quantized) {                                                                         \
-                std::apply(perftest<BOOST_PP_CAT(T, _index), wand_uniform_index_quantized>, params); \
+                perftest<BOOST_PP_CAT(T, _index), wand_uniform_index_quantized>(options);            \
             } else {                                                                                 \
-                std::apply(perftest<BOOST_PP_CAT(T, _index), wand_uniform_index>, params);           \
+                perftest<BOOST_PP_CAT(T, _index), wand_uniform_index>(options);                      \
             }                                                                                        \
         } else {                                                                                     \
-            std::apply(perftest<BOOST_PP_CAT(T, _index), wand_raw_index>, params);                   \
+            perftest<BOOST_PP_CAT(T, _index), wand_raw_index>(options);                              \
         }
         /**/
         BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <CLI/CLI.hpp>
+#include <mio/mmap.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "app.hpp"
+#include "index_types.hpp"
+#include "memory_residency.hpp"
+#include "query/query_scheduler.hpp"
+#include "query/query_server.hpp"
+#include "query/sharded_search.hpp"
+#include "query/term_processor.hpp"
+#include "scorer/scorer.hpp"
+#include "string_table.hpp"
+#include "wand_data_compressed.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+using Clock = std::chrono::steady_clock;
+
+/// A client connected to the socket. Responses of concurrent requests are written whole, in
+/// the order they finish.
+class Connection {
+  public:
+    explicit Connection(int fd) : m_fd(fd) {}
+    Connection(Connection const&) = delete;
+    Connection(Connection&&) = delete;
+    Connection& operator=(Connection const&) = delete;
+    Connection& operator=(Connection&&) = delete;
+    ~Connection() { ::close(m_fd); }
+
+    [[nodiscard]] auto fd() const -> int { return m_fd; }
+
+    /// Writes `line` followed by a newline. A client that left is ignored.
+    void send(std::string line)
+    {
+        line.push_back('\n');
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::size_t written = 0;
+        while (written < line.size()) {
+            auto count =
+                ::send(m_fd, line.data() + written, line.size() - written, MSG_NOSIGNAL);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return;
+            }
+            written += count;
+        }
+    }
+
+  private:
+    int m_fd;
+    std::mutex m_mutex;
+};
+
+/// Calls `fn` with each non-empty line read from `fd`, until the end of the stream.
+template <typename Fn>
+void for_each_socket_line(int fd, Fn fn)
+{
+    std::string buffer;
+    std::vector<char> chunk(64 * 1024);
+    while (true) {
+        auto count = ::read(fd, chunk.data(), chunk.size());
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        buffer.append(chunk.data(), count);
+        std::size_t start = 0;
+        for (auto end = buffer.find('\n'); end != std::string::npos;
+             end = buffer.find('\n', start)) {
+            if (end > start) {
+                fn(buffer.substr(start, end - start));
+            }
+            start = end + 1;
+        }
+        buffer.erase(0, start);
+    }
+    if (not buffer.empty()) {
+        fn(buffer);
+    }
+}
+
+template <typename IndexType, typename WandType>
+void serve(
+    std::string const& index_filename,
+    std::string const& wand_data_filename,
+    std::string const& index_type,
+    std::string const& default_algorithm,
+    std::size_t default_k,
+    ScorerParams const& scorer_params,
+    std::size_t threads,
+    LoadPolicy load_policy,
+    std::vector<std::string> const& locked_structures,
+    bool load_report,
+    std::optional<std::string> const& terms_file,
+    std::optional<std::string> const& stopwords_file,
+    std::optional<std::string> const& stemmer,
+    std::optional<std::string> const& documents_file,
+    std::optional<std::string> const& socket_path,
+    std::size_t max_sessions)
+{
+    spdlog::info("Loading {} index from {}", index_type, index_filename);
+    auto index_start = Clock::now();
+    IndexType index(MemorySource::mapped_file(index_filename, load_policy));
+    lock_structure("index", index, locked_structures);
+    if (load_report) {
+        log_residency("index", index, index_start);
+    }
+    auto wand_start = Clock::now();
+    WandType wdata(MemorySource::mapped_file(wand_data_filename, load_policy));
+    lock_structure("wand", wdata, locked_structures);
+    if (load_report) {
+        log_residency("wand", wdata, wand_start);
+    }
+    auto scorer = scorer::from_params(scorer_params, wdata);
+    IndexCursors<IndexType, WandType> cursors{index, wdata, *scorer};
+
+    std::optional<TermProcessor> term_processor;
+    if (terms_file) {
+        term_processor.emplace(terms_file, stopwords_file, stemmer);
+    }
+    std::shared_ptr<mio::mmap_source> documents_source;
+    std::optional<Lexicon> documents;
+    if (documents_file) {
+        documents_source = std::make_shared<mio::mmap_source>(documents_file->c_str());
+        documents = Lexicon::from(*documents_source);
+    }
+    SessionStore sessions(max_sessions);
+
+    auto parse_query = [&](std::string const& text) {
+        return term_processor ? parse_query_terms(text, *term_processor) : parse_query_ids(text);
+    };
+
+    // Returns the page asked for by `request`, and whether its session retained it.
+    auto search = [&](ServerRequest const& request, std::size_t k, std::string const& name)
+        -> std::pair<std::vector<std::pair<float, std::uint64_t>>, bool> {
+        if (request.page == 2 && request.session) {
+            auto next = sessions.get(*request.session);
+            bool retained = next && next->k == k && next->algorithm == name
+                && (not request.query || *request.query == next->query);
+            if (retained) {
+                return {std::move(next->results), true};
+            }
+        }
+        if (not request.query) {
+            throw std::invalid_argument("A query is needed unless its session retained the page");
+        }
+        auto query = parse_query(*request.query);
+        auto algorithm = ShardedAlgorithm::parse(name);
+        if (request.page == 1) {
+            auto results = paged_search(cursors, query, index.num_docs(), algorithm, k, k, nullptr);
+            if (algorithm.method == PageMethod::None) {
+                // Without a next-page method, both pages are in the primary results.
+                auto size = std::min(k, results.primary.size());
+                results.secondary.assign(results.primary.begin() + size, results.primary.end());
+                results.primary.resize(size);
+            }
+            if (request.session) {
+                sessions.put(
+                    *request.session,
+                    NextPage{*request.query, name, k, std::move(results.secondary)});
+            }
+            return {std::move(results.primary), false};
+        }
+        // Deeper pages, and second pages no longer retained, come from the top `page * k`.
+        auto first = (request.page - 1) * k;
+        algorithm.method = PageMethod::None;
+        auto results = paged_search(cursors, query, index.num_docs(), algorithm, first, k, nullptr);
+        auto& primary = results.primary;
+        primary.erase(primary.begin(), primary.begin() + std::min(first, primary.size()));
+        return {std::move(primary), false};
+    };
+
+    auto respond = [&](std::string const& line, Clock::time_point received) {
+        auto started = Clock::now();
+        ServerRequest request;
+        try {
+            request = parse_request(line);
+            auto k = request.k.value_or(default_k);
+            if (k == 0) {
+                throw std::invalid_argument("k must be positive");
+            }
+            auto algorithm = request.algorithm.value_or(default_algorithm);
+            auto [results, from_session] = search(request, k, algorithm);
+            std::vector<ServerResult> page;
+            std::string title;
+            for (auto [score, docid]: results) {
+                page.push_back(ServerResult{
+                    documents ? std::string(documents->lookup(docid, title))
+                              : std::to_string(docid),
+                    score});
+            }
+            auto finished = Clock::now();
+            auto usecs = std::chrono::duration<double, std::micro>(finished - received).count();
+            spdlog::info(
+                "session: {}, page: {}, k: {}, algorithm: {}, results: {}, retained: {}, "
+                "queued: {:.0f} us, latency: {:.0f} us",
+                request.session.value_or("-"),
+                request.page,
+                k,
+                algorithm,
+                page.size(),
+                from_session,
+                std::chrono::duration<double, std::micro>(started - received).count(),
+                usecs);
+            return format_response(request, (request.page - 1) * k, page, from_session, usecs);
+        } catch (std::exception const& error) {
+            spdlog::warn("Failed request: {}", error.what());
+            return format_error(request.id, error.what());
+        }
+    };
+
+    QueryScheduler workers(threads, SchedulingPolicy::Fifo);
+    if (not socket_path) {
+        spdlog::info("Reading requests from the standard input");
+        std::mutex output_mutex;
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            workers.submit(0, [&, line, received = Clock::now()] {
+                auto response = respond(line, received);
+                std::lock_guard<std::mutex> lock(output_mutex);
+                std::cout << response << std::endl;
+            });
+        }
+        workers.wait();
+        return;
+    }
+
+    int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        throw std::system_error(errno, std::generic_category(), "Cannot create socket");
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path->size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument(fmt::format("Socket path too long: {}", *socket_path));
+    }
+    std::strcpy(address.sun_path, socket_path->c_str());
+    ::unlink(socket_path->c_str());
+    if (::bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || ::listen(server, SOMAXCONN) < 0) {
+        throw std::system_error(
+            errno, std::generic_category(), fmt::format("Cannot listen on {}", *socket_path));
+    }
+    spdlog::info("Listening on {} with {} worker threads", *socket_path, threads);
+    while (true) {
+        int fd = ::accept(server, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "Cannot accept connection");
+        }
+        // Each client has a thread reading its requests; workers run them and respond.
+        std::thread([&, connection = std::make_shared<Connection>(fd)] {
+            for_each_socket_line(connection->fd(), [&](std::string line) {
+                workers.submit(0, [&, connection, line, received = Clock::now()] {
+                    connection->send(respond(line, received));
+                });
+            });
+        }).detach();
+    }
+}
+
+using wand_raw_index = wand_data<wand_data_raw>;
+using wand_uniform_index = wand_data<wand_data_compressed<>>;
+
+int main(int argc, const char** argv)
+{
+    spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+
+    std::size_t k = 10;
+    std::optional<std::string> terms_file;
+    std::optional<std::string> stopwords_file;
+    std::optional<std::string> stemmer;
+    std::optional<std::string> documents_file;
+    std::optional<std::string> socket_path;
+    std::size_t max_sessions = 100'000;
+
+    App<arg::Index,
+        arg::WandData<arg::WandMode::Required>,
+        arg::Algorithm,
+        arg::Scorer,
+        arg::Threads,
+        arg::Loading>
+        app{"Keeps an index loaded and answers JSON query requests, one per line, from a Unix "
+            "socket or the standard input."};
+    app.add_option("-k", k, "Number of results per page if a request gives none", true);
+    auto* terms_option = app.add_option("--terms", terms_file, "Term lexicon");
+    app.add_option("--stopwords", stopwords_file, "List of blacklisted stop words to filter out")
+        ->needs(terms_option);
+    app.add_option("--stemmer", stemmer, "Stemmer type")->needs(terms_option);
+    app.add_option("--documents", documents_file, "Document lexicon");
+    app.add_option(
+        "--socket", socket_path, "Unix socket to listen on instead of the standard input");
+    app.add_option(
+        "--max-sessions", max_sessions, "Number of sessions whose second page is retained", true);
+    CLI11_PARSE(app, argc, argv);
+
+    auto params = std::make_tuple(
+        app.index_filename(),
+        app.wand_data_path(),
+        app.index_encoding(),
+        app.algorithm(),
+        k,
+        app.scorer_params(),
+        app.threads(),
+        app.load_policy(),
+        app.locked_structures(),
+        app.load_report(),
+        terms_file,
+        stopwords_file,
+        stemmer,
+        documents_file,
+        socket_path,
+        max_sessions);
+    /**/
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                                        \
+    }                                                                                \
+    else if (app.index_encoding() == BOOST_PP_STRINGIZE(T))                          \
+    {                                                                                \
+        if (app.is_wand_compressed()) {                                              \
+            std::apply(serve<BOOST_PP_CAT(T, _index), wand_uniform_index>, params);  \
+        } else {                                                                     \
+            std::apply(serve<BOOST_PP_CAT(T, _index), wand_raw_index>, params);      \
+        }
+        /**/
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+
+    } else {
+        spdlog::error("Unknown type {}", app.index_encoding());
+    }
+}
@@ -6,7 +6,7 @@
 #include "binary_collection.hpp"
 #include "io.hpp"
 #include "memory_source.hpp"
-#include "payload_vector.hpp"
+#include "string_table.hpp"
 #include "util/util.hpp"
 
 using namespace pisa;
@@ -23,9 +23,10 @@ print_function(std::optional<std::string> const& map_file, std::optional<std::st
     if (lex_file) {
         auto source =
             std::make_shared<pisa::MemorySource>(pisa::MemorySource::mapped_file(*lex_file));
-        auto lexicon = Payload_Vector<>::from(*source);
-        return [source = std::move(source), lexicon](std::uint32_t term) {
-            std::cout << lexicon[term] << ' ';
+        auto lexicon = Lexicon::from(*source);
+        return [source = std::move(source), lexicon, buffer = std::string()](
+                   std::uint32_t term) mutable {
+            std::cout << lexicon.lookup(term, buffer) << ' ';
         };
     }
     return [](auto const& term) { std::cout << term << " "; };
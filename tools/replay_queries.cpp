@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "app.hpp"
+#include "index_types.hpp"
+#include "query/cost_model.hpp"
+#include "query/query_scheduler.hpp"
+#include "query/sharded_search.hpp"
+#include "query/split_search.hpp"
+#include "scorer/scorer.hpp"
+#include "util/do_not_optimize_away.hpp"
+#include "util/util.hpp"
+#include "wand_data_compressed.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+using Clock = std::chrono::steady_clock;
+
+/// Arrival times of `count` queries, in microseconds since the start of a replay, of a
+/// Poisson process with `qps` queries per second.
+[[nodiscard]] auto poisson_arrivals(std::size_t count, double qps, std::uint64_t seed)
+    -> std::vector<double>
+{
+    std::mt19937_64 rng(seed);
+    std::exponential_distribution<double> gap(qps / 1'000'000.0);
+    std::vector<double> arrivals;
+    double arrival = 0;
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        arrival += gap(rng);
+        arrivals.push_back(arrival);
+    }
+    return arrivals;
+}
+
+/// Number of queries timed to convert numbers of postings into times without a cost model.
+constexpr std::size_t calibration_queries = 1'000;
+
+/// State shared by the document ranges of a split query.
+struct SplitQuery {
+    SharedThreshold threshold;
+    std::vector<std::vector<std::pair<float, std::uint64_t>>> results;
+    std::atomic_size_t remaining;
+};
+
+template <typename IndexType, typename WandType>
+void replay(
+    std::string const& index_filename,
+    std::string const& wand_data_filename,
+    std::vector<Query> const& queries,
+    std::string const& index_type,
+    std::string const& query_type,
+    std::size_t k,
+    ScorerParams const& scorer_params,
+    std::size_t threads,
+    double qps,
+    std::vector<std::string> const& policies,
+    double aging,
+    std::optional<double> split_cost,
+    std::optional<std::string> const& cost_model_filename,
+    std::uint64_t seed)
+{
+    auto algorithm = ShardedAlgorithm::parse(query_type);
+    if (split_cost && algorithm.method != PageMethod::None) {
+        throw std::invalid_argument("Next-page methods cannot be split into document ranges");
+    }
+    for (auto const& policy: policies) {
+        static_cast<void>(parse_scheduling_policy(policy));
+    }
+    spdlog::info("Loading index from {}", index_filename);
+    IndexType index(MemorySource::mapped_file(index_filename));
+    WandType wdata(MemorySource::mapped_file(wand_data_filename));
+    auto scorer = scorer::from_params(scorer_params, wdata);
+    IndexCursors<IndexType, WandType> cursors{index, wdata, *scorer};
+
+    // Both policies must see the same resident index, so the lists are read up front.
+    spdlog::info("Warming up posting lists");
+    for (auto const& query: queries) {
+        for (auto term: query.terms) {
+            index.warmup(term);
+        }
+    }
+
+    // Costs are times in microseconds, so that `aging` and `split_cost` mean the same with or
+    // without a cost model. Without one, times are estimated from the numbers of postings of
+    // the queries, at the rate measured on a sample of them.
+    std::vector<double> costs;
+    if (cost_model_filename) {
+        std::ifstream is(*cost_model_filename);
+        auto model = CostModel::read(is);
+        for (auto const& query: queries) {
+            auto features = query_cost_features(index, wdata, query, k, 0, model.decode());
+            costs.push_back(model.predict(query_type, features));
+        }
+    } else {
+        for (auto const& query: queries) {
+            double postings = 0;
+            for (auto term: query.terms) {
+                postings += index[term].size();
+            }
+            costs.push_back(postings);
+        }
+        auto stride = std::max<std::size_t>(1, queries.size() / calibration_queries);
+        double sampled_postings = 0;
+        auto start = Clock::now();
+        for (std::size_t qid = 0; qid < queries.size(); qid += stride) {
+            do_not_optimize_away(
+                paged_search(cursors, queries[qid], index.num_docs(), algorithm, k, 0, nullptr));
+            sampled_postings += costs[qid];
+        }
+        double usecs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+        double rate = std::max(sampled_postings, 1.0) / std::max(usecs, 1.0);
+        spdlog::info("Estimating query times at {:.1f} postings per microsecond", rate);
+        for (auto& cost: costs) {
+            cost /= rate;
+        }
+    }
+    auto ranges = split_documents(index.num_docs(), threads);
+    auto arrivals = poisson_arrivals(queries.size(), qps, seed);
+
+    for (auto const& policy_name: policies) {
+        auto policy = parse_scheduling_policy(policy_name);
+        std::vector<double> latencies(queries.size(), 0.0);
+        std::size_t num_split = 0;
+        auto start = Clock::now();
+        {
+            QueryScheduler scheduler(threads, policy, aging);
+            for (std::size_t qid = 0; qid < queries.size(); ++qid) {
+                // Latency counts from the scheduled arrival, so that a late dispatcher does
+                // not hide queueing delays.
+                auto arrival = start
+                    + std::chrono::duration_cast<Clock::duration>(
+                                   std::chrono::duration<double, std::micro>(arrivals[qid]));
+                std::this_thread::sleep_until(arrival);
+                auto finish = [&latencies, qid, arrival] {
+                    latencies[qid] =
+                        std::chrono::duration<double, std::micro>(Clock::now() - arrival).count();
+                };
+                if (not split_cost || costs[qid] <= *split_cost || ranges.size() == 1) {
+                    scheduler.submit(costs[qid], [&, qid, finish] {
+                        do_not_optimize_away(paged_search(
+                            cursors, queries[qid], index.num_docs(), algorithm, k, 0, nullptr));
+                        finish();
+                    });
+                    continue;
+                }
+                num_split += 1;
+                auto split = std::make_shared<SplitQuery>();
+                split->results.resize(ranges.size());
+                split->remaining = ranges.size();
+                std::vector<std::function<void()>> parts;
+                for (std::size_t part = 0; part < ranges.size(); ++part) {
+                    parts.emplace_back([&, qid, part, split, finish] {
+                        split->results[part] = range_search(
+                            cursors,
+                            queries[qid],
+                            ranges[part].first,
+                            ranges[part].second,
+                            algorithm,
+                            k,
+                            &split->threshold);
+                        // The last range to finish merges the results of all.
+                        if (split->remaining.fetch_sub(1) == 1) {
+                            do_not_optimize_away(merge_ranges(split->results, k));
+                            finish();
+                        }
+                    });
+                }
+                scheduler.submit(costs[qid], std::move(parts));
+            }
+            scheduler.wait();
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::sort(latencies.begin(), latencies.end());
+        double avg =
+            std::accumulate(latencies.begin(), latencies.end(), double()) / latencies.size();
+        double q50 = latencies[latencies.size() / 2];
+        double q95 = latencies[95 * latencies.size() / 100];
+        double q99 = latencies[99 * latencies.size() / 100];
+        double max = latencies.back();
+        double throughput = latencies.size() / elapsed;
+
+        spdlog::info("---- {} {} {}", index_type, query_type, policy_name);
+        spdlog::info("Offered load: {} queries/s on {} threads", qps, threads);
+        spdlog::info("Throughput: {:.1f} queries/s", throughput);
+        spdlog::info("Split queries: {}", num_split);
+        spdlog::info("Mean latency: {}", avg);
+        spdlog::info("50% quantile: {}", q50);
+        spdlog::info("95% quantile: {}", q95);
+        spdlog::info("99% quantile: {}", q99);
+        spdlog::info("Max: {}", max);
+
+        stats_line()("type", index_type)("query", query_type)("policy", policy_name)(
+            "threads", threads)("qps", qps)("throughput", throughput)("split", num_split)(
+            "avg", avg)("q50", q50)("q95", q95)("q99", q99)("max", max);
+    }
+}
+
+using wand_raw_index = wand_data<wand_data_raw>;
+using wand_uniform_index = wand_data<wand_data_compressed<>>;
+
+int main(int argc, const char** argv)
+{
+    spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+
+    double qps = 0;
+    std::vector<std::string> policies{"fifo", "spjf"};
+    double aging = 1.0;
+    std::optional<double> split_cost;
+    std::optional<std::string> cost_model_file;
+    std::uint64_t seed = 0;
+
+    App<arg::Index,
+        arg::WandData<arg::WandMode::Required>,
+        arg::Query<arg::QueryMode::Ranked>,
+        arg::Algorithm,
+        arg::Scorer,
+        arg::Threads>
+        app{"Replays queries arriving at a fixed rate, and reports latencies under each "
+            "scheduling policy."};
+    app.add_option("--qps", qps, "Mean number of queries arriving per second")->required();
+    app.add_option("--policy", policies, "Scheduling policies to compare: fifo, spjf", true);
+    app.add_option(
+        "--aging",
+        aging,
+        "Predicted microseconds by which a waiting query is promoted per microsecond under spjf",
+        true);
+    app.add_option(
+        "--split-cost",
+        split_cost,
+        "Split queries predicted to take more microseconds than this into a document range per "
+        "thread");
+    app.add_option(
+        "--cost-model",
+        cost_model_file,
+        "Cost model predicting query times; without one, times are estimated from numbers of "
+        "postings");
+    app.add_option("--seed", seed, "Seed of the arrival times", true);
+    CLI11_PARSE(app, argc, argv);
+
+    auto params = std::make_tuple(
+        app.index_filename(),
+        app.wand_data_path(),
+        app.queries(),
+        app.index_encoding(),
+        app.algorithm(),
+        app.k(),
+        app.scorer_params(),
+        app.threads(),
+        qps,
+        policies,
+        aging,
+        split_cost,
+        cost_model_file,
+        seed);
+    /**/
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                                          \
+    }                                                                                  \
+    else if (app.index_encoding() == BOOST_PP_STRINGIZE(T))                            \
+    {                                                                                  \
+        if (app.is_wand_compressed()) {                                                \
+            std::apply(replay<BOOST_PP_CAT(T, _index), wand_uniform_index>, params);   \
+        } else {                                                                       \
+            std::apply(replay<BOOST_PP_CAT(T, _index), wand_raw_index>, params);       \
+        }
+        /**/
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+
+    } else {
+        spdlog::error("Unknown type {}", app.index_encoding());
+    }
+}
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+
+#include "app.hpp"
+#include "index_types.hpp"
+#include "query/sharded_search.hpp"
+#include "segmented_index.hpp"
+#include "timer.hpp"
+#include "util/util.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+using wand_raw_index = wand_data<wand_data_raw>;
+
+namespace {
+std::atomic_bool interrupted{false};
+}
+
+/// Returns both pages of `query`, with document IDs of the whole segmented index.
+template <typename IndexType>
+[[nodiscard]] auto search(
+    SegmentedIndex<IndexType, wand_raw_index> const& index,
+    Query const& query,
+    ShardedAlgorithm const& algorithm,
+    std::size_t k,
+    std::size_t secondary_k) -> ShardedPages
+{
+    auto results = paged_search(index, query, index.num_docs(), algorithm, k, secondary_k, nullptr);
+    return merge_shard_results(gsl::make_span(&results, 1), k, secondary_k);
+}
+
+template <typename IndexType>
+void perftest(SegmentedQueryArgs const& args)
+{
+    SegmentDirectory dir(args.directory());
+    auto index = SegmentedIndex<IndexType, wand_raw_index>::open(dir, args.scorer_params());
+    auto queries = args.segment_queries(dir.term_lexicon_path());
+    spdlog::info(
+        "Loaded {} segments with {} documents", index.segments().size(), index.num_docs());
+    spdlog::info("Performing {} queries", args.index_encoding());
+    spdlog::info("K: {}", args.k());
+
+    std::vector<std::string> query_types;
+    boost::algorithm::split(query_types, args.algorithm(), boost::is_any_of(":"));
+    for (auto&& t: query_types) {
+        spdlog::info("Query type: {}", t);
+        auto algorithm = ShardedAlgorithm::parse(t);
+        std::vector<double> query_times;
+        for (size_t run_idx = 0; run_idx <= 2; ++run_idx) {
+            for (auto const& query: queries) {
+                auto usecs = run_with_timer<std::chrono::microseconds>([&]() {
+                    auto pages = search(index, query, algorithm, args.k(), args.secondary_k());
+                    do_not_optimize_away(pages.first_page.size() + pages.second_page.size());
+                });
+                if (run_idx != 0) {  // first run is not timed
+                    query_times.push_back(usecs.count());
+                }
+            }
+        }
+        std::sort(query_times.begin(), query_times.end());
+        double avg =
+            std::accumulate(query_times.begin(), query_times.end(), double()) / query_times.size();
+        double q50 = query_times[query_times.size() / 2];
+        double q90 = query_times[90 * query_times.size() / 100];
+        double q95 = query_times[95 * query_times.size() / 100];
+        double q99 = query_times[99 * query_times.size() / 100];
+
+        spdlog::info("---- {} {}", args.index_encoding(), t);
+        spdlog::info("Mean: {}", avg);
+        spdlog::info("50% quantile: {}", q50);
+        spdlog::info("90% quantile: {}", q90);
+        spdlog::info("95% quantile: {}", q95);
+        spdlog::info("99% quantile: {}", q99);
+
+        stats_line()("type", args.index_encoding())("query", t)(
+            "segments", index.segments().size())("avg", avg)("q50", q50)("q90", q90)(
+            "q95", q95)("q99", q99);
+    }
+}
+
+template <typename IndexType>
+void evaluate(SegmentedQueryArgs const& args, std::string const& run_id)
+{
+    SegmentDirectory dir(args.directory());
+    auto index = SegmentedIndex<IndexType, wand_raw_index>::open(dir, args.scorer_params());
+    auto queries = args.segment_queries(dir.term_lexicon_path());
+    auto algorithm = ShardedAlgorithm::parse(args.algorithm());
+    for (std::size_t query = 0; query < queries.size(); ++query) {
+        auto pages = search(index, queries[query], algorithm, args.k(), args.secondary_k());
+        auto qid = queries[query].id.value_or(std::to_string(query));
+        std::size_t rank = 0;
+        for (auto const* page: {&pages.first_page, &pages.second_page}) {
+            for (auto const& result: *page) {
+                std::cout << fmt::format(
+                    "{}\tQ0\t{}\t{}\t{}\t{}\n",
+                    qid,
+                    index.document(result.docid),
+                    rank++,
+                    result.score,
+                    run_id);
+            }
+        }
+    }
+}
+
+template <typename IndexType>
+void compact(SegmentBuildArgs const& args, std::optional<std::size_t> merge_factor, int watch)
+{
+    SegmentDirectory dir(args.directory());
+    auto step = [&] {
+        return compact_segments<IndexType, wand_raw_index>(
+            dir, args.index_encoding(), args.scorer_params(), args.block_size(), merge_factor);
+    };
+    if (watch == 0) {
+        while (step()) {
+        }
+        return;
+    }
+    std::signal(SIGINT, [](int) { interrupted = true; });
+    std::signal(SIGTERM, [](int) { interrupted = true; });
+    spdlog::info("Compacting {} every {} seconds", args.directory(), watch);
+    BackgroundCompaction compaction(step, std::chrono::seconds(watch));
+    while (not interrupted) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    spdlog::info("Stopping compaction");
+}
+
+int main(int argc, char** argv)
+{
+    spdlog::set_default_logger(spdlog::stderr_color_mt("default"));
+
+    CLI::App app{"Builds, compacts, and searches an index made of incrementally added segments."};
+    auto* add_cmd = app.add_subcommand("add", "Adds a forward index as a new segment.");
+    auto* compact_cmd = app.add_subcommand("compact", "Merges segments.");
+    auto* queries_cmd = app.add_subcommand("queries", "Benchmarks queries.");
+    auto* evaluate_cmd = app.add_subcommand("evaluate", "Retrieves query results in TREC format.");
+    SegmentBuildArgs add_args(add_cmd);
+    SegmentBuildArgs compact_args(compact_cmd);
+    SegmentedQueryArgs queries_args(queries_cmd);
+    SegmentedQueryArgs evaluate_args(evaluate_cmd);
+
+    std::string input_basename;
+    std::size_t batch_size = 100'000;
+    add_cmd->add_option("-i,--input", input_basename, "Forward index basename")->required();
+    add_cmd->add_option(
+        "--batch-size", batch_size, "Number of documents to process at a time", true);
+
+    std::size_t merge_factor = 10;
+    bool merge_all = false;
+    int watch = 0;
+    compact_cmd->add_option(
+        "--merge-factor", merge_factor, "Number of segments of similar size merged at once", true);
+    compact_cmd->add_flag("--all", merge_all, "Merge all segments into one");
+    compact_cmd->add_option(
+        "--watch", watch, "Keep compacting in the background, every given number of seconds");
+
+    std::string run_id = "R0";
+    evaluate_cmd->add_option("-r,--run", run_id, "Run identifier");
+
+    app.require_subcommand(1);
+    CLI11_PARSE(app, argc, argv);
+
+    auto threads = add_cmd->parsed()
+        ? add_args.threads()
+        : (compact_cmd->parsed() ? compact_args.threads()
+                                 : (queries_cmd->parsed() ? queries_args.threads()
+                                                          : evaluate_args.threads()));
+    auto const& encoding = add_cmd->parsed()
+        ? add_args.index_encoding()
+        : (compact_cmd->parsed() ? compact_args.index_encoding()
+                                 : (queries_cmd->parsed() ? queries_args.index_encoding()
+                                                          : evaluate_args.index_encoding()));
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, threads + 1);
+    spdlog::info("Number of worker threads: {}", threads);
+
+    try {
+        /**/
+        if (false) {  // NOLINT
+#define LOOP_BODY(R, DATA, T)                                                                  \
+    }                                                                                          \
+    else if (encoding == BOOST_PP_STRINGIZE(T))                                                \
+    {                                                                                          \
+        using index_type = BOOST_PP_CAT(T, _index);                                            \
+        if (add_cmd->parsed()) {                                                               \
+            add_segment<index_type, wand_raw_index>(                                           \
+                SegmentDirectory(add_args.directory()),                                        \
+                input_basename,                                                                \
+                encoding,                                                                      \
+                add_args.scorer_params(),                                                      \
+                add_args.block_size(),                                                         \
+                batch_size,                                                                    \
+                threads);                                                                      \
+        } else if (compact_cmd->parsed()) {                                                    \
+            compact<index_type>(                                                               \
+                compact_args,                                                                  \
+                merge_all ? std::nullopt : std::make_optional(merge_factor),                   \
+                watch);                                                                        \
+        } else if (queries_cmd->parsed()) {                                                    \
+            perftest<index_type>(queries_args);                                                \
+        } else {                                                                               \
+            evaluate<index_type>(evaluate_args, run_id.empty() ? std::string("PISA") : run_id); \
+        }                                                                                      \
+        /**/
+
+            BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+        } else {
+            spdlog::error("Unknown type {}", encoding);
+            return 1;
+        }
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+    return 0;
+}
@@ -1,7 +1,7 @@
 #include <iostream>
 
 #include "mappable/mapper.hpp"
-#include "mio/mmap.hpp"
+#include "memory_source.hpp"
 
 #include "CLI/CLI.hpp"
 #include "app.hpp"
@@ -18,10 +18,8 @@ template <typename IndexType>
 void selective_queries(
     const std::string& index_filename, std::string const& encoding, std::vector<Query> const& queries)
 {
-    IndexType index;
     spdlog::info("Loading index from {}", index_filename);
-    mio::mmap_source m(index_filename.c_str());
-    mapper::map(index, m, mapper::map_flags::warmup);
+    IndexType index(MemorySource::mapped_file(index_filename));
 
     spdlog::info("Performing {} queries", encoding);
 
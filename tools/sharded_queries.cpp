@@ -0,0 +1,444 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <mio/mmap.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+
+#include "app.hpp"
+#include "index_types.hpp"
+#include "query/selective_search.hpp"
+#include "query/sharded_search.hpp"
+#include "sharding.hpp"
+#include "string_table.hpp"
+#include "taily_stats.hpp"
+#include "timer.hpp"
+#include "util/util.hpp"
+#include "vec_map.hpp"
+#include "wand_data_compressed.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+/// Queries resolved against the term lexicon of each shard, indexed by shard and then query.
+using ShardQueries = VecMap<Shard_Id, std::vector<Query>>;
+
+[[nodiscard]] auto read_thresholds(std::optional<std::string> const& filename, std::size_t count)
+    -> std::vector<Threshold>
+{
+    std::vector<Threshold> thresholds(count, 0.0);
+    if (filename) {
+        std::string t;
+        std::ifstream tin(*filename);
+        size_t idx = 0;
+        while (std::getline(tin, t)) {
+            thresholds[idx] = std::stof(t);
+            idx += 1;
+        }
+        if (idx != count) {
+            throw std::invalid_argument("Invalid thresholds file.");
+        }
+    }
+    return thresholds;
+}
+
+/// Gathers the query with index `query` from all shards.
+[[nodiscard]] auto query_shards(ShardQueries const& queries, std::size_t query) -> std::vector<Query>
+{
+    std::vector<Query> shard_queries;
+    for (auto const& queries_in_shard: queries) {
+        shard_queries.push_back(queries_in_shard[query]);
+    }
+    return shard_queries;
+}
+
+template <typename IndexType, typename WandType>
+void perftest(
+    std::vector<std::string> const& index_paths,
+    std::vector<std::string> const& wand_paths,
+    ShardQueries const& queries,
+    std::optional<std::string> const& thresholds_filename,
+    std::string const& type,
+    std::string const& query_type,
+    uint64_t k,
+    uint64_t secondary_k,
+    ScorerParams const& scorer_params,
+    bool extract)
+{
+    spdlog::info("Loading {} shards", index_paths.size());
+    auto searcher =
+        ShardedSearcher<IndexType, WandType>::open(index_paths, wand_paths, scorer_params);
+    auto query_count = queries.front().size();
+    auto thresholds = read_thresholds(thresholds_filename, query_count);
+    std::vector<std::vector<Query>> shard_queries(query_count);
+    for (std::size_t query = 0; query < query_count; ++query) {
+        shard_queries[query] = query_shards(queries, query);
+    }
+
+    spdlog::info("Performing {} queries", type);
+    spdlog::info("K: {}", k);
+
+    std::vector<std::string> query_types;
+    boost::algorithm::split(query_types, query_type, boost::is_any_of(":"));
+
+    for (auto&& t: query_types) {
+        spdlog::info("Query type: {}", t);
+        auto algorithm = ShardedAlgorithm::parse(t);
+        auto run = [&](std::size_t query) {
+            auto pages =
+                searcher.search(shard_queries[query], algorithm, k, secondary_k, thresholds[query]);
+            return pages.first_page.size() + pages.second_page.size();
+        };
+        if (extract) {
+            std::vector<std::size_t> times(2);
+            for (std::size_t query = 0; query < query_count; ++query) {
+                do_not_optimize_away(run(query));
+                std::generate(times.begin(), times.end(), [&]() {
+                    return run_with_timer<std::chrono::microseconds>(
+                               [&]() { do_not_optimize_away(run(query)); })
+                        .count();
+                });
+                auto mean = std::accumulate(times.begin(), times.end(), std::size_t{0}) / 2;
+                std::cout << fmt::format(
+                    "{}\t{}\n",
+                    queries.front()[query].id.value_or(std::to_string(query)),
+                    mean);
+            }
+            continue;
+        }
+        std::vector<double> query_times;
+        for (size_t run_idx = 0; run_idx <= 2; ++run_idx) {
+            for (std::size_t query = 0; query < query_count; ++query) {
+                auto usecs = run_with_timer<std::chrono::microseconds>(
+                    [&]() { do_not_optimize_away(run(query)); });
+                if (run_idx != 0) {  // first run is not timed
+                    query_times.push_back(usecs.count());
+                }
+            }
+        }
+        std::sort(query_times.begin(), query_times.end());
+        double avg =
+            std::accumulate(query_times.begin(), query_times.end(), double()) / query_times.size();
+        double q50 = query_times[query_times.size() / 2];
+        double q90 = query_times[90 * query_times.size() / 100];
+        double q95 = query_times[95 * query_times.size() / 100];
+        double q99 = query_times[99 * query_times.size() / 100];
+
+        spdlog::info("---- {} {}", type, t);
+        spdlog::info("Mean: {}", avg);
+        spdlog::info("50% quantile: {}", q50);
+        spdlog::info("90% quantile: {}", q90);
+        spdlog::info("95% quantile: {}", q95);
+        spdlog::info("99% quantile: {}", q99);
+
+        stats_line()("type", type)("query", t)("shards", index_paths.size())("avg", avg)(
+            "q50", q50)("q90", q90)("q95", q95)("q99", q99);
+    }
+}
+
+template <typename IndexType, typename WandType>
+void evaluate(
+    std::vector<std::string> const& index_paths,
+    std::vector<std::string> const& wand_paths,
+    ShardQueries const& queries,
+    std::optional<std::string> const& thresholds_filename,
+    std::string const& query_type,
+    uint64_t k,
+    uint64_t secondary_k,
+    std::vector<std::string> const& documents_paths,
+    ScorerParams const& scorer_params,
+    std::string const& run_id,
+    std::string const& iteration)
+{
+    auto searcher =
+        ShardedSearcher<IndexType, WandType>::open(index_paths, wand_paths, scorer_params);
+    auto algorithm = ShardedAlgorithm::parse(query_type);
+    auto query_count = queries.front().size();
+    auto thresholds = read_thresholds(thresholds_filename, query_count);
+
+    std::vector<std::shared_ptr<mio::mmap_source>> sources;
+    std::vector<Lexicon> docmaps;
+    for (auto const& path: documents_paths) {
+        sources.push_back(std::make_shared<mio::mmap_source>(path.c_str()));
+        docmaps.push_back(Lexicon::from(*sources.back()));
+    }
+    std::string title;
+
+    for (std::size_t query = 0; query < query_count; ++query) {
+        auto pages = searcher.search(
+            query_shards(queries, query), algorithm, k, secondary_k, thresholds[query]);
+        auto qid = queries.front()[query].id.value_or(std::to_string(query));
+        std::size_t rank = 0;
+        for (auto const* page: {&pages.first_page, &pages.second_page}) {
+            for (auto const& result: *page) {
+                std::cout << fmt::format(
+                    "{}\t{}\t{}\t{}\t{}\t{}\n",
+                    qid,
+                    iteration,
+                    docmaps[result.shard.as_int()].lookup(result.docid, title),
+                    rank++,
+                    result.score,
+                    run_id);
+            }
+        }
+    }
+}
+
+template <typename IndexType, typename WandType>
+void selective(
+    std::vector<std::string> const& index_paths,
+    std::vector<std::string> const& wand_paths,
+    ShardQueries const& queries,
+    std::vector<Query> const& global_queries,
+    std::string const& global_stats_path,
+    std::vector<std::string> const& shard_stats_paths,
+    double cutoff,
+    std::string const& query_type,
+    uint64_t k,
+    uint64_t secondary_k,
+    std::vector<std::string> const& documents_paths,
+    ScorerParams const& scorer_params,
+    std::string const& run_id,
+    std::string const& iteration)
+{
+    auto searcher =
+        ShardedSearcher<IndexType, WandType>::open(index_paths, wand_paths, scorer_params);
+    auto algorithm = ShardedAlgorithm::parse(query_type);
+    auto query_count = queries.front().size();
+    if (global_queries.size() != query_count) {
+        throw std::invalid_argument("Global queries and shard queries do not have the same size.");
+    }
+
+    auto global_stats = TailyStats::from_mapped(global_stats_path);
+    std::vector<TailyStats> shard_stats;
+    for (auto const& path: shard_stats_paths) {
+        shard_stats.push_back(TailyStats::from_mapped(path));
+    }
+
+    std::vector<std::shared_ptr<mio::mmap_source>> sources;
+    std::vector<Lexicon> docmaps;
+    for (auto const& path: documents_paths) {
+        sources.push_back(std::make_shared<mio::mmap_source>(path.c_str()));
+        docmaps.push_back(Lexicon::from(*sources.back()));
+    }
+    std::string title;
+
+    SelectiveSearchCost first_page_cost;
+    SelectiveSearchCost total_cost;
+    for (std::size_t query = 0; query < query_count; ++query) {
+        auto shard_queries = query_shards(queries, query);
+        auto selection = select_shards(
+            taily_shard_estimates(
+                global_stats, shard_stats, global_queries[query], shard_queries, k),
+            taily_shard_estimates(
+                global_stats, shard_stats, global_queries[query], shard_queries, k + secondary_k),
+            cutoff);
+        SelectiveQuery selective_query(
+            searcher, shard_queries, std::move(selection), algorithm, k, secondary_k);
+        auto qid = queries.front()[query].id.value_or(std::to_string(query));
+        std::size_t rank = 0;
+        auto print = [&](std::vector<ShardedResult> const& page) {
+            for (auto const& result: page) {
+                std::cout << fmt::format(
+                    "{}\t{}\t{}\t{}\t{}\t{}\n",
+                    qid,
+                    iteration,
+                    docmaps[result.shard.as_int()].lookup(result.docid, title),
+                    rank++,
+                    result.score,
+                    run_id);
+            }
+        };
+        print(selective_query.first_page());
+        first_page_cost.shards += selective_query.cost().shards;
+        first_page_cost.postings += selective_query.cost().postings;
+        print(selective_query.second_page());
+        total_cost.shards += selective_query.cost().shards;
+        total_cost.postings += selective_query.cost().postings;
+        total_cost.exhaustive_shards += selective_query.cost().exhaustive_shards;
+        total_cost.exhaustive_postings += selective_query.cost().exhaustive_postings;
+    }
+
+    auto percent = [&](std::size_t visited, std::size_t exhaustive) {
+        return exhaustive > 0 ? 100.0 * visited / exhaustive : 0.0;
+    };
+    spdlog::info("---- Selective search: {} queries", query_count);
+    spdlog::info(
+        "Shards searched, first page: {:.2f}%",
+        percent(first_page_cost.shards, total_cost.exhaustive_shards));
+    spdlog::info(
+        "Shards searched, both pages: {:.2f}%",
+        percent(total_cost.shards, total_cost.exhaustive_shards));
+    spdlog::info(
+        "Postings visited, first page: {:.2f}%",
+        percent(first_page_cost.postings, total_cost.exhaustive_postings));
+    spdlog::info(
+        "Postings visited, both pages: {:.2f}%",
+        percent(total_cost.postings, total_cost.exhaustive_postings));
+}
+
+enum class Mode { Benchmark, Evaluate, Selective };
+
+template <
+    typename IndexType,
+    typename WandType,
+    typename PerftestParams,
+    typename EvaluateParams,
+    typename SelectiveParams>
+void run(
+    Mode mode,
+    PerftestParams const& perftest_params,
+    EvaluateParams const& evaluate_params,
+    SelectiveParams const& selective_params)
+{
+    switch (mode) {
+    case Mode::Benchmark: std::apply(perftest<IndexType, WandType>, perftest_params); break;
+    case Mode::Evaluate: std::apply(evaluate<IndexType, WandType>, evaluate_params); break;
+    case Mode::Selective: std::apply(selective<IndexType, WandType>, selective_params); break;
+    }
+}
+
+using wand_raw_index = wand_data<wand_data_raw>;
+using wand_uniform_index = wand_data<wand_data_compressed<>>;
+using wand_uniform_index_quantized = wand_data<wand_data_compressed<PayloadType::Quantized>>;
+
+int main(int argc, const char** argv)
+{
+    spdlog::set_default_logger(spdlog::stderr_color_mt("default"));
+
+    CLI::App app{"Executes queries on all shards in parallel and merges their results."};
+    auto* queries_cmd = app.add_subcommand("queries", "Benchmarks queries.");
+    auto* evaluate_cmd = app.add_subcommand("evaluate", "Retrieves query results in TREC format.");
+    auto* selective_cmd = app.add_subcommand(
+        "selective",
+        "Retrieves query results in TREC format, searching only the shards selected with Taily.");
+    ShardedQueryArgs queries_args(queries_cmd);
+    ShardedQueryArgs evaluate_args(evaluate_cmd);
+    SelectiveQueryArgs selective_args(selective_cmd);
+
+    bool extract = false;
+    queries_cmd->add_flag("--extract", extract, "Extract individual query times");
+
+    std::string documents_basename;
+    std::string run_id = "R0";
+    evaluate_cmd->add_option("-r,--run", run_id, "Run identifier");
+    evaluate_cmd->add_option("--documents", documents_basename, "Shard document lexicons")
+        ->required();
+    selective_cmd->add_option("-r,--run", run_id, "Run identifier");
+    selective_cmd->add_option("--documents", documents_basename, "Shard document lexicons")
+        ->required();
+
+    app.require_subcommand(1);
+    CLI11_PARSE(app, argc, argv);
+
+    auto mode = Mode::Evaluate;
+    if (queries_cmd->parsed()) {
+        mode = Mode::Benchmark;
+    } else if (selective_cmd->parsed()) {
+        mode = Mode::Selective;
+    }
+    ShardedQueryArgs const& args = mode == Mode::Benchmark
+        ? queries_args
+        : (mode == Mode::Selective ? selective_args : evaluate_args);
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, args.threads() + 1);
+    spdlog::info("Number of worker threads: {}", args.threads());
+
+    try {
+        std::vector<std::string> index_paths;
+        std::vector<std::string> wand_paths;
+        std::vector<std::string> documents_paths;
+        std::vector<std::string> shard_stats_paths;
+        ShardQueries queries;
+        for (auto shard: resolve_shards(args.index_filename())) {
+            auto shard_args = args;
+            shard_args.apply_shard(shard);
+            index_paths.push_back(shard_args.index_filename());
+            wand_paths.push_back(shard_args.wand_data_path());
+            documents_paths.push_back(expand_shard(documents_basename, shard));
+            shard_stats_paths.push_back(expand_shard(selective_args.shard_stats(), shard));
+            queries.push_back(shard_args.queries());
+        }
+        if (index_paths.empty()) {
+            return 1;
+        }
+
+        auto perftest_params = std::make_tuple(
+            index_paths,
+            wand_paths,
+            queries,
+            args.thresholds_file(),
+            args.index_encoding(),
+            args.algorithm(),
+            args.k(),
+            args.secondary_k(),
+            args.scorer_params(),
+            extract);
+        auto evaluate_params = std::make_tuple(
+            index_paths,
+            wand_paths,
+            queries,
+            args.thresholds_file(),
+            args.algorithm(),
+            args.k(),
+            args.secondary_k(),
+            documents_paths,
+            args.scorer_params(),
+            run_id.empty() ? std::string("PISA") : run_id,
+            std::string("Q0"));
+        auto selective_params = std::make_tuple(
+            index_paths,
+            wand_paths,
+            queries,
+            mode == Mode::Selective ? selective_args.global_queries() : std::vector<Query>{},
+            selective_args.global_stats(),
+            shard_stats_paths,
+            selective_args.cutoff(),
+            args.algorithm(),
+            args.k(),
+            args.secondary_k(),
+            documents_paths,
+            args.scorer_params(),
+            run_id.empty() ? std::string("PISA") : run_id,
+            std::string("Q0"));
+
+        /**/
+        if (false) {  // NOLINT
+#define LOOP_BODY(R, DATA, T)                                                              \
+    }                                                                                      \
+    else if (args.index_encoding() == BOOST_PP_STRINGIZE(T))                               \
+    {                                                                                      \
+        if (args.is_wand_compressed()) {                                                   \
+            if (args.quantized()) {                                                        \
+                run<BOOST_PP_CAT(T, _index), wand_uniform_index_quantized>(                \
+                    mode, perftest_params, evaluate_params, selective_params);             \
+            } else {                                                                       \
+                run<BOOST_PP_CAT(T, _index), wand_uniform_index>(                          \
+                    mode, perftest_params, evaluate_params, selective_params);             \
+            }                                                                              \
+        } else {                                                                           \
+            run<BOOST_PP_CAT(T, _index), wand_raw_index>(                                  \
+                mode, perftest_params, evaluate_params, selective_params);                 \
+        }                                                                                  \
+        /**/
+
+            BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+        } else {
+            spdlog::error("Unknown type {}", args.index_encoding());
+            return 1;
+        }
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+    return 0;
+}
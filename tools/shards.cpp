@@ -84,7 +84,9 @@ int main(int argc, char** argv)
                     format_shard(invert_args.input_basename(), shard_id),
                     format_shard(invert_args.output_basename(), shard_id),
                     invert_args.batch_size(),
-                    invert_args.threads());
+                    invert_args.threads(),
+                    std::nullopt,
+                    invert_args.memory_budget());
                 shard_id += 1;
             }
         }
@@ -101,6 +103,9 @@ int main(int argc, char** argv)
             return 0;
         }
         if (compress->parsed()) {
+            tbb::global_control control(
+                tbb::global_control::max_allowed_parallelism, compress_args.threads() + 1);
+            spdlog::info("Number of worker threads: {}", compress_args.threads());
             auto shards = resolve_shards(compress_args.input_basename(), ".docs");
             spdlog::info("Processing {} shards", shards.size());
             for (auto shard: shards) {
@@ -118,6 +123,9 @@ int main(int argc, char** argv)
             return 0;
         }
         if (wand->parsed()) {
+            tbb::global_control control(
+                tbb::global_control::max_allowed_parallelism, wand_args.threads() + 1);
+            spdlog::info("Number of worker threads: {}", wand_args.threads());
             auto shards = resolve_shards(wand_args.input_basename(), ".docs");
             spdlog::info("Processing {} shards", shards.size());
             for (auto shard: shards) {